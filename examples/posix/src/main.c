@@ -81,6 +81,7 @@
 #include "sdkconfig.h"
 
 // Local includes
+#include "multi_radio.h"
 #include "my_platform.h"
 
 #define USB_VENDOR_ID_REALTEK 0x0bda
@@ -269,7 +270,7 @@ static char* help_options[] = {
     "print (this) help.",
     "set file to store debug output and HCI trace.",
     "reset bonding information stored in TLV.",
-    "set USB path to Bluetooth Controller.",
+    "set USB path to Bluetooth Controller. Repeat it to use several controllers.",
 };
 
 static char* option_arg_name[] = {
@@ -294,7 +295,10 @@ int main(int argc, const char* argv[]) {
     uint8_t usb_path[USB_MAX_PATH_LEN];
     int usb_path_len = 0;
     const char* usb_path_string = NULL;
+    const char* usb_path_strings[MULTI_RADIO_MAX];
+    int usb_path_strings_count = 0;
     const char* log_file_path = NULL;
+    int radio = -1;
 
     // parse command line parameters
     while (true) {
@@ -307,7 +311,11 @@ int main(int argc, const char* argv[]) {
         }
         switch (c) {
             case 'u':
-                usb_path_string = optarg;
+                if (usb_path_strings_count == MULTI_RADIO_MAX) {
+                    printf("Too many USB paths. Max: %d\n", MULTI_RADIO_MAX);
+                    return EXIT_FAILURE;
+                }
+                usb_path_strings[usb_path_strings_count++] = optarg;
                 break;
             case 'l':
                 log_file_path = optarg;
@@ -322,6 +330,16 @@ int main(int argc, const char* argv[]) {
         }
     }
 
+    if (usb_path_strings_count > 1) {
+        // One process per controller. Returns in the child process only.
+        radio = multi_radio_start(usb_path_strings_count, &my_platform_on_multi_radio_controller_data);
+        usb_path_string = usb_path_strings[radio];
+    } else if (usb_path_strings_count == 1) {
+        usb_path_string = usb_path_strings[0];
+    }
+
+    // Parsing consumes usb_path_string. The log file name uses the whole path.
+    const char* usb_path_name = usb_path_string;
     if (usb_path_string != NULL) {
         // parse command line options for "-u 11:22:33"
         printf("Specified USB Path: ");
@@ -349,15 +367,19 @@ int main(int argc, const char* argv[]) {
     }
 
     // log into file using HCI_DUMP_PACKETLOGGER format
-    char pklg_path[100];
+    char pklg_path[256];
     if (log_file_path == NULL) {
         btstack_strcpy(pklg_path, sizeof(pklg_path), "/tmp/hci_dump");
         if (usb_path_len) {
             btstack_strcat(pklg_path, sizeof(pklg_path), "_");
-            btstack_strcat(pklg_path, sizeof(pklg_path), usb_path_string);
+            btstack_strcat(pklg_path, sizeof(pklg_path), usb_path_name);
         }
         btstack_strcat(pklg_path, sizeof(pklg_path), ".pklg");
         log_file_path = pklg_path;
+    } else if (radio >= 0) {
+        // With several radios, each one has its own log file: "<path>.<radio>"
+        snprintf(pklg_path, sizeof(pklg_path), "%s.%d", log_file_path, radio);
+        log_file_path = pklg_path;
     }
 
     hci_dump_posix_fs_open(log_file_path, HCI_DUMP_PACKETLOGGER);
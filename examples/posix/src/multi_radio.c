@@ -0,0 +1,397 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#include "multi_radio.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <btstack_run_loop.h>
+
+#include "sdkconfig.h"
+
+#define CONSOLE_SOCKET_ENV "BLUEPAD32_CONSOLE_SOCKET"
+
+enum {
+    // Child -> parent
+    MSG_RADIO_READY,
+    MSG_DEVICE_CONNECTED,
+    MSG_DEVICE_READY,
+    MSG_DEVICE_DISCONNECTED,
+    MSG_CONTROLLER_DATA,
+    // Parent -> child
+    MSG_SCAN_ENABLE,
+    MSG_SCAN_DISABLE,
+};
+
+// Sent over a SOCK_SEQPACKET socket: one message per read.
+typedef struct {
+    uint8_t type;
+    // Index in the radio device table
+    int8_t device_idx;
+    bd_addr_t addr;
+    char name[32];
+    uni_controller_t controller;
+} msg_t;
+
+typedef struct {
+    bool used;
+    bool ready;
+    bd_addr_t addr;
+    char name[32];
+} device_entry_t;
+
+typedef struct {
+    pid_t pid;
+    int fd;
+    bool up;
+    bool scanning;
+    bd_addr_t addr;
+    device_entry_t devices[CONFIG_BLUEPAD32_MAX_DEVICES];
+} radio_t;
+
+// Parent
+static radio_t radios[MULTI_RADIO_MAX];
+static int radios_count;
+static multi_radio_controller_data_callback_t controller_data_callback;
+
+// Child
+static int child_idx = -1;
+static int child_fd = -1;
+static btstack_data_source_t child_data_source;
+
+//
+// Helpers: parent
+//
+// Radio * devices per radio + index in the radio
+static int get_global_idx(int radio_idx, int device_idx) {
+    return radio_idx * CONFIG_BLUEPAD32_MAX_DEVICES + device_idx;
+}
+
+static int get_load(const radio_t* r) {
+    int load = 0;
+    for (int i = 0; i < CONFIG_BLUEPAD32_MAX_DEVICES; i++)
+        load += r->devices[i].used;
+    return load;
+}
+
+static void send_msg(int fd, uint8_t type) {
+    msg_t msg = {.type = type};
+    if (send(fd, &msg, sizeof(msg), 0) < 0)
+        loge("multi_radio: failed to send message: %s\n", strerror(errno));
+}
+
+static void rebalance(void) {
+    int load[MULTI_RADIO_MAX];
+    bool up[MULTI_RADIO_MAX];
+    int pick;
+
+    for (int i = 0; i < radios_count; i++) {
+        load[i] = get_load(&radios[i]);
+        up[i] = radios[i].up;
+    }
+    pick = multi_radio_pick_scanning_radio(load, up, radios_count, CONFIG_BLUEPAD32_MAX_DEVICES);
+
+    // Disable first, so that two radios don't discover the same device.
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < radios_count; i++) {
+            radio_t* r = &radios[i];
+            bool want = (i == pick);
+            if (!r->up || r->scanning == want || want != (pass == 1))
+                continue;
+            r->scanning = want;
+            send_msg(r->fd, want ? MSG_SCAN_ENABLE : MSG_SCAN_DISABLE);
+            logi("multi_radio: radio %d: scan -> %d\n", i, want);
+        }
+    }
+}
+
+static void dump_devices(void) {
+    logi("multi_radio: devices:\n");
+    for (int i = 0; i < radios_count; i++) {
+        for (int j = 0; j < CONFIG_BLUEPAD32_MAX_DEVICES; j++) {
+            const device_entry_t* e = &radios[i].devices[j];
+            if (!e->used)
+                continue;
+            logi(" - idx=%d, radio=%d, %s, '%s', %s\n", get_global_idx(i, j), i,
+                 bd_addr_to_str(e->addr), e->name, e->ready ? "ready" : "connecting");
+        }
+    }
+}
+
+static void process_msg(int radio_idx, const msg_t* msg) {
+    radio_t* r = &radios[radio_idx];
+    device_entry_t* e = NULL;
+
+    if (msg->device_idx >= 0 && msg->device_idx < CONFIG_BLUEPAD32_MAX_DEVICES)
+        e = &r->devices[msg->device_idx];
+
+    switch (msg->type) {
+        case MSG_RADIO_READY:
+            r->up = true;
+            bd_addr_copy(r->addr, msg->addr);
+            logi("multi_radio: radio %d: up, %s\n", radio_idx, bd_addr_to_str(r->addr));
+            break;
+        case MSG_DEVICE_CONNECTED:
+            if (!e)
+                return;
+            memset(e, 0, sizeof(*e));
+            e->used = true;
+            bd_addr_copy(e->addr, msg->addr);
+            break;
+        case MSG_DEVICE_READY:
+            if (!e)
+                return;
+            e->used = true;
+            e->ready = true;
+            bd_addr_copy(e->addr, msg->addr);
+            memcpy(e->name, msg->name, sizeof(e->name));
+            break;
+        case MSG_DEVICE_DISCONNECTED:
+            if (!e)
+                return;
+            memset(e, 0, sizeof(*e));
+            break;
+        case MSG_CONTROLLER_DATA:
+            // Doesn't change the device table. Data that arrives after a disconnect is dropped.
+            if (e && e->ready && controller_data_callback)
+                controller_data_callback(get_global_idx(radio_idx, msg->device_idx), &msg->controller);
+            return;
+        default:
+            loge("multi_radio: radio %d: invalid message: %d\n", radio_idx, msg->type);
+            return;
+    }
+    rebalance();
+    if (msg->type != MSG_RADIO_READY)
+        dump_devices();
+}
+
+static void on_radio_exited(int radio_idx) {
+    radio_t* r = &radios[radio_idx];
+
+    logi("multi_radio: radio %d: exited\n", radio_idx);
+    close(r->fd);
+    r->fd = -1;
+    r->up = false;
+    r->scanning = false;
+    memset(r->devices, 0, sizeof(r->devices));
+    rebalance();
+    dump_devices();
+}
+
+static void run_parent(void) {
+    struct pollfd pfds[MULTI_RADIO_MAX];
+    int alive = radios_count;
+
+    // CTRL-C is received by the children too. Wait for them to shut down.
+    signal(SIGINT, SIG_IGN);
+
+    while (alive > 0) {
+        for (int i = 0; i < radios_count; i++) {
+            pfds[i].fd = radios[i].fd;
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+        }
+        if (poll(pfds, radios_count, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            loge("multi_radio: poll failed: %s\n", strerror(errno));
+            break;
+        }
+        for (int i = 0; i < radios_count; i++) {
+            msg_t msg;
+            ssize_t n;
+
+            if (pfds[i].fd < 0 || pfds[i].revents == 0)
+                continue;
+            n = recv(radios[i].fd, &msg, sizeof(msg), 0);
+            if (n <= 0) {
+                on_radio_exited(i);
+                alive--;
+                continue;
+            }
+            if (n == sizeof(msg))
+                process_msg(i, &msg);
+        }
+    }
+
+    while (wait(NULL) > 0) {
+    }
+    exit(EXIT_SUCCESS);
+}
+
+//
+// Helpers: child
+//
+static void child_send(const msg_t* msg) {
+    if (send(child_fd, msg, sizeof(*msg), 0) < 0)
+        loge("multi_radio: failed to send message: %s\n", strerror(errno));
+}
+
+static void child_send_controller_data(uni_hid_device_t* d, const uni_controller_t* ctl) {
+    msg_t msg = {
+        .type = MSG_CONTROLLER_DATA,
+        .device_idx = uni_hid_device_get_idx_for_instance(d),
+        .controller = *ctl,
+    };
+    // Called from the BT thread: never block it. The next report has the full state anyway.
+    if (send(child_fd, &msg, sizeof(msg), MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        loge("multi_radio: failed to send controller data: %s\n", strerror(errno));
+}
+
+static void child_send_device(uint8_t type, uni_hid_device_t* d) {
+    msg_t msg = {
+        .type = type,
+        .device_idx = uni_hid_device_get_idx_for_instance(d),
+    };
+    bd_addr_copy(msg.addr, d->conn.btaddr);
+    // Truncated: only used in the logs. "msg" is zeroed, so it is always NUL-terminated.
+    memcpy(msg.name, d->name, sizeof(msg.name) - 1);
+    child_send(&msg);
+}
+
+static void on_child_data(btstack_data_source_t* ds, btstack_data_source_callback_type_t callback_type) {
+    ARG_UNUSED(callback_type);
+    msg_t msg;
+
+    if (recv(ds->source.fd, &msg, sizeof(msg), 0) != sizeof(msg)) {
+        // Parent is gone. Keep running with the current scan state.
+        btstack_run_loop_remove_data_source(ds);
+        return;
+    }
+
+    switch (msg.type) {
+        case MSG_SCAN_ENABLE:
+            uni_bt_enable_new_connections_unsafe(true);
+            break;
+        case MSG_SCAN_DISABLE:
+            uni_bt_enable_new_connections_unsafe(false);
+            break;
+        default:
+            loge("multi_radio: invalid message: %d\n", msg.type);
+            break;
+    }
+}
+
+// Only the first radio reads the console from stdin. Each radio has its own console socket, if enabled.
+static void setup_child_console(int idx) {
+    const char* path = getenv(CONSOLE_SOCKET_ENV);
+    char radio_path[128];
+
+    if (path && path[0] != '\0') {
+        snprintf(radio_path, sizeof(radio_path), "%s.%d", path, idx);
+        setenv(CONSOLE_SOCKET_ENV, radio_path, 1);
+    } else if (idx > 0) {
+        int fd = open("/dev/null", O_RDONLY);
+        if (fd >= 0) {
+            dup2(fd, STDIN_FILENO);
+            close(fd);
+        }
+    }
+}
+
+//
+// Public functions
+//
+int multi_radio_start(int count, multi_radio_controller_data_callback_t callback) {
+    if (count > MULTI_RADIO_MAX) {
+        loge("multi_radio: too many radios: %d. Max: %d\n", count, MULTI_RADIO_MAX);
+        exit(EXIT_FAILURE);
+    }
+    controller_data_callback = callback;
+
+    for (int i = 0; i < count; i++) {
+        int sv[2];
+        pid_t pid;
+
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+            loge("multi_radio: socketpair failed: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        // So that the children's output doesn't get duplicated.
+        fflush(stdout);
+        pid = fork();
+        if (pid < 0) {
+            loge("multi_radio: fork failed: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0) {
+            for (int j = 0; j < i; j++)
+                close(radios[j].fd);
+            close(sv[0]);
+            child_idx = i;
+            child_fd = sv[1];
+            setup_child_console(i);
+            return i;
+        }
+        close(sv[1]);
+        radios[i].pid = pid;
+        radios[i].fd = sv[0];
+        radios_count++;
+        logi("multi_radio: radio %d: pid %d\n", i, pid);
+    }
+
+    run_parent();
+    return -1;
+}
+
+bool multi_radio_is_child(void) {
+    return child_idx >= 0;
+}
+
+int multi_radio_pick_scanning_radio(const int* load, const bool* up, int count, int capacity) {
+    int pick = -1;
+
+    for (int i = 0; i < count; i++) {
+        if (!up[i] || load[i] >= capacity)
+            continue;
+        if (pick < 0 || load[i] < load[pick])
+            pick = i;
+    }
+    return pick;
+}
+
+void multi_radio_on_init_complete(void) {
+    msg_t msg = {.type = MSG_RADIO_READY, .device_idx = -1};
+
+    if (!multi_radio_is_child())
+        return;
+
+    btstack_run_loop_set_data_source_fd(&child_data_source, child_fd);
+    btstack_run_loop_set_data_source_handler(&child_data_source, &on_child_data);
+    btstack_run_loop_enable_data_source_callbacks(&child_data_source, DATA_SOURCE_CALLBACK_READ);
+    btstack_run_loop_add_data_source(&child_data_source);
+
+    // The parent decides when to scan.
+    gap_local_bd_addr(msg.addr);
+    child_send(&msg);
+}
+
+void multi_radio_on_device_connected(uni_hid_device_t* d) {
+    if (multi_radio_is_child())
+        child_send_device(MSG_DEVICE_CONNECTED, d);
+}
+
+void multi_radio_on_device_ready(uni_hid_device_t* d) {
+    if (multi_radio_is_child())
+        child_send_device(MSG_DEVICE_READY, d);
+}
+
+void multi_radio_on_device_disconnected(uni_hid_device_t* d) {
+    if (multi_radio_is_child())
+        child_send_device(MSG_DEVICE_DISCONNECTED, d);
+}
+
+void multi_radio_on_controller_data(uni_hid_device_t* d, const uni_controller_t* ctl) {
+    if (multi_radio_is_child())
+        child_send_controller_data(d, ctl);
+}
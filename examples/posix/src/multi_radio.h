@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#ifndef MULTI_RADIO_H
+#define MULTI_RADIO_H
+
+#include <stdbool.h>
+
+#include <uni.h>
+
+// Several Bluetooth controllers (radios) from one command line.
+//
+// BTstack supports one HCI controller per process. So, one process is forked per radio, and
+// the parent process keeps the unified device table: devices from all the radios, with a global index.
+// Only one radio scans for new devices at a time: the one with fewer devices. Bonded devices
+// can reconnect to any radio at any time.
+//
+// The controller data of the ready devices is forwarded to the parent process, which calls the
+// callback with the global index. Everything else, like rumble or LEDs, stays in the child process
+// that owns the device.
+
+#define MULTI_RADIO_MAX 8
+
+// Called in the parent process. "idx" is the global index: radio * CONFIG_BLUEPAD32_MAX_DEVICES + device index.
+typedef void (*multi_radio_controller_data_callback_t)(int idx, const uni_controller_t* ctl);
+
+// Forks one process per radio. Returns the radio index in the child process.
+// Doesn't return in the parent process: it exits once all the children have finished.
+int multi_radio_start(int count, multi_radio_controller_data_callback_t callback);
+bool multi_radio_is_child(void);
+
+// Returns the radio that should scan for new devices, or -1 if none.
+// The one with the fewest devices, and space left. Ties go to the lowest index.
+int multi_radio_pick_scanning_radio(const int* load, const bool* up, int count, int capacity);
+
+// Called from the platform, in the child process
+void multi_radio_on_init_complete(void);
+void multi_radio_on_device_connected(uni_hid_device_t* d);
+void multi_radio_on_device_ready(uni_hid_device_t* d);
+void multi_radio_on_device_disconnected(uni_hid_device_t* d);
+// Forwards the data to the parent process. Dropped if the parent can't keep up.
+void multi_radio_on_controller_data(uni_hid_device_t* d, const uni_controller_t* ctl);
+
+#endif  // MULTI_RADIO_H
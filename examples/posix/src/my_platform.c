@@ -6,6 +6,8 @@
 
 #include <uni.h>
 
+#include "multi_radio.h"
+
 //
 // Globals
 //
@@ -104,6 +106,12 @@ static void posix_on_init_complete(void) {
 
     uni_property_dump_all();
 
+    // With several radios, the parent process decides which one scans.
+    if (multi_radio_is_child()) {
+        multi_radio_on_init_complete();
+        return;
+    }
+
     // Start scanning
     uni_bt_enable_new_connections_unsafe(true);
 }
@@ -126,10 +134,12 @@ static uni_error_t posix_on_device_discovered(bd_addr_t addr, const char* name,
 
 static void posix_on_device_connected(uni_hid_device_t* d) {
     logi("posix: device connected: %p\n", d);
+    multi_radio_on_device_connected(d);
 }
 
 static void posix_on_device_disconnected(uni_hid_device_t* d) {
     logi("posix: device disconnected: %p\n", d);
+    multi_radio_on_device_disconnected(d);
 }
 
 static uni_error_t posix_on_device_ready(uni_hid_device_t* d) {
@@ -138,6 +148,7 @@ static uni_error_t posix_on_device_ready(uni_hid_device_t* d) {
     ins->gamepad_seat = GAMEPAD_SEAT_A;
 
     trigger_event_on_gamepad(d);
+    multi_radio_on_device_ready(d);
     return UNI_ERROR_SUCCESS;
 }
 
@@ -154,9 +165,14 @@ static void posix_on_controller_data(uni_hid_device_t* d, uni_controller_t* ctl)
         return;
     }
     prev = *ctl;
-    // Print device Id before dumping gamepad.
-    logi("(%p) ", d);
-    uni_controller_dump(ctl);
+    if (multi_radio_is_child()) {
+        // Printed by the parent process, with the global index.
+        multi_radio_on_controller_data(d, ctl);
+    } else {
+        // Print device Id before dumping gamepad.
+        logi("(%p) ", d);
+        uni_controller_dump(ctl);
+    }
 
     switch (ctl->klass) {
         case UNI_CONTROLLER_CLASS_GAMEPAD:
@@ -338,3 +354,9 @@ struct uni_platform* get_my_platform(void) {
 
     return &plat;
 }
+
+void my_platform_on_multi_radio_controller_data(int idx, const uni_controller_t* ctl) {
+    // Print the global index before dumping the controller.
+    logi("(idx=%d) ", idx);
+    uni_controller_dump(ctl);
+}
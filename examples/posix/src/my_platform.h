@@ -4,5 +4,7 @@
 #include <uni.h>
 
 struct uni_platform* get_my_platform(void);
+// Controller data from all the radios, in the parent process. See multi_radio.h
+void my_platform_on_multi_radio_controller_data(int idx, const uni_controller_t* ctl);
 
 #endif  // MY_PLATFORM
@@ -6,6 +6,9 @@
 #define CONFIG_BLUEPAD32_GAP_SECURITY 1
 #define CONFIG_BLUEPAD32_ENABLE_BLE_BY_DEFAULT 1
 // #define CONFIG_BLUEPAD32_ENABLE_VIRTUAL_DEVICE_BY_DEFAULT 1
+// #define CONFIG_BLUEPAD32_ENABLE_DS_INPUT_CRC_CHECK 1
+// Console: commands from stdin, or from BLUEPAD32_CONSOLE_SOCKET
+#define CONFIG_BLUEPAD32_CONSOLE_ENABLE 1
 
 // 2 == Info
 #define CONFIG_BLUEPAD32_LOG_LEVEL 2
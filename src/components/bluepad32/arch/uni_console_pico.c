@@ -4,6 +4,114 @@
 
 #include "uni_console.h"
 
+#include <btstack.h>
+#include <pico/stdlib.h>
+
+#include "uni_common.h"
+#include "uni_log.h"
+
+// Console for Pico W.
+// Commands are read from stdio (USB or UART, whatever the application enabled).
+// getchar() blocks, so stdio is polled from a BTstack timer instead: no extra threads are needed.
+// Enabled with CONFIG_BLUEPAD32_CONSOLE_ENABLE.
+
+#define POLL_INTERVAL_MS 50
+#define LINE_MAX_LEN 256
+#define PROMPT_STR "bp32> "
+
+static btstack_timer_source_t s_poll_timer;
+
+static char s_line[LINE_MAX_LEN];
+static int s_line_len;
+static bool s_line_overflow;
+static bool s_last_was_cr;
+
+// The command called uni_console_wait_for_output()
+static bool s_wait_requested;
+// Waiting for the callbacks queued by the command. Input is not read meanwhile.
+static bool s_waiting;
+static btstack_context_callback_registration_t s_output_done;
+
+static void print_prompt(void) {
+    printf(PROMPT_STR);
+    fflush(stdout);
+}
+
+static void process_char(char c) {
+    // Terminals send "\r", "\n" or "\r\n". Treat "\r\n" as one line ending.
+    bool skip = (c == '\n' && s_last_was_cr);
+    s_last_was_cr = (c == '\r');
+    if (skip)
+        return;
+
+    switch (c) {
+        case '\r':
+        case '\n':
+            printf("\n");
+            s_line[s_line_len] = '\0';
+            if (s_line_overflow)
+                loge("Line too long. Max: %d\n", LINE_MAX_LEN - 1);
+            else
+                uni_console_run_line(s_line);
+            s_line_len = 0;
+            s_line_overflow = false;
+            if (s_wait_requested) {
+                // Queued after the callbacks of the command: it runs once their output is printed.
+                s_wait_requested = false;
+                s_waiting = true;
+                btstack_run_loop_execute_on_main_thread(&s_output_done);
+            } else {
+                print_prompt();
+            }
+            break;
+        case '\b':
+        case 0x7f:  // DEL
+            if (s_line_len > 0) {
+                s_line_len--;
+                printf("\b \b");
+            }
+            break;
+        default:
+            if (s_line_len < LINE_MAX_LEN - 1) {
+                s_line[s_line_len++] = c;
+                // Terminals don't do local echo
+                putchar(c);
+            } else {
+                s_line_overflow = true;
+            }
+            break;
+    }
+}
+
+static void on_output_done(void* context) {
+    ARG_UNUSED(context);
+    s_waiting = false;
+    print_prompt();
+}
+
+static void on_poll(btstack_timer_source_t* ts) {
+    int c;
+
+    // While waiting, the input stays in the stdio buffer.
+    while (!s_waiting && (c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT)
+        process_char((char)c);
+
+    btstack_run_loop_set_timer(ts, POLL_INTERVAL_MS);
+    btstack_run_loop_add_timer(ts);
+}
+
 void uni_console_init(void) {
-    // FIXME: Implement me
+    s_output_done.callback = &on_output_done;
+
+    btstack_run_loop_set_timer_handler(&s_poll_timer, &on_poll);
+    btstack_run_loop_set_timer(&s_poll_timer, POLL_INTERVAL_MS);
+    btstack_run_loop_add_timer(&s_poll_timer);
+
+    print_prompt();
+}
+
+void uni_console_wait_for_output(void) {
+    // Called from the command, on the BTstack thread: blocking would never let the callbacks run.
+    // The wait starts once the command returns. See process_char().
+    s_wait_requested = true;
 }
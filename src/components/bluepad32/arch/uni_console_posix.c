@@ -4,6 +4,229 @@
 
 #include "uni_console.h"
 
+#include <btstack.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "uni_common.h"
+#include "uni_log.h"
+
+// Console for Linux / macOS.
+// Commands are read from stdin. If the BLUEPAD32_CONSOLE_SOCKET environment variable is set,
+// they are read from a Unix socket at that path instead, E.g:
+//   BLUEPAD32_CONSOLE_SOCKET=/tmp/bp32.sock ./bluepad32_posix_example_app
+//   socat - UNIX-CONNECT:/tmp/bp32.sock
+// While a client is connected, stdout is redirected to it.
+//
+// It runs on the BTstack run loop, using data sources: no extra threads, and reads never block.
+// Enabled with CONFIG_BLUEPAD32_CONSOLE_ENABLE.
+
+#define CONSOLE_SOCKET_ENV "BLUEPAD32_CONSOLE_SOCKET"
+#define LINE_MAX_LEN 256
+#define PROMPT_STR "bp32> "
+
+// stdin, or the socket client
+static btstack_data_source_t s_input;
+static bool s_input_active;
+// Unix socket listener
+static btstack_data_source_t s_listener;
+// Original stdout, while it is redirected to the socket client
+static int s_saved_stdout = -1;
+
+static char s_line[LINE_MAX_LEN];
+static int s_line_len;
+static bool s_line_overflow;
+
+// Input read, but not processed yet: processing stops while waiting for output.
+static char s_buf[64];
+static int s_buf_len;
+static int s_buf_pos;
+
+// The command called uni_console_wait_for_output()
+static bool s_wait_requested;
+// Waiting for the callbacks queued by the command. Input is not read meanwhile.
+static bool s_waiting;
+static btstack_context_callback_registration_t s_output_done;
+
+static void print_prompt(void) {
+    printf(PROMPT_STR);
+    fflush(stdout);
+}
+
+static void process_char(char c) {
+    if (c != '\n') {
+        if (s_line_len < LINE_MAX_LEN - 1)
+            s_line[s_line_len++] = c;
+        else
+            s_line_overflow = true;
+        return;
+    }
+
+    s_line[s_line_len] = '\0';
+    if (s_line_overflow)
+        loge("Line too long. Max: %d\n", LINE_MAX_LEN - 1);
+    else
+        uni_console_run_line(s_line);
+    s_line_len = 0;
+    s_line_overflow = false;
+
+    if (!s_wait_requested) {
+        print_prompt();
+        return;
+    }
+
+    // Queued after the callbacks of the command: it runs once their output is printed.
+    s_wait_requested = false;
+    s_waiting = true;
+    btstack_run_loop_disable_data_source_callbacks(&s_input, DATA_SOURCE_CALLBACK_READ);
+    btstack_run_loop_execute_on_main_thread(&s_output_done);
+}
+
+static void process_input(void) {
+    while (s_buf_pos < s_buf_len && !s_waiting)
+        process_char(s_buf[s_buf_pos++]);
+}
+
+static void on_output_done(void* context) {
+    ARG_UNUSED(context);
+
+    s_waiting = false;
+    if (!s_input_active)
+        return;
+
+    print_prompt();
+    // Lines that arrived together with the command
+    process_input();
+    if (!s_waiting)
+        btstack_run_loop_enable_data_source_callbacks(&s_input, DATA_SOURCE_CALLBACK_READ);
+}
+
+static void close_input(void) {
+    btstack_run_loop_remove_data_source(&s_input);
+    s_input_active = false;
+    s_line_len = 0;
+    s_buf_len = 0;
+    s_buf_pos = 0;
+
+    if (s_input.source.fd == STDIN_FILENO) {
+        logi("Console: stdin closed\n");
+        return;
+    }
+
+    // Socket client: restore stdout
+    close(s_input.source.fd);
+    fflush(stdout);
+    dup2(s_saved_stdout, STDOUT_FILENO);
+    close(s_saved_stdout);
+    s_saved_stdout = -1;
+    logi("Console: client disconnected\n");
+}
+
+static void on_input(btstack_data_source_t* ds, btstack_data_source_callback_type_t callback_type) {
+    ARG_UNUSED(callback_type);
+
+    ssize_t n = read(ds->source.fd, s_buf, sizeof(s_buf));
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (n <= 0) {
+        // EOF or error
+        close_input();
+        return;
+    }
+
+    s_buf_len = (int)n;
+    s_buf_pos = 0;
+    process_input();
+}
+
+static void add_input(int fd) {
+    btstack_run_loop_set_data_source_fd(&s_input, fd);
+    btstack_run_loop_set_data_source_handler(&s_input, &on_input);
+    btstack_run_loop_enable_data_source_callbacks(&s_input, DATA_SOURCE_CALLBACK_READ);
+    btstack_run_loop_add_data_source(&s_input);
+    s_input_active = true;
+}
+
+static void on_accept(btstack_data_source_t* ds, btstack_data_source_callback_type_t callback_type) {
+    ARG_UNUSED(callback_type);
+
+    int fd = accept(ds->source.fd, NULL, NULL);
+    if (fd < 0)
+        return;
+
+    // Only one client at the time
+    if (s_input_active) {
+        logi("Console: busy, rejecting new client\n");
+        close(fd);
+        return;
+    }
+
+    logi("Console: client connected\n");
+    fflush(stdout);
+    s_saved_stdout = dup(STDOUT_FILENO);
+    dup2(fd, STDOUT_FILENO);
+
+    add_input(fd);
+    print_prompt();
+}
+
+static int listen_on_socket(const char* path) {
+    struct sockaddr_un addr = {0};
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        loge("Console: socket path too long: %s\n", path);
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        loge("Console: could not create socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    // Remove stale socket from a previous run
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+        loge("Console: could not listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    // A client that disconnects while we are writing to it should not kill the process.
+    signal(SIGPIPE, SIG_IGN);
+
+    btstack_run_loop_set_data_source_fd(&s_listener, fd);
+    btstack_run_loop_set_data_source_handler(&s_listener, &on_accept);
+    btstack_run_loop_enable_data_source_callbacks(&s_listener, DATA_SOURCE_CALLBACK_READ);
+    btstack_run_loop_add_data_source(&s_listener);
+
+    logi("Console: listening on %s\n", path);
+    return 0;
+}
+
 void uni_console_init(void) {
-    // FIXME: Implement me
+    const char* path = getenv(CONSOLE_SOCKET_ENV);
+
+    s_output_done.callback = &on_output_done;
+
+    if (path && path[0] != '\0') {
+        listen_on_socket(path);
+        return;
+    }
+
+    add_input(STDIN_FILENO);
+    print_prompt();
+}
+
+void uni_console_wait_for_output(void) {
+    // Called from the command, on the BTstack thread: blocking would never let the callbacks run.
+    // The wait starts once the command returns. See process_char().
+    s_wait_requested = true;
 }
@@ -0,0 +1,212 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#include "uni_metrics.h"
+
+#include <arpa/inet.h>
+#include <btstack.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "uni_common.h"
+#include "uni_log.h"
+
+// Metrics exporter for Linux / macOS, in Prometheus text format over HTTP. E.g:
+//   BLUEPAD32_METRICS_PORT=9432 ./bluepad32_posix_example_app
+//   curl http://127.0.0.1:9432/metrics
+// or:
+//   BLUEPAD32_METRICS_SOCKET=/tmp/bp32-metrics.sock ./bluepad32_posix_example_app
+//   curl --unix-socket /tmp/bp32-metrics.sock http://localhost/metrics
+//
+// The BTstack thread takes a snapshot every REFRESH_INTERVAL_MS, and publishes it.
+// The exporter thread only reads the published snapshot: scrapes never block the BTstack thread.
+
+#define METRICS_SOCKET_ENV "BLUEPAD32_METRICS_SOCKET"
+#define METRICS_PORT_ENV "BLUEPAD32_METRICS_PORT"
+#define REFRESH_INTERVAL_MS 1000
+#define RESPONSE_MAX_LEN (16 * 1024)
+
+static btstack_timer_source_t s_refresh_timer;
+// Only used by the BTstack thread
+static uni_metrics_snapshot_t s_snapshot_bt;
+
+// Published snapshot. Protected by s_snapshot_mutex.
+static uni_metrics_snapshot_t s_snapshot;
+static pthread_mutex_t s_snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Only used by the exporter thread
+static uni_metrics_snapshot_t s_snapshot_exporter;
+static char s_body[RESPONSE_MAX_LEN];
+
+static int s_listen_fd = -1;
+
+//
+// Helpers
+//
+static void on_refresh(btstack_timer_source_t* ts) {
+    uni_metrics_take_snapshot(&s_snapshot_bt);
+
+    pthread_mutex_lock(&s_snapshot_mutex);
+    s_snapshot = s_snapshot_bt;
+    pthread_mutex_unlock(&s_snapshot_mutex);
+
+    btstack_run_loop_set_timer(ts, REFRESH_INTERVAL_MS);
+    btstack_run_loop_add_timer(ts);
+}
+
+static void write_all(int fd, const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        buf += n;
+        len -= n;
+    }
+}
+
+static void serve_client(int fd) {
+    char request[512];
+    char header[128];
+
+    // The request is not parsed: any path returns the metrics.
+    // Just consume it, so that the client doesn't get a "connection reset".
+    if (recv(fd, request, sizeof(request), 0) <= 0)
+        return;
+
+    pthread_mutex_lock(&s_snapshot_mutex);
+    s_snapshot_exporter = s_snapshot;
+    pthread_mutex_unlock(&s_snapshot_mutex);
+
+    int len = uni_metrics_format_prometheus(&s_snapshot_exporter, s_body, sizeof(s_body));
+    if (len < 0) {
+        static const char error[] = "HTTP/1.0 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n";
+        write_all(fd, error, sizeof(error) - 1);
+        return;
+    }
+
+    int header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.0 200 OK\r\n"
+                              "Content-Type: text/plain; version=0.0.4\r\n"
+                              "Content-Length: %d\r\n"
+                              "\r\n",
+                              len);
+    write_all(fd, header, header_len);
+    write_all(fd, s_body, len);
+}
+
+static void* exporter_thread(void* arg) {
+    ARG_UNUSED(arg);
+
+    while (true) {
+        int fd = accept(s_listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            loge("Metrics: accept() failed: %s\n", strerror(errno));
+            break;
+        }
+        serve_client(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+static int listen_on_unix_socket(const char* path) {
+    struct sockaddr_un addr = {0};
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        loge("Metrics: socket path too long: %s\n", path);
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    // Remove stale socket from a previous run
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int listen_on_loopback(int port) {
+    struct sockaddr_in addr = {0};
+    int one = 1;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    // Loopback only: metrics are not meant to be exposed to the network
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+//
+// Public functions
+//
+void uni_metrics_exporter_init(void) {
+    const char* path = getenv(METRICS_SOCKET_ENV);
+    const char* port = getenv(METRICS_PORT_ENV);
+    pthread_t thread;
+
+    if (path && path[0] != '\0') {
+        s_listen_fd = listen_on_unix_socket(path);
+    } else if (port && port[0] != '\0') {
+        int p = atoi(port);
+        if (p <= 0 || p > 65535) {
+            loge("Metrics: invalid port: %s\n", port);
+            return;
+        }
+        s_listen_fd = listen_on_loopback(p);
+    } else {
+        // Exporter not enabled
+        return;
+    }
+
+    if (s_listen_fd < 0 || listen(s_listen_fd, 4) < 0) {
+        loge("Metrics: could not listen on %s: %s\n", path ? path : port, strerror(errno));
+        if (s_listen_fd >= 0)
+            close(s_listen_fd);
+        s_listen_fd = -1;
+        return;
+    }
+
+    // A client that disconnects while we are writing to it should not kill the process.
+    signal(SIGPIPE, SIG_IGN);
+
+    // First snapshot, so that early scrapes don't return empty values. It also arms the timer.
+    btstack_run_loop_set_timer_handler(&s_refresh_timer, &on_refresh);
+    on_refresh(&s_refresh_timer);
+
+    if (pthread_create(&thread, NULL, exporter_thread, NULL) != 0) {
+        loge("Metrics: could not create thread\n");
+        return;
+    }
+    pthread_detach(thread);
+
+    logi("Metrics: exporter listening on %s\n", path ? path : port);
+}
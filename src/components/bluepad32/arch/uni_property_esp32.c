@@ -10,8 +10,6 @@
 
 #include "uni_log.h"
 
-#define PROPERTY_STRING_MAX_LEN 128
-
 static const char* STORAGE_NAMESPACE = "bp32";
 
 // Uses NVS for storage. Used in all ESP32 Bluepad32 platforms.
@@ -72,8 +70,8 @@ uni_property_value_t uni_property_get_with_property(const uni_property_t* p) {
     nvs_handle_t nvs_handle;
     esp_err_t err;
     uni_property_value_t ret;
-    size_t str_len = PROPERTY_STRING_MAX_LEN - 1;
-    static char str_ret[PROPERTY_STRING_MAX_LEN];
+    size_t str_len = UNI_PROPERTY_STRING_MAX_LEN - 1;
+    static char str_ret[UNI_PROPERTY_STRING_MAX_LEN];
 
     if (!p) {
         loge("Cannot get invalid property\n");
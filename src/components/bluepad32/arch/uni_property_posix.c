@@ -7,6 +7,7 @@
 #include <btstack_tlv_posix.h>
 #include <btstack_util.h>
 #include <hci.h>
+#include <string.h>
 
 #include "uni_common.h"
 #include "uni_log.h"
@@ -68,6 +69,20 @@ void uni_property_set_with_property(const uni_property_t* p, uni_property_value_
             data = (uint8_t*)&value.f32;
             size = sizeof(value.f32);
             break;
+        case UNI_PROPERTY_TYPE_STRING:
+            // Stored with the terminating NUL. An empty string deletes it, so the default is used again.
+            if (!value.str || value.str[0] == 0) {
+                tlv_impl->delete_tag(tlv_context_ptr, posix_get_tag_for_index(p->idx));
+                return;
+            }
+            data = (uint8_t*)value.str;
+            size = strlen(value.str) + 1;
+            if (size > UNI_PROPERTY_STRING_MAX_LEN) {
+                loge("Property %s: string too long: %d, max %d\n", p->name, size - 1,
+                     UNI_PROPERTY_STRING_MAX_LEN - 1);
+                return;
+            }
+            break;
         default:
             loge("uni_property_set_with_property: unsupported type %d\n", p->type);
             return;
@@ -82,6 +97,7 @@ uni_property_value_t uni_property_get_with_property(const uni_property_t* p) {
     uni_property_value_t value;
     int size;
     int read;
+    static char str_ret[UNI_PROPERTY_STRING_MAX_LEN];
 
     if (!p) {
         loge("Invalid get property\n");
@@ -90,8 +106,12 @@ uni_property_value_t uni_property_get_with_property(const uni_property_t* p) {
     }
 
     if (p->type == UNI_PROPERTY_TYPE_STRING) {
-        loge("No TLV for %s, returning default value\n", p->name);
-        return p->default_value;
+        memset(str_ret, 0, sizeof(str_ret));
+        read = tlv_impl->get_tag(tlv_context_ptr, posix_get_tag_for_index(p->idx), (uint8_t*)str_ret, sizeof(str_ret) - 1);
+        if (read <= 0)
+            return p->default_value;
+        value.str = str_ret;
+        return value;
     }
 
     switch (p->type) {
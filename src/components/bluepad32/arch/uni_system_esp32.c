@@ -2,8 +2,22 @@
 // Copyright 2024 Ricardo Quesada
 // http://retro.moe/unijoysticle2
 
+#include "uni_system.h"
+
+#include <esp_heap_caps.h>
 #include <esp_system.h>
+#include <esp_timer.h>
 
 void uni_system_reboot(void) {
     esp_restart();
-}
\ No newline at end of file
+}
+
+uint64_t uni_system_get_time_us(void) {
+    return esp_timer_get_time();
+}
+
+void uni_system_get_memory(uni_system_memory_t* mem) {
+    mem->heap_free = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    mem->heap_used = heap_caps_get_total_size(MALLOC_CAP_DEFAULT) - mem->heap_free;
+    mem->heap_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+}
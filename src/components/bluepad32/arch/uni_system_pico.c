@@ -4,8 +4,29 @@
 
 #include "uni_system.h"
 
+#include <malloc.h>
+
 #include <hardware/watchdog.h>
+#include <pico/time.h>
+
+// Defined by the Pico SDK linker script. The heap goes from the end of .bss up to the stack.
+extern char __StackLimit;
+extern char __bss_end__;
 
 void uni_system_reboot(void) {
     watchdog_reboot(0 /* pc */, 0 /* sp */, 0 /* delay ms */);
-}
\ No newline at end of file
+}
+
+uint64_t uni_system_get_time_us(void) {
+    return time_us_64();
+}
+
+void uni_system_get_memory(uni_system_memory_t* mem) {
+    struct mallinfo mi = mallinfo();
+    size_t total = &__StackLimit - &__bss_end__;
+
+    mem->heap_used = mi.uordblks;
+    mem->heap_free = total - mi.uordblks;
+    // Not tracked by newlib
+    mem->heap_min_free = 0;
+}
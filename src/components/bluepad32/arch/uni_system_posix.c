@@ -4,8 +4,30 @@
 
 #include "uni_system.h"
 
+#include <string.h>
+#include <time.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif  // __GLIBC__
+
 #include "uni_log.h"
 
 void uni_system_reboot(void) {
     logi("uni_system_reboot() not implemented in Linux\n");
-}
\ No newline at end of file
+}
+
+uint64_t uni_system_get_time_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void uni_system_get_memory(uni_system_memory_t* mem) {
+    memset(mem, 0, sizeof(*mem));
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 mi = mallinfo2();
+    mem->heap_used = mi.uordblks;
+    mem->heap_free = mi.fordblks;
+#endif  // __GLIBC__ >= 2.33
+}
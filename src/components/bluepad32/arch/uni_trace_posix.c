@@ -0,0 +1,498 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#include "uni_trace.h"
+
+#include <btstack.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bt/uni_bt_conn.h"
+#include "uni_common.h"
+#include "uni_log.h"
+#include "uni_system.h"
+
+#define TRACE_FILE_ENV "BLUEPAD32_TRACE_FILE"
+#define TRACE_SIZE_ENV "BLUEPAD32_TRACE_SIZE"
+#define TRACE_REPLAY_ENV "BLUEPAD32_TRACE_REPLAY"
+
+#define TRACE_SIZE_DEFAULT (4 * 1024 * 1024)
+#define TRACE_SIZE_MIN (64 * 1024)
+
+// Max records replayed in one timer callback, when they have the same timestamp
+#define REPLAY_BATCH_MAX 64
+
+#define ALIGN_UP(x, a) (((x) + (a)-1) & ~((a)-1))
+
+#define DEVICE_SLOT_SIZE \
+    ALIGN_UP(sizeof(uni_trace_device_slot_t) + sizeof(uni_trace_device_t) + UNI_TRACE_DESCRIPTOR_MAX_LEN, \
+             UNI_TRACE_RECORD_ALIGN)
+
+_Static_assert(HID_DEVICE_MAX_DESCRIPTORS_LEN <= UNI_TRACE_DESCRIPTOR_MAX_LEN,
+               "HID descriptors don't fit in device slot");
+_Static_assert(HID_DEVICE_MAX_LE_SERVICES <= UNI_TRACE_SERVICES_MAX, "HID services don't fit in device record");
+
+// Recorder
+static struct {
+    bool enabled;
+    uint8_t* map;
+    size_t map_size;
+    uni_trace_file_header_t* hdr;
+    uint8_t* devices;
+    uint8_t* data;
+} s_trace;
+
+// Replayer
+static struct {
+    uint8_t* map;
+    size_t map_size;
+    const uni_trace_file_header_t* hdr;
+    const uint8_t* devices;
+    const uint8_t* data;
+
+    uint32_t cursor;
+    uint32_t remaining;
+    // Replay timeline, in microseconds: recorded time of the first record, and when it was replayed.
+    uint64_t first_timestamp_us;
+    uint64_t start_us;
+
+    // Recorded device index -> address of the replayed device
+    bd_addr_t addr[CONFIG_BLUEPAD32_MAX_DEVICES];
+    bool valid[CONFIG_BLUEPAD32_MAX_DEVICES];
+
+    btstack_timer_source_t timer;
+} s_replay;
+
+//
+// Helpers
+//
+static uint32_t record_size(uint32_t payload_len) {
+    return ALIGN_UP(sizeof(uni_trace_record_header_t) + payload_len, UNI_TRACE_RECORD_ALIGN);
+}
+
+// Returns the offset of the record that follows the one at "offset". Wraps if needed.
+// Works both for the recorder and the replayer.
+static uint32_t next_record_offset(const uint8_t* data, uint32_t data_size, uint32_t offset) {
+    const uni_trace_record_header_t* r = (const uni_trace_record_header_t*)(data + offset);
+    offset += record_size(r->len);
+    if (data_size - offset < sizeof(uni_trace_record_header_t))
+        offset = 0;
+    return offset;
+}
+
+// Returns the offset of the record at "offset", skipping the WRAP marker if present.
+static uint32_t skip_wrap(const uint8_t* data, uint32_t data_size, uint32_t offset) {
+    if (data_size - offset < sizeof(uni_trace_record_header_t))
+        return 0;
+    const uni_trace_record_header_t* r = (const uni_trace_record_header_t*)(data + offset);
+    return (r->type == UNI_TRACE_RECORD_WRAP) ? 0 : offset;
+}
+
+// Keeps the device table in sync with the oldest record. See uni_trace_format.h.
+static void update_device_slot(const uni_trace_record_header_t* r) {
+    if (r->device_idx >= s_trace.hdr->device_slots)
+        return;
+
+    uni_trace_device_slot_t* slot = (uni_trace_device_slot_t*)(s_trace.devices + r->device_idx * DEVICE_SLOT_SIZE);
+    if (r->type == UNI_TRACE_RECORD_DEVICE) {
+        // DEVICE records are never bigger than a slot. See uni_trace_record_device().
+        memcpy(slot + 1, r + 1, r->len);
+        slot->len = r->len;
+        slot->valid = 1;
+    } else if (r->type == UNI_TRACE_RECORD_DISCONNECT) {
+        slot->valid = 0;
+    }
+}
+
+// Drops the oldest records, while they are in the [start, end) range.
+static void drop_records_in(uint32_t start, uint32_t end) {
+    uni_trace_file_header_t* hdr = s_trace.hdr;
+
+    while (hdr->records > 0) {
+        hdr->tail = skip_wrap(s_trace.data, hdr->data_size, hdr->tail);
+        if (hdr->tail < start || hdr->tail >= end)
+            break;
+        update_device_slot((const uni_trace_record_header_t*)(s_trace.data + hdr->tail));
+        hdr->tail = next_record_offset(s_trace.data, hdr->data_size, hdr->tail);
+        hdr->records--;
+    }
+}
+
+static void write_record(uni_hid_device_t* d,
+                         uni_trace_record_type_t type,
+                         uni_trace_channel_t channel,
+                         uint8_t service_index,
+                         const void* payload1,
+                         uint16_t len1,
+                         const void* payload2,
+                         uint16_t len2) {
+    uni_trace_file_header_t* hdr = s_trace.hdr;
+    uint32_t size = record_size(len1 + len2);
+
+    if (size > hdr->data_size / 2) {
+        loge("Trace: record too big (%d bytes), skipping\n", size);
+        return;
+    }
+
+    if (hdr->data_size - hdr->head < size) {
+        // Doesn't fit at the end: mark the wrap and continue from the beginning
+        drop_records_in(hdr->head, hdr->data_size);
+        if (hdr->data_size - hdr->head >= sizeof(uni_trace_record_header_t)) {
+            uni_trace_record_header_t* wrap = (uni_trace_record_header_t*)(s_trace.data + hdr->head);
+            memset(wrap, 0, sizeof(*wrap));
+            wrap->type = UNI_TRACE_RECORD_WRAP;
+        }
+        hdr->head = 0;
+    }
+
+    drop_records_in(hdr->head, hdr->head + size);
+    if (hdr->records == 0)
+        hdr->tail = hdr->head;
+
+    uint8_t* p = s_trace.data + hdr->head;
+    uni_trace_record_header_t r = {
+        .timestamp_us = uni_system_get_time_us(),
+        .len = len1 + len2,
+        .type = type,
+        .device_idx = uni_hid_device_get_idx_for_instance(d),
+        .channel = channel,
+        .service_index = service_index,
+    };
+    memcpy(p, &r, sizeof(r));
+    if (len1)
+        memcpy(p + sizeof(r), payload1, len1);
+    if (len2)
+        memcpy(p + sizeof(r) + len1, payload2, len2);
+
+    hdr->head += size;
+    if (hdr->data_size - hdr->head < sizeof(uni_trace_record_header_t))
+        hdr->head = 0;
+    hdr->records++;
+    hdr->records_total++;
+}
+
+static void* map_file(const char* path, bool writable, size_t size, size_t* out_size) {
+    int fd = open(path, writable ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+    if (fd < 0) {
+        loge("Trace: could not open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    if (writable) {
+        // Preallocate the whole file. Writing to the map never extends it.
+        if (ftruncate(fd, size) < 0) {
+            loge("Trace: could not allocate %d bytes: %s\n", (int)size, strerror(errno));
+            close(fd);
+            return NULL;
+        }
+    } else {
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            close(fd);
+            return NULL;
+        }
+        size = st.st_size;
+    }
+
+    void* map = mmap(NULL, size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps the file open
+    close(fd);
+    if (map == MAP_FAILED) {
+        loge("Trace: could not map %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    *out_size = size;
+    return map;
+}
+
+static int recorder_init(const char* path) {
+    const char* size_str = getenv(TRACE_SIZE_ENV);
+    size_t data_size = TRACE_SIZE_DEFAULT;
+
+    if (size_str && size_str[0] != '\0')
+        data_size = strtoul(size_str, NULL, 0);
+    if (data_size < TRACE_SIZE_MIN)
+        data_size = TRACE_SIZE_MIN;
+    data_size = ALIGN_UP(data_size, UNI_TRACE_RECORD_ALIGN);
+
+    size_t devices_size = CONFIG_BLUEPAD32_MAX_DEVICES * DEVICE_SLOT_SIZE;
+    s_trace.map =
+        map_file(path, true, sizeof(uni_trace_file_header_t) + devices_size + data_size, &s_trace.map_size);
+    if (!s_trace.map)
+        return -1;
+
+    // The file was truncated: the device table starts empty
+    s_trace.hdr = (uni_trace_file_header_t*)s_trace.map;
+    s_trace.devices = s_trace.map + sizeof(uni_trace_file_header_t);
+    s_trace.data = s_trace.devices + devices_size;
+
+    memset(s_trace.hdr, 0, sizeof(*s_trace.hdr));
+    memcpy(s_trace.hdr->magic, UNI_TRACE_MAGIC, UNI_TRACE_MAGIC_LEN);
+    s_trace.hdr->version = UNI_TRACE_VERSION;
+    s_trace.hdr->header_size = sizeof(uni_trace_file_header_t);
+    s_trace.hdr->data_size = data_size;
+    s_trace.hdr->device_slots = CONFIG_BLUEPAD32_MAX_DEVICES;
+    s_trace.hdr->device_slot_size = DEVICE_SLOT_SIZE;
+
+    s_trace.enabled = true;
+    logi("Trace: recording reports to %s (%d bytes)\n", path, (int)data_size);
+    return 0;
+}
+
+static uni_hid_device_t* replay_get_device(uint8_t idx) {
+    if (idx >= CONFIG_BLUEPAD32_MAX_DEVICES || !s_replay.valid[idx])
+        return NULL;
+    // Lookup by address: the device might have been deleted, E.g: connection timeout.
+    return uni_hid_device_get_instance_for_address(s_replay.addr[idx]);
+}
+
+// BLE: the descriptors of each HID service are back to back in "descriptor".
+static void replay_le_service_descriptors(uni_hid_device_t* d,
+                                          const uni_trace_device_t* info,
+                                          const uint8_t* descriptor,
+                                          uint16_t descriptor_len) {
+    const uint8_t* descriptors[HID_DEVICE_MAX_LE_SERVICES];
+    uint16_t lens[HID_DEVICE_MAX_LE_SERVICES];
+    int count = btstack_min(info->services, HID_DEVICE_MAX_LE_SERVICES);
+    uint16_t offset = 0;
+
+    for (int i = 0; i < count; i++) {
+        descriptors[i] = descriptor + offset;
+        lens[i] = btstack_min(info->service_descriptor_len[i], descriptor_len - offset);
+        offset += lens[i];
+    }
+    uni_hid_device_set_le_service_descriptors(d, descriptors, lens, count);
+}
+
+// "payload" is the one of a DEVICE record, or of a device slot.
+static void replay_device(uint8_t device_idx, const uint8_t* payload, uint16_t len) {
+    uni_trace_device_t info;
+
+    if (device_idx >= CONFIG_BLUEPAD32_MAX_DEVICES || len < sizeof(info))
+        return;
+    memcpy(&info, payload, sizeof(info));
+    info.name[sizeof(info.name) - 1] = '\0';
+
+    uni_hid_device_t* d = uni_hid_device_create(info.addr);
+    if (!d) {
+        loge("Trace: could not create device %s\n", bd_addr_to_str(info.addr));
+        return;
+    }
+    bd_addr_copy(s_replay.addr[device_idx], info.addr);
+    s_replay.valid[device_idx] = true;
+
+    // Not a real connection: make sure nothing is sent / disconnected through HCI
+    d->conn.handle = UNI_BT_CONN_HANDLE_INVALID;
+    uni_bt_conn_set_protocol(&d->conn, info.protocol);
+    uni_hid_device_set_name(d, info.name);
+    uni_hid_device_set_vendor_id(d, info.vendor_id);
+    uni_hid_device_set_product_id(d, info.product_id);
+    uni_hid_device_set_cod(d, info.cod);
+    uint16_t descriptor_len = btstack_min(info.descriptor_len, len - sizeof(info));
+    if (info.services > 0)
+        replay_le_service_descriptors(d, &info, payload + sizeof(info), descriptor_len);
+    else if (descriptor_len > 0)
+        uni_hid_device_set_hid_descriptor(d, payload + sizeof(info), btstack_min(descriptor_len, HID_MAX_DESCRIPTOR_LEN));
+
+    uni_hid_device_guess_controller_type_from_pid_vid(d);
+    if (d->controller_type != info.controller_type)
+        logi("Trace: controller type differs. Recorded: 0x%02x, guessed: 0x%02x\n", info.controller_type,
+             d->controller_type);
+
+    logi("Trace: replaying device %s (%s)\n", bd_addr_to_str(info.addr), info.name);
+    uni_hid_device_connect(d);
+    uni_hid_device_set_ready(d);
+}
+
+static void replay_record(const uni_trace_record_header_t* r, const uint8_t* payload) {
+    uni_hid_device_t* d;
+
+    switch (r->type) {
+        case UNI_TRACE_RECORD_DEVICE:
+            replay_device(r->device_idx, payload, r->len);
+            break;
+        case UNI_TRACE_RECORD_INPUT:
+            d = replay_get_device(r->device_idx);
+            if (!d)
+                break;
+            // Setup might be waiting for a reply that is not in the trace
+            if (uni_bt_conn_get_state(&d->conn) != UNI_BT_CONN_STATE_DEVICE_READY &&
+                !uni_hid_device_set_ready_complete(d))
+                break;
+            if (r->channel == UNI_TRACE_CHANNEL_GATT)
+                uni_hid_device_on_le_input_report(d, r->service_index, payload, r->len);
+            else
+                uni_hid_device_on_input_report(d, payload, r->len);
+            break;
+        case UNI_TRACE_RECORD_FEATURE:
+            d = replay_get_device(r->device_idx);
+            if (d && d->report_parser.parse_feature_report)
+                d->report_parser.parse_feature_report(d, payload, r->len);
+            break;
+        case UNI_TRACE_RECORD_DISCONNECT:
+            d = replay_get_device(r->device_idx);
+            if (!d)
+                break;
+            uni_hid_device_on_connected(d, false);
+            uni_hid_device_delete(d);
+            s_replay.valid[r->device_idx] = false;
+            break;
+        case UNI_TRACE_RECORD_OUTPUT:
+            // Nothing to replay. Output reports generated by the parsers are dropped, since there is no connection.
+            break;
+        default:
+            logi("Trace: unknown record type %d\n", r->type);
+            break;
+    }
+}
+
+static void on_replay(btstack_timer_source_t* ts) {
+    const uni_trace_file_header_t* hdr = s_replay.hdr;
+
+    for (int i = 0; i < REPLAY_BATCH_MAX && s_replay.remaining > 0; i++) {
+        s_replay.cursor = skip_wrap(s_replay.data, hdr->data_size, s_replay.cursor);
+        const uni_trace_record_header_t* r = (const uni_trace_record_header_t*)(s_replay.data + s_replay.cursor);
+        if (r->len > hdr->data_size - s_replay.cursor - sizeof(*r)) {
+            loge("Trace: corrupted record at offset %d\n", s_replay.cursor);
+            s_replay.remaining = 0;
+            break;
+        }
+
+        // Keep the recorded timing. The timer has 1ms resolution, but each record is due at its recorded
+        // offset in microseconds from the first one: delays are not truncated, and errors don't add up.
+        uint64_t now_us = uni_system_get_time_us();
+        if (s_replay.start_us == 0) {
+            s_replay.start_us = now_us;
+            s_replay.first_timestamp_us = r->timestamp_us;
+        }
+        uint64_t due_us = s_replay.start_us;
+        if (r->timestamp_us > s_replay.first_timestamp_us)
+            due_us += r->timestamp_us - s_replay.first_timestamp_us;
+        if (due_us > now_us) {
+            btstack_run_loop_set_timer(ts, (uint32_t)((due_us - now_us + 999) / 1000));
+            btstack_run_loop_add_timer(ts);
+            return;
+        }
+
+        replay_record(r, (const uint8_t*)(r + 1));
+        s_replay.cursor = next_record_offset(s_replay.data, hdr->data_size, s_replay.cursor);
+        s_replay.remaining--;
+    }
+
+    if (s_replay.remaining == 0) {
+        logi("Trace: replay finished\n");
+        munmap(s_replay.map, s_replay.map_size);
+        s_replay.map = NULL;
+        return;
+    }
+
+    // More records with the same timestamp. Let other events run.
+    btstack_run_loop_set_timer(ts, 0);
+    btstack_run_loop_add_timer(ts);
+}
+
+static int replayer_init(const char* path) {
+    s_replay.map = map_file(path, false, 0, &s_replay.map_size);
+    if (!s_replay.map)
+        return -1;
+
+    const uni_trace_file_header_t* hdr = (const uni_trace_file_header_t*)s_replay.map;
+    if (s_replay.map_size < sizeof(*hdr) || memcmp(hdr->magic, UNI_TRACE_MAGIC, UNI_TRACE_MAGIC_LEN) != 0 ||
+        hdr->version != UNI_TRACE_VERSION || hdr->header_size != sizeof(*hdr) ||
+        hdr->device_slot_size < sizeof(uni_trace_device_slot_t) ||
+        (uint64_t)hdr->device_slots * hdr->device_slot_size + hdr->data_size > s_replay.map_size - sizeof(*hdr) ||
+        hdr->tail >= hdr->data_size) {
+        loge("Trace: invalid trace file: %s\n", path);
+        munmap(s_replay.map, s_replay.map_size);
+        s_replay.map = NULL;
+        return -1;
+    }
+
+    s_replay.hdr = hdr;
+    s_replay.devices = s_replay.map + hdr->header_size;
+    s_replay.data = s_replay.devices + hdr->device_slots * hdr->device_slot_size;
+    s_replay.cursor = hdr->tail;
+    s_replay.remaining = hdr->records;
+
+    logi("Trace: replaying %d records from %s\n", hdr->records, path);
+    if (hdr->records_total != hdr->records)
+        logi("Trace: %d older records were overwritten\n", hdr->records_total - hdr->records);
+
+    // Devices whose DEVICE record was overwritten. Needed by the records that follow.
+    for (uint32_t i = 0; i < hdr->device_slots; i++) {
+        const uni_trace_device_slot_t* slot =
+            (const uni_trace_device_slot_t*)(s_replay.devices + i * hdr->device_slot_size);
+        if (slot->valid && slot->len <= hdr->device_slot_size - sizeof(*slot))
+            replay_device(i, (const uint8_t*)(slot + 1), slot->len);
+    }
+
+    btstack_run_loop_set_timer_handler(&s_replay.timer, &on_replay);
+    btstack_run_loop_set_timer(&s_replay.timer, 0);
+    btstack_run_loop_add_timer(&s_replay.timer);
+    return 0;
+}
+
+//
+// Public functions
+//
+void uni_trace_init(void) {
+    const char* path;
+
+    path = getenv(TRACE_REPLAY_ENV);
+    if (path && path[0] != '\0') {
+        replayer_init(path);
+        return;
+    }
+
+    path = getenv(TRACE_FILE_ENV);
+    if (path && path[0] != '\0')
+        recorder_init(path);
+}
+
+void uni_trace_record_report(uni_hid_device_t* d,
+                             uni_trace_record_type_t type,
+                             uni_trace_channel_t channel,
+                             const uint8_t* report,
+                             uint16_t len) {
+    if (!s_trace.enabled)
+        return;
+    write_record(d, type, channel, 0, report, len, NULL, 0);
+}
+
+void uni_trace_record_le_input_report(uni_hid_device_t* d, uint8_t service_index, const uint8_t* report, uint16_t len) {
+    if (!s_trace.enabled)
+        return;
+    write_record(d, UNI_TRACE_RECORD_INPUT, UNI_TRACE_CHANNEL_GATT, service_index, report, len, NULL, 0);
+}
+
+void uni_trace_record_device(uni_hid_device_t* d, uni_trace_record_type_t type) {
+    uni_trace_device_t info = {0};
+
+    if (!s_trace.enabled)
+        return;
+
+    if (type != UNI_TRACE_RECORD_DEVICE) {
+        write_record(d, type, UNI_TRACE_CHANNEL_NONE, 0, NULL, 0, NULL, 0);
+        return;
+    }
+
+    memcpy(info.addr, d->conn.btaddr, sizeof(info.addr));
+    info.vendor_id = d->vendor_id;
+    info.product_id = d->product_id;
+    info.controller_type = d->controller_type;
+    info.protocol = d->conn.protocol;
+    info.cod = d->cod;
+    strncpy(info.name, d->name, sizeof(info.name) - 1);
+    info.descriptor_len = d->hid_descriptor_len;
+    info.services = d->le_services_count;
+    for (int i = 0; i < d->le_services_count; i++)
+        info.service_descriptor_len[i] = d->le_services[i].len;
+
+    write_record(d, type, UNI_TRACE_CHANNEL_NONE, 0, &info, sizeof(info), d->hid_descriptor, d->hid_descriptor_len);
+}
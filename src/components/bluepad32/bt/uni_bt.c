@@ -64,6 +64,8 @@
 #include "bt/uni_bt_bredr.h"
 #include "bt/uni_bt_hci_cmd.h"
 #include "bt/uni_bt_le.h"
+#include "bt/uni_bt_link_policy.h"
+#include "bt/uni_bt_reconnect.h"
 #include "bt/uni_bt_service.h"
 #include "bt/uni_bt_setup.h"
 #include "platform/uni_platform.h"
@@ -71,6 +73,7 @@
 #include "uni_config.h"
 #include "uni_hid_device.h"
 #include "uni_log.h"
+#include "uni_metrics.h"
 #include "uni_property.h"
 
 // globals
@@ -93,11 +96,14 @@ enum {
     CMD_DISCONNECT_DEVICE,
     CMD_BLE_SERVICE_ENABLE,
     CMD_BLE_SERVICE_DISABLE,
+    CMD_BT_RECONNECT,
 };
 
 static void bluetooth_del_keys(void) {
-    if (IS_ENABLED(UNI_ENABLE_BREDR))
+    if (IS_ENABLED(UNI_ENABLE_BREDR)) {
         uni_bt_bredr_delete_bonded_keys();
+        uni_bt_reconnect_clear();
+    }
     if (IS_ENABLED(UNI_ENABLE_BLE))
         uni_bt_le_delete_bonded_keys();
 }
@@ -163,6 +169,9 @@ static void on_hci_disconnection_complete(uint16_t channel, const uint8_t* packe
 
         logi("Device %s disconnected, deleting it. Reason=%#x, status=%d\n", bd_addr_to_str(d->conn.btaddr), reason,
              status);
+        uni_metrics_inc(UNI_METRICS_COUNTER_DISCONNECTIONS);
+        if (reason == ERROR_CODE_CONNECTION_TIMEOUT)
+            uni_metrics_inc(UNI_METRICS_COUNTER_LINK_LOSSES);
         uni_hid_device_disconnect(d);
         uni_hid_device_delete(d);
         // Device cannot be used after delete.
@@ -214,6 +223,10 @@ static void cmd_callback(void* context) {
         case CMD_BLE_SERVICE_DISABLE:
             uni_bt_service_set_enabled(false);
             break;
+        case CMD_BT_RECONNECT:
+            if (IS_ENABLED(UNI_ENABLE_BREDR))
+                uni_bt_reconnect_start();
+            break;
         default:
             loge("Unknown command: %#x\n", cmd);
             break;
@@ -278,6 +291,12 @@ void uni_bt_enable_service_safe(bool enabled) {
     btstack_run_loop_execute_on_main_thread(&cmd_callback_registration);
 }
 
+void uni_bt_reconnect_safe(void) {
+    cmd_callback_registration.callback = &cmd_callback;
+    cmd_callback_registration.context = (void*)CMD_BT_RECONNECT;
+    btstack_run_loop_execute_on_main_thread(&cmd_callback_registration);
+}
+
 void uni_bt_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t* packet, uint16_t size) {
     uint8_t event;
     uni_hid_device_t* device;
@@ -309,8 +328,18 @@ void uni_bt_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t* packe
                     if (status)
                         logi("Failed command: HCI_EVENT_COMMAND_COMPLETE: opcode = 0x%04x - status=%d\n", opcode,
                              status);
+                    if (IS_ENABLED(UNI_ENABLE_BREDR))
+                        uni_bt_link_policy_process();
                     break;
                 }
+                case HCI_EVENT_COMMAND_STATUS:
+                    if (IS_ENABLED(UNI_ENABLE_BREDR))
+                        uni_bt_link_policy_on_hci_command_status(packet, size);
+                    break;
+                case HCI_EVENT_MODE_CHANGE:
+                    if (IS_ENABLED(UNI_ENABLE_BREDR))
+                        uni_bt_link_policy_on_hci_mode_change(packet, size);
+                    break;
                 case HCI_EVENT_AUTHENTICATION_COMPLETE_EVENT: {
                     status = hci_event_authentication_complete_get_status(packet);
                     handle = hci_event_authentication_complete_get_connection_handle(packet);
@@ -401,6 +430,8 @@ void uni_bt_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t* packe
                     break;
                 case HCI_EVENT_ROLE_CHANGE:
                     logi("--> HCI_EVENT_ROLE_CHANGE\n");
+                    if (IS_ENABLED(UNI_ENABLE_BREDR))
+                        uni_bt_link_policy_on_hci_role_change(packet, size);
                     break;
                 case HCI_EVENT_SYNCHRONOUS_CONNECTION_COMPLETE:
                     logi("--> HCI_EVENT_SYNCHRONOUS_CONNECTION_COMPLETE\n");
@@ -14,11 +14,14 @@
 #include "bt/uni_bt.h"
 #include "bt/uni_bt_allowlist.h"
 #include "bt/uni_bt_defines.h"
+#include "bt/uni_bt_reconnect.h"
 #include "bt/uni_bt_sdp.h"
 #include "platform/uni_platform.h"
 #include "uni_common.h"
 #include "uni_config.h"
 #include "uni_log.h"
+#include "uni_system.h"
+#include "uni_trace.h"
 
 // These are the only two supported platforms with BR/EDR support.
 #if !(defined(CONFIG_IDF_TARGET_ESP32) || defined(CONFIG_TARGET_POSIX) || defined(CONFIG_TARGET_PICO_W))
@@ -61,6 +64,10 @@ static void inquiry_remote_name_timeout_callback(btstack_timer_source_t* ts) {
     uni_bt_bredr_process_fsm(d);
 }
 
+void uni_bt_bredr_l2cap_create_control_connection(uni_hid_device_t* d) {
+    l2cap_create_control_connection(d);
+}
+
 void uni_bt_bredr_scan_start(void) {
     uint8_t status;
 
@@ -146,6 +153,13 @@ void uni_bt_bredr_list_bonded_keys(void) {
     gap_link_key_iterator_done(&it);
 }
 
+bool uni_bt_bredr_is_bonded(bd_addr_t addr) {
+    link_key_t link_key;
+    link_key_type_t type;
+
+    return gap_get_link_key_for_bd_addr(addr, link_key, &type) != 0;
+}
+
 void uni_bt_bredr_setup(void) {
     int security_level = uni_bt_get_gap_security_level();
     gap_set_security_level(security_level);
@@ -163,6 +177,8 @@ void uni_bt_bredr_setup(void) {
     // Needed for some incoming connections
     uni_bt_sdp_server_init();
 
+    uni_bt_reconnect_init();
+
     l2cap_register_service(uni_bt_packet_handler, BLUETOOTH_PSM_HID_INTERRUPT, UNI_BT_L2CAP_CHANNEL_MTU,
                            security_level);
     l2cap_register_service(uni_bt_packet_handler, BLUETOOTH_PSM_HID_CONTROL, UNI_BT_L2CAP_CHANNEL_MTU, security_level);
@@ -239,6 +255,19 @@ void uni_bt_bredr_process_fsm(uni_hid_device_t* d) {
     }
 
     if (state == UNI_BT_CONN_STATE_REMOTE_NAME_FETCHED) {
+        // Directed reconnect: HID channels were opened before fetching the name.
+        if (!uni_hid_device_is_incoming(d) && d->conn.interrupt_cid != 0) {
+            if (d->sdp_query_type == SDP_QUERY_NOT_NEEDED) {
+                logi("uni_bt_process_fsm: Device is ready\n");
+                uni_hid_device_set_ready(d);
+            } else {
+                logi("uni_bt_process_fsm: starting SDP query\n");
+                uni_bt_sdp_query_start(d);
+                /* 'd' might be invalid */
+            }
+            return;
+        }
+
         // TODO: Move comparison to DS4 code
         if (strcmp("Wireless Controller", d->name) == 0) {
             logi("uni_bt_process_fsm: gamepad is 'Wireless Controller', starting SDP query\n");
@@ -421,8 +450,11 @@ void uni_bt_bredr_on_l2cap_channel_opened(uint16_t channel, const uint8_t* packe
         if (status == L2CAP_CONNECTION_RESPONSE_RESULT_REFUSED_SECURITY) {
             logi("Probably GAP-security-related issues. Set GAP security to 2\n");
         }
-        logi("Removing key for device: %s.\n", bd_addr_to_str(address));
-        gap_drop_link_key_for_bd_addr(device->conn.btaddr);
+        // Page timeout: the device is off or out of range. The key is still valid.
+        if (status != ERROR_CODE_PAGE_TIMEOUT) {
+            logi("Removing key for device: %s.\n", bd_addr_to_str(address));
+            gap_drop_link_key_for_bd_addr(device->conn.btaddr);
+        }
         uni_hid_device_disconnect(device);
         uni_hid_device_delete(device);
         /* 'device' is destroyed, don't use */
@@ -500,6 +532,7 @@ void uni_bt_bredr_on_l2cap_data_packet(uint16_t channel, const uint8_t* packet,
 
     if (channel == d->conn.control_cid) {
         // Feature report
+        uni_trace_record_report(d, UNI_TRACE_RECORD_FEATURE, UNI_TRACE_CHANNEL_CONTROL, &packet[1], size - 1);
         if (d->report_parser.parse_feature_report)
             // Skip the first byte which must be 0xa3
             d->report_parser.parse_feature_report(d, &packet[1], size - 1);
@@ -520,8 +553,7 @@ void uni_bt_bredr_on_l2cap_data_packet(uint16_t channel, const uint8_t* packet,
     }
 
     // Skip the first byte, which is always 0xa1
-    uni_hid_parse_input_report(d, &packet[1], size - 1);
-    uni_hid_device_process_controller(d);
+    uni_hid_device_on_input_report(d, &packet[1], size - 1);
 }
 
 void uni_bt_bredr_on_gap_inquiry_result(uint16_t channel, const uint8_t* packet, uint16_t size) {
@@ -568,7 +600,7 @@ void uni_bt_bredr_on_gap_inquiry_result(uint16_t channel, const uint8_t* packet,
             logi("Device already added, waiting (current state=0x%02x)...\n", d->conn.state);
         } else {
             // Device not found, create one.
-            d = uni_hid_device_create(addr);
+            d = uni_hid_device_create_discovered(addr, cod, rssi);
             if (d == NULL) {
                 loge("\nError: cannot create device, no more available slots\n");
                 return;
@@ -623,6 +655,7 @@ void uni_bt_bredr_on_hci_connection_complete(uint16_t channel, const uint8_t* pa
 
     hci_event_connection_complete_get_bd_addr(packet, event_addr);
     status = hci_event_connection_complete_get_status(packet);
+    uni_bt_reconnect_on_connection_complete(event_addr, status);
     if (status) {
         logi("on_hci_connection_complete failed (0x%02x) for %s\n", status, bd_addr_to_str(event_addr));
         return;
@@ -636,6 +669,7 @@ void uni_bt_bredr_on_hci_connection_complete(uint16_t channel, const uint8_t* pa
 
     handle = hci_event_connection_complete_get_connection_handle(packet);
     uni_hid_device_set_connection_handle(d, handle);
+    d->conn.link.connected_us = uni_system_get_time_us();
 
     // if (uni_hid_device_is_incoming(d)) {
     //   hci_send_cmd(&hci_authentication_requested, handle);
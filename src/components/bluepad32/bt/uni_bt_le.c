@@ -74,8 +74,9 @@
 static bool is_scanning;
 static bool ble_enabled;
 
-// Temporal space for SDP in BLE
-static uint8_t hid_descriptor_storage[512];
+// Used by the BTstack HIDS client to store the HID descriptors of each connected device, until it disconnects.
+// Each device might have several HID services: same size as the descriptors of a device, see uni_hid_device_t.
+static uint8_t hid_descriptor_storage[CONFIG_BLUEPAD32_MAX_DEVICES * HID_DEVICE_MAX_DESCRIPTORS_LEN];
 static btstack_packet_callback_registration_t sm_event_callback_registration;
 
 /**
@@ -204,12 +205,25 @@ static void adv_event_get_data(const uint8_t* packet, uint16_t* appearance, char
     get_advertisement_data(ad_data, ad_len, appearance, name);
 }
 
+// Copies the HID descriptor of each HID service to the device, before the parser is set up.
+// E.g: Xbox uses the descriptor to detect the firmware version.
+static void set_service_descriptors(uni_hid_device_t* device, uint16_t hids_cid, int num_instances) {
+    const uint8_t* descriptors[HID_DEVICE_MAX_LE_SERVICES];
+    uint16_t lens[HID_DEVICE_MAX_LE_SERVICES];
+    int count = btstack_min(num_instances, HID_DEVICE_MAX_LE_SERVICES);
+
+    for (int i = 0; i < count; i++) {
+        descriptors[i] = hids_client_descriptor_storage_get_descriptor_data(hids_cid, i);
+        lens[i] = hids_client_descriptor_storage_get_descriptor_len(hids_cid, i);
+        logi("HID service %d: descriptor len=%d\n", i, lens[i]);
+    }
+    uni_hid_device_set_le_service_descriptors(device, descriptors, lens, count);
+}
+
 static void parse_report(uint8_t* packet, uint16_t size) {
     uint16_t service_index;
     uint16_t hids_cid;
     uni_hid_device_t* device;
-    const uint8_t* descriptor_data;
-    uint16_t descriptor_len;
     const uint8_t* report_data;
     uint16_t report_len;
 
@@ -224,20 +238,10 @@ static void parse_report(uint8_t* packet, uint16_t size) {
         return;
     }
 
-    // FIXME: Copying the HID descriptor should be done at setup time since some device, like Xbox requires it
-    // to set the correct parser.
-    // But not clear how to get the "service_index" from setup
-    if (device->hid_descriptor_len == 0) {
-        descriptor_data = hids_client_descriptor_storage_get_descriptor_data(hids_cid, service_index);
-        descriptor_len = hids_client_descriptor_storage_get_descriptor_len(hids_cid, service_index);
-
-        uni_hid_device_set_hid_descriptor(device, descriptor_data, descriptor_len);
-    }
     report_data = gattservice_subevent_hid_report_get_report(packet);
     report_len = gattservice_subevent_hid_report_get_report_len(packet);
 
-    uni_hid_parse_input_report(device, report_data, report_len);
-    uni_hid_device_process_controller(device);
+    uni_hid_device_on_le_input_report(device, service_index, report_data, report_len);
 }
 
 static void hids_client_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t* packet, uint16_t size) {
@@ -290,6 +294,8 @@ static void hids_client_packet_handler(uint8_t packet_type, uint16_t channel, ui
                         logi("Client notifications enabled for for hids_cid=%d\n", hids_cid);
 #endif
 
+                    set_service_descriptors(device, hids_cid,
+                                            gattservice_subevent_hid_service_connected_get_num_instances(packet));
                     uni_hid_device_guess_controller_type_from_pid_vid(device);
                     uni_hid_device_connect(device);
                     uni_hid_device_set_ready(device);
@@ -334,7 +340,14 @@ static void hids_client_packet_handler(uint8_t packet_type, uint16_t channel, ui
         case GATTSERVICE_SUBEVENT_HID_REPORT_WRITTEN:
             // Called when a client a hid report was written.
             // E.g.: "set rumble" was sent to the gamepad.
-            // TODO: Inform the device that it is ready to write another hid report?
+            // The device can write the next queued report.
+            hids_cid = gattservice_subevent_hid_report_written_get_hids_cid(packet);
+            device = uni_hid_device_get_instance_for_hids_cid(hids_cid);
+            if (!device) {
+                loge("Hids Cid: Could not find valid device for hids_cid=%d\n", hids_cid);
+                break;
+            }
+            uni_hid_device_on_le_report_written(device);
             break;
         default:
             logi("Unsupported gatt client event: 0x%02x\n", hci_event_gattservice_meta_get_subevent_code(packet));
@@ -792,7 +805,7 @@ void uni_bt_le_on_gap_event_advertising_report(const uint8_t* packet, uint16_t s
     if (uni_hid_device_on_device_discovered(addr, name, cod, rssi) != UNI_ERROR_SUCCESS)
         return;
 
-    uni_hid_device_t* d = uni_hid_device_create(addr);
+    uni_hid_device_t* d = uni_hid_device_create_discovered(addr, cod, rssi);
     if (!d) {
         loge("Error: no more available device slots\n");
         return;
@@ -861,6 +874,26 @@ void uni_bt_le_delete_bonded_keys(void) {
     logi(".\n");
 }
 
+bool uni_bt_le_is_bonded(bd_addr_t addr) {
+    bd_addr_t entry_address;
+
+    if (!ble_enabled)
+        return false;
+
+    for (int i = 0; i < le_device_db_max_count(); i++) {
+        int entry_address_type = (int)BD_ADDR_TYPE_UNKNOWN;
+        le_device_db_info(i, &entry_address_type, entry_address, NULL);
+
+        // skip unused entries
+        if (entry_address_type == (int)BD_ADDR_TYPE_UNKNOWN)
+            continue;
+
+        if (bd_addr_cmp(entry_address, addr) == 0)
+            return true;
+    }
+    return false;
+}
+
 void uni_bt_le_setup(void) {
     // register for events from Security Manager
     sm_event_callback_registration.callback = &sm_packet_handler;
@@ -0,0 +1,352 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#include "bt/uni_bt_link_policy.h"
+
+#include <btstack.h>
+
+#include "sdkconfig.h"
+#include "uni_common.h"
+#include "uni_log.h"
+#include "uni_system.h"
+
+// HCI modes, as reported by the "mode change" event
+#define LINK_MODE_ACTIVE 0
+#define LINK_MODE_HOLD 1
+#define LINK_MODE_SNIFF 2
+
+// Sniff attempt / timeout, in slots. Used when Bluepad32 requests sniff.
+#define SNIFF_ATTEMPT 2
+#define SNIFF_TIMEOUT 1
+
+// Max flush timeout, in slots, as defined by the spec.
+#define FLUSH_TIMEOUT_MAX_SLOTS 0x07ff
+
+typedef enum {
+    // Step done, or nothing to do. Run the next one.
+    STEP_RESULT_NEXT,
+    // Command sent, or waiting for an event. Resume later.
+    STEP_RESULT_WAIT,
+    // Can't run now. Run the same step later.
+    STEP_RESULT_RETRY,
+} step_result_t;
+
+typedef step_result_t (*step_fn_t)(uni_hid_device_t* d, const uni_bt_link_policy_t* p);
+
+typedef struct {
+    uni_controller_type_t type;
+    uni_bt_link_policy_t policy;
+} type_policy_t;
+
+static step_result_t step_write_link_policy(uni_hid_device_t* d, const uni_bt_link_policy_t* p);
+static step_result_t step_sniff(uni_hid_device_t* d, const uni_bt_link_policy_t* p);
+static step_result_t step_role(uni_hid_device_t* d, const uni_bt_link_policy_t* p);
+static step_result_t step_supervision_timeout(uni_hid_device_t* d, const uni_bt_link_policy_t* p);
+static step_result_t step_flush_timeout(uni_hid_device_t* d, const uni_bt_link_policy_t* p);
+
+// Order is important: the role must be known before setting the supervision timeout.
+static const step_fn_t steps[] = {
+    &step_write_link_policy, &step_sniff, &step_role, &step_supervision_timeout, &step_flush_timeout,
+};
+
+static const uni_bt_link_policy_t default_policy = {
+    .sniff_enabled = false,
+    .central_role = true,
+    .supervision_timeout_ms = 2000,
+};
+
+static const type_policy_t builtin_policies[] = {
+    // Keyboards are not that sensitive to latency. Sniff is allowed, but bounded to 20ms.
+    {CONTROLLER_TYPE_GenericKeyboard,
+     {
+         .sniff_enabled = true,
+         .sniff_min_interval = 16,
+         .sniff_max_interval = 32,
+         .central_role = true,
+         .supervision_timeout_ms = 2000,
+     }},
+};
+
+static type_policy_t custom_policies[UNI_BT_LINK_POLICY_MAX_CUSTOM];
+static int custom_policies_count;
+
+// Connection whose role switch is in flight. The "command status" of a rejected role switch
+// doesn't say which connection it was for, so only one role switch is requested at a time.
+static hci_con_handle_t role_switch_handle = UNI_BT_CONN_HANDLE_INVALID;
+
+//
+// Helpers
+//
+static uint16_t ms_to_slots(uint16_t ms) {
+    return (uint16_t)(((uint32_t)ms * 8) / 5);
+}
+
+static const char* mode_to_str(uint8_t mode) {
+    switch (mode) {
+        case LINK_MODE_ACTIVE:
+            return "active";
+        case LINK_MODE_HOLD:
+            return "hold";
+        case LINK_MODE_SNIFF:
+            return "sniff";
+        default:
+            return "unknown";
+    }
+}
+
+static const char* role_to_str(hci_role_t role) {
+    return role == HCI_ROLE_MASTER ? "central" : "peripheral";
+}
+
+static int get_elapsed_ms(const uni_bt_conn_link_t* link) {
+    return (int)((uni_system_get_time_us() - link->connected_us) / 1000);
+}
+
+static bool is_role_switch_in_flight(void) {
+    uni_hid_device_t* d;
+
+    if (role_switch_handle == UNI_BT_CONN_HANDLE_INVALID)
+        return false;
+
+    d = uni_hid_device_get_instance_for_connection_handle(role_switch_handle);
+    if (d == NULL || !d->conn.link.role_switch_pending) {
+        // Disconnected, or its "role change" event already arrived.
+        role_switch_handle = UNI_BT_CONN_HANDLE_INVALID;
+        return false;
+    }
+    return true;
+}
+
+static step_result_t step_write_link_policy(uni_hid_device_t* d, const uni_bt_link_policy_t* p) {
+    uint16_t settings = LM_LINK_POLICY_ENABLE_ROLE_SWITCH;
+
+    if (p->sniff_enabled)
+        settings |= LM_LINK_POLICY_ENABLE_SNIFF_MODE;
+    hci_send_cmd(&hci_write_link_policy_settings, d->conn.handle, settings);
+    return STEP_RESULT_WAIT;
+}
+
+static step_result_t step_sniff(uni_hid_device_t* d, const uni_bt_link_policy_t* p) {
+    if (!p->sniff_enabled) {
+        if (d->conn.link.mode == LINK_MODE_SNIFF) {
+            logi("Link: %s, exiting sniff mode\n", bd_addr_to_str(d->conn.btaddr));
+            gap_sniff_mode_exit(d->conn.handle);
+        }
+        return STEP_RESULT_NEXT;
+    }
+
+    if (p->sniff_max_interval != 0)
+        gap_sniff_mode_enter(d->conn.handle, p->sniff_min_interval, p->sniff_max_interval, SNIFF_ATTEMPT,
+                             SNIFF_TIMEOUT);
+    if (p->sniff_subrating_max_latency != 0)
+        gap_sniff_subrating_configure(d->conn.handle, p->sniff_subrating_max_latency, 0, 0);
+    return STEP_RESULT_NEXT;
+}
+
+static step_result_t step_role(uni_hid_device_t* d, const uni_bt_link_policy_t* p) {
+    if (!p->central_role || d->conn.link.role == HCI_ROLE_MASTER)
+        return STEP_RESULT_NEXT;
+
+    // Another connection is switching role. Resumed once it is done.
+    if (is_role_switch_in_flight())
+        return STEP_RESULT_RETRY;
+
+    logi("Link: %s, requesting central role\n", bd_addr_to_str(d->conn.btaddr));
+    d->conn.link.role_switch_pending = true;
+    role_switch_handle = d->conn.handle;
+    gap_request_role(d->conn.btaddr, HCI_ROLE_MASTER);
+    // Resumed from the "role change" event.
+    return STEP_RESULT_WAIT;
+}
+
+static step_result_t step_supervision_timeout(uni_hid_device_t* d, const uni_bt_link_policy_t* p) {
+    if (p->supervision_timeout_ms == 0)
+        return STEP_RESULT_NEXT;
+
+    // The supervision timeout is negotiated by the central.
+    if (d->conn.link.role != HCI_ROLE_MASTER) {
+        logi("Link: %s, not central, supervision timeout not set\n", bd_addr_to_str(d->conn.btaddr));
+        return STEP_RESULT_NEXT;
+    }
+    hci_send_cmd(&hci_write_link_supervision_timeout, d->conn.handle, ms_to_slots(p->supervision_timeout_ms));
+    return STEP_RESULT_WAIT;
+}
+
+static step_result_t step_flush_timeout(uni_hid_device_t* d, const uni_bt_link_policy_t* p) {
+    uint16_t slots;
+
+    if (p->flush_timeout_ms == 0)
+        return STEP_RESULT_NEXT;
+
+    slots = ms_to_slots(p->flush_timeout_ms);
+    if (slots > FLUSH_TIMEOUT_MAX_SLOTS)
+        slots = FLUSH_TIMEOUT_MAX_SLOTS;
+    hci_send_cmd(&hci_write_automatic_flush_timeout, d->conn.handle, slots);
+    return STEP_RESULT_WAIT;
+}
+
+static void process_device(uni_hid_device_t* d) {
+    uni_bt_conn_link_t* link = &d->conn.link;
+    const uni_bt_link_policy_t* p;
+    step_result_t res;
+
+    p = uni_bt_link_policy_get_for_controller_type(d->controller_type);
+
+    // policy_step is 1-based. 0 means "nothing to do".
+    while (link->policy_step > 0 && link->policy_step <= ARRAY_SIZE(steps)) {
+        // Resumed from the "role change" event.
+        if (link->role_switch_pending)
+            return;
+        // One HCI command at a time. Resumed from the "command complete / status" events.
+        if (!hci_can_send_command_packet_now())
+            return;
+
+        res = steps[link->policy_step - 1](d, p);
+        if (res == STEP_RESULT_RETRY)
+            return;
+        link->policy_step++;
+        if (res == STEP_RESULT_WAIT)
+            return;
+    }
+
+    if (link->policy_step > ARRAY_SIZE(steps)) {
+        logi("Link: %s, policy applied, t=%d ms (mode=%s, role=%s)\n", bd_addr_to_str(d->conn.btaddr),
+             get_elapsed_ms(link), mode_to_str(link->mode), role_to_str(link->role));
+        link->policy_step = 0;
+    }
+}
+
+//
+// Public functions
+//
+const uni_bt_link_policy_t* uni_bt_link_policy_get_for_controller_type(uni_controller_type_t type) {
+    for (int i = 0; i < custom_policies_count; i++) {
+        if (custom_policies[i].type == type)
+            return &custom_policies[i].policy;
+    }
+    for (int i = 0; i < ARRAY_SIZE(builtin_policies); i++) {
+        if (builtin_policies[i].type == type)
+            return &builtin_policies[i].policy;
+    }
+    return &default_policy;
+}
+
+bool uni_bt_link_policy_set_for_controller_type(uni_controller_type_t type, const uni_bt_link_policy_t* policy) {
+    for (int i = 0; i < custom_policies_count; i++) {
+        if (custom_policies[i].type == type) {
+            custom_policies[i].policy = *policy;
+            return true;
+        }
+    }
+    if (custom_policies_count == UNI_BT_LINK_POLICY_MAX_CUSTOM) {
+        loge("Link: cannot add policy for controller type %d, no space left\n", type);
+        return false;
+    }
+    custom_policies[custom_policies_count].type = type;
+    custom_policies[custom_policies_count].policy = *policy;
+    custom_policies_count++;
+    return true;
+}
+
+void uni_bt_link_policy_apply(uni_hid_device_t* d) {
+    uni_bt_conn_link_t* link = &d->conn.link;
+
+    if (uni_hid_device_is_virtual_device(d) || d->conn.protocol != UNI_BT_CONN_PROTOCOL_BR_EDR ||
+        d->conn.handle == UNI_BT_CONN_HANDLE_INVALID)
+        return;
+
+    link->policy_step = 1;
+    link->role_switch_pending = false;
+    link->role = gap_get_role(d->conn.handle);
+    process_device(d);
+}
+
+void uni_bt_link_policy_dump_device(uni_hid_device_t* d) {
+    const uni_bt_conn_link_t* link = &d->conn.link;
+
+    if (uni_hid_device_is_virtual_device(d) || d->conn.protocol != UNI_BT_CONN_PROTOCOL_BR_EDR)
+        return;
+
+    logi("\tlink: role=%s, mode=%s, interval=%d slots, mode changes=%d", role_to_str(link->role),
+         mode_to_str(link->mode), link->mode_interval, link->mode_changes);
+    if (link->mode_changes > 0)
+        logi(", last one %d ms ago", (int)((uni_system_get_time_us() - link->mode_change_us) / 1000));
+    logi("\n");
+}
+
+void uni_bt_link_policy_process(void) {
+    for (int i = 0; i < CONFIG_BLUEPAD32_MAX_DEVICES; i++) {
+        uni_hid_device_t* d = uni_hid_device_get_instance_for_idx(i);
+        if (d->conn.link.policy_step > 0)
+            process_device(d);
+    }
+}
+
+void uni_bt_link_policy_on_hci_mode_change(const uint8_t* packet, uint16_t size) {
+    uni_hid_device_t* d;
+    uint8_t status;
+    hci_con_handle_t handle;
+
+    ARG_UNUSED(size);
+
+    status = hci_event_mode_change_get_status(packet);
+    handle = hci_event_mode_change_get_handle(packet);
+    d = uni_hid_device_get_instance_for_connection_handle(handle);
+    if (d == NULL)
+        return;
+    if (status) {
+        logi("Link: %s, mode change failed, status=0x%02x\n", bd_addr_to_str(d->conn.btaddr), status);
+        return;
+    }
+
+    d->conn.link.mode = hci_event_mode_change_get_mode(packet);
+    d->conn.link.mode_interval = hci_event_mode_change_get_interval(packet);
+    d->conn.link.mode_changes++;
+    d->conn.link.mode_change_us = uni_system_get_time_us();
+    logi("Link: %s, mode=%s, interval=%d slots, t=%d ms\n", bd_addr_to_str(d->conn.btaddr),
+         mode_to_str(d->conn.link.mode), d->conn.link.mode_interval, get_elapsed_ms(&d->conn.link));
+}
+
+void uni_bt_link_policy_on_hci_role_change(const uint8_t* packet, uint16_t size) {
+    uni_hid_device_t* d;
+    bd_addr_t addr;
+    uint8_t status;
+
+    ARG_UNUSED(size);
+
+    hci_event_role_change_get_bd_addr(packet, addr);
+    status = hci_event_role_change_get_status(packet);
+    d = uni_hid_device_get_instance_for_address(addr);
+    if (d == NULL)
+        return;
+
+    d->conn.link.role_switch_pending = false;
+    if (d->conn.handle == role_switch_handle)
+        role_switch_handle = UNI_BT_CONN_HANDLE_INVALID;
+    if (status == ERROR_CODE_SUCCESS)
+        d->conn.link.role = hci_event_role_change_get_role(packet);
+    logi("Link: %s, role=%s, status=0x%02x, t=%d ms\n", bd_addr_to_str(addr), role_to_str(d->conn.link.role), status,
+         get_elapsed_ms(&d->conn.link));
+
+    // Role switch might have been requested by the policy.
+    uni_bt_link_policy_process();
+}
+
+void uni_bt_link_policy_on_hci_command_status(const uint8_t* packet, uint16_t size) {
+    ARG_UNUSED(size);
+
+    // If the role switch was rejected, there won't be a "role change" event.
+    // The event doesn't have the connection handle: it is the one whose role switch is in flight.
+    if (hci_event_command_status_get_command_opcode(packet) == HCI_OPCODE_HCI_SWITCH_ROLE_COMMAND &&
+        hci_event_command_status_get_status(packet) != ERROR_CODE_SUCCESS) {
+        uni_hid_device_t* d = uni_hid_device_get_instance_for_connection_handle(role_switch_handle);
+        if (d != NULL) {
+            logi("Link: %s, role switch rejected, status=0x%02x\n", bd_addr_to_str(d->conn.btaddr),
+                 hci_event_command_status_get_status(packet));
+            d->conn.link.role_switch_pending = false;
+        }
+        role_switch_handle = UNI_BT_CONN_HANDLE_INVALID;
+    }
+    uni_bt_link_policy_process();
+}
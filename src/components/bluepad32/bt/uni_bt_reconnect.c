@@ -0,0 +1,291 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#include "bt/uni_bt_reconnect.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bt/uni_bt_allowlist.h"
+#include "bt/uni_bt_bredr.h"
+#include "uni_common.h"
+#include "uni_log.h"
+#include "uni_property.h"
+#include "uni_system.h"
+
+// Most controllers page-scan every 1.28 seconds (R1). Give them two chances to answer.
+#define RECONNECT_PAGE_TIMEOUT_MS 2600
+// BTstack default page timeout: ~15 seconds.
+#define DEFAULT_PAGE_TIMEOUT_SLOTS 0x6000
+// In case the "connection complete" event never arrives.
+#define RECONNECT_GUARD_MS (RECONNECT_PAGE_TIMEOUT_MS + 1000)
+
+// Each entry: "001122334455/054c/05c4,"
+#define ENTRY_STR_LEN (12 + 1 + 4 + 1 + 4 + 1)
+_Static_assert(ENTRY_STR_LEN * UNI_BT_RECONNECT_MAX_DEVICES < UNI_PROPERTY_STRING_MAX_LEN,
+               "Reconnect property too big");
+
+typedef struct {
+    bd_addr_t addr;
+    uint16_t vendor_id;
+    uint16_t product_id;
+    // Paged in this reconnect. Used to log the time to ready.
+    bool paged;
+} reconnect_entry_t;
+
+// Most recently used first
+static reconnect_entry_t entries[UNI_BT_RECONNECT_MAX_DEVICES];
+static int entries_count;
+
+// Copy of the entries, taken when the reconnect starts. "entries" might be reordered while paging.
+static reconnect_entry_t queue[UNI_BT_RECONNECT_MAX_DEVICES];
+static int queue_count;
+// Entry in the queue being paged. -1 if not in progress.
+static int attempt_idx = -1;
+static uint64_t start_us;
+static btstack_timer_source_t guard_timer;
+
+static void connect_next(void);
+
+//
+// Helpers
+//
+static int parse_hex(const char* str, int digits, uint32_t* out) {
+    uint32_t v = 0;
+    for (int i = 0; i < digits; i++) {
+        char c = str[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9')
+            v |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            v |= c - 'A' + 10;
+        else
+            return -1;
+    }
+    *out = v;
+    return 0;
+}
+
+static void load_from_property(void) {
+    uni_property_value_t val;
+    uint32_t v;
+
+    entries_count = 0;
+    val = uni_property_get(UNI_PROPERTY_IDX_RECONNECT_LIST);
+    if (val.str == NULL)
+        return;
+
+    const char* str = val.str;
+    int len = strlen(str);
+    for (int offset = 0; offset + ENTRY_STR_LEN - 1 <= len && entries_count < UNI_BT_RECONNECT_MAX_DEVICES;
+         offset += ENTRY_STR_LEN) {
+        const char* s = &str[offset];
+        reconnect_entry_t* e = &entries[entries_count];
+
+        for (int i = 0; i < 6; i++) {
+            if (parse_hex(&s[i * 2], 2, &v) != 0)
+                goto error;
+            e->addr[i] = v;
+        }
+        if (s[12] != '/' || parse_hex(&s[13], 4, &v) != 0)
+            goto error;
+        e->vendor_id = v;
+        if (s[17] != '/' || parse_hex(&s[18], 4, &v) != 0)
+            goto error;
+        e->product_id = v;
+        entries_count++;
+    }
+    return;
+
+error:
+    loge("Reconnect: failed to parse '%s'\n", str);
+}
+
+static void save_to_property(void) {
+    uni_property_value_t val;
+    char str[ENTRY_STR_LEN * UNI_BT_RECONNECT_MAX_DEVICES + 1];
+
+    str[0] = 0;
+    for (int i = 0; i < entries_count; i++) {
+        const reconnect_entry_t* e = &entries[i];
+        snprintf(&str[i * ENTRY_STR_LEN], ENTRY_STR_LEN + 1, "%02x%02x%02x%02x%02x%02x/%04x/%04x,", e->addr[0],
+                 e->addr[1], e->addr[2], e->addr[3], e->addr[4], e->addr[5], e->vendor_id, e->product_id);
+    }
+    val.str = str;
+    uni_property_set(UNI_PROPERTY_IDX_RECONNECT_LIST, val);
+}
+
+static int get_elapsed_ms(void) {
+    return (int)((uni_system_get_time_us() - start_us) / 1000);
+}
+
+static void finish(void) {
+    btstack_run_loop_remove_timer(&guard_timer);
+    attempt_idx = -1;
+    gap_set_page_timeout(DEFAULT_PAGE_TIMEOUT_SLOTS);
+    logi("Reconnect: finished paging, %d ms\n", get_elapsed_ms());
+}
+
+static void on_guard_timeout(btstack_timer_source_t* ts) {
+    ARG_UNUSED(ts);
+    logi("Reconnect: no answer from %s\n", bd_addr_to_str(queue[attempt_idx].addr));
+    connect_next();
+}
+
+static bool try_connect(reconnect_entry_t* e) {
+    uni_hid_device_t* d;
+
+    if (!uni_bt_allowlist_is_allowed_addr((uint8_t*)e->addr))
+        return false;
+    // Already connected. E.g: the controller reconnected by itself.
+    if (uni_hid_device_get_instance_for_address((uint8_t*)e->addr))
+        return false;
+    // Only bonded controllers: the connection is authenticated with the stored key, no pairing needed.
+    if (!uni_bt_bredr_is_bonded(e->addr)) {
+        logi("Reconnect: %s has no link key, skipping\n", bd_addr_to_str(e->addr));
+        return false;
+    }
+
+    d = uni_hid_device_create((uint8_t*)e->addr);
+    if (d == NULL) {
+        logi("Reconnect: cannot create new device... no more slots available\n");
+        return false;
+    }
+
+    // VID / PID are known, no need to query them.
+    uni_hid_device_set_vendor_id(d, e->vendor_id);
+    uni_hid_device_set_product_id(d, e->product_id);
+    uni_hid_device_guess_controller_type_from_pid_vid(d);
+    if (uni_hid_device_does_require_hid_descriptor(d))
+        d->sdp_query_type = SDP_QUERY_AFTER_CONNECT;
+    else
+        d->sdp_query_type = SDP_QUERY_NOT_NEEDED;
+
+    logi("Reconnect: paging %s (vid=0x%04x, pid=0x%04x)\n", bd_addr_to_str(e->addr), e->vendor_id, e->product_id);
+    e->paged = true;
+    uni_bt_bredr_l2cap_create_control_connection(d);
+    return true;
+}
+
+static void connect_next(void) {
+    btstack_run_loop_remove_timer(&guard_timer);
+
+    // Paging is serialized by the Bluetooth controller: page one device at a time.
+    // The next one is paged once the ACL connection completes, while L2CAP is being set up.
+    while (++attempt_idx < queue_count) {
+        if (try_connect(&queue[attempt_idx])) {
+            btstack_run_loop_set_timer_handler(&guard_timer, &on_guard_timeout);
+            btstack_run_loop_set_timer(&guard_timer, RECONNECT_GUARD_MS);
+            btstack_run_loop_add_timer(&guard_timer);
+            return;
+        }
+    }
+    finish();
+}
+
+//
+// Public functions
+//
+void uni_bt_reconnect_init(void) {
+    load_from_property();
+}
+
+void uni_bt_reconnect_start(void) {
+    if (uni_bt_reconnect_is_in_progress()) {
+        logi("Reconnect: already in progress\n");
+        return;
+    }
+    if (entries_count == 0) {
+        logi("Reconnect: no controllers to reconnect\n");
+        return;
+    }
+
+    memcpy(queue, entries, sizeof(queue));
+    queue_count = entries_count;
+    for (int i = 0; i < queue_count; i++)
+        queue[i].paged = false;
+    start_us = uni_system_get_time_us();
+    // Page timeout is in baseband slots (0.625 ms)
+    gap_set_page_timeout(RECONNECT_PAGE_TIMEOUT_MS * 8 / 5);
+    connect_next();
+}
+
+bool uni_bt_reconnect_is_in_progress(void) {
+    return attempt_idx >= 0;
+}
+
+void uni_bt_reconnect_set_enabled(bool enabled) {
+    uni_property_value_t val;
+
+    val.boolean = enabled;
+    uni_property_set(UNI_PROPERTY_IDX_RECONNECT_ENABLED, val);
+}
+
+bool uni_bt_reconnect_is_enabled(void) {
+    return uni_property_get(UNI_PROPERTY_IDX_RECONNECT_ENABLED).boolean;
+}
+
+void uni_bt_reconnect_clear(void) {
+    entries_count = 0;
+    save_to_property();
+}
+
+void uni_bt_reconnect_list(void) {
+    logi("Reconnect (%s), in order:\n", uni_bt_reconnect_is_enabled() ? "enabled" : "disabled");
+    for (int i = 0; i < entries_count; i++)
+        logi(" - %s, vid=0x%04x, pid=0x%04x\n", bd_addr_to_str(entries[i].addr), entries[i].vendor_id,
+             entries[i].product_id);
+}
+
+void uni_bt_reconnect_on_device_ready(uni_hid_device_t* d) {
+    int idx;
+
+    if (uni_hid_device_is_virtual_device(d) || d->conn.protocol != UNI_BT_CONN_PROTOCOL_BR_EDR)
+        return;
+
+    // Time to playable, only for the ones that were paged.
+    for (int i = 0; i < queue_count; i++) {
+        if (queue[i].paged && bd_addr_cmp(queue[i].addr, d->conn.btaddr) == 0) {
+            logi("Reconnect: %s ready, %d ms\n", bd_addr_to_str(d->conn.btaddr), get_elapsed_ms());
+            queue[i].paged = false;
+            break;
+        }
+    }
+
+    // Move it to the front
+    for (idx = 0; idx < entries_count; idx++) {
+        if (bd_addr_cmp(entries[idx].addr, d->conn.btaddr) == 0)
+            break;
+    }
+    if (idx == 0 && entries_count > 0 && entries[0].vendor_id == d->vendor_id &&
+        entries[0].product_id == d->product_id) {
+        // Already the first one. Don't write the property again.
+        return;
+    }
+    if (idx == entries_count) {
+        // New one. The least recently used one is dropped if full.
+        if (entries_count < UNI_BT_RECONNECT_MAX_DEVICES)
+            entries_count++;
+        idx = entries_count - 1;
+    }
+    memmove(&entries[1], &entries[0], idx * sizeof(entries[0]));
+    bd_addr_copy(entries[0].addr, d->conn.btaddr);
+    entries[0].vendor_id = d->vendor_id;
+    entries[0].product_id = d->product_id;
+    entries[0].paged = false;
+    save_to_property();
+}
+
+void uni_bt_reconnect_on_connection_complete(bd_addr_t addr, uint8_t status) {
+    if (!uni_bt_reconnect_is_in_progress() || bd_addr_cmp(addr, queue[attempt_idx].addr) != 0)
+        return;
+
+    if (status == ERROR_CODE_SUCCESS)
+        logi("Reconnect: %s answered, %d ms\n", bd_addr_to_str(addr), get_elapsed_ms());
+    else
+        logi("Reconnect: failed to page %s, status=0x%02x\n", bd_addr_to_str(addr), status);
+    connect_next();
+}
@@ -13,6 +13,7 @@
 #include "bt/uni_bt_defines.h"
 #include "bt/uni_bt_hci_cmd.h"
 #include "bt/uni_bt_le.h"
+#include "bt/uni_bt_reconnect.h"
 #include "bt/uni_bt_service.h"
 #include "platform/uni_platform.h"
 #include "uni_common.h"
@@ -85,6 +86,9 @@ static void setup_call_next_fn(void) {
         // Platform can disable the service.
         if (IS_ENABLED(UNI_ENABLE_BLE) && uni_bt_service_is_enabled())
             uni_bt_service_init();
+
+        if (IS_ENABLED(UNI_ENABLE_BREDR) && uni_bt_bredr_is_enabled() && uni_bt_reconnect_is_enabled())
+            uni_bt_reconnect_start();
     }
 }
 
@@ -4,6 +4,8 @@
 
 #include "controller/uni_balance_board.h"
 
+#include <string.h>
+
 #include "sdkconfig.h"
 
 // Don't compile it on when console is not present
@@ -14,15 +16,31 @@
 
 #endif  // CONFIG_BLUEPAD32_USB_CONSOLE_ENABLE
 
+#include "uni_common.h"
 #include "uni_log.h"
 #include "uni_property.h"
 
+// Index of each sensor in the filter arrays
+enum {
+    SENSOR_TR,
+    SENSOR_BR,
+    SENSOR_TL,
+    SENSOR_BL,
+};
+
 // Gets initialized at platform_init time.
 static uni_balance_board_threshold_t bb_threshold = {
     .move = UNI_BALANCE_BOARD_MOVE_THRESHOLD_DEFAULT,
     .fire = UNI_BALANCE_BOARD_FIRE_THRESHOLD_DEFAULT,
 };
 
+static uni_balance_board_filter_config_t bb_filter_config = {
+    .alpha = UNI_BALANCE_BOARD_FILTER_ALPHA_DEFAULT,
+    .median = true,
+    .occupied_on = UNI_BALANCE_BOARD_FILTER_OCCUPIED_ON_DEFAULT,
+    .occupied_off = UNI_BALANCE_BOARD_FILTER_OCCUPIED_OFF_DEFAULT,
+};
+
 #ifdef CONFIG_BLUEPAD32_USB_CONSOLE_ENABLE
 static struct {
     struct arg_int* value;
@@ -34,6 +52,12 @@ static struct {
     struct arg_end* end;
 } bb_fire_threshold_args;
 
+static struct {
+    struct arg_int* alpha;
+    struct arg_int* median;
+    struct arg_end* end;
+} bb_filter_args;
+
 static void set_bb_move_threshold_to_nvs(int threshold) {
     uni_property_value_t value;
     value.u32 = threshold;
@@ -103,8 +127,53 @@ static int cmd_bb_fire_threshold(int argc, char** argv) {
     logi("New Balance Board Fire threshold: %d\n", threshold);
     return 0;
 }
+
+static int cmd_bb_filter(int argc, char** argv) {
+    int nerrors = arg_parse(argc, argv, (void**)&bb_filter_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, bb_filter_args.end, argv[0]);
+        return 1;
+    }
+
+    uni_balance_board_filter_config_t config = uni_balance_board_get_filter_config();
+    if (bb_filter_args.alpha->count) {
+        int alpha = bb_filter_args.alpha->ival[0];
+        if (alpha < 1 || alpha > 256) {
+            loge("Invalid alpha: %d. Valid range: 1-256\n", alpha);
+            return 1;
+        }
+        config.alpha = alpha;
+    }
+    if (bb_filter_args.median->count)
+        config.median = !!bb_filter_args.median->ival[0];
+    uni_balance_board_set_filter_config(&config);
+
+    logi("Balance Board filter: alpha=%d/256, median=%d\n", config.alpha, config.median);
+    return 0;
+}
 #endif  // CONFIG_BLUEPAD32_USB_CONSOLE_ENABLE
 
+//
+// Helpers
+//
+static uint16_t median3(uint16_t a, uint16_t b, uint16_t c) {
+    if (a > b) {
+        uint16_t t = a;
+        a = b;
+        b = t;
+    }
+    // a <= b
+    if (c <= a)
+        return a;
+    if (c >= b)
+        return b;
+    return c;
+}
+
+static int16_t cop_axis(int32_t positive, int32_t negative, int32_t total) {
+    return (int16_t)(((positive - negative) * UNI_BALANCE_BOARD_COP_MAX) / total);
+}
+
 void uni_balance_board_register_cmds(void) {
 #ifdef CONFIG_BLUEPAD32_USB_CONSOLE_ENABLE
     bb_move_threshold_args.value = arg_int1(NULL, NULL, "<threshold>", "balance board 'move weight' threshold");
@@ -133,8 +202,23 @@ void uni_balance_board_register_cmds(void) {
         .argtable = &bb_fire_threshold_args,
     };
 
+    bb_filter_args.alpha = arg_int0("a", "alpha", "<1-256>", "low-pass factor, out of 256. 256 means no low-pass");
+    bb_filter_args.median = arg_int0("m", "median", "<0|1>", "whether to apply a median-of-3 filter");
+    bb_filter_args.end = arg_end(3);
+
+    const esp_console_cmd_t bb_filter = {
+        .command = "bb_filter",
+        .help =
+            "Get/Set the Balance Board filter\n"
+            "Default: alpha 64, median 1",
+        .hint = NULL,
+        .func = &cmd_bb_filter,
+        .argtable = &bb_filter_args,
+    };
+
     ESP_ERROR_CHECK(esp_console_cmd_register(&bb_move_threshold));
     ESP_ERROR_CHECK(esp_console_cmd_register(&bb_fire_threshold));
+    ESP_ERROR_CHECK(esp_console_cmd_register(&bb_filter));
 #endif  // CONFIG_BLUEPAD32_USB_CONSOLE_ENABLE
 }
 
@@ -148,9 +232,81 @@ void uni_balance_board_init(void) {
 
 void uni_balance_board_dump(const uni_balance_board_t* bb) {
     // Don't add "\n"
-    logi("tl=%d, tr=%d, bl=%d, br=%d, temperature=%d", bb->tl, bb->tr, bb->bl, bb->br, bb->temperature);
+    logi("tl=%d, tr=%d, bl=%d, br=%d, temperature=%d, weight=%d, cop=(%d,%d), occupied=%d", bb->tl, bb->tr, bb->bl,
+         bb->br, bb->temperature, (int)bb->filtered.weight, bb->filtered.cop_x, bb->filtered.cop_y,
+         bb->filtered.occupied);
 }
 
 uni_balance_board_threshold_t uni_balance_board_get_threshold(void) {
     return bb_threshold;
 }
+
+uni_balance_board_filter_config_t uni_balance_board_get_filter_config(void) {
+    return bb_filter_config;
+}
+
+void uni_balance_board_set_filter_config(const uni_balance_board_filter_config_t* config) {
+    bb_filter_config = *config;
+    if (bb_filter_config.alpha == 0)
+        bb_filter_config.alpha = 1;
+    else if (bb_filter_config.alpha > 256)
+        bb_filter_config.alpha = 256;
+}
+
+void uni_balance_board_filter_init(uni_balance_board_filter_t* f) {
+    memset(f, 0, sizeof(*f));
+}
+
+void uni_balance_board_filter_process(uni_balance_board_filter_t* f, uni_balance_board_t* bb) {
+    const uni_balance_board_filter_config_t* cfg = &bb_filter_config;
+    uint16_t raw[4];
+    uint16_t out[4];
+
+    raw[SENSOR_TR] = bb->tr;
+    raw[SENSOR_BR] = bb->br;
+    raw[SENSOR_TL] = bb->tl;
+    raw[SENSOR_BL] = bb->bl;
+
+    // First sample: fill the history, so that the filter starts from the current value, and not from 0.
+    if (!f->initialized) {
+        for (int i = 0; i < 3; i++)
+            memcpy(f->history[i], raw, sizeof(raw));
+        for (int i = 0; i < 4; i++)
+            f->smooth[i] = (int32_t)raw[i] << 8;
+        f->initialized = true;
+    }
+
+    memcpy(f->history[f->history_idx], raw, sizeof(raw));
+    f->history_idx = (f->history_idx + 1) % 3;
+
+    for (int i = 0; i < 4; i++) {
+        int32_t v = cfg->median ? median3(f->history[0][i], f->history[1][i], f->history[2][i]) : raw[i];
+        // Exponential low-pass, in 24.8 fixed point: smooth += (v - smooth) * alpha / 256
+        // Sensors are 16-bit and alpha goes up to 256: the product needs more than 32 bits.
+        f->smooth[i] += (int32_t)((((int64_t)v << 8) - f->smooth[i]) * cfg->alpha / 256);
+        out[i] = (uint16_t)((f->smooth[i] + 128) >> 8);
+    }
+
+    uni_balance_board_filtered_t* r = &bb->filtered;
+    r->tr = out[SENSOR_TR];
+    r->br = out[SENSOR_BR];
+    r->tl = out[SENSOR_TL];
+    r->bl = out[SENSOR_BL];
+    r->weight = (uint32_t)r->tr + r->br + r->tl + r->bl;
+
+    // Hysteresis, so that "occupied" doesn't flicker around the threshold.
+    if (f->occupied && r->weight < cfg->occupied_off)
+        f->occupied = false;
+    else if (!f->occupied && r->weight >= cfg->occupied_on)
+        f->occupied = true;
+    r->occupied = f->occupied;
+
+    if (r->occupied && r->weight > 0) {
+        int32_t total = (int32_t)r->weight;
+        r->cop_x = cop_axis(r->tr + r->br, r->tl + r->bl, total);
+        r->cop_y = cop_axis(r->tr + r->tl, r->br + r->bl, total);
+    } else {
+        r->cop_x = 0;
+        r->cop_y = 0;
+    }
+}
@@ -45,6 +45,9 @@ void uni_bt_enable_service_safe(bool enabled);
 // Disconnects a device
 void uni_bt_disconnect_device_safe(int device_idx);
 
+// Pages the recently used BR/EDR controllers. See uni_bt_reconnect.h
+void uni_bt_reconnect_safe(void);
+
 // Get local BD address
 void uni_bt_get_local_bd_addr_safe(bd_addr_t addr);
 
@@ -26,6 +26,7 @@ void uni_bt_bredr_disconnect(uni_hid_device_t* d);
 
 void uni_bt_bredr_list_bonded_keys(void);
 void uni_bt_bredr_delete_bonded_keys(void);
+bool uni_bt_bredr_is_bonded(bd_addr_t addr);
 void uni_bt_bredr_setup(void);
 
 void uni_bt_bredr_set_enabled(bool enabled);
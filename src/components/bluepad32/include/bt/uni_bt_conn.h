@@ -41,6 +41,23 @@ typedef enum {
     UNI_BT_CONN_STATE_DEVICE_READY,
 } uni_bt_conn_state_t;
 
+// BR/EDR link state. Updated by uni_bt_link_policy.c
+typedef struct {
+    // Next link policy step to run. 0 if there is nothing to do.
+    uint8_t policy_step;
+    bool role_switch_pending;
+    // When the ACL connection was established. Used as reference for the timestamps.
+    uint64_t connected_us;
+
+    hci_role_t role;
+    // HCI mode: active, hold or sniff.
+    uint8_t mode;
+    // Sniff interval, in slots (0.625 ms).
+    uint16_t mode_interval;
+    uint16_t mode_changes;
+    uint64_t mode_change_us;
+} uni_bt_conn_link_t;
+
 typedef struct {
     bd_addr_t btaddr;
     hci_con_handle_t handle;
@@ -51,6 +68,7 @@ typedef struct {
     // BR/EDR only
     uint8_t page_scan_repetition_mode;
     uint16_t clock_offset;
+    uni_bt_conn_link_t link;
 
     // BLE & BR/EDR
     uint8_t rssi;
@@ -31,6 +31,7 @@ void uni_bt_le_disconnect(uni_hid_device_t* d);
 
 void uni_bt_le_list_bonded_keys(void);
 void uni_bt_le_delete_bonded_keys(void);
+bool uni_bt_le_is_bonded(bd_addr_t addr);
 void uni_bt_le_setup(void);
 
 void uni_bt_le_set_enabled(bool enabled);
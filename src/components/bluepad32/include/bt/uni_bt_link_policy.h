@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#ifndef UNI_BT_LINK_POLICY_H
+#define UNI_BT_LINK_POLICY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "controller/uni_controller_type.h"
+#include "uni_hid_device.h"
+
+// BR/EDR per-link policy. Applied once the HID channels are up and the controller type is known.
+//
+// Sniff mode saves battery on the controller, but each sniff interval adds latency to the
+// input reports, and with several links it adds scheduling jitter.
+// By default sniff is disabled, and Bluepad32 stays as central on each link.
+
+// Max number of policies that can be set with uni_bt_link_policy_set_for_controller_type().
+#define UNI_BT_LINK_POLICY_MAX_CUSTOM 4
+
+typedef struct {
+    // Sniff allowed. If false, the link is forced to active mode.
+    bool sniff_enabled;
+    // If sniff is enabled: sniff intervals requested by Bluepad32, in slots (0.625 ms).
+    // Bounds the latency added by sniff. 0 means "let the controller decide".
+    uint16_t sniff_max_interval;
+    uint16_t sniff_min_interval;
+    // Sniff subrating max latency, in slots. 0 to disable subrating.
+    uint16_t sniff_subrating_max_latency;
+
+    // Request the central (master) role.
+    bool central_role;
+
+    // In milliseconds. 0 to leave the controller default.
+    // Link supervision timeout: how fast a lost controller is detected. Only set when central.
+    uint16_t supervision_timeout_ms;
+    // Automatic flush timeout: output reports that couldn't be delivered in time are dropped.
+    // It applies to the whole ACL link, not just the interrupt channel.
+    uint16_t flush_timeout_ms;
+} uni_bt_link_policy_t;
+
+// Returns the policy for a controller type. Custom ones have precedence over the built-in ones.
+const uni_bt_link_policy_t* uni_bt_link_policy_get_for_controller_type(uni_controller_type_t type);
+// Overrides the policy for a controller type. Can be called from the platform "on_init_complete".
+// Returns false if there is no space left.
+bool uni_bt_link_policy_set_for_controller_type(uni_controller_type_t type, const uni_bt_link_policy_t* policy);
+
+// Applies the policy to a device. Commands are sent one at a time, when HCI is ready.
+void uni_bt_link_policy_apply(uni_hid_device_t* d);
+void uni_bt_link_policy_dump_device(uni_hid_device_t* d);
+
+// Called from uni_bt.c
+void uni_bt_link_policy_process(void);
+void uni_bt_link_policy_on_hci_mode_change(const uint8_t* packet, uint16_t size);
+void uni_bt_link_policy_on_hci_role_change(const uint8_t* packet, uint16_t size);
+void uni_bt_link_policy_on_hci_command_status(const uint8_t* packet, uint16_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // UNI_BT_LINK_POLICY_H
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#ifndef UNI_BT_RECONNECT_H
+#define UNI_BT_RECONNECT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <btstack.h>
+
+#include "uni_hid_device.h"
+
+// Directed reconnect, BR/EDR only.
+//
+// Bluepad32 remembers the most recently used BR/EDR controllers (address, VID and PID)
+// in the "bp.bt.reconn" property. When enabled, at boot (or on demand) they are paged
+// in most-recently-used order, with a short page timeout, and the HID channels are opened directly.
+// Inquiry and SDP are skipped, unless the parser needs the HID descriptor.
+// Only controllers that still have a link key are paged.
+
+// Max number of controllers to remember. Limited by the size of string properties.
+#define UNI_BT_RECONNECT_MAX_DEVICES 4
+
+void uni_bt_reconnect_init(void);
+
+// Pages the remembered controllers, one at a time.
+void uni_bt_reconnect_start(void);
+bool uni_bt_reconnect_is_in_progress(void);
+
+// Whether uni_bt_reconnect_start() is called at boot. Stored in the "bp.bt.reconn_en" property.
+void uni_bt_reconnect_set_enabled(bool enabled);
+bool uni_bt_reconnect_is_enabled(void);
+
+// Forgets all the controllers.
+void uni_bt_reconnect_clear(void);
+void uni_bt_reconnect_list(void);
+
+// Called from the BR/EDR code
+void uni_bt_reconnect_on_device_ready(uni_hid_device_t* d);
+void uni_bt_reconnect_on_connection_complete(bd_addr_t addr, uint8_t status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // UNI_BT_RECONNECT_H
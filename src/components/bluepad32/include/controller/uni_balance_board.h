@@ -9,6 +9,7 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
 #include <stdint.h>
 
 // States of fire
@@ -25,13 +26,36 @@ enum {
 #define UNI_BALANCE_BOARD_MOVE_THRESHOLD_DEFAULT 1500  // Diff in weight to consider a Movement
 #define UNI_BALANCE_BOARD_FIRE_THRESHOLD_DEFAULT 5000  // Max weight before staring the "de-accel" to trigger fire.
 
+// Filter defaults
+#define UNI_BALANCE_BOARD_FILTER_ALPHA_DEFAULT 64           // Low-pass factor, out of 256. Higher is faster.
+#define UNI_BALANCE_BOARD_FILTER_OCCUPIED_ON_DEFAULT 8000   // Total weight, in grams, to consider someone on top
+#define UNI_BALANCE_BOARD_FILTER_OCCUPIED_OFF_DEFAULT 4000  // Total weight, in grams, to consider the BB empty
+
+// Centre of pressure goes from -UNI_BALANCE_BOARD_COP_MAX to UNI_BALANCE_BOARD_COP_MAX.
+#define UNI_BALANCE_BOARD_COP_MAX 1024
+
+// Sensor values after the filter. Sensors in grams.
+typedef struct {
+    uint16_t tr;
+    uint16_t br;
+    uint16_t tl;
+    uint16_t bl;
+    uint32_t weight;  // Total weight, in grams
+    int16_t cop_x;    // Centre of pressure: negative is left, positive is right
+    int16_t cop_y;    // Centre of pressure: negative is bottom, positive is top
+    bool occupied;    // Whether someone is on top. Uses hysteresis. When false, cop_x and cop_y are 0.
+} uni_balance_board_filtered_t;
+
 // Represents the Balance Board sensor values.
 typedef struct {
-    uint16_t tr;      // Top right
-    uint16_t br;      // Bottom right
-    uint16_t tl;      // Top left
-    uint16_t bl;      // Bottom left
+    uint16_t tr;      // Top right, in grams
+    uint16_t br;      // Bottom right, in grams
+    uint16_t tl;      // Top left, in grams
+    uint16_t bl;      // Bottom left, in grams
     int temperature;  // Temperature
+
+    // Filled by uni_balance_board_filter_process().
+    uni_balance_board_filtered_t filtered;
 } uni_balance_board_t;
 
 // Represents the Balance Board state.
@@ -39,12 +63,31 @@ typedef struct {
 typedef struct {
     uint8_t fire_state;
     uint8_t fire_counter;
-    int16_t smooth_left;
-    int16_t smooth_right;
-    int16_t smooth_top;
-    int16_t smooth_down;
+    // Directions from the previous report. Used for the hysteresis.
+    uint8_t dir_bits;
 } uni_balance_board_state_t;
 
+// Filter configuration. Global to all the Balance Boards.
+typedef struct {
+    // Low-pass factor, out of 256. 256 means no low-pass.
+    uint16_t alpha;
+    // Whether to apply a median-of-3 before the low-pass. Removes spikes at the cost of one report of latency.
+    bool median;
+    uint32_t occupied_on;
+    uint32_t occupied_off;
+} uni_balance_board_filter_config_t;
+
+// Filter state. One per Balance Board.
+typedef struct {
+    // Last 3 samples of each sensor, for the median.
+    uint16_t history[3][4];
+    uint8_t history_idx;
+    bool initialized;
+    bool occupied;
+    // Low-pass output, per sensor. Grams in 24.8 fixed point.
+    int32_t smooth[4];
+} uni_balance_board_filter_t;
+
 // Represents the threshold for movement and fire.
 typedef struct {
     int move;
@@ -59,6 +102,15 @@ void uni_balance_board_init(void);
 
 uni_balance_board_threshold_t uni_balance_board_get_threshold(void);
 
+uni_balance_board_filter_config_t uni_balance_board_get_filter_config(void);
+void uni_balance_board_set_filter_config(const uni_balance_board_filter_config_t* config);
+
+// Resets the filter. Should be called when a Balance Board connects.
+void uni_balance_board_filter_init(uni_balance_board_filter_t* f);
+// Filters the sensor values of "bb", and stores the result in bb->filtered.
+// Only integer math is used.
+void uni_balance_board_filter_process(uni_balance_board_filter_t* f, uni_balance_board_t* bb);
+
 #ifdef __cplusplus
 }
 #endif
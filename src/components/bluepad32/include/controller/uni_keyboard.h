@@ -9,6 +9,7 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "uni_common.h"
@@ -18,6 +19,9 @@ extern "C" {
 // since we have a max of 10 fingers.
 #define UNI_KEYBOARD_PRESSED_KEYS_MAX 10
 
+// One bit per HID usage: 256 bits
+#define UNI_KEYBOARD_PRESSED_BITMAP_WORDS (256 / 32)
+
 // Instead of using the HID_USAGE values, we use a special field for them.
 // Easier to parse.
 enum {
@@ -35,10 +39,23 @@ typedef struct {
     // Bitmap of the modifiers.
     uint8_t modifiers;
     uint8_t pressed_keys[UNI_KEYBOARD_PRESSED_KEYS_MAX];
+    // Same keys as "pressed_keys", plus the modifiers (0xe0 - 0xe7), but as a bitmap indexed by HID usage.
+    // Use uni_keyboard_is_key_pressed() to query it.
+    uint32_t pressed_bitmap[UNI_KEYBOARD_PRESSED_BITMAP_WORDS];
     // Reserved for future use, like "Consumer page": eject, play, pause keyboard buttons.
     uint8_t reserved[16];
 } uni_keyboard_t;
 
+// Key down / key up event. Generated by the keyboard parser when the state of a key changes.
+typedef struct {
+    uint8_t usage;  // HID usage. Modifiers are reported as 0xe0 - 0xe7
+    bool pressed;   // true: key down, false: key up
+} uni_keyboard_event_t;
+
+static inline bool uni_keyboard_is_key_pressed(const uni_keyboard_t* kb, uint8_t usage) {
+    return (kb->pressed_bitmap[usage / 32] & BIT(usage % 32)) != 0;
+}
+
 void uni_keyboard_dump(const uni_keyboard_t* kb);
 
 #ifdef __cplusplus
@@ -5,6 +5,7 @@
 #ifndef UNI_HID_PARSER_H
 #define UNI_HID_PARSER_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 // Forward declarations
@@ -29,10 +30,15 @@ typedef void (*report_parse_usage_fn_t)(struct uni_hid_device_s* d,
                                         uint16_t usage_page,
                                         uint16_t usage,
                                         int32_t value);
+// Called after all the usages of the report were parsed.
+typedef void (*report_finish_report_fn_t)(struct uni_hid_device_s* d);
 // "Parse_input_report" receives uni_hid_device_s instead of gamepad since it is needed
 // for devices like Nintendo. If needed, the same thing should be done for
 // "parse_usage".
 typedef void (*report_parse_input_report_fn_t)(struct uni_hid_device_s* d, const uint8_t* report, uint16_t report_len);
+typedef bool (*report_validate_input_report_fn_t)(struct uni_hid_device_s* d,
+                                                  const uint8_t* report,
+                                                  uint16_t report_len);
 typedef void (*report_parse_feature_report_fn_t)(struct uni_hid_device_s* d,
                                                  const uint8_t* report,
                                                  uint16_t report_len);
@@ -58,6 +64,10 @@ typedef struct {
     report_init_report_fn_t init_report;
     // Called for each usage in the report: usage page + usage + value
     report_parse_usage_fn_t parse_usage;
+    // Called after all the usages of the report were parsed
+    report_finish_report_fn_t finish_report;
+    // If implemented, called with the raw input report before parsing it. Invalid reports are dropped.
+    report_validate_input_report_fn_t validate_input_report;
     // Called with the raw input report
     report_parse_input_report_fn_t parse_input_report;
     // Called with the feature report
@@ -72,7 +82,13 @@ typedef struct {
     report_device_dump_t device_dump;
 } uni_report_parser_t;
 
-void uni_hid_parse_input_report(struct uni_hid_device_s* d, const uint8_t* report, uint16_t report_len);
+// "descriptor" is the HID descriptor used to parse the report. Usually "d->hid_descriptor", but
+// BLE devices with several HID services use the descriptor of the service that sent the report.
+void uni_hid_parse_input_report(struct uni_hid_device_s* d,
+                                const uint8_t* descriptor,
+                                uint16_t descriptor_len,
+                                const uint8_t* report,
+                                uint16_t report_len);
 int32_t uni_hid_parser_process_axis(hid_globals_t* globals, uint32_t value);
 int32_t uni_hid_parser_process_pedal(hid_globals_t* globals, uint32_t value);
 uint8_t uni_hid_parser_process_hat(hid_globals_t* globals, uint32_t value);
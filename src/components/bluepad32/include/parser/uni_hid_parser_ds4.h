@@ -13,6 +13,7 @@
 void uni_hid_parser_ds4_setup(struct uni_hid_device_s* d);
 void uni_hid_parser_ds4_init_report(struct uni_hid_device_s* d);
 void uni_hid_parser_ds4_parse_input_report(struct uni_hid_device_s* d, const uint8_t* report, uint16_t len);
+bool uni_hid_parser_ds4_validate_input_report(struct uni_hid_device_s* d, const uint8_t* report, uint16_t len);
 void uni_hid_parser_ds4_parse_feature_report(struct uni_hid_device_s* d, const uint8_t* report, uint16_t len);
 void uni_hid_parser_ds4_set_lightbar_color(struct uni_hid_device_s* d, uint8_t r, uint8_t g, uint8_t b);
 void uni_hid_parser_ds4_play_dual_rumble(struct uni_hid_device_s* d,
@@ -24,6 +24,7 @@ typedef enum {
 void uni_hid_parser_ds5_setup(struct uni_hid_device_s* d);
 void uni_hid_parser_ds5_init_report(struct uni_hid_device_s* d);
 void uni_hid_parser_ds5_parse_input_report(struct uni_hid_device_s* d, const uint8_t* report, uint16_t len);
+bool uni_hid_parser_ds5_validate_input_report(struct uni_hid_device_s* d, const uint8_t* report, uint16_t len);
 void uni_hid_parser_ds5_parse_feature_report(struct uni_hid_device_s* d, const uint8_t* report, uint16_t len);
 void uni_hid_parser_ds5_set_player_leds(struct uni_hid_device_s* d, uint8_t value);
 void uni_hid_parser_ds5_set_lightbar_color(struct uni_hid_device_s* d, uint8_t r, uint8_t g, uint8_t b);
@@ -5,8 +5,10 @@
 #ifndef UNI_HID_PARSER_KEYBOARD_H
 #define UNI_HID_PARSER_KEYBOARD_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "controller/uni_keyboard.h"
 #include "parser/uni_hid_parser.h"
 
 // Keyboard devices
@@ -18,9 +20,13 @@ void uni_hid_parser_keyboard_parse_usage(struct uni_hid_device_s* d,
                                          uint16_t usage_page,
                                          uint16_t usage,
                                          int32_t value);
+void uni_hid_parser_keyboard_finish_report(struct uni_hid_device_s* d);
 void uni_hid_parser_keyboard_device_dump(struct uni_hid_device_s* d);
 
 // Unique to Keyboard. Not part of the "hid_parser" interface
 void uni_hid_parser_keyboard_set_leds(struct uni_hid_device_s* d, uint8_t led_bitmask);
+// Pops the oldest key down / key up event. Returns false if there are no more events,
+// or if the device is not a keyboard.
+bool uni_hid_parser_keyboard_pop_event(struct uni_hid_device_s* d, uni_keyboard_event_t* out);
 
 #endif  // UNI_HID_PARSER_KEYBOARD_H
\ No newline at end of file
@@ -30,6 +30,7 @@ typedef enum {
     UNI_PLATFORM_UNIJOYSTICLE_CMD_SET_C64_POT_MODE_5BUTTONS,  // Used for 5 buttons (select + start)
     UNI_PLATFORM_UNIJOYSTICLE_CMD_SET_C64_POT_MODE_RUMBLE,    // C64 can enable rumble via Pots
     UNI_PLATFORM_UNIJOYSTICLE_CMD_SET_C64_POT_MODE_PADDLE,    // Use for paddle
+    UNI_PLATFORM_UNIJOYSTICLE_CMD_SET_C64_POT_MODE_SYNC,      // Joystick port is latched on the Pot sync IRQ
 
     UNI_PLATFORM_UNIJOYSTICLE_CMD_COUNT,
 } uni_platform_unijoysticle_cmd_t;
@@ -105,6 +106,7 @@ typedef struct uni_platform_unijoysticle_instance_s {
 _Static_assert(sizeof(uni_platform_unijoysticle_instance_t) < HID_DEVICE_MAX_PLATFORM_DATA,
                "Unijoysticle intance too big");
 
+// Called from the esp_timer task, once the button press is debounced. Must not block.
 typedef void (*uni_platform_unijoysticle_button_cb_t)(int button_idx);
 
 // These are const values. Cannot be modified in runtime.
@@ -159,6 +161,10 @@ struct uni_platform_unijoysticle_variant {
     // Set the pot values
     void (*set_gpio_level_for_pot)(gpio_num_t gpio, bool value);
 
+    // Write the joystick lines of the seat's port. Optional.
+    // The variant must apply the masks, either immediately or later. E.g: C64 latches them until the next sync IRQ.
+    void (*write_joy_port)(uni_gamepad_seat_t seat, uint64_t set_mask, uint64_t clear_mask);
+
     // Process gamepad misc buttons
     // Returns "True" if the Misc buttons where processed. Otherwise, "False"
     bool (*process_gamepad_misc_buttons)(uni_hid_device_t* d, uni_gamepad_seat_t seat, uint8_t misc_buttons);
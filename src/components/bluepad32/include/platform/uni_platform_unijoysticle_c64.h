@@ -18,6 +18,7 @@ typedef enum {
     UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_5BUTTONS,  // Pots are used for extra buttons
     UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_RUMBLE,    // Pots are used to toggle rumble
     UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_PADDLE,    // Pots are used to control paddle (experimental)
+    UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_SYNC,      // Pots signal the frame: joystick port is written on sync
 
     UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_COUNT,
 } uni_platform_unijoysticle_c64_pot_mode_t;
@@ -41,6 +41,7 @@ extern "C" {
 #include "uni_hid_device.h"
 #include "uni_init.h"
 #include "uni_joystick.h"
+#include "uni_keymap.h"
 #include "uni_log.h"
 #include "uni_mouse_quadrature.h"
 #include "uni_property.h"
@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#ifndef UNI_AUTOFIRE_H
+#define UNI_AUTOFIRE_H
+
+#include <stdint.h>
+
+#include "uni_joystick.h"
+
+// Autofire engine.
+//
+// It has no dependencies on the hardware: the caller passes the current time,
+// and the engine returns the level of each autofire button, plus the time until the next edge.
+// The caller should call uni_autofire_run() again at that time, e.g. from a one-shot timer.
+//
+// The level is computed from the time the button became active, so the toggling
+// is phase-locked: a late callback doesn't shift the following edges.
+//
+// Each port / button has its own rate and duty cycle.
+
+#define UNI_AUTOFIRE_PORT_MAX 2
+
+// Buttons that support autofire
+#define UNI_AUTOFIRE_BUTTONS_MASK (UNI_JOYSTICK_BIT_FIRE | UNI_JOYSTICK_BIT_BUTTON2 | UNI_JOYSTICK_BIT_BUTTON3)
+
+#define UNI_AUTOFIRE_DUTY_DEFAULT 50
+
+typedef struct {
+    uint32_t period_us;
+    // Time that the button is "pressed" in each period.
+    uint32_t on_us;
+    // When the button became active. Edges are relative to it.
+    uint64_t start_us;
+} uni_autofire_channel_t;
+
+typedef struct {
+    // Indexed by the bit number of the button in uni_joystick_bits_t.
+    uni_autofire_channel_t channels[UNI_AUTOFIRE_PORT_MAX][8];
+    // Buttons that are in autofire mode, per port.
+    uni_joystick_bits_t active[UNI_AUTOFIRE_PORT_MAX];
+} uni_autofire_t;
+
+// All buttons are configured with "cps" and UNI_AUTOFIRE_DUTY_DEFAULT.
+void uni_autofire_init(uni_autofire_t* af, uint32_t cps);
+
+// cps: clicks per second. One click is "press" + "release".
+// duty_pct: percentage of the period in which the button is pressed. 1-99.
+// Active buttons restart their phase at "now_us", so the change is applied immediately.
+// Returns 0 on success, -1 on invalid arguments.
+int uni_autofire_set_rate(uni_autofire_t* af,
+                          int port_idx,
+                          uni_joystick_bits_t buttons,
+                          uint32_t cps,
+                          uint8_t duty_pct,
+                          uint64_t now_us);
+
+// Sets the buttons that are in autofire mode. Newly activated buttons start "pressed" at "now_us".
+void uni_autofire_set_active(uni_autofire_t* af, int port_idx, uni_joystick_bits_t buttons, uint64_t now_us);
+
+// Returns the level of the active buttons in "out_levels" (one per port).
+// Returns the microseconds until the next edge, or 0 if there are no active buttons.
+uint32_t uni_autofire_run(const uni_autofire_t* af,
+                          uint64_t now_us,
+                          uni_joystick_bits_t out_levels[UNI_AUTOFIRE_PORT_MAX]);
+
+#endif  // UNI_AUTOFIRE_H
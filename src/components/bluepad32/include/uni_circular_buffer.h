@@ -19,6 +19,7 @@ enum {
     UNI_CIRCULAR_BUFFER_ERROR_BUFFER_FULL,
     UNI_CIRCULAR_BUFFER_ERROR_BUFFER_EMPTY,
     UNI_CIRCULAR_BUFFER_ERROR_BUFFER_TOO_BIG,
+    UNI_CIRCULAR_BUFFER_ERROR_NOT_FOUND,
 };
 
 typedef struct uni_ciruclar_buffer_data_s {
@@ -35,8 +36,15 @@ typedef struct uni_circular_buffer_s {
 
 uint8_t uni_circular_buffer_put(uni_circular_buffer_t* b, int16_t cid, const void* data, int len);
 uint8_t uni_circular_buffer_get(uni_circular_buffer_t* b, int16_t* cid, void** data, int* len);
+// Like get, but the packet is not removed from the buffer
+uint8_t uni_circular_buffer_peek(uni_circular_buffer_t* b, int16_t* cid, void** data, int* len);
+// Replaces the data of the most recent queued packet with the same cid.
+// Returns UNI_CIRCULAR_BUFFER_ERROR_NOT_FOUND if there is no such packet.
+uint8_t uni_circular_buffer_replace(uni_circular_buffer_t* b, int16_t cid, const void* data, int len);
 uint8_t uni_circular_buffer_is_empty(uni_circular_buffer_t* b);
 uint8_t uni_circular_buffer_is_full(uni_circular_buffer_t* b);
+// Returns the number of queued packets
+int uni_circular_buffer_count(const uni_circular_buffer_t* b);
 void uni_circular_buffer_reset(uni_circular_buffer_t* b);
 
 #endif  // UNI_CIRCULAR_BUFFER_H
@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#ifndef UNI_COMBO_H
+#define UNI_COMBO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "controller/uni_gamepad.h"
+
+// Button combo recognizer: chords, long presses, double taps and sequences.
+//
+// Combos are registered in a table, shared by all the devices. Each device has its own
+// uni_combo_state_t, updated with uni_combo_process() on each report.
+// The table is indexed by button, so only the combos that use a button that changed are evaluated.
+// Reports without changes cost the same regardless of the number of combos.
+//
+// It has no dependencies on the hardware: the caller passes the current time, and
+// uni_combo_process() returns the time until the next long-press deadline.
+// The caller should call uni_combo_process() again at that time, with the same buttons.
+
+#define UNI_COMBO_MAX 32
+#define UNI_COMBO_SEQUENCE_MAX 8
+
+// Button state: gamepad buttons, dpad and misc buttons packed in 32 bits.
+#define UNI_COMBO_BUTTONS(b) ((uint32_t)(b))
+#define UNI_COMBO_DPAD(d) ((uint32_t)(d) << 16)
+#define UNI_COMBO_MISC(m) ((uint32_t)(m) << 24)
+
+typedef enum {
+    // All the buttons pressed at the same time. Fires once, until one of them is released.
+    UNI_COMBO_TYPE_CHORD,
+    // All the buttons held for "time_ms".
+    UNI_COMBO_TYPE_LONG_PRESS,
+    // Chord pressed twice, the second one at most "time_ms" after the first one.
+    UNI_COMBO_TYPE_DOUBLE_TAP,
+    // Chords of "steps" pressed in order, at most "time_ms" between them.
+    // Pressing any other button restarts the sequence.
+    UNI_COMBO_TYPE_SEQUENCE,
+} uni_combo_type_t;
+
+typedef void (*uni_combo_callback_t)(void* context, int id);
+
+typedef struct {
+    uni_combo_type_t type;
+    // Chord of each step. Only sequences use more than one.
+    uint32_t steps[UNI_COMBO_SEQUENCE_MAX];
+    uint8_t steps_count;
+    uint16_t time_ms;
+    // Once fired, the combo is ignored for this time.
+    // E.g: some controllers report press + release + press for a single press.
+    uint16_t debounce_ms;
+    uni_combo_callback_t callback;
+    // Passed to the callback.
+    int id;
+} uni_combo_t;
+
+typedef struct {
+    uni_combo_t combos[UNI_COMBO_MAX];
+    int count;
+    // Combos that use each button. Indexed by bit number.
+    uint32_t by_button[32];
+    // Combos that are sequences.
+    uint32_t sequences;
+} uni_combo_table_t;
+
+typedef struct {
+    uint32_t prev_buttons;
+    // Bitmasks, one bit per combo.
+    // Chord is held. Won't fire again until it is released.
+    uint32_t held;
+    // Long presses waiting for their deadline.
+    uint32_t armed;
+    // Double taps and sequences with some progress.
+    uint32_t in_progress;
+
+    // Time of the last event of each combo: chord completed, step matched, or fired.
+    uint32_t time_ms[UNI_COMBO_MAX];
+    // Double tap: taps. Sequence: steps matched.
+    uint8_t progress[UNI_COMBO_MAX];
+} uni_combo_state_t;
+
+void uni_combo_table_init(uni_combo_table_t* t);
+// Returns the combo index, or -1 if the table is full or the combo is invalid.
+int uni_combo_table_add(uni_combo_table_t* t, const uni_combo_t* combo);
+
+void uni_combo_state_init(uni_combo_state_t* st);
+// Evaluates the combos, and calls the callbacks of the ones that fired with "context".
+// Returns the milliseconds until the next long-press deadline, or 0 if there is none.
+uint32_t uni_combo_process(const uni_combo_table_t* t,
+                           uni_combo_state_t* st,
+                           uint32_t buttons,
+                           uint32_t now_ms,
+                           void* context);
+
+static inline uint32_t uni_combo_buttons_from_gamepad(const uni_gamepad_t* gp) {
+    return UNI_COMBO_BUTTONS(gp->buttons) | UNI_COMBO_DPAD(gp->dpad) | UNI_COMBO_MISC(gp->misc_buttons);
+}
+
+#endif  // UNI_COMBO_H
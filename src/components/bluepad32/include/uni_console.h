@@ -5,9 +5,35 @@
 #ifndef UNI_CONSOLE_H
 #define UNI_CONSOLE_H
 
+// Commands shared by all the archs. Defined in uni_console_cmds.c.
+// ESP32 registers them with esp_console. POSIX and Pico parse the command line
+// with uni_console_run_line().
+typedef int (*uni_console_cmd_func_t)(int argc, char** argv);
+
+typedef struct {
+    const char* command;
+    const char* help;
+    // Arguments, E.g: "<0 | 1>". Could be NULL.
+    const char* hint;
+    uni_console_cmd_func_t func;
+} uni_console_cmd_t;
+
+// Returns the shared command table, and the number of commands in "count".
+const uni_console_cmd_t* uni_console_get_cmds(int* count);
+
+// Splits the line into arguments and runs the command. "line" is modified.
+// Also supports "help". Returns the command's return value, or -1 if the command was not found.
+int uni_console_run_line(char* line);
+
 // Interface
 // Each arch needs to implement these functions
 
 void uni_console_init(void);
 
-#endif  // UNI_CONSOLE_H
\ No newline at end of file
+// Waits until the output of the "*_safe" functions, which run on the BTstack thread, is printed.
+// Called by the commands, so that the prompt is printed after the output.
+// Linux and Pico W: the console runs on the BTstack thread, so it can't block. Instead, the prompt and
+// the next command are deferred until the callbacks queued by the command have run.
+void uni_console_wait_for_output(void);
+
+#endif  // UNI_CONSOLE_H
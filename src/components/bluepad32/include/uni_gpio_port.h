@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#ifndef UNI_GPIO_PORT_H
+#define UNI_GPIO_PORT_H
+
+#include <stdint.h>
+
+// A "port" is a group of up to UNI_GPIO_PORT_LINES_MAX GPIOs that are updated together.
+// E.g: the 7 lines of a joystick port.
+//
+// The set/clear masks are computed once per update, and then are applied
+// with up to two register writes per bank, instead of one gpio_set_level() call per line.
+// The lines are not updated atomically: first the W1TS write raises the lines to set, and then the
+// W1TC write lowers the lines to clear. Between the two writes, a few CPU cycles, the port has the
+// new "high" lines and the old "low" ones. GPIOs 32-39 are in a second bank, written after the first one.
+#define UNI_GPIO_PORT_LINES_MAX 8
+
+typedef struct {
+    // GPIO mask for each line. Zero if the line is not connected.
+    uint64_t line_masks[UNI_GPIO_PORT_LINES_MAX];
+    // Lines that are connected to a GPIO.
+    uint32_t valid_lines;
+} uni_gpio_port_t;
+
+// gpios[n] is the GPIO for line "n". Use -1 for lines that are not connected.
+void uni_gpio_port_init(uni_gpio_port_t* port, const int* gpios, int count);
+
+// Updates the lines present in "lines_mask". Bit "n" in "bits" is the level of line "n".
+// Lines not present in "lines_mask" are not modified.
+void uni_gpio_port_write(const uni_gpio_port_t* port, uint32_t bits, uint32_t lines_mask);
+
+// Same as uni_gpio_port_write(), but returns the masks instead of applying them.
+// Useful to apply them later, e.g. from an ISR.
+void uni_gpio_port_get_masks(const uni_gpio_port_t* port,
+                             uint32_t bits,
+                             uint32_t lines_mask,
+                             uint64_t* out_set_mask,
+                             uint64_t* out_clear_mask);
+
+// Low level: sets the GPIOs in "set_mask", and then clears the ones in "clear_mask".
+// See the comment above about the window between the two writes.
+void uni_gpio_port_apply(uint64_t set_mask, uint64_t clear_mask);
+
+#ifndef CONFIG_IDF_TARGET
+// Host-side mock: there are no GPIOs, so the "registers" are emulated.
+// Useful to test the port logic on Linux.
+uint64_t uni_gpio_port_mock_get_levels(void);
+uint32_t uni_gpio_port_mock_get_write_count(void);
+void uni_gpio_port_mock_reset(void);
+#endif  // !CONFIG_IDF_TARGET
+
+#endif  // UNI_GPIO_PORT_H
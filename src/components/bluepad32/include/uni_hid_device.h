@@ -14,12 +14,20 @@
 #include "controller/uni_controller_type.h"
 #include "parser/uni_hid_parser.h"
 #include "uni_circular_buffer.h"
+#include "uni_combo.h"
 #include "uni_error.h"
+#include "uni_joystick.h"
+#include "uni_led_anim.h"
+#include "uni_perf.h"
 
 #define HID_MAX_NAME_LEN 240
 #define HID_MAX_DESCRIPTOR_LEN 512
 #define HID_DEVICE_MAX_PARSER_DATA 256
 #define HID_DEVICE_MAX_PLATFORM_DATA 256
+// BLE only: max HID service instances per device. Same as BTstack's MAX_NUM_HID_SERVICES.
+#define HID_DEVICE_MAX_LE_SERVICES 3
+// All the HID descriptors of a device. On BLE, there is one per HID service instance.
+#define HID_DEVICE_MAX_DESCRIPTORS_LEN (HID_MAX_DESCRIPTOR_LEN * HID_DEVICE_MAX_LE_SERVICES)
 // HID_DEVICE_CONNECTION_TIMEOUT_MS includes the time from when the device is created until it is ready.
 #define HID_DEVICE_CONNECTION_TIMEOUT_MS 20000
 
@@ -29,6 +37,12 @@ typedef enum {
     SDP_QUERY_NOT_NEEDED,      // Because the Controller type was inferred by other means.
 } uni_sdp_query_type_t;
 
+// BLE only: where the HID descriptor of a HID service instance is, inside "hid_descriptor".
+typedef struct {
+    uint16_t offset;
+    uint16_t len;
+} uni_hid_device_le_service_t;
+
 struct uni_hid_device_s {
     uint32_t cod;  // Class of Device.
     uint16_t vendor_id;
@@ -44,7 +58,7 @@ struct uni_hid_device_s {
     btstack_timer_source_t inquiry_remote_name_timer;
 
     // SDP
-    uint8_t hid_descriptor[HID_MAX_DESCRIPTOR_LEN];
+    uint8_t hid_descriptor[HID_DEVICE_MAX_DESCRIPTORS_LEN];
     uint16_t hid_descriptor_len;
     // DualShock4 1st gen requires to do the SDP query before l2cap connect,
     // otherwise it won't work.
@@ -59,6 +73,12 @@ struct uni_hid_device_s {
     // Channels
     uint16_t hids_cid;  // BLE only
 
+    // BLE only: one HID descriptor per HID service instance, indexed by service index.
+    // They are stored back to back in "hid_descriptor", and resolved when the HID service is connected.
+    // Each report is parsed with the descriptor of the service that sent it.
+    uni_hid_device_le_service_t le_services[HID_DEVICE_MAX_LE_SERVICES];
+    uint8_t le_services_count;
+
     // TODO: Create a union of gamepad/mouse/keyboard structs
     // At the moment "mouse" reuses gamepad struct, but it is a hack.
     // Gamepad
@@ -69,16 +89,27 @@ struct uni_hid_device_s {
     // Functions used to parse the usage page/usage.
     uni_report_parser_t report_parser;
 
-    // Buttons that need to be released before triggering the action again.
-    uint32_t misc_button_wait_release;
-    // Buttons that need to wait for a delay before triggering the action again.
-    uint32_t misc_button_wait_delay;
-    // Needed for Nintendo Switch family of controllers.
-    btstack_timer_source_t misc_button_delay_timer;
+    // Button combos: recent button history, and the progress of each combo.
+    uni_combo_state_t combo;
+    // Long presses fire even if no more reports arrive.
+    btstack_timer_source_t combo_timer;
+
+    // Analog sticks / accelerometer to joystick directions: config and hysteresis state.
+    uni_joy_analog_t joy_analog;
+
+    // Lightbar / player-LED animation
+    uni_led_anim_state_t led_anim;
+    btstack_timer_source_t led_anim_timer;
 
     // Circular buffer that contains the outgoing packets that couldn't be sent
     // immediately.
     uni_circular_buffer_t outgoing_buffer;
+    // BLE only: the output report write that is waiting for GATTSERVICE_SUBEVENT_HID_REPORT_WRITTEN.
+    // Only one write can be in flight. The queued ones are written when it is acknowledged.
+    bool outgoing_le_in_flight;
+    uint64_t outgoing_le_start_us;
+    // BLE only: used when the HIDS client is busy, and no acknowledgement is expected.
+    btstack_timer_source_t outgoing_le_retry_timer;
 
     // Bytes reserved to controller's parser instances.
     // E.g.: The Wii driver uses it for the state machine.
@@ -91,6 +122,9 @@ struct uni_hid_device_s {
     // Bluetooth connection info.
     uni_bt_conn_t conn;
 
+    // Performance counters. Used by the "perf", "latency" and "queues" console commands.
+    uni_perf_device_t perf;
+
     // Link to parent device. Used only when the device is a "virtual child".
     // Safe to assume that when parent != NULL, then it is a "virtual" device.
     // For example, the mouse implemented by DualShock4 has the "gamepad" as parent.
@@ -105,8 +139,17 @@ typedef struct uni_hid_device_s uni_hid_device_t;
 typedef uint8_t (*uni_hid_device_predicate_t)(uni_hid_device_t* d, void* data);
 
 void uni_hid_device_setup(void);
+// Registers a button combo, evaluated on every gamepad report of every device.
+// The callback receives the uni_hid_device_t* as context.
+// Can be called from the platform "on_init_complete". Returns the combo index, or -1 on error.
+int uni_hid_device_add_combo(const uni_combo_t* combo);
 
+// Creates a device for a remote device that is connecting, or that Bluepad32 is reconnecting to.
+// If the table is full, a half-open device with a lower admission score might be evicted.
 uni_hid_device_t* uni_hid_device_create(bd_addr_t address);
+// Same as uni_hid_device_create(), but for devices that were just discovered (inquiry or advertisement).
+// Candidates are ranked by allowlist / bonded status, class of device and RSSI.
+uni_hid_device_t* uni_hid_device_create_discovered(bd_addr_t address, uint32_t cod, uint8_t rssi);
 
 // Used for controllers that implement two input devices like DualShock4, which is a gamepad and a mouse
 // at the same time. The mouse will be the "virtual" device in this case.
@@ -149,6 +192,12 @@ bool uni_hid_device_is_cod_supported(uint32_t cod);
 uni_error_t uni_hid_device_on_device_discovered(bd_addr_t addr, const char* name, uint16_t cod, uint8_t rssi);
 
 void uni_hid_device_set_hid_descriptor(uni_hid_device_t* d, const uint8_t* descriptor, int len);
+// BLE only: sets the descriptors of all the HID service instances. "hid_descriptor" has all of them.
+// Services that don't fit in HID_DEVICE_MAX_DESCRIPTORS_LEN get an empty descriptor.
+void uni_hid_device_set_le_service_descriptors(uni_hid_device_t* d,
+                                               const uint8_t* const* descriptors,
+                                               const uint16_t* lens,
+                                               int count);
 bool uni_hid_device_has_hid_descriptor(uni_hid_device_t* d);
 
 void uni_hid_device_set_incoming(uni_hid_device_t* d, bool incoming);
@@ -171,6 +220,12 @@ void uni_hid_device_guess_controller_type_from_pid_vid(uni_hid_device_t* d);
 bool uni_hid_device_has_controller_type(uni_hid_device_t* d);
 
 void uni_hid_device_process_controller(uni_hid_device_t* d);
+// Parses the input report, and sends the controller data to the platform.
+// "report" must not include the HID transaction type (0xa1).
+void uni_hid_device_on_input_report(uni_hid_device_t* d, const uint8_t* report, uint16_t len);
+// BLE only: same as uni_hid_device_on_input_report(), but parsed with the descriptor of the HID service.
+// If the service has no descriptor, the report is dropped, unless the parser doesn't need one.
+void uni_hid_device_on_le_input_report(uni_hid_device_t* d, uint8_t service_index, const uint8_t* report, uint16_t len);
 
 void uni_hid_device_set_connection_handle(uni_hid_device_t* d, hci_con_handle_t handle);
 
@@ -178,6 +233,9 @@ void uni_hid_device_send_report(uni_hid_device_t* d, uint16_t cid, const uint8_t
 void uni_hid_device_send_intr_report(uni_hid_device_t* d, const uint8_t* report, uint16_t len);
 void uni_hid_device_send_ctrl_report(uni_hid_device_t* d, const uint8_t* report, uint16_t len);
 void uni_hid_device_send_queued_reports(uni_hid_device_t* d);
+// BLE only
+void uni_hid_device_send_le_report(uni_hid_device_t* d, uint8_t report_id, const uint8_t* report, uint16_t len);
+void uni_hid_device_on_le_report_written(uni_hid_device_t* d);
 
 bool uni_hid_device_does_require_hid_descriptor(uni_hid_device_t* d);
 
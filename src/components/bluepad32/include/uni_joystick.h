@@ -5,11 +5,13 @@
 #ifndef UNI_JOYSTICK_H
 #define UNI_JOYSTICK_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "controller/uni_balance_board.h"
 #include "controller/uni_gamepad.h"
 #include "controller/uni_keyboard.h"
+#include "uni_common.h"
 
 // Valid for Amiga, Atari 8-bit, Atari St, C64 and others...
 typedef struct {
@@ -25,6 +27,103 @@ typedef struct {
     uint8_t auto_fire;  // virtual button
 } uni_joystick_t;
 
+// Packed representation of one joystick port: one bit per line.
+// The bit order matches the UNI_PLATFORM_UNIJOYSTICLE_JOY_ enums, so that
+// bit "n" can be mapped to "gpios[n]" without any translation.
+enum {
+    UNI_JOYSTICK_BIT_UP = BIT(0),         // line 1
+    UNI_JOYSTICK_BIT_DOWN = BIT(1),       // line 2
+    UNI_JOYSTICK_BIT_LEFT = BIT(2),       // line 3
+    UNI_JOYSTICK_BIT_RIGHT = BIT(3),      // line 4
+    UNI_JOYSTICK_BIT_FIRE = BIT(4),       // line 6
+    UNI_JOYSTICK_BIT_BUTTON2 = BIT(5),    // line 9
+    UNI_JOYSTICK_BIT_BUTTON3 = BIT(6),    // line 5
+    UNI_JOYSTICK_BIT_AUTO_FIRE = BIT(7),  // virtual button
+
+    // Masks
+    UNI_JOYSTICK_BIT_DIR_MASK =
+        (UNI_JOYSTICK_BIT_UP | UNI_JOYSTICK_BIT_DOWN | UNI_JOYSTICK_BIT_LEFT | UNI_JOYSTICK_BIT_RIGHT),
+    UNI_JOYSTICK_BIT_POT_MASK = (UNI_JOYSTICK_BIT_BUTTON2 | UNI_JOYSTICK_BIT_BUTTON3),
+    UNI_JOYSTICK_BIT_LINES_MASK = (UNI_JOYSTICK_BIT_DIR_MASK | UNI_JOYSTICK_BIT_FIRE | UNI_JOYSTICK_BIT_POT_MASK),
+};
+
+typedef uint8_t uni_joystick_bits_t;
+
+// Analog to digital conversion of the sticks, and of the Wii accelerometer.
+//
+// The stick is "pressed" once it leaves a circular deadzone, and the direction is given by
+// its sector: 4 or 8 ways. Only integer math is used.
+// Both have hysteresis, so that a stick resting near a boundary doesn't toggle the directions:
+// - Once pressed, it is released at "deadzone - hysteresis".
+// - Once in a sector, it must go 5 degrees past the boundary to change sector.
+// Axis range is the one from uni_gamepad_t: -512 to 511.
+#define UNI_JOY_ANALOG_DEADZONE_DEFAULT 128  // Same as AXIS_THRESHOLD
+#define UNI_JOY_ANALOG_HYSTERESIS_DEFAULT 32
+#define UNI_JOY_ANALOG_WAYS_DEFAULT 8
+#define UNI_JOY_ANALOG_ACCEL_THRESHOLD_DEFAULT 26
+
+typedef struct {
+    // Radius where the stick starts to be "pressed". 1-511.
+    uint16_t deadzone;
+    // Once pressed, it is released at "deadzone - hysteresis". Smaller than deadzone.
+    uint16_t hysteresis;
+    // 4: only the dominant direction. 8: diagonals too.
+    uint8_t ways;
+    // Wii accelerometer, in "wheel" mode. Once active, it is released at 3/4 of it.
+    uint8_t accel_threshold;
+} uni_joy_analog_config_t;
+
+// Per device
+typedef struct {
+    uni_joy_analog_config_t config;
+
+    // Directions from the previous report. Used for the hysteresis.
+    uni_joystick_bits_t left_dir;
+    uni_joystick_bits_t right_dir;
+    uni_joystick_bits_t accel_dir;
+    bool accel_active;
+} uni_joy_analog_t;
+
+// Loads the default config from the properties.
+void uni_joystick_init(void);
+
+// Default config, used by new devices. Stored in the properties.
+// Returns 0 on success, -1 if the config is invalid.
+int uni_joy_analog_set_default_config(const uni_joy_analog_config_t* config);
+uni_joy_analog_config_t uni_joy_analog_get_default_config(void);
+bool uni_joy_analog_is_valid_config(const uni_joy_analog_config_t* config);
+
+// Resets the state, and uses the default config.
+void uni_joy_analog_init(uni_joy_analog_t* a);
+
+// Hardware independent: returns the directions of the stick at (x, y).
+// "prev" are the directions returned for the previous report. Zero disables the hysteresis.
+uni_joystick_bits_t uni_joy_analog_to_dir(const uni_joy_analog_config_t* config,
+                                          uni_joystick_bits_t prev,
+                                          int x,
+                                          int y);
+
+// Packed converters. They return the bits instead of updating a uni_joystick_t.
+// "analog" is the per-device analog state. If NULL, the default config is used, without hysteresis.
+uni_joystick_bits_t uni_joy_bits_single_from_gamepad(const uni_gamepad_t* gp,
+                                                     int use_two_buttons,
+                                                     uni_joy_analog_t* analog);
+void uni_joy_bits_twinstick_from_gamepad(const uni_gamepad_t* gp,
+                                         uni_joy_analog_t* analog,
+                                         uni_joystick_bits_t* out_joy1,
+                                         uni_joystick_bits_t* out_joy2);
+uni_joystick_bits_t uni_joy_bits_single_from_wii_accel(const uni_gamepad_t* gp, uni_joy_analog_t* analog);
+uni_joystick_bits_t uni_joy_bits_single_from_keyboard(const uni_keyboard_t* kb);
+void uni_joy_bits_twinstick_from_keyboard(const uni_keyboard_t* kb,
+                                          uni_joystick_bits_t* out_joy1,
+                                          uni_joystick_bits_t* out_joy2);
+uni_joystick_bits_t uni_joy_bits_single_from_balance_board(const uni_balance_board_t* bb,
+                                                           uni_balance_board_state_t* bb_state);
+
+// Conversion between the packed and the "one byte per line" representation.
+uni_joystick_bits_t uni_joy_bits_from_joystick(const uni_joystick_t* joy);
+void uni_joy_bits_to_joystick(uni_joystick_bits_t bits, uni_joystick_t* out_joy);
+
 // Gamepad related
 void uni_joy_to_single_joy_from_gamepad(const uni_gamepad_t* gp, uni_joystick_t* out_joy, int use_two_buttons);
 void uni_joy_to_twinstick_from_gamepad(const uni_gamepad_t* gp, uni_joystick_t* out_joy1, uni_joystick_t* out_joy2);
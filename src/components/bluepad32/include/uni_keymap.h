@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#ifndef UNI_KEYMAP_H
+#define UNI_KEYMAP_H
+
+#include <stdint.h>
+
+#include "controller/uni_gamepad.h"
+
+// A keymap translates a keyboard HID usage (0x00-0xff) into a joystick line or a gamepad button.
+//
+// Keymaps are "compiled" once into a 256-entry table, either from the built-in defaults
+// or from the user profile stored in the "bp.kb.keymap" property.
+// Translating a key is a table lookup: no switch / if-else chains per report.
+//
+// Modifiers (Left Control, Right Alt, etc.) use their HID usages: 0xe0 - 0xe7.
+#define UNI_KEYMAP_ENTRIES_MAX 256
+
+typedef enum {
+    UNI_KEYMAP_ID_JOY_SINGLE,     // Keyboard -> one joystick
+    UNI_KEYMAP_ID_JOY_TWINSTICK,  // Keyboard -> two joysticks
+    UNI_KEYMAP_ID_ICADE_CABINET,  // iCade Cabinet -> gamepad
+    UNI_KEYMAP_ID_ICADE_8BITTY,   // iCade 8-Bitty -> gamepad
+
+    UNI_KEYMAP_ID_COUNT,
+} uni_keymap_id_t;
+
+typedef enum {
+    UNI_KEYMAP_TARGET_NONE,
+    UNI_KEYMAP_TARGET_JOY1,          // value: uni_joystick_bits_t
+    UNI_KEYMAP_TARGET_JOY2,          // value: uni_joystick_bits_t
+    UNI_KEYMAP_TARGET_DPAD,          // value: DPAD_
+    UNI_KEYMAP_TARGET_BUTTONS,       // value: BUTTON_
+    UNI_KEYMAP_TARGET_MISC_BUTTONS,  // value: MISC_BUTTON_
+} uni_keymap_target_t;
+
+typedef enum {
+    // Target is "on" while the key is pressed. Used by regular keyboards.
+    UNI_KEYMAP_ACTION_HOLD,
+    // Key turns the target "on", and it stays "on". E.g: iCade "w" (up on).
+    UNI_KEYMAP_ACTION_PRESS,
+    // Key turns the target "off". E.g: iCade "e" (up off).
+    UNI_KEYMAP_ACTION_RELEASE,
+} uni_keymap_action_t;
+
+typedef struct {
+    uint8_t target;  // uni_keymap_target_t
+    uint8_t action;  // uni_keymap_action_t
+    uint16_t value;  // Bits to set / clear in the target
+} uni_keymap_entry_t;
+
+typedef struct {
+    uni_keymap_entry_t entries[UNI_KEYMAP_ENTRIES_MAX];
+} uni_keymap_t;
+
+void uni_keymap_init(void);
+
+// Returns the compiled keymap. Always valid after uni_keymap_init().
+const uni_keymap_t* uni_keymap_get(uni_keymap_id_t id);
+
+static inline const uni_keymap_entry_t* uni_keymap_lookup(const uni_keymap_t* km, uint8_t usage) {
+    return &km->entries[usage];
+}
+
+// Applies a DPAD / BUTTONS / MISC_BUTTONS entry to the gamepad. Joystick entries are ignored.
+void uni_keymap_apply_to_gamepad(const uni_keymap_entry_t* e, uni_gamepad_t* gp);
+
+// Stores the user profile in the "bp.kb.keymap" property, and recompiles the keymaps.
+// Format: sections separated by ';'. Each section is "<keymap>:" followed by a comma-separated list of
+// "<usage in hex>=[+|-]<target>" bindings, that override the defaults. E.g:
+//   "single:2c=j1.b2,1d=none;twin:e6=j2.fire;cabinet:1c=+btn.b,17=-btn.b"
+// Keymaps: "single", "twin", "cabinet", "8bitty"
+// Targets: "j1.up|down|left|right|fire|b2|b3", "j2.<same>", "dpad.up|down|left|right",
+//          "btn.a|b|x|y|l|r|zl|zr|thumb_l|thumb_r", "misc.system|select|start|capture", "none".
+// Prefix "+" is UNI_KEYMAP_ACTION_PRESS, "-" is UNI_KEYMAP_ACTION_RELEASE. Default is UNI_KEYMAP_ACTION_HOLD.
+// Returns 0 on success. On error the previous keymaps are kept.
+// The profile must be shorter than UNI_PROPERTY_STRING_MAX_LEN, so that it can be stored on all the archs.
+int uni_keymap_set_profile(const char* profile);
+
+void uni_keymap_dump(uni_keymap_id_t id);
+
+#endif  // UNI_KEYMAP_H
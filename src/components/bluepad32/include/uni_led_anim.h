@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#ifndef UNI_LED_ANIM_H
+#define UNI_LED_ANIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Lightbar and player-LED animations. E.g: breathing, pulsing, battery warning.
+//
+// An animation is a list of keyframes. The lightbar color is interpolated between keyframes,
+// the player LEDs change at each keyframe.
+// Animations run from a per-device timer in the BTstack run loop. An output report is sent only
+// when the quantized color (or the player LEDs) change, and at most at the configured rate per device.
+// Frames are skipped while the device has queued output reports, so that rumble goes first.
+
+#define UNI_LED_ANIM_MAX_KEYFRAMES 8
+// Default max rate of output reports per device, used by animations.
+#define UNI_LED_ANIM_DEFAULT_MAX_RATE_HZ 20
+
+// Outputs used by an animation
+enum {
+    UNI_LED_ANIM_OUTPUT_LIGHTBAR = 1 << 0,
+    UNI_LED_ANIM_OUTPUT_PLAYER_LEDS = 1 << 1,
+};
+
+typedef struct {
+    // Since the start of the animation. Must be increasing.
+    uint16_t time_ms;
+    uint8_t r, g, b;
+    uint8_t player_leds;
+} uni_led_anim_keyframe_t;
+
+typedef struct {
+    const uni_led_anim_keyframe_t* keyframes;
+    uint8_t keyframes_count;
+    // UNI_LED_ANIM_OUTPUT_ flags
+    uint8_t outputs;
+    // Restarts after the last keyframe. Otherwise the last keyframe stays.
+    bool loop;
+} uni_led_anim_t;
+
+// Output of an animation at a given time
+typedef struct {
+    uint8_t r, g, b;
+    uint8_t player_leds;
+} uni_led_anim_frame_t;
+
+// Per device
+typedef struct {
+    uni_led_anim_keyframe_t keyframes[UNI_LED_ANIM_MAX_KEYFRAMES];
+    uint8_t keyframes_count;
+    uint8_t outputs;
+    bool loop;
+    bool playing;
+    uint32_t start_ms;
+
+    // Last values sent to the device
+    uni_led_anim_frame_t last;
+    bool lightbar_sent;
+    bool player_leds_sent;
+
+    uint32_t frames_sent;
+    uint32_t frames_skipped;
+} uni_led_anim_state_t;
+
+struct uni_hid_device_s;
+
+// Copies the animation. It replaces the one that is playing.
+// Returns false if the device doesn't support any of the outputs, or the animation is invalid.
+bool uni_led_anim_play(struct uni_hid_device_s* d, const uni_led_anim_t* anim);
+void uni_led_anim_stop(struct uni_hid_device_s* d);
+bool uni_led_anim_is_playing(struct uni_hid_device_s* d);
+
+// Built-in animations
+// Fades in and out, from "off" to the color.
+bool uni_led_anim_breathe(struct uni_hid_device_s* d, uint8_t r, uint8_t g, uint8_t b, uint16_t period_ms);
+// Short flash of the color, then off.
+bool uni_led_anim_pulse(struct uni_hid_device_s* d, uint8_t r, uint8_t g, uint8_t b, uint16_t period_ms);
+// Red blink, and player LEDs blink, until stopped.
+bool uni_led_anim_battery_warning(struct uni_hid_device_s* d);
+
+// Max output reports per second per device, used by animations. Shared by all devices.
+void uni_led_anim_set_max_rate(uint8_t hz);
+uint8_t uni_led_anim_get_max_rate(void);
+
+// Hardware independent: returns the frame at "elapsed_ms" since the start.
+// Returns true if the animation has finished: non-looping, and past the last keyframe.
+bool uni_led_anim_eval(const uni_led_anim_keyframe_t* keyframes,
+                       int count,
+                       bool loop,
+                       uint32_t elapsed_ms,
+                       uni_led_anim_frame_t* out);
+
+// Called from uni_hid_device.c
+void uni_led_anim_on_device_deleted(struct uni_hid_device_s* d);
+
+#endif  // UNI_LED_ANIM_H
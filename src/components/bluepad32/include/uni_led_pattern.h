@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#ifndef UNI_LED_PATTERN_H
+#define UNI_LED_PATTERN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Blink patterns for a status LED, like the Unijoysticle Bluetooth LED.
+//
+// Patterns are queued, and played one after the other. A pattern with a higher priority
+// preempts the one that is playing, which restarts once the higher priority ones are done.
+// When the queue is empty, the LED goes back to its "idle" level.
+//
+// It has no dependencies on the hardware: the caller passes the current time, and the engine
+// returns the LED level, plus the time until the next edge.
+// The caller should call uni_led_pattern_run() again at that time, e.g. from a one-shot timer.
+// It is not thread-safe: the caller must serialize the calls.
+
+#define UNI_LED_PATTERN_QUEUE_SIZE 4
+
+typedef enum {
+    UNI_LED_PATTERN_PRIORITY_LOW,
+    UNI_LED_PATTERN_PRIORITY_NORMAL,
+    UNI_LED_PATTERN_PRIORITY_HIGH,
+} uni_led_pattern_priority_t;
+
+typedef struct {
+    // Each blink is: LED off for "off_ms", then on for "on_ms".
+    uint16_t off_ms;
+    uint16_t on_ms;
+    uint8_t times;
+    uni_led_pattern_priority_t priority;
+} uni_led_pattern_t;
+
+typedef struct {
+    // Sorted by priority. Same priority: in order of arrival. The first one is the one playing.
+    uni_led_pattern_t queue[UNI_LED_PATTERN_QUEUE_SIZE];
+    uint8_t count;
+    // When the first pattern started playing
+    uint64_t start_us;
+    bool idle_level;
+
+    // Patterns that didn't fit in the queue
+    uint32_t dropped;
+} uni_led_pattern_queue_t;
+
+void uni_led_pattern_init(uni_led_pattern_queue_t* q, bool idle_level);
+
+// Level of the LED when no pattern is playing.
+void uni_led_pattern_set_idle_level(uni_led_pattern_queue_t* q, bool level);
+
+// Queues a pattern. If the queue is full, the newest pattern with the lowest priority is dropped:
+// either the new one, or a queued one with a lower priority.
+// Returns 0 if queued, -1 if dropped or invalid.
+int uni_led_pattern_push(uni_led_pattern_queue_t* q, const uni_led_pattern_t* pattern, uint64_t now_us);
+
+// Removes all the patterns. The LED goes back to the idle level.
+void uni_led_pattern_clear(uni_led_pattern_queue_t* q);
+
+// Returns the LED level in "out_level".
+// Returns the microseconds until the next edge, or 0 if no pattern is playing.
+uint32_t uni_led_pattern_run(uni_led_pattern_queue_t* q, uint64_t now_us, bool* out_level);
+
+// Blinks "times" with the default timing (100ms off, 100ms on).
+uni_led_pattern_t uni_led_pattern_blink(uint8_t times, uni_led_pattern_priority_t priority);
+
+#endif  // UNI_LED_PATTERN_H
@@ -0,0 +1,93 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#ifndef UNI_METRICS_H
+#define UNI_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+#include "uni_hid_device.h"
+
+// Metrics registry: health counters and gauges, meant to be exported to a monitoring system.
+//
+// Counters are only updated from the BTstack thread, on connection events. Per-report counters
+// are not duplicated here: they are read from each device's uni_perf_device_t when the snapshot is taken.
+// So the cost in the report path is zero.
+//
+// Exporters must not read the device table. Instead, the BTstack thread takes a snapshot,
+// that can be copied and formatted from any thread.
+
+typedef enum {
+    // Devices that completed the setup
+    UNI_METRICS_COUNTER_CONNECTIONS,
+    // Connections of devices that were already connected since boot
+    UNI_METRICS_COUNTER_RECONNECTIONS,
+    // Connections declined by the platform
+    UNI_METRICS_COUNTER_CONNECTIONS_REJECTED,
+    // HCI disconnections of known devices
+    UNI_METRICS_COUNTER_DISCONNECTIONS,
+    // Disconnections because of a supervision timeout (out of range, battery died, etc.)
+    UNI_METRICS_COUNTER_LINK_LOSSES,
+    // Devices not created because the device table was full
+    UNI_METRICS_COUNTER_DEVICES_REJECTED,
+    // Half-open devices evicted from the device table by a better candidate
+    UNI_METRICS_COUNTER_DEVICES_EVICTED,
+
+    UNI_METRICS_COUNTER_COUNT,
+} uni_metrics_counter_t;
+
+// Max chars of the device name included in the snapshot, including the NUL
+#define UNI_METRICS_NAME_LEN 32
+
+typedef struct {
+    uint8_t addr[6];
+    char name[UNI_METRICS_NAME_LEN];
+    uint16_t vendor_id;
+    uint16_t product_id;
+
+    uint32_t input_reports;
+    uint32_t output_reports;
+    uint32_t output_dropped;
+    // As reported by HCI Read RSSI: dBm on BLE, distance from the "golden range" on BR/EDR.
+    int8_t rssi;
+    // 0=empty, 254=full, 255=not available
+    uint8_t battery;
+} uni_metrics_device_t;
+
+typedef struct {
+    uint64_t uptime_us;
+    uint32_t counters[UNI_METRICS_COUNTER_COUNT];
+
+    // Totals, including the devices that are no longer connected
+    uint64_t input_reports;
+    uint64_t output_reports;
+    uint64_t output_dropped;
+
+    // Connected devices, that completed the setup
+    int device_count;
+    uni_metrics_device_t devices[CONFIG_BLUEPAD32_MAX_DEVICES];
+} uni_metrics_snapshot_t;
+
+// Must be called from the BTstack thread
+void uni_metrics_inc(uni_metrics_counter_t counter);
+void uni_metrics_on_device_ready(uni_hid_device_t* d);
+void uni_metrics_on_device_deleted(uni_hid_device_t* d);
+
+// Fills "out" with the current values. Must be called from the BTstack thread.
+// It also requests a new RSSI measurement for the connected devices, available in the next snapshot.
+void uni_metrics_take_snapshot(uni_metrics_snapshot_t* out);
+
+// Formats the snapshot in Prometheus text format. Can be called from any thread.
+// Returns the number of bytes written, excluding the NUL, or -1 if "buf" is too small.
+int uni_metrics_format_prometheus(const uni_metrics_snapshot_t* snap, char* buf, size_t len);
+
+// Starts the exporter. Only available on Linux / macOS.
+// Listens on the Unix socket defined by BLUEPAD32_METRICS_SOCKET, or on the loopback TCP port
+// defined by BLUEPAD32_METRICS_PORT. It does nothing if none of them are set.
+void uni_metrics_exporter_init(void);
+
+#endif  // UNI_METRICS_H
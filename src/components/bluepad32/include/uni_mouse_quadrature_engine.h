@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#ifndef UNI_MOUSE_QUADRATURE_ENGINE_H
+#define UNI_MOUSE_QUADRATURE_ENGINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "uni_mouse_quadrature.h"
+
+// Quadrature mouse engine: phase generation and scheduling for all the encoders.
+//
+// It has no dependencies on the hardware. It is driven by one timer: the caller
+// passes the current time in ticks, and the engine returns the GPIOs to set / clear,
+// plus the ticks until the next step is due.
+// Only integer math is used, so that it can be called from an ISR.
+//
+// A tick is 80us (12500 ticks per second).
+#define UNI_MOUSE_QUADRATURE_ENGINE_TICKS_PER_SECOND 12500
+
+// Scale factor is stored as 8.8 fixed point.
+#define UNI_MOUSE_QUADRATURE_ENGINE_SCALE_ONE 256
+
+typedef struct {
+    // GPIO masks for phase A and B.
+    uint64_t mask_a;
+    uint64_t mask_b;
+
+    // Pending steps
+    int32_t remaining;
+    // -1 or +1
+    int8_t dir;
+    // Quadrature phase: 0-3
+    uint8_t phase;
+    // Ticks between steps
+    uint32_t interval;
+    // Tick in which the next step is due
+    uint32_t next_tick;
+} uni_mouse_quadrature_encoder_t;
+
+typedef struct {
+    uni_mouse_quadrature_encoder_t encoders[UNI_MOUSE_QUADRATURE_PORT_MAX][UNI_MOUSE_QUADRATURE_ENCODER_MAX];
+    bool enabled[UNI_MOUSE_QUADRATURE_PORT_MAX];
+    // Scale factor, 8.8 fixed point. Higher means faster.
+    uint32_t scale_q8;
+} uni_mouse_quadrature_engine_t;
+
+void uni_mouse_quadrature_engine_init(uni_mouse_quadrature_engine_t* eng);
+void uni_mouse_quadrature_engine_setup_encoder(uni_mouse_quadrature_engine_t* eng,
+                                               int port_idx,
+                                               int encoder_idx,
+                                               uint64_t mask_a,
+                                               uint64_t mask_b);
+void uni_mouse_quadrature_engine_set_scale(uni_mouse_quadrature_engine_t* eng, uint32_t scale_q8);
+void uni_mouse_quadrature_engine_set_enabled(uni_mouse_quadrature_engine_t* eng, int port_idx, bool enabled);
+
+// Sets a new delta for the encoder. Previous pending steps are discarded.
+void uni_mouse_quadrature_engine_update(uni_mouse_quadrature_engine_t* eng,
+                                        int port_idx,
+                                        int encoder_idx,
+                                        int32_t delta,
+                                        uint32_t now);
+
+// Runs all the steps that are due at "now". The GPIOs to change are returned in "set_mask" and "clear_mask",
+// to be applied with one write.
+// Returns the ticks until the next step, or 0 if there are no pending steps.
+uint32_t uni_mouse_quadrature_engine_run(uni_mouse_quadrature_engine_t* eng,
+                                         uint32_t now,
+                                         uint64_t* set_mask,
+                                         uint64_t* clear_mask);
+
+// Returns the ticks until the next step, or 0 if there are no pending steps.
+uint32_t uni_mouse_quadrature_engine_next_delay(const uni_mouse_quadrature_engine_t* eng, uint32_t now);
+
+#endif  // UNI_MOUSE_QUADRATURE_ENGINE_H
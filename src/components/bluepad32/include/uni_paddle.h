@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#ifndef UNI_PADDLE_H
+#define UNI_PADDLE_H
+
+#include <stdint.h>
+
+// Paddle emulation for the C64 SID: Pot X and Pot Y.
+//
+// Every SID sample starts with a sync: the SID discharges the capacitor, and then it measures
+// how long the line takes to go high. Both lines are raised at the sync, and each one is released
+// "discharge + delay" microseconds later. The longer the delay, the bigger the paddle value.
+//
+// It has no dependencies on the hardware: the caller passes the current time, in microseconds,
+// writes the returned masks to the port, and calls uni_paddle_run() again after the returned delay,
+// e.g. from a one-shot timer alarm. It is not thread-safe: the caller must serialize the calls,
+// e.g. with a spinlock shared with the ISRs.
+
+#define UNI_PADDLE_DELAY_MIN_US 3
+// Larger values exceed the SID sampling window
+#define UNI_PADDLE_DELAY_MAX_US 243
+
+typedef struct {
+    // GPIO masks of Pot X and Pot Y
+    uint64_t mask_x;
+    uint64_t mask_y;
+    // Time that the SID needs to discharge the capacitor. Delays are relative to its end.
+    uint32_t discharge_us;
+
+    // Current sample
+    uint64_t start_us;
+    uint16_t x_us;
+    uint16_t y_us;
+    // GPIO mask of the lines still high
+    uint64_t pending;
+} uni_paddle_t;
+
+void uni_paddle_init(uni_paddle_t* p, uint64_t mask_x, uint64_t mask_y, uint32_t discharge_us);
+
+// Clamps both delays to the valid range, and packs them in one word: X in the high 16 bits, Y in the low ones.
+// The caller can publish it with one 32-bit store, so the sync ISR never reads a torn pair.
+uint32_t uni_paddle_pack_delays(int x_us, int y_us);
+
+// To be called from the sync ISR. "delays" is the value returned by uni_paddle_pack_delays().
+// Both lines are raised: returned in "out_set_mask".
+// Returns the microseconds until the next line must be released.
+uint32_t uni_paddle_on_sync(uni_paddle_t* p, uint32_t delays, uint64_t now_us, uint64_t* out_set_mask);
+
+// Releases the lines whose delay has expired: returned in "out_clear_mask".
+// Returns the microseconds until the next line must be released, or 0 if there are no lines pending.
+uint32_t uni_paddle_run(uni_paddle_t* p, uint64_t now_us, uint64_t* out_clear_mask);
+
+#endif  // UNI_PADDLE_H
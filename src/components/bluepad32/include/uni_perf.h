@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#ifndef UNI_PERF_H
+#define UNI_PERF_H
+
+#include <stdint.h>
+
+// Latency histogram. Buckets are powers of two, starting at UNI_PERF_HISTOGRAM_FIRST_US:
+//   [0, 64us), [64us, 128us), ... [4096us, 8192us), [8192us, inf)
+#define UNI_PERF_HISTOGRAM_BUCKETS 9
+#define UNI_PERF_HISTOGRAM_FIRST_US 64
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t buckets[UNI_PERF_HISTOGRAM_BUCKETS];
+} uni_perf_histogram_t;
+
+// Per-device performance counters. Reset when the device is created.
+typedef struct {
+    uint32_t input_reports;
+    // Input reports dropped because they failed validation. E.g: CRC.
+    uint32_t input_invalid;
+    // Time to parse an input report, including the platform callback.
+    uni_perf_histogram_t input_latency;
+
+    // Output reports sent, either immediately or from the queue.
+    uint32_t output_reports;
+    // Output reports that couldn't be sent immediately, and were queued.
+    uint32_t output_queued;
+    // Output reports dropped because the queue was full.
+    uint32_t output_dropped;
+    // Queued output reports replaced by a newer one with the same report ID. BLE only.
+    uint32_t output_collapsed;
+    // Max number of reports in the queue.
+    uint16_t output_queue_max;
+    // Time from the output report write until it is acknowledged. BLE only.
+    uni_perf_histogram_t output_latency;
+} uni_perf_device_t;
+
+void uni_perf_histogram_add(uni_perf_histogram_t* h, uint32_t us);
+void uni_perf_histogram_dump(const uni_perf_histogram_t* h);
+
+#endif  // UNI_PERF_H
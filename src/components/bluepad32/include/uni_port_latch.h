@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#ifndef UNI_PORT_LATCH_H
+#define UNI_PORT_LATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "uni_perf.h"
+
+// Just-in-time port latching.
+//
+// Some hosts signal when they are about to read the joystick port. E.g: a C64 program that pulses
+// the Pot line every frame (the "sync IRQ"). Instead of writing each controller state as soon
+// as it arrives, the latest one is latched and written to the port from the sync IRQ.
+// The host sees one consistent state per frame, and it is the newest one.
+//
+// If no sync arrives for UNI_PORT_LATCH_SYNC_TIMEOUT_US, states are written immediately,
+// so programs that don't generate syncs keep working.
+//
+// It has no dependencies on the hardware: the caller passes the current time, and writes the
+// returned masks to the port. It is not thread-safe: the caller must serialize the calls,
+// e.g. with a spinlock shared with the ISR.
+
+// 5 frames at 50Hz
+#define UNI_PORT_LATCH_SYNC_TIMEOUT_US (100 * 1000)
+
+typedef struct {
+    // Latest state, waiting for the next sync.
+    uint64_t set_mask;
+    uint64_t clear_mask;
+    bool pending;
+    // When the latest state was latched.
+    uint64_t latched_us;
+    // Last sync. Zero if never received.
+    uint64_t last_sync_us;
+
+    uint32_t syncs;
+    // States written immediately, because there was no recent sync.
+    uint32_t immediate;
+    // States replaced by a newer one before reaching the port.
+    uint32_t coalesced;
+    // From the sync IRQ until the port is written. Updated by the caller.
+    uni_perf_histogram_t irq_to_port;
+    // Age of the state when it reaches the port.
+    uni_perf_histogram_t state_age;
+} uni_port_latch_t;
+
+void uni_port_latch_init(uni_port_latch_t* l);
+
+// A new state for the port. Returns true if it was latched until the next sync.
+// Otherwise, the caller must write "set_mask" / "clear_mask" to the port now.
+bool uni_port_latch_write(uni_port_latch_t* l, uint64_t set_mask, uint64_t clear_mask, uint64_t now_us);
+
+// To be called from the sync IRQ. Returns true if there is a state to write to the port,
+// in "out_set_mask" / "out_clear_mask".
+bool uni_port_latch_on_sync(uni_port_latch_t* l, uint64_t now_us, uint64_t* out_set_mask, uint64_t* out_clear_mask);
+
+// Goes back to immediate mode. Returns true if there is a latched state that must be written now.
+// To be called when the syncs stop (see uni_port_latch_is_synced()), or when they are disabled.
+bool uni_port_latch_flush(uni_port_latch_t* l, uint64_t now_us, uint64_t* out_set_mask, uint64_t* out_clear_mask);
+
+// Whether a sync was received recently. When false, states are written immediately.
+bool uni_port_latch_is_synced(const uni_port_latch_t* l, uint64_t now_us);
+
+void uni_port_latch_dump(const uni_port_latch_t* l);
+
+#endif  // UNI_PORT_LATCH_H
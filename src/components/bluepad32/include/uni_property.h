@@ -19,7 +19,14 @@
 #define UNI_PROPERTY_NAME_GAP_LEVEL "bp.gap.level"
 #define UNI_PROPERTY_NAME_GAP_MAX_PERIODIC_LEN "bp.gap.max_len"
 #define UNI_PROPERTY_NAME_GAP_MIN_PERIODIC_LEN "bp.gap.min_len"
+#define UNI_PROPERTY_NAME_JOY_ACCEL_THRESHOLD "bp.joy.accel"
+#define UNI_PROPERTY_NAME_JOY_DEADZONE "bp.joy.deadzone"
+#define UNI_PROPERTY_NAME_JOY_HYSTERESIS "bp.joy.hyst"
+#define UNI_PROPERTY_NAME_JOY_WAYS "bp.joy.ways"
+#define UNI_PROPERTY_NAME_KEYBOARD_KEYMAP "bp.kb.keymap"
 #define UNI_PROPERTY_NAME_MOUSE_SCALE "bp.mouse.scale"
+#define UNI_PROPERTY_NAME_RECONNECT_ENABLED "bp.bt.reconn_en"
+#define UNI_PROPERTY_NAME_RECONNECT_LIST "bp.bt.reconn"
 #define UNI_PROPERTY_NAME_VERSION "bp.version"
 #define UNI_PROPERTY_NAME_VIRTUAL_DEVICE_ENABLED "bp.virt_dev_en"
 
@@ -31,7 +38,14 @@ typedef enum {
     UNI_PROPERTY_IDX_GAP_LEVEL,
     UNI_PROPERTY_IDX_GAP_MAX_PERIODIC_LEN,
     UNI_PROPERTY_IDX_GAP_MIN_PERIODIC_LEN,
+    UNI_PROPERTY_IDX_JOY_ACCEL_THRESHOLD,
+    UNI_PROPERTY_IDX_JOY_DEADZONE,
+    UNI_PROPERTY_IDX_JOY_HYSTERESIS,
+    UNI_PROPERTY_IDX_JOY_WAYS,
+    UNI_PROPERTY_IDX_KEYBOARD_KEYMAP,
     UNI_PROPERTY_IDX_MOUSE_SCALE,
+    UNI_PROPERTY_IDX_RECONNECT_ENABLED,
+    UNI_PROPERTY_IDX_RECONNECT_LIST,
     UNI_PROPERTY_IDX_VERSION,
     UNI_PROPERTY_IDX_VIRTUAL_DEVICE_ENABLED,
     UNI_PROPERTY_IDX_LAST,
@@ -53,6 +67,9 @@ typedef enum {
     UNI_PROPERTY_IDX_COUNT = UNI_PROPERTY_IDX_UNI_LAST
 } uni_property_idx_t;
 
+// Max length of string properties, including the terminating NUL. Same on all the archs.
+#define UNI_PROPERTY_STRING_MAX_LEN 128
+
 typedef enum {
     UNI_PROPERTY_TYPE_BOOL,
     UNI_PROPERTY_TYPE_U8,
@@ -5,10 +5,26 @@
 #ifndef UNI_SYSTEM_H
 #define UNI_SYSTEM_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 // Interface
 // Each arch needs to implement these functions
 
+typedef struct {
+    // Bytes. 0 when not available in the arch.
+    size_t heap_free;
+    size_t heap_used;
+    // Lowest "heap_free" since boot.
+    size_t heap_min_free;
+} uni_system_memory_t;
+
 // Reboots the microcontroller
 void uni_system_reboot(void);
 
+// Monotonic time, in microseconds
+uint64_t uni_system_get_time_us(void);
+
+void uni_system_get_memory(uni_system_memory_t* mem);
+
 #endif  // UNI_SYSTEM_H
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#ifndef UNI_TOUCHPAD_H
+#define UNI_TOUCHPAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "controller/uni_mouse.h"
+
+// Touchpad to mouse converter. Used by the DualShock4 / DualSense virtual mouse.
+//
+// A report can contain more than one touch frame. All of them are integrated, oldest first,
+// so fast swipes don't lose motion:
+//   uni_touchpad_begin(), uni_touchpad_add_frame() for each frame, uni_touchpad_end().
+//
+// - One finger: moves the pointer.
+// - Two fingers: vertical motion generates scroll wheel events. The pointer doesn't move.
+//
+// Deltas are only computed between frames of the same finger (same tracking id),
+// so lifting a finger and touching in a different place doesn't make the pointer jump.
+// No dynamic memory, and integer math only.
+
+#define UNI_TOUCHPAD_FINGERS_MAX 2
+
+// Touchpad units per scroll wheel step.
+#define UNI_TOUCHPAD_SCROLL_STEP 40
+
+typedef struct {
+    bool active;
+    // Tracking id. Changes each time a finger touches the touchpad.
+    uint8_t id;
+    uint16_t x;
+    uint16_t y;
+} uni_touchpad_finger_t;
+
+typedef struct {
+    // Last frame. Used to convert absolute coordinates into relative ones.
+    uni_touchpad_finger_t prev[UNI_TOUCHPAD_FINGERS_MAX];
+    // Scroll motion that didn't complete a step yet.
+    int32_t scroll_remainder;
+
+    // Accumulated since uni_touchpad_begin()
+    int32_t delta_x;
+    int32_t delta_y;
+    int32_t scroll;
+    uint16_t frames;
+} uni_touchpad_t;
+
+void uni_touchpad_init(uni_touchpad_t* tp);
+
+// Starts a new report. Clears the accumulated motion.
+void uni_touchpad_begin(uni_touchpad_t* tp);
+// Integrates one frame. Frames must be added in the order they were sampled.
+void uni_touchpad_add_frame(uni_touchpad_t* tp, const uni_touchpad_finger_t fingers[UNI_TOUCHPAD_FINGERS_MAX]);
+// Stores the accumulated motion in the mouse: delta_x, delta_y and scroll_wheel.
+void uni_touchpad_end(uni_touchpad_t* tp, uni_mouse_t* ms);
+
+// Returns the last known position of the first finger. Returns false if it is not touching.
+bool uni_touchpad_get_position(const uni_touchpad_t* tp, uint16_t* x, uint16_t* y);
+
+#endif  // UNI_TOUCHPAD_H
@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#ifndef UNI_TRACE_H
+#define UNI_TRACE_H
+
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+#include "uni_hid_device.h"
+#include "uni_trace_format.h"
+
+// Report trace: records the raw input, output and feature reports, to reproduce controller issues offline.
+//
+// Only available on Linux / macOS, and opt-in:
+//   BLUEPAD32_TRACE_FILE=/tmp/pad.trace ./bluepad32_posix_example_app
+// The file is preallocated and memory-mapped. It is a ring buffer, so it keeps the latest records.
+// Size can be changed with BLUEPAD32_TRACE_SIZE (bytes). Default: 4 MiB.
+//
+// The recorded file can be decoded with tools/bp32trace, or replayed through the parsers with:
+//   BLUEPAD32_TRACE_REPLAY=/tmp/pad.trace ./bluepad32_posix_example_app
+// While replaying, recording is disabled.
+//
+// Must be called from the BTstack thread.
+
+#ifdef CONFIG_TARGET_POSIX
+
+void uni_trace_init(void);
+// For UNI_TRACE_RECORD_INPUT, OUTPUT and FEATURE.
+void uni_trace_record_report(uni_hid_device_t* d,
+                             uni_trace_record_type_t type,
+                             uni_trace_channel_t channel,
+                             const uint8_t* report,
+                             uint16_t len);
+// For UNI_TRACE_RECORD_INPUT on BLE: also records the HID service that sent the report.
+void uni_trace_record_le_input_report(uni_hid_device_t* d, uint8_t service_index, const uint8_t* report, uint16_t len);
+// For UNI_TRACE_RECORD_DEVICE and DISCONNECT.
+void uni_trace_record_device(uni_hid_device_t* d, uni_trace_record_type_t type);
+
+#else  // !CONFIG_TARGET_POSIX
+
+static inline void uni_trace_init(void) {}
+static inline void uni_trace_record_report(uni_hid_device_t* d,
+                                           uni_trace_record_type_t type,
+                                           uni_trace_channel_t channel,
+                                           const uint8_t* report,
+                                           uint16_t len) {
+    (void)d;
+    (void)type;
+    (void)channel;
+    (void)report;
+    (void)len;
+}
+static inline void uni_trace_record_le_input_report(uni_hid_device_t* d,
+                                                    uint8_t service_index,
+                                                    const uint8_t* report,
+                                                    uint16_t len) {
+    (void)d;
+    (void)service_index;
+    (void)report;
+    (void)len;
+}
+static inline void uni_trace_record_device(uni_hid_device_t* d, uni_trace_record_type_t type) {
+    (void)d;
+    (void)type;
+}
+
+#endif  // !CONFIG_TARGET_POSIX
+
+#endif  // UNI_TRACE_H
@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#ifndef UNI_TRACE_FORMAT_H
+#define UNI_TRACE_FORMAT_H
+
+#include <stdint.h>
+
+// Binary format of the report trace file. See uni_trace.h.
+//
+// It has no dependencies, so that host tools can include it. E.g: tools/bp32trace.
+// All fields are little-endian.
+//
+// Layout:
+//   uni_trace_file_header_t
+//   device table: "device_slots" slots of "device_slot_size" bytes, indexed by device_idx.
+//   ring buffer of "data_size" bytes, with the records.
+//
+// Each record is a uni_trace_record_header_t followed by "len" bytes of payload, padded to
+// UNI_TRACE_RECORD_ALIGN bytes. Records go from "tail" (oldest) to "head" (next write).
+// When a record doesn't fit at the end of the ring, a UNI_TRACE_RECORD_WRAP is written
+// (if there is space for its header), and the record is written at offset 0.
+// A reader should also wrap when there are less than sizeof(uni_trace_record_header_t) bytes left.
+//
+// The device table has the devices that were connected when the oldest record in the ring was written.
+// When a DEVICE record is overwritten, its payload is copied to the slot. When a DISCONNECT record is
+// overwritten, the slot is cleared. So, after the ring wraps, the records can still be matched
+// with their device: load the device table first, and then read the records.
+
+#define UNI_TRACE_MAGIC "BP32TRC1"
+#define UNI_TRACE_MAGIC_LEN 8
+#define UNI_TRACE_VERSION 3
+#define UNI_TRACE_RECORD_ALIGN 8
+#define UNI_TRACE_NAME_LEN 32
+// BLE only: max HID service instances per device
+#define UNI_TRACE_SERVICES_MAX 3
+// Max HID descriptor stored in a device slot. On BLE, the descriptors of all the HID services.
+#define UNI_TRACE_DESCRIPTOR_MAX_LEN (512 * UNI_TRACE_SERVICES_MAX)
+
+typedef enum {
+    UNI_TRACE_RECORD_WRAP,
+    // Input report, without the HID transaction type. On BLE, "service_index" has the HID service that sent it.
+    UNI_TRACE_RECORD_INPUT,
+    // Output report, as sent. Includes the HID transaction type on BR/EDR.
+    UNI_TRACE_RECORD_OUTPUT,
+    // Feature report, without the HID transaction type
+    UNI_TRACE_RECORD_FEATURE,
+    // Device is about to be set up. Payload: uni_trace_device_t + HID descriptor
+    UNI_TRACE_RECORD_DEVICE,
+    // Device was deleted. No payload.
+    UNI_TRACE_RECORD_DISCONNECT,
+} uni_trace_record_type_t;
+
+typedef enum {
+    UNI_TRACE_CHANNEL_NONE,
+    UNI_TRACE_CHANNEL_INTERRUPT,  // BR/EDR
+    UNI_TRACE_CHANNEL_CONTROL,    // BR/EDR
+    UNI_TRACE_CHANNEL_GATT,       // BLE
+} uni_trace_channel_t;
+
+typedef struct __attribute__((packed)) {
+    char magic[UNI_TRACE_MAGIC_LEN];
+    uint32_t version;
+    uint32_t header_size;
+    // Size of the ring buffer
+    uint32_t data_size;
+    // Offsets in the ring buffer
+    uint32_t head;
+    uint32_t tail;
+    // Records in the ring buffer
+    uint32_t records;
+    // Records written since the trace started. "records_total - records" were overwritten.
+    uint32_t records_total;
+    // Device table. Placed between the header and the ring buffer.
+    uint32_t device_slots;
+    uint32_t device_slot_size;
+    uint32_t reserved[5];
+} uni_trace_file_header_t;
+
+typedef struct __attribute__((packed)) {
+    // Monotonic time
+    uint64_t timestamp_us;
+    // Payload length
+    uint16_t len;
+    uint8_t type;        // uni_trace_record_type_t
+    uint8_t device_idx;  // Index in the device table
+    uint8_t channel;     // uni_trace_channel_t
+    // INPUT records, BLE only: HID service instance that sent the report
+    uint8_t service_index;
+    uint8_t reserved[2];
+} uni_trace_record_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t addr[6];
+    uint16_t vendor_id;
+    uint16_t product_id;
+    uint16_t controller_type;  // uni_controller_type_t
+    uint8_t protocol;          // uni_bt_conn_protocol_t
+    // BLE only: number of HID service instances. Zero if the device has a single HID descriptor.
+    uint8_t services;
+    uint32_t cod;
+    char name[UNI_TRACE_NAME_LEN];
+    uint16_t descriptor_len;
+    // BLE only: HID descriptor length of each service. They are back to back in the HID descriptor.
+    // A service without a descriptor has length zero.
+    uint16_t service_descriptor_len[UNI_TRACE_SERVICES_MAX];
+    // Followed by the HID descriptor
+} uni_trace_device_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t valid;
+    uint8_t reserved[5];
+    // Payload length
+    uint16_t len;
+    // Followed by the payload of the DEVICE record: uni_trace_device_t + HID descriptor
+} uni_trace_device_slot_t;
+
+_Static_assert(sizeof(uni_trace_file_header_t) == 64, "Invalid trace header size");
+_Static_assert(sizeof(uni_trace_record_header_t) == 16, "Invalid trace record size");
+_Static_assert(sizeof(uni_trace_device_slot_t) == 8, "Invalid trace device slot size");
+
+#endif  // UNI_TRACE_FORMAT_H
@@ -5,12 +5,18 @@
 #ifndef UNI_UTILS_H
 #define UNI_UTILS_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
 // Little-endian CRC32.
 // ESP32 has its own crc32_le as well, but they don't return the same values (?).
 // It is important to use ours with the "uni_" prefix.
+// Table-driven. On ESP32 it uses the ROM routine.
 uint32_t uni_crc32_le(uint32_t crc, const uint8_t* data, size_t len);
 
+// Returns whether the CRC32 at the end of a PlayStation (DS4, DualSense) Bluetooth report is valid.
+// "seed" is the HID transaction type, which is part of the CRC but not of the report. E.g: 0xa1 for input reports.
+bool uni_crc32_is_ps_report_valid(uint8_t seed, const uint8_t* report, uint16_t len);
+
 #endif  // UNI_UTILS_H
@@ -11,7 +11,11 @@
 // HID Usage Tables:
 // https://www.usb.org/sites/default/files/documents/hut1_12v2.pdf
 
-void uni_hid_parse_input_report(struct uni_hid_device_s* d, const uint8_t* report, uint16_t report_len) {
+void uni_hid_parse_input_report(struct uni_hid_device_s* d,
+                                const uint8_t* descriptor,
+                                uint16_t descriptor_len,
+                                const uint8_t* report,
+                                uint16_t report_len) {
     btstack_hid_parser_t parser;
 
     uni_report_parser_t* rp = &d->report_parser;
@@ -30,8 +34,7 @@ void uni_hid_parse_input_report(struct uni_hid_device_s* d, const uint8_t* repor
 
     // Devices that suport regular HID reports.
     if (rp->parse_usage) {
-        btstack_hid_parser_init(&parser, d->hid_descriptor, d->hid_descriptor_len, HID_REPORT_TYPE_INPUT, report,
-                                report_len);
+        btstack_hid_parser_init(&parser, descriptor, descriptor_len, HID_REPORT_TYPE_INPUT, report, report_len);
         while (btstack_hid_parser_has_more(&parser)) {
             uint16_t usage_page;
             uint16_t usage;
@@ -53,6 +56,9 @@ void uni_hid_parse_input_report(struct uni_hid_device_s* d, const uint8_t* repor
             rp->parse_usage(d, &globals, usage_page, usage, value);
         }
     }
+
+    if (rp->finish_report)
+        rp->finish_report(d);
 }
 
 // Converts a possible value between (0, x) to (-x/2, x/2), and normalizes it
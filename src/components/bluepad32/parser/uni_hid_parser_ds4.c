@@ -18,6 +18,7 @@
 #include "uni_config.h"
 #include "uni_hid_device.h"
 #include "uni_log.h"
+#include "uni_touchpad.h"
 #include "uni_utils.h"
 
 #define DS4_FEATURE_REPORT_FIRMWARE_VERSION 0xa3
@@ -70,11 +71,8 @@ typedef struct {
     struct ds4_calibration_data gyro_calib_data[3];
     struct ds4_calibration_data accel_calib_data[3];
 
-    // Prev Touchpad values, to convert them from absolute
-    // coordinates into relative ones.
-    int x_prev;
-    int y_prev;
-    bool prev_touch_active;
+    // Touchpad to mouse. Used by the virtual mouse.
+    uni_touchpad_t touchpad;
 
     // Prev LED color and rumble values.
     uint8_t prev_color_red;
@@ -220,6 +218,7 @@ static void ds4_parse_mouse(uni_hid_device_t* d, const ds4_input_report_11_t* r)
 void uni_hid_parser_ds4_setup(struct uni_hid_device_s* d) {
     ds4_instance_t* ins = get_ds4_instance(d);
     memset(ins, 0, sizeof(*ins));
+    uni_touchpad_init(&ins->touchpad);
 
     // Default values for Accel / Gyro calibration data, until calibration is supported.
     for (size_t i = 0; i < ARRAY_SIZE(ins->accel_calib_data); i++) {
@@ -512,6 +511,17 @@ void uni_hid_parser_ds4_parse_input_report(uni_hid_device_t* d, const uint8_t* r
     return;
 }
 
+bool uni_hid_parser_ds4_validate_input_report(uni_hid_device_t* d, const uint8_t* report, uint16_t len) {
+    ARG_UNUSED(d);
+
+    // Only report 0x11 has CRC. Report 0x01 doesn't.
+    if (report[0] != 0x11 || len != 78)
+        return true;
+
+    // 0xa1: DATA | INPUT_REPORT
+    return uni_crc32_is_ps_report_valid(0xa1, report, len);
+}
+
 // uni_hid_parser_ds4_parse_usage() was removed since "stream" mode is the only
 // one supported. If needed, the function is preserved in git history:
 // https://gitlab.com/ricardoquesada/bluepad32/-/blob/c32598f39831fd8c2fa2f73ff3c1883049caafc2/src/main/uni_hid_parser_ds4.c#L185
@@ -716,31 +726,35 @@ static void ds4_send_enable_lightbar_report(uni_hid_device_t* d) {
 
 static void ds4_parse_mouse(uni_hid_device_t* d, const ds4_input_report_11_t* r) {
     ds4_instance_t* ins = get_ds4_instance(d);
+    uni_touchpad_finger_t fingers[UNI_TOUCHPAD_FINGERS_MAX];
+    uint16_t x, y;
 
     // We can safely assume that device is connected and report is valid; otherwise
     // this function should have not been called.
 
-    if (r->num_touch_reports < 1) {
-        ins->prev_touch_active = false;
-        return;
-    }
-
     uni_controller_t* ctl = &d->controller;
-    const ds4_touch_point_t* point = &r->touches[0].points[0];
-
-    int x = (point->x_hi << 8) + point->x_lo;
-    int y = (point->y_hi << 4) + point->y_lo;
 
-    if (ins->prev_touch_active) {
-        ctl->mouse.delta_x = x - ins->x_prev;
-        ctl->mouse.delta_y = y - ins->y_prev;
-    } else {
-        ctl->mouse.delta_x = 0;
-        ctl->mouse.delta_y = 0;
+    // The report might have more than one touch frame, oldest first.
+    // Integrate all of them, otherwise fast swipes lose motion.
+    int num_frames = btstack_min(r->num_touch_reports, ARRAY_SIZE(r->touches));
+    uni_touchpad_begin(&ins->touchpad);
+    for (int i = 0; i < num_frames; i++) {
+        for (int j = 0; j < UNI_TOUCHPAD_FINGERS_MAX; j++) {
+            const ds4_touch_point_t* point = &r->touches[i].points[j];
+            // Bit 7: finger not touching. Bits 0-6: tracking id.
+            fingers[j].active = !(point->contact & BIT(7));
+            fingers[j].id = point->contact & 0x7f;
+            fingers[j].x = (point->x_hi << 8) + point->x_lo;
+            fingers[j].y = (point->y_hi << 4) + point->y_lo;
+        }
+        uni_touchpad_add_frame(&ins->touchpad, fingers);
     }
+    uni_touchpad_end(&ins->touchpad, &ctl->mouse);
 
+    ctl->mouse.buttons = 0;
     // "Click" on Touchpad
     if (r->buttons[2] & 0x02) {
+        uni_touchpad_get_position(&ins->touchpad, &x, &y);
         // Touchpad is divided in 0.75 (left) + 0.25 (right)
         // Touchpad range: 1920 x 942
         if (x < 1440)
@@ -750,12 +764,5 @@ static void ds4_parse_mouse(uni_hid_device_t* d, const ds4_input_report_11_t* r)
         // TODO: Support middle button.
     }
 
-    // Previous delta only if we are touching the touchpad.
-    ins->prev_touch_active = !(point->contact & BIT(7));
-
-    // Update prev regardless of whether it is valid.
-    ins->x_prev = x;
-    ins->y_prev = y;
-
     uni_hid_device_process_controller(d);
 }
@@ -16,6 +16,7 @@
 #include "uni_config.h"
 #include "uni_hid_device.h"
 #include "uni_log.h"
+#include "uni_touchpad.h"
 #include "uni_utils.h"
 
 #define DS5_FEATURE_REPORT_CALIBRATION 0x05
@@ -110,11 +111,8 @@ typedef struct {
     struct ds5_calibration_data gyro_calib_data[3];
     struct ds5_calibration_data accel_calib_data[3];
 
-    // Prev Touchpad values, to convert them from absolute
-    // coordinates into relative ones.
-    int x_prev;
-    int y_prev;
-    bool prev_touch_active;
+    // Touchpad to mouse. Used by the virtual mouse.
+    uni_touchpad_t touchpad;
 
 } ds5_instance_t;
 _Static_assert(sizeof(ds5_instance_t) < HID_DEVICE_MAX_PARSER_DATA, "DS5 instance too big");
@@ -158,7 +156,7 @@ typedef struct __attribute((packed)) {
     uint32_t crc32;
 } ds5_output_report_t;
 
-/* Touchpad. Not used, added for completeness. */
+/* Touchpad. Used by the virtual mouse. */
 typedef struct __attribute((packed)) {
     uint8_t contact;
     uint8_t x_lo;
@@ -406,6 +404,7 @@ void uni_hid_parser_ds5_init_report(uni_hid_device_t* d) {
 void uni_hid_parser_ds5_setup(uni_hid_device_t* d) {
     ds5_instance_t* ins = get_ds5_instance(d);
     memset(ins, 0, sizeof(*ins));
+    uni_touchpad_init(&ins->touchpad);
 
     // Default values for Accel / Gyro calibration data, until calibration is supported.
     for (size_t i = 0; i < ARRAY_SIZE(ins->accel_calib_data); i++) {
@@ -554,6 +553,16 @@ void uni_hid_parser_ds5_parse_feature_report(uni_hid_device_t* d, const uint8_t*
     }
 }
 
+bool uni_hid_parser_ds5_validate_input_report(uni_hid_device_t* d, const uint8_t* report, uint16_t len) {
+    ARG_UNUSED(d);
+
+    if (report[0] != 0x31 || len != 78)
+        return true;
+
+    // 0xa1: DATA | INPUT_REPORT
+    return uni_crc32_is_ps_report_valid(0xa1, report, len);
+}
+
 void uni_hid_parser_ds5_parse_input_report(uni_hid_device_t* d, const uint8_t* report, uint16_t len) {
     ds5_instance_t* ins = get_ds5_instance(d);
 
@@ -895,6 +904,8 @@ static void ds5_parse_mouse(uni_hid_device_t* d, const uint8_t* report, uint16_t
     ARG_UNUSED(len);
 
     ds5_instance_t* ins = get_ds5_instance(d);
+    uni_touchpad_finger_t fingers[UNI_TOUCHPAD_FINGERS_MAX];
+    uint16_t x, y;
 
     // We can safely assume that device is connected and report is valid; otherwise
     // this function should have not been called.
@@ -902,19 +913,22 @@ static void ds5_parse_mouse(uni_hid_device_t* d, const uint8_t* report, uint16_t
     uni_controller_t* ctl = &d->controller;
     const ds5_input_report_t* r = (ds5_input_report_t*)&report[2];
 
-    int x = (r->points[0].x_hi << 8) + r->points[0].x_lo;
-    int y = (r->points[0].y_hi << 4) + r->points[0].y_lo;
-
-    if (ins->prev_touch_active) {
-        ctl->mouse.delta_x = x - ins->x_prev;
-        ctl->mouse.delta_y = y - ins->y_prev;
-    } else {
-        ctl->mouse.delta_x = 0;
-        ctl->mouse.delta_y = 0;
+    // DualSense has one touch frame per report.
+    for (int j = 0; j < UNI_TOUCHPAD_FINGERS_MAX; j++) {
+        // Bit 7: finger not touching. Bits 0-6: tracking id.
+        fingers[j].active = !(r->points[j].contact & BIT(7));
+        fingers[j].id = r->points[j].contact & 0x7f;
+        fingers[j].x = (r->points[j].x_hi << 8) + r->points[j].x_lo;
+        fingers[j].y = (r->points[j].y_hi << 4) + r->points[j].y_lo;
     }
+    uni_touchpad_begin(&ins->touchpad);
+    uni_touchpad_add_frame(&ins->touchpad, fingers);
+    uni_touchpad_end(&ins->touchpad, &ctl->mouse);
 
+    ctl->mouse.buttons = 0;
     // "Click" on Touchpad
     if (r->buttons[2] & 0x02) {
+        uni_touchpad_get_position(&ins->touchpad, &x, &y);
         // Touchpad is divided in 0.75 (left) + 0.25 (right)
         // Touchpad range: 1920 x 1080
         if (x < 1440)
@@ -924,12 +938,5 @@ static void ds5_parse_mouse(uni_hid_device_t* d, const uint8_t* report, uint16_t
         // TODO: Support middle button.
     }
 
-    // Previous delta only if we are touching the touchpad.
-    ins->prev_touch_active = !(r->points[0].contact & BIT(7));
-
-    // Update prev regardless of whether it is valid.
-    ins->x_prev = x;
-    ins->y_prev = y;
-
     uni_hid_device_process_controller(d);
 }
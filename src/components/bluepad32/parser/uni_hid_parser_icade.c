@@ -7,6 +7,7 @@
 #include "hid_usage.h"
 #include "uni_common.h"
 #include "uni_hid_device.h"
+#include "uni_keymap.h"
 #include "uni_log.h"
 
 /*
@@ -55,6 +56,8 @@
  *  Start  ON,OFF  = u,f        : Mapped to "Home" button (debug)
  */
 
+// The mappings are defined in uni_keymap.c, and can be overridden by the user.
+
 // Different types of iCade devices. Mappings are slightly different.
 typedef enum {
     ICADE_CABINET,
@@ -98,201 +101,21 @@ void uni_hid_parser_icade_parse_usage(uni_hid_device_t* d,
     if (usage_page != HID_USAGE_PAGE_KEYBOARD_KEYPAD)
         return;
 
-    switch (usage) {
-        case 0x00:  // reserved. ignore
-        case 0xe0:  // from 0xe0 - 0xe7: ignore
-        case 0xe1:
-        case 0xe2:
-        case 0xe3:
-        case 0xe4:
-        case 0xe5:
-        case 0xe6:
-        case 0xe7:
-            break;
-        case HID_USAGE_KB_W:  // w (up on)
-            ctl->gamepad.dpad |= DPAD_UP;
-            break;
-        case HID_USAGE_KB_E:  // e (up off)
-            ctl->gamepad.dpad &= ~DPAD_UP;
-            break;
-        case HID_USAGE_KB_D:  // d (right on)
-            ctl->gamepad.dpad |= DPAD_RIGHT;
-            break;
-        case HID_USAGE_KB_C:  // c (right off)
-            ctl->gamepad.dpad &= ~DPAD_RIGHT;
-            break;
-        case HID_USAGE_KB_X:  // x (down on)
-            ctl->gamepad.dpad |= DPAD_DOWN;
-            break;
-        case HID_USAGE_KB_Z:  // z (down off)
-            ctl->gamepad.dpad &= ~DPAD_DOWN;
-            break;
-        case HID_USAGE_KB_A:  // a (left on)
-            ctl->gamepad.dpad |= DPAD_LEFT;
-            break;
-        case HID_USAGE_KB_Q:  // q (left off)
-            ctl->gamepad.dpad &= ~DPAD_LEFT;
-            break;
-
-        case HID_USAGE_KB_Y:  // y (button A / "select": on)
-            if (ins->model == ICADE_CABINET) {
-                // Cabinet.
-                ctl->gamepad.buttons |= BUTTON_A;
-            } else {
-                // 8-Bitty.
-                ctl->gamepad.misc_buttons |= MISC_BUTTON_SYSTEM;
-            }
-            break;
-        case HID_USAGE_KB_T:  // t (button A / "select": off)
-            if (ins->model == ICADE_CABINET) {
-                // Cabinet.
-                ctl->gamepad.buttons &= ~BUTTON_A;
-            } else {
-                // 8-Bitty.
-                ctl->gamepad.misc_buttons &= ~MISC_BUTTON_SYSTEM;
-            }
-            break;
-
-        case HID_USAGE_KB_H:  // h (button B / shoulder-left: on)
-            if (ins->model == ICADE_CABINET) {
-                // Cabinet.
-                ctl->gamepad.buttons |= BUTTON_B;
-            } else {
-                // 8-bitty.
-                ctl->gamepad.buttons |= BUTTON_SHOULDER_L;
-            }
-            break;
-        case HID_USAGE_KB_R:  // r (button B, shoulder-left: off)
-            if (ins->model == ICADE_CABINET) {
-                // Cabinet.
-                ctl->gamepad.buttons &= ~BUTTON_B;
-            } else {
-                // 8-bitty.
-                ctl->gamepad.buttons &= ~BUTTON_SHOULDER_L;
-            }
-            break;
-
-        case HID_USAGE_KB_U:  // u (button C / "start": on)
-            if (ins->model == ICADE_CABINET) {
-                // Cabinet.
-                ctl->gamepad.buttons |= BUTTON_X;
-            } else {
-                // 8-bitty.
-                ctl->gamepad.misc_buttons |= MISC_BUTTON_START;
-            }
-            break;
-        case HID_USAGE_KB_F:  // f (button C / "start": off)
-            if (ins->model == ICADE_CABINET) {
-                // Cabinet.
-                ctl->gamepad.buttons &= ~BUTTON_X;
-            } else {
-                // 8-bitty.
-                ctl->gamepad.misc_buttons &= ~MISC_BUTTON_START;
-            }
-            break;
-
-        case HID_USAGE_KB_J:  // j (button X / shoulder right: on)
-            if (ins->model == ICADE_CABINET) {
-                // Cabinet.
-                ctl->gamepad.buttons |= BUTTON_Y;
-            } else {
-                // 8-bitty.
-                ctl->gamepad.buttons |= BUTTON_SHOULDER_R;
-            }
-            break;
-        case HID_USAGE_KB_N:  // n (button X / shoulder right: off)
-            if (ins->model == ICADE_CABINET) {
-                // Cabinet.
-                ctl->gamepad.buttons &= ~BUTTON_Y;
-            } else {
-                // 8-bitty.
-                ctl->gamepad.buttons &= ~BUTTON_SHOULDER_R;
-            }
-            break;
-
-        case HID_USAGE_KB_O:  // o (button L / Y on)
-            if (ins->model == ICADE_CABINET) {
-                // Cabinet.
-                ctl->gamepad.misc_buttons |= MISC_BUTTON_SYSTEM;
-            } else {
-                // 8-bitty.
-                ctl->gamepad.buttons |= BUTTON_Y;
-            }
-            break;
-        case HID_USAGE_KB_G:  // g (button L / Y: off)
-            if (ins->model == ICADE_CABINET) {
-                // Cabinet.
-                ctl->gamepad.misc_buttons &= ~MISC_BUTTON_SYSTEM;
-            } else {
-                // 8-bitty.
-                ctl->gamepad.buttons &= ~BUTTON_Y;
-            }
-            break;
-
-        case HID_USAGE_KB_I:  // i (button Y / X: on)
-            if (ins->model == ICADE_CABINET) {
-                // Cabinet.
-                ctl->gamepad.misc_buttons |= MISC_BUTTON_START;
-            } else {
-                // 8-bitty.
-                ctl->gamepad.buttons |= BUTTON_X;
-            }
-            break;
-        case HID_USAGE_KB_M:  // m (button Y / X: off)
-            if (ins->model == ICADE_CABINET) {
-                // Cabinet.
-                ctl->gamepad.misc_buttons &= ~MISC_BUTTON_START;
-            } else {
-                // 8-bitty.
-                ctl->gamepad.buttons &= ~BUTTON_X;
-            }
-            break;
-
-        case HID_USAGE_KB_K:  // k (button  Z / A: on)
-            if (ins->model == ICADE_CABINET) {
-                // Cabinet.
-                ctl->gamepad.buttons |= BUTTON_SHOULDER_L;
-            } else {
-                // 8-bitty.
-                ctl->gamepad.buttons |= BUTTON_A;
-            }
-            break;
-        case HID_USAGE_KB_P:  // p (button Z / A: off)
-            if (ins->model == ICADE_CABINET) {
-                // Cabinet.
-                ctl->gamepad.buttons &= ~BUTTON_SHOULDER_L;
-            } else {
-                // 8-bitty.
-                ctl->gamepad.buttons &= ~BUTTON_A;
-            }
-            break;
-
-        case HID_USAGE_KB_L:  // l (button R / B: on)
-            if (ins->model == ICADE_CABINET) {
-                // Cabinet.
-                ctl->gamepad.buttons |= BUTTON_SHOULDER_R;
-            } else {
-                // 8-bitty.
-                ctl->gamepad.buttons |= BUTTON_B;
-            }
-            break;
-        case HID_USAGE_KB_V:  // v (button R / B: off)
-            if (ins->model == ICADE_CABINET) {
-                // Cabinet.
-                ctl->gamepad.buttons &= ~BUTTON_SHOULDER_R;
-            } else {
-                // 8-bitty.
-                ctl->gamepad.buttons &= ~BUTTON_B;
-            }
-            break;
+    // 0x00: reserved. 0xe0 - 0xe7: modifiers. Ignore them.
+    if (usage == 0x00 || (usage >= HID_USAGE_KB_LEFT_CONTROL && usage <= HID_USAGE_KB_RIGHT_GUI))
+        return;
 
-        default:
-            logi(
-                "iCade: Unsupported page: 0x%04x, usage: 0x%04x, "
-                "value=0x%x\n",
-                usage_page, usage, value);
-            break;
+    const uni_keymap_t* km = uni_keymap_get(ins->model == ICADE_CABINET ? UNI_KEYMAP_ID_ICADE_CABINET
+                                                                        : UNI_KEYMAP_ID_ICADE_8BITTY);
+    const uni_keymap_entry_t* e = uni_keymap_lookup(km, usage & 0xff);
+    if (usage > 0xff || e->target == UNI_KEYMAP_TARGET_NONE) {
+        logi(
+            "iCade: Unsupported page: 0x%04x, usage: 0x%04x, "
+            "value=0x%x\n",
+            usage_page, usage, value);
+        return;
     }
+    uni_keymap_apply_to_gamepad(e, &ctl->gamepad);
 }
 
 //
@@ -26,15 +26,34 @@ typedef struct {
     bool is_down_or_button;
 } keyboard_jx_05_t;
 
+// Key events not consumed yet. If full, the oldest events are dropped.
+// Must be a power of 2.
+#define KEYBOARD_EVENTS_MAX 32
+
 typedef struct {
     int pressed_key_index;
 
+    // Keyboard reported "roll over" in the current report: the keys state is not valid.
+    bool roll_over;
+    // Pressed keys in the previous report. Used to generate the key down / key up events.
+    uint32_t prev_pressed_bitmap[UNI_KEYBOARD_PRESSED_BITMAP_WORDS];
+
+    uni_keyboard_event_t events[KEYBOARD_EVENTS_MAX];
+    uint8_t events_head;
+    uint8_t events_count;
+    uint32_t events_dropped;
+
     // TODO: JX_05 parser should be moved to its own parser... when the Keyboard parser becomes unmaintainable.
     bool using_jx_05;
     keyboard_jx_05_t jx_05;
 } keyboard_instance_t;
+_Static_assert(sizeof(keyboard_instance_t) < HID_DEVICE_MAX_PARSER_DATA, "Keyboard intance too big");
+_Static_assert((KEYBOARD_EVENTS_MAX & (KEYBOARD_EVENTS_MAX - 1)) == 0, "KEYBOARD_EVENTS_MAX must be power of 2");
 
 static keyboard_instance_t* get_keyboard_instance(uni_hid_device_t* d);
+static void set_pressed_bit(uni_keyboard_t* kb, uint8_t usage);
+static void add_pressed_key(uni_hid_device_t* d, uint8_t usage);
+static void push_event(keyboard_instance_t* ins, uint8_t usage, bool pressed);
 
 static void jx_05_parse_usage(uni_hid_device_t* d,
                               hid_globals_t* globals,
@@ -42,7 +61,6 @@ static void jx_05_parse_usage(uni_hid_device_t* d,
                               uint16_t usage,
                               int32_t value) {
     keyboard_instance_t* ins = get_keyboard_instance(d);
-    int idx = ins->pressed_key_index;
 
     switch (usage_page) {
         case HID_USAGE_PAGE_GENERIC_DESKTOP:
@@ -88,9 +106,9 @@ static void jx_05_parse_usage(uni_hid_device_t* d,
 
                         // Button repeats the first and last (second) report coordinates
                         if (x == -260 && y == 145)
-                            d->controller.keyboard.pressed_keys[idx++] = HID_USAGE_KB_SPACEBAR;
+                            add_pressed_key(d, HID_USAGE_KB_SPACEBAR);
                         else
-                            d->controller.keyboard.pressed_keys[idx++] = HID_USAGE_KB_DOWN_ARROW;
+                            add_pressed_key(d, HID_USAGE_KB_DOWN_ARROW);
                     }
                     if (ins->jx_05.ready_to_process) {
                         // This is the last usage in the JX05 report.
@@ -102,17 +120,16 @@ static void jx_05_parse_usage(uni_hid_device_t* d,
                         //  x=-48,  y=251  / ... / x=-467, y=251, and tip_switch=false, "scroll right"
                         //  x=-260, y=145  / x=-260, y=145, and tip_switch=false, "button"
                         if (x == -260 && y == -222)
-                            d->controller.keyboard.pressed_keys[idx++] = HID_USAGE_KB_UP_ARROW;
+                            add_pressed_key(d, HID_USAGE_KB_UP_ARROW);
                         else if (x == -260 && y == 145)
                             // Could either be "down" or "press". The next packet decides
                             ins->jx_05.is_down_or_button = true;
                         else if (x == -387 && y == 251)
-                            d->controller.keyboard.pressed_keys[idx++] = HID_USAGE_KB_LEFT_ARROW;
+                            add_pressed_key(d, HID_USAGE_KB_LEFT_ARROW);
                         else if (x == -48 && y == 251)
-                            d->controller.keyboard.pressed_keys[idx++] = HID_USAGE_KB_RIGHT_ARROW;
+                            add_pressed_key(d, HID_USAGE_KB_RIGHT_ARROW);
                         else
                             break;
-                        ins->pressed_key_index = idx;
                         ins->jx_05.ready_to_process = false;
                     }
                     break;
@@ -148,6 +165,7 @@ void uni_hid_parser_keyboard_init_report(uni_hid_device_t* d) {
     // Reset pressed key index
     keyboard_instance_t* ins = get_keyboard_instance(d);
     ins->pressed_key_index = 0;
+    ins->roll_over = false;
 
     // Reset old state. Each report contains a full-state.
     uni_controller_t* ctl = &d->controller;
@@ -168,25 +186,19 @@ void uni_hid_parser_keyboard_parse_usage(uni_hid_device_t* d,
 
     logd("usage page=%#x, usage=%#x, value=%d\n", usage_page, usage, value);
 
-    int idx = ins->pressed_key_index;
     switch (usage_page) {
         case HID_USAGE_PAGE_KEYBOARD_KEYPAD:
             if (value) {
                 if (usage < HID_USAGE_KB_LEFT_CONTROL) {
-                    if (idx >= UNI_KEYBOARD_PRESSED_KEYS_MAX) {
-                        loge("Keyboard: Reached max keyboard keys, skipping page: %d, usage: %d, value: %d\n",
-                             usage_page, usage, value);
-                        return;
-                    }
                     // "usage" represents the pressed key.
                     // See: USB HID Usage Tables, Section 10 (page 53).
-                    d->controller.keyboard.pressed_keys[idx++] = usage;
-                    ins->pressed_key_index = idx;
+                    add_pressed_key(d, usage);
                 } else if (usage <= HID_USAGE_KB_RIGHT_GUI) {
                     // Value is between 0xe0 and 0xe7: the modifiers
                     // Modifier is between 0 - 7
                     uint8_t modifier = usage - HID_USAGE_KB_LEFT_CONTROL;
                     d->controller.keyboard.modifiers |= BIT(modifier);
+                    set_pressed_bit(&d->controller.keyboard, usage);
                 } else {
                     // Usage >= 0xe8, unsupported value.
                     logi("Keyboard: unsupported page:%d, usage:%d, value:%d\n", usage_page, usage, value);
@@ -206,41 +218,32 @@ void uni_hid_parser_keyboard_parse_usage(uni_hid_device_t* d,
                     break;
                 // Used by "TikTog Ring Controller"
                 case HID_USAGE_POWER:
-                    d->controller.keyboard.pressed_keys[idx++] = HID_USAGE_KB_POWER;
-                    ins->pressed_key_index = idx;
+                    add_pressed_key(d, HID_USAGE_KB_POWER);
                     break;
                 case HID_USAGE_VOLUME_UP:
-                    d->controller.keyboard.pressed_keys[idx++] = HID_USAGE_KB_VOLUME_UP;
-                    ins->pressed_key_index = idx;
+                    add_pressed_key(d, HID_USAGE_KB_VOLUME_UP);
                     break;
                 case HID_USAGE_VOLUME_DOWN:
-                    d->controller.keyboard.pressed_keys[idx++] = HID_USAGE_KB_VOLUME_DOWN;
-                    ins->pressed_key_index = idx;
+                    add_pressed_key(d, HID_USAGE_KB_VOLUME_DOWN);
                     break;
                 case HID_USAGE_AC_HOME:
-                    d->controller.keyboard.pressed_keys[idx++] = HID_USAGE_KB_HOME;
-                    ins->pressed_key_index = idx;
+                    add_pressed_key(d, HID_USAGE_KB_HOME);
                     break;
                 case HID_USAGE_AC_SCROLL_UP:
-                    d->controller.keyboard.pressed_keys[idx++] = HID_USAGE_KB_PAGE_UP;
-                    ins->pressed_key_index = idx;
+                    add_pressed_key(d, HID_USAGE_KB_PAGE_UP);
                     break;
                 case HID_USAGE_AC_SCROLL_DOWN:
-                    d->controller.keyboard.pressed_keys[idx++] = HID_USAGE_KB_PAGE_DOWN;
-                    ins->pressed_key_index = idx;
+                    add_pressed_key(d, HID_USAGE_KB_PAGE_DOWN);
                     break;
                 // Used by "5-button keyboard"
                 case HID_USAGE_SCAN_NEXT_TRACK:
-                    d->controller.keyboard.pressed_keys[idx++] = HID_USAGE_KB_RIGHT_ARROW;
-                    ins->pressed_key_index = idx;
+                    add_pressed_key(d, HID_USAGE_KB_RIGHT_ARROW);
                     break;
                 case HID_USAGE_SCAN_PREVIOUS_TRACK:
-                    d->controller.keyboard.pressed_keys[idx++] = HID_USAGE_KB_LEFT_ARROW;
-                    ins->pressed_key_index = idx;
+                    add_pressed_key(d, HID_USAGE_KB_LEFT_ARROW);
                     break;
                 case HID_USAGE_PLAY_PAUSE:
-                    d->controller.keyboard.pressed_keys[idx++] = HID_USAGE_KB_PAUSE;
-                    ins->pressed_key_index = idx;
+                    add_pressed_key(d, HID_USAGE_KB_PAUSE);
                     break;
                 default:
                     logi("Keyboard: Unsupported page: 0x%04x, usage: 0x%04x, value=0x%x\n", usage_page, usage, value);
@@ -255,14 +258,50 @@ void uni_hid_parser_keyboard_parse_usage(uni_hid_device_t* d,
     }
 }
 
+void uni_hid_parser_keyboard_finish_report(uni_hid_device_t* d) {
+    keyboard_instance_t* ins = get_keyboard_instance(d);
+    uni_keyboard_t* kb = &d->controller.keyboard;
+
+    if (ins->roll_over) {
+        // Too many keys pressed: the report doesn't say which ones.
+        // Keep the previous state, and don't generate events.
+        memcpy(kb->pressed_bitmap, ins->prev_pressed_bitmap, sizeof(kb->pressed_bitmap));
+        return;
+    }
+
+    // One XOR per 32 keys. Only the changed bits generate events.
+    for (int i = 0; i < UNI_KEYBOARD_PRESSED_BITMAP_WORDS; i++) {
+        uint32_t changed = kb->pressed_bitmap[i] ^ ins->prev_pressed_bitmap[i];
+        while (changed) {
+            int bit = __builtin_ctz(changed);
+            changed &= changed - 1;
+            push_event(ins, i * 32 + bit, (kb->pressed_bitmap[i] & BIT(bit)) != 0);
+        }
+        ins->prev_pressed_bitmap[i] = kb->pressed_bitmap[i];
+    }
+}
+
+bool uni_hid_parser_keyboard_pop_event(uni_hid_device_t* d, uni_keyboard_event_t* out) {
+    if (d->report_parser.finish_report != uni_hid_parser_keyboard_finish_report)
+        return false;
+
+    keyboard_instance_t* ins = get_keyboard_instance(d);
+    if (ins->events_count == 0)
+        return false;
+
+    *out = ins->events[ins->events_head];
+    ins->events_head = (ins->events_head + 1) & (KEYBOARD_EVENTS_MAX - 1);
+    ins->events_count--;
+    return true;
+}
+
 void uni_hid_parser_keyboard_device_dump(struct uni_hid_device_s* d) {
-    ARG_UNUSED(d);
+    keyboard_instance_t* ins = get_keyboard_instance(d);
 
-    logi("\tuni_hid_parser_keyboard_device_dump: implement me: \n");
+    logi("\tkeyboard: pending events=%d, dropped events=%u\n", ins->events_count, ins->events_dropped);
 }
 
 void uni_hid_parser_keyboard_set_leds(struct uni_hid_device_s* d, uint8_t led_bitmask) {
-    uint8_t status;
     gap_connection_type_t type;
 
     if (!d) {
@@ -274,10 +313,7 @@ void uni_hid_parser_keyboard_set_leds(struct uni_hid_device_s* d, uint8_t led_bi
 
     if (type == GAP_CONNECTION_LE) {
         // TODO: Which is the report Id ? Is it always 1 ?
-        status = hids_client_send_write_report(d->hids_cid, 1, HID_REPORT_TYPE_OUTPUT, &led_bitmask, 1);
-        // TODO: If error, it should retry
-        if (status != ERROR_CODE_SUCCESS)
-            logi("Keyboard: Failed to send LED report, error=%#x\n", status);
+        uni_hid_device_send_le_report(d, 1, &led_bitmask, 1);
     } else {
         logi("Keyboard: Set LED report not implemented for BR/EDR yet\n");
     }
@@ -287,3 +323,38 @@ void uni_hid_parser_keyboard_set_leds(struct uni_hid_device_s* d, uint8_t led_bi
 static keyboard_instance_t* get_keyboard_instance(uni_hid_device_t* d) {
     return (keyboard_instance_t*)&d->parser_data[0];
 }
+
+static void set_pressed_bit(uni_keyboard_t* kb, uint8_t usage) {
+    kb->pressed_bitmap[usage / 32] |= BIT(usage % 32);
+}
+
+static void add_pressed_key(uni_hid_device_t* d, uint8_t usage) {
+    keyboard_instance_t* ins = get_keyboard_instance(d);
+
+    if (usage <= HID_USAGE_KB_ERROR_UNDEFINED) {
+        // Not a key, but an error. "Roll over" is sent in all the slots when too many keys are pressed.
+        if (usage == HID_USAGE_KB_ERROR_ROLL_OVER)
+            ins->roll_over = true;
+    } else {
+        set_pressed_bit(&d->controller.keyboard, usage);
+    }
+
+    if (ins->pressed_key_index >= UNI_KEYBOARD_PRESSED_KEYS_MAX) {
+        loge("Keyboard: Reached max keyboard keys, skipping usage: %#x\n", usage);
+        return;
+    }
+    d->controller.keyboard.pressed_keys[ins->pressed_key_index++] = usage;
+}
+
+static void push_event(keyboard_instance_t* ins, uint8_t usage, bool pressed) {
+    if (ins->events_count == KEYBOARD_EVENTS_MAX) {
+        // Full: drop the oldest one
+        ins->events_head = (ins->events_head + 1) & (KEYBOARD_EVENTS_MAX - 1);
+        ins->events_count--;
+        ins->events_dropped++;
+    }
+    int idx = (ins->events_head + ins->events_count) & (KEYBOARD_EVENTS_MAX - 1);
+    ins->events[idx].usage = usage;
+    ins->events[idx].pressed = pressed;
+    ins->events_count++;
+}
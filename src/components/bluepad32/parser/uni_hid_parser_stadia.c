@@ -13,8 +13,6 @@
 
 #define STADIA_RUMBLE_REPORT_ID 0x05
 
-#define BLE_RETRY_MS 50
-
 struct stadia_ff_report {
     uint16_t strong_magnitude;  // Left: 2100 RPM
     uint16_t weak_magnitude;    // Right: 3350 RPM
@@ -103,7 +101,6 @@ void uni_hid_parser_stadia_play_dual_rumble(struct uni_hid_device_s* d,
 // Helpers
 //
 static void stadia_stop_rumble_now(uni_hid_device_t* d) {
-    uint8_t status;
     stadia_instance_t* ins = get_stadia_instance(d);
 
     // No need to protect it with a mutex since it runs in the same main thread
@@ -115,29 +112,13 @@ static void stadia_stop_rumble_now(uni_hid_device_t* d) {
         .weak_magnitude = 0,
     };
 
-    status = hids_client_send_write_report(d->hids_cid, STADIA_RUMBLE_REPORT_ID, HID_REPORT_TYPE_OUTPUT,
-                                           (const uint8_t*)&ff, sizeof(ff));
-    if (status == ERROR_CODE_COMMAND_DISALLOWED) {
-        logd("Stadia: Failed to turn off rumble, error=%#x, retrying...\n", status);
-        ins->rumble_timer_duration.process = &on_stadia_set_rumble_off;
-        ins->rumble_timer_duration.context = d;
-        ins->rumble_state = STATE_RUMBLE_IN_PROGRESS;
-
-        btstack_run_loop_set_timer(&ins->rumble_timer_duration, BLE_RETRY_MS);
-        btstack_run_loop_add_timer(&ins->rumble_timer_duration);
-    } else if (status != ERROR_CODE_SUCCESS) {
-        // Do nothing, just log the error
-        logi("Stadia: Failed to turn off rumble, error=%#x\n", status);
-    }
-    // else, SUCCESS
+    uni_hid_device_send_le_report(d, STADIA_RUMBLE_REPORT_ID, (const uint8_t*)&ff, sizeof(ff));
 }
 
 static void stadia_play_dual_rumble_now(uni_hid_device_t* d,
                                         uint16_t duration_ms,
                                         uint8_t weak_magnitude,
                                         uint8_t strong_magnitude) {
-    uint8_t status;
-
     stadia_instance_t* ins = get_stadia_instance(d);
 
     if (duration_ms == 0) {
@@ -151,22 +132,8 @@ static void stadia_play_dual_rumble_now(uni_hid_device_t* d,
         .weak_magnitude = weak_magnitude << 8,
     };
 
-    status = hids_client_send_write_report(d->hids_cid, STADIA_RUMBLE_REPORT_ID, HID_REPORT_TYPE_OUTPUT,
-                                           (const uint8_t*)&ff, sizeof(ff));
-    if (status == ERROR_CODE_COMMAND_DISALLOWED) {
-        logd("Stadia: Failed to send rumble report, error=%#x, retrying...\n", status);
-        ins->rumble_timer_delayed_start.process = &on_stadia_set_rumble_on;
-        ins->rumble_timer_delayed_start.context = d;
-        ins->rumble_state = STATE_RUMBLE_DELAYED;
-
-        btstack_run_loop_set_timer(&ins->rumble_timer_delayed_start, BLE_RETRY_MS);
-        btstack_run_loop_add_timer(&ins->rumble_timer_delayed_start);
-        return;
-    } else if (status != ERROR_CODE_SUCCESS) {
-        // Don't retry, just log the error and return
-        logi("Stadia: Failed to send rumble report, error=%#x\n", status);
-        return;
-    }
+    // Queued if there is a write in flight. Sent as soon as it is acknowledged.
+    uni_hid_device_send_le_report(d, STADIA_RUMBLE_REPORT_ID, (const uint8_t*)&ff, sizeof(ff));
 
     // Set timer to turn off rumble
     ins->rumble_timer_duration.process = &on_stadia_set_rumble_off;
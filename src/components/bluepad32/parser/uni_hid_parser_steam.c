@@ -10,11 +10,14 @@
 
 #include "parser/uni_hid_parser_steam.h"
 
+#include <string.h>
+
 #include "controller/uni_controller.h"
 #include "hid_usage.h"
 #include "uni_common.h"
 #include "uni_hid_device.h"
 #include "uni_log.h"
+#include "uni_system.h"
 
 // clang-format off
 #define STEAM_CONTROLLER_FLAG_BUTTONS       0x0010
@@ -27,9 +30,7 @@
 typedef enum {
     STATE_QUERY_SERVICE,
     STATE_QUERY_CHARACTERISTIC_REPORT,
-    STATE_QUERY_CLEAR_MAPPINGS,
-    STATE_QUERY_DISABLE_LIZARD,
-    STATE_QUERY_FORCEFEEDBACK,
+    STATE_QUERY_SETUP_COMMANDS,
     STATE_QUERY_END,
 } steam_query_state_t;
 
@@ -73,13 +74,13 @@ static uint8_t le_steam_characteristic_report_uuid[16] = {0x10, 0x0f, 0x6c, 0x34
 #define STEAM_REG_LPAD_CLICK_PRESSURE 0x34
 #define STEAM_REG_RPAD_CLICK_PRESSURE 0x35
 
-static uint8_t cmd_clear_mappings[] = {
+static const uint8_t cmd_clear_mappings[] = {
     0xc0, STEAM_CMD_CLEAR_MAPPINGS,  // Command
     0x01                             // Command Len
 };
 
 // clang-format off
-static uint8_t cmd_disable_lizard[] = {
+static const uint8_t cmd_disable_lizard[] = {
 	0xc0, STEAM_CMD_WRITE_REGISTER,    // Command
 	0x0f,                              // Command Len
 	STEAM_REG_GYRO_MODE,   0x00, 0x00, // Disable gyro/accel
@@ -90,17 +91,59 @@ static uint8_t cmd_disable_lizard[] = {
 };
 // clang-format on
 
-static gatt_client_service_t le_steam_service;
-static gatt_client_characteristic_t le_steam_characteristic_report;
-static hci_con_handle_t connection_handle;
-static uni_hid_device_t* device;
-static steam_query_state_t query_state;
+// Commands written to the "report" characteristic during setup, in order.
+static const struct {
+    const uint8_t* data;
+    uint16_t len;
+} setup_cmds[] = {
+    {cmd_clear_mappings, sizeof(cmd_clear_mappings)},
+    {cmd_disable_lizard, sizeof(cmd_disable_lizard)},
+};
 
+// Per-device state. Several Steam Controllers can be set up at the same time.
+typedef struct {
+    steam_query_state_t query_state;
+    // Index in setup_cmds of the command being written
+    uint8_t setup_cmd_idx;
+    gatt_client_service_t service;
+    gatt_client_characteristic_t characteristic_report;
+    // To measure the time it takes to set up the controller
+    uint64_t setup_start_us;
+} steam_instance_t;
+_Static_assert(sizeof(steam_instance_t) < HID_DEVICE_MAX_PARSER_DATA, "Steam instance too big");
+
+static steam_instance_t* get_steam_instance(uni_hid_device_t* d);
 static void parse_buttons(struct uni_hid_device_s* d, const uint8_t* data);
 static void parse_triggers(struct uni_hid_device_s* d, const uint8_t* data);
 static void parse_thumbstick(struct uni_hid_device_s* d, const uint8_t* data);
 static void parse_right_pad(struct uni_hid_device_s* d, const uint8_t* data);
 
+// Writes the next setup command. Commands that can't be written are skipped.
+// Returns false when there are no more commands.
+static bool write_next_setup_cmd(uni_hid_device_t* d);
+static void setup_complete(uni_hid_device_t* d);
+
+// GATT client events don't have a context, but all of them have the connection handle.
+// It is used to find the device.
+static uni_hid_device_t* get_device_for_event(uint8_t* packet) {
+    hci_con_handle_t con_handle;
+
+    switch (hci_event_packet_get_type(packet)) {
+        case GATT_EVENT_SERVICE_QUERY_RESULT:
+            con_handle = gatt_event_service_query_result_get_handle(packet);
+            break;
+        case GATT_EVENT_CHARACTERISTIC_QUERY_RESULT:
+            con_handle = gatt_event_characteristic_query_result_get_handle(packet);
+            break;
+        case GATT_EVENT_QUERY_COMPLETE:
+            con_handle = gatt_event_query_complete_get_handle(packet);
+            break;
+        default:
+            return NULL;
+    }
+    return uni_hid_device_get_instance_for_connection_handle(con_handle);
+}
+
 // TODO: Make it easier for "parsers" to write/read/get notified from characteristics
 static void handle_gatt_client_event(uint8_t packet_type, uint16_t channel, uint8_t* packet, uint16_t size) {
     uint8_t att_status;
@@ -112,26 +155,38 @@ static void handle_gatt_client_event(uint8_t packet_type, uint16_t channel, uint
         return;
 
     uint8_t event = hci_event_packet_get_type(packet);
-    switch (query_state) {
+    uni_hid_device_t* d = get_device_for_event(packet);
+    if (d == NULL) {
+        loge("Steam: Device not found for event: %#x\n", event);
+        return;
+    }
+    steam_instance_t* ins = get_steam_instance(d);
+
+    if (event == GATT_EVENT_QUERY_COMPLETE) {
+        att_status = gatt_event_query_complete_get_att_status(packet);
+        if (att_status != ATT_ERROR_SUCCESS) {
+            loge("Steam: Query failed in state %d, status %#x\n", ins->query_state, att_status);
+            // A failed setup command is not fatal: continue with the next one.
+            if (ins->query_state != STATE_QUERY_SETUP_COMMANDS) {
+                // Should disconnect (?)
+                // gap_disconnect(d->conn.handle);
+                return;
+            }
+        }
+    }
+
+    switch (ins->query_state) {
         case STATE_QUERY_SERVICE:
             switch (event) {
                 case GATT_EVENT_SERVICE_QUERY_RESULT:
                     // store service (we expect only one)
-                    gatt_event_service_query_result_get_service(packet, &le_steam_service);
+                    gatt_event_service_query_result_get_service(packet, &ins->service);
                     break;
                 case GATT_EVENT_QUERY_COMPLETE:
-                    att_status = gatt_event_query_complete_get_att_status(packet);
-                    if (att_status != ATT_ERROR_SUCCESS) {
-                        loge("Steam: SERVICE_QUERY_RESULT - Error status %x.\n", att_status);
-                        // Should disconnect (?)
-                        // gap_disconnect(connection_handle);
-                        break;
-                    }
                     // service query complete, look for characteristic report
-                    query_state = STATE_QUERY_CHARACTERISTIC_REPORT;
-                    gatt_client_discover_characteristics_for_service_by_uuid128(handle_gatt_client_event,
-                                                                                connection_handle, &le_steam_service,
-                                                                                le_steam_characteristic_report_uuid);
+                    ins->query_state = STATE_QUERY_CHARACTERISTIC_REPORT;
+                    gatt_client_discover_characteristics_for_service_by_uuid128(
+                        handle_gatt_client_event, d->conn.handle, &ins->service, le_steam_characteristic_report_uuid);
                     break;
                 default:
                     loge("Steam: Unknown event: %#x\n", event);
@@ -139,74 +194,70 @@ static void handle_gatt_client_event(uint8_t packet_type, uint16_t channel, uint
             break;
         case STATE_QUERY_CHARACTERISTIC_REPORT:
             switch (event) {
-                case GATT_EVENT_QUERY_COMPLETE:
-                    att_status = gatt_event_query_complete_get_att_status(packet);
-                    if (att_status != ATT_ERROR_SUCCESS) {
-                        loge("Steam: SERVICE_QUERY_RESULT - Error status %x.\n", att_status);
-                        // Should disconnect (?)
-                        // gap_disconnect(connection_handle);
-                        break;
-                    }
-                    gatt_client_write_value_of_characteristic(handle_gatt_client_event, connection_handle,
-                                                              le_steam_characteristic_report.value_handle,
-                                                              sizeof(cmd_clear_mappings), cmd_clear_mappings);
-                    query_state = STATE_QUERY_CLEAR_MAPPINGS;
-                    break;
                 case GATT_EVENT_CHARACTERISTIC_QUERY_RESULT:
-                    gatt_event_characteristic_query_result_get_characteristic(packet, &le_steam_characteristic_report);
+                    gatt_event_characteristic_query_result_get_characteristic(packet, &ins->characteristic_report);
                     break;
-                default:
-                    loge("Steam: Unknown event: %#x\n", event);
-            }
-            break;
-        case STATE_QUERY_CLEAR_MAPPINGS:
-            switch (event) {
                 case GATT_EVENT_QUERY_COMPLETE:
-                    att_status = gatt_event_query_complete_get_att_status(packet);
-                    if (att_status != ATT_ERROR_SUCCESS) {
-                        loge("Steam: SERVICE_QUERY_RESULT - Error status %x.\n", att_status);
-                        // Should disconnect (?)
-                        // gap_disconnect(connection_handle);
-                        break;
-                    }
-                    gatt_client_write_value_of_characteristic(handle_gatt_client_event, connection_handle,
-                                                              le_steam_characteristic_report.value_handle,
-                                                              sizeof(cmd_disable_lizard), cmd_disable_lizard);
-                    query_state = STATE_QUERY_DISABLE_LIZARD;
+                    // Characteristic is known: start writing the setup commands
+                    ins->query_state = STATE_QUERY_SETUP_COMMANDS;
+                    ins->setup_cmd_idx = 0;
+                    if (!write_next_setup_cmd(d))
+                        setup_complete(d);
                     break;
                 default:
                     loge("Steam: Unknown event: %#x\n", event);
             }
             break;
-        case STATE_QUERY_DISABLE_LIZARD:
-            switch (event) {
-                case GATT_EVENT_QUERY_COMPLETE:
-                    att_status = gatt_event_query_complete_get_att_status(packet);
-                    if (att_status != ATT_ERROR_SUCCESS) {
-                        loge("Steam: SERVICE_QUERY_RESULT - Error status %x.\n", att_status);
-                        // Should disconnect (?)
-                        // gap_disconnect(connection_handle);
-                        break;
-                    }
-                    uni_hid_device_set_ready_complete(device);
-                    query_state = STATE_QUERY_END;
-                    break;
-                default:
-                    loge("Steam: Unknown event: %#x\n", event);
+        case STATE_QUERY_SETUP_COMMANDS:
+            if (event != GATT_EVENT_QUERY_COMPLETE) {
+                loge("Steam: Unknown event: %#x\n", event);
+                break;
             }
+            ins->setup_cmd_idx++;
+            if (!write_next_setup_cmd(d))
+                setup_complete(d);
             break;
         case STATE_QUERY_END:
             // pass-through
         default:
-            loge("Steam: Unknown query state: %#x\n", query_state);
+            loge("Steam: Unknown query state: %#x\n", ins->query_state);
             break;
     }
 }
 
+static bool write_next_setup_cmd(uni_hid_device_t* d) {
+    steam_instance_t* ins = get_steam_instance(d);
+    uint8_t status;
+
+    // ATT allows only one pending request per connection, so the next command is written from
+    // the GATT_EVENT_QUERY_COMPLETE of the previous one.
+    // If the write can't be issued, no GATT_EVENT_QUERY_COMPLETE will arrive: skip the command.
+    while (ins->setup_cmd_idx < ARRAY_SIZE(setup_cmds)) {
+        status = gatt_client_write_value_of_characteristic(
+            handle_gatt_client_event, d->conn.handle, ins->characteristic_report.value_handle,
+            setup_cmds[ins->setup_cmd_idx].len, (uint8_t*)setup_cmds[ins->setup_cmd_idx].data);
+        if (status == ERROR_CODE_SUCCESS)
+            return true;
+        loge("Steam: Failed to write setup command %d, status: %#x\n", ins->setup_cmd_idx, status);
+        ins->setup_cmd_idx++;
+    }
+    return false;
+}
+
+static void setup_complete(uni_hid_device_t* d) {
+    steam_instance_t* ins = get_steam_instance(d);
+
+    ins->query_state = STATE_QUERY_END;
+    logi("Steam: setup completed in %d ms\n", (int)((uni_system_get_time_us() - ins->setup_start_us) / 1000));
+    uni_hid_device_set_ready_complete(d);
+}
+
 void uni_hid_parser_steam_setup(struct uni_hid_device_s* d) {
-    device = d;
-    connection_handle = d->conn.handle;
-    query_state = STATE_QUERY_SERVICE;
+    steam_instance_t* ins = get_steam_instance(d);
+
+    memset(ins, 0, sizeof(*ins));
+    ins->query_state = STATE_QUERY_SERVICE;
+    ins->setup_start_us = uni_system_get_time_us();
     gatt_client_discover_primary_services_by_uuid128(handle_gatt_client_event, d->conn.handle, le_steam_service_uuid);
 
     // Set the type of controller class once.
@@ -341,4 +392,11 @@ static void parse_right_pad(struct uni_hid_device_s* d, const uint8_t* data) {
 
     ctl->gamepad.axis_rx = (x >> 6);
     ctl->gamepad.axis_ry = (y >> 6);
+}
+
+//
+// Helpers
+//
+static steam_instance_t* get_steam_instance(uni_hid_device_t* d) {
+    return (steam_instance_t*)&d->parser_data[0];
 }
\ No newline at end of file
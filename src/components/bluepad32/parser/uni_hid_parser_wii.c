@@ -161,6 +161,7 @@ typedef struct wii_instance_s {
     uint16_t rumble_duration_ms;
 
     balance_board_calibration_t balance_board_calibration;
+    uni_balance_board_filter_t balance_board_filter;
 
     // Debug only
     int debug_fd;         // File descriptor where dump is saved
@@ -393,25 +394,34 @@ static void process_req_data_read_calibration_data2(uni_hid_device_t* d, const u
          ins->balance_board_calibration.kg34.tr, ins->balance_board_calibration.kg34.br,
          ins->balance_board_calibration.kg34.tl, ins->balance_board_calibration.kg34.bl);
 
+    // New calibration, start the filter from scratch.
+    uni_balance_board_filter_init(&ins->balance_board_filter);
+
     ins->state = WII_FSM_DEV_GUESSED;
     wii_process_fsm(d);
 }
 
 // Returns the calibrated weight in grams.
 static int32_t balance_interpolate(uint16_t val, uint16_t kg0, uint16_t kg17, uint16_t kg34) {
-    float weight = 0;
+    int32_t weight;
 
     // Each sensor can read up to 34kg, at least in theory.
     // It seems that it supports a bit more that's why we don't cap it to 34.
-    if (val < kg0) {
+    // Integer math, rounded to the nearest gram.
+    if (val < kg0 || kg17 <= kg0) {
         weight = 0;
     } else if (val < kg17) {
-        weight = 17 * (float)(val - kg0) / (float)(kg17 - kg0);
+        int32_t range = kg17 - kg0;
+        weight = (17000 * (int32_t)(val - kg0) + range / 2) / range;
     } else /* if (val < kg34) */ {
-        weight = 17 + 17 * (float)(val - kg17) / (float)(kg34 - kg17);
+        int32_t range = (kg34 > kg17) ? kg34 - kg17 : 1;
+        weight = 17000 + (17000 * (int32_t)(val - kg17) + range / 2) / range;
     }
 
-    return weight * 1000;
+    // Stored in uint16_t
+    if (weight > UINT16_MAX)
+        weight = UINT16_MAX;
+    return weight;
 }
 
 static void process_req_data_dump_eeprom(uni_hid_device_t* d, const uint8_t* report, uint16_t len) {
@@ -758,6 +768,7 @@ static void process_drm_kee(uni_hid_device_t* d, const uint8_t* report, uint16_t
         ctl->balance_board.tl = b.tl;
         ctl->balance_board.bl = b.bl;
         ctl->balance_board.temperature = b.temperature;
+        uni_balance_board_filter_process(&ins->balance_board_filter, &ctl->balance_board);
         ctl->battery = b.battery;
         if (ctl->battery < UNI_CONTROLLER_BATTERY_EMPTY)
             ctl->battery = UNI_CONTROLLER_BATTERY_EMPTY;
@@ -22,8 +22,6 @@
 
 #define XBOX_RUMBLE_REPORT_ID 0x03
 
-#define BLE_RETRY_MS 50
-
 static const uint16_t XBOX_WIRELESS_VID = 0x045e;  // Microsoft
 static const uint16_t XBOX_WIRELESS_PID = 0x02e0;  // Xbox One (Bluetooth)
 
@@ -56,6 +54,12 @@ enum xboxone_firmware {
     XBOXONE_FIRMWARE_V5,    // BLE version
 };
 
+static const char* firmware_names[] = {
+    "v3.1",
+    "v4.8",
+    "v5.x",
+};
+
 // Actuators for the force feedback (FF).
 enum {
     XBOXONE_FF_WEAK = BIT(0),
@@ -70,11 +74,6 @@ typedef enum {
     XBOXONE_STATE_RUMBLE_IN_PROGRESS,
 } xboxone_state_rumble_t;
 
-typedef enum {
-    XBOXONE_RETRY_CMD_RUMBLE_ON,
-    XBOXONE_RETRY_CMD_RUMBLE_OFF,
-} xboxone_retry_cmd_t;
-
 struct xboxone_ff_report {
     // Report related
     uint8_t transaction_type;  // type of transaction
@@ -114,6 +113,7 @@ typedef struct xboxone_instance_s {
 _Static_assert(sizeof(xboxone_instance_t) < HID_DEVICE_MAX_PARSER_DATA, "Xbox one instance too big");
 
 static xboxone_instance_t* get_xboxone_instance(uni_hid_device_t* d);
+static enum xboxone_firmware get_firmware_from_hid_descriptor(const uint8_t* descriptor, uint16_t len);
 static void on_xboxone_set_rumble_on(btstack_timer_source_t* ts);
 static void on_xboxone_set_rumble_off(btstack_timer_source_t* ts);
 static void xboxone_stop_rumble_now(uni_hid_device_t* d);
@@ -123,7 +123,6 @@ static void xboxone_play_quad_rumble_now(uni_hid_device_t* d,
                                          uint8_t trigger_right,
                                          uint8_t weak_magnitude,
                                          uint8_t strong_magnitude);
-static void xboxone_retry_cmd(uni_hid_device_t* d, xboxone_retry_cmd_t cmd);
 static void parse_usage_firmware_v3_1(uni_hid_device_t* d,
                                       hid_globals_t* globals,
                                       uint16_t usage_page,
@@ -154,19 +153,18 @@ bool uni_hid_parser_xboxone_does_name_match(struct uni_hid_device_s* d, const ch
 
 void uni_hid_parser_xboxone_setup(uni_hid_device_t* d) {
     xboxone_instance_t* ins = get_xboxone_instance(d);
-    // FIXME: Parse HID descriptor and see if it supports 0xf buttons. Checking
-    // for the len is a horrible hack.
-    if (gap_get_connection_type(d->conn.handle) == GAP_CONNECTION_LE) {
-        logi("Xbox: Assuming it is firmware v5.x\n");
+
+    if (gap_get_connection_type(d->conn.handle) == GAP_CONNECTION_LE)
         ins->version = XBOXONE_FIRMWARE_V5;
-    } else if (d->hid_descriptor_len > 330) {
-        logi("Xbox: Assuming it is firmware v4.8\n");
-        ins->version = XBOXONE_FIRMWARE_V4_8;
-    } else {
-        // If it is really firmware 4.8, it will be set later.
-        logi("Xbox: Assuming it is firmware v3.1\n");
-        ins->version = XBOXONE_FIRMWARE_V3_1;
-    }
+    else
+        ins->version = get_firmware_from_hid_descriptor(d->hid_descriptor, d->hid_descriptor_len);
+    logi("Xbox: Firmware %s detected\n", firmware_names[ins->version]);
+
+    // The version doesn't change: bind the parser directly, instead of checking the version on each usage.
+    if (ins->version == XBOXONE_FIRMWARE_V3_1)
+        d->report_parser.parse_usage = parse_usage_firmware_v3_1;
+    else
+        d->report_parser.parse_usage = parse_usage_firmware_v4_v5;
 
     uni_hid_device_set_ready_complete(d);
 }
@@ -179,6 +177,8 @@ void uni_hid_parser_xboxone_init_report(uni_hid_device_t* d) {
     ctl->klass = UNI_CONTROLLER_CLASS_GAMEPAD;
 }
 
+// Only used for the reports received before the setup. Afterwards the parser of the detected firmware
+// is called directly.
 void uni_hid_parser_xboxone_parse_usage(uni_hid_device_t* d,
                                         hid_globals_t* globals,
                                         uint16_t usage_page,
@@ -295,13 +295,6 @@ static void parse_usage_firmware_v3_1(uni_hid_device_t* d,
                     if (value)
                         ctl->gamepad.buttons |= BUTTON_THUMB_R;
                     break;
-                case 0x0f: {
-                    // Only available in firmware v4.8 / 5.x
-                    xboxone_instance_t* ins = get_xboxone_instance(d);
-                    ins->version = XBOXONE_FIRMWARE_V4_8;
-                    logi("Xbox: Firmware 4.8 / 5.x detected\n");
-                    break;
-                }
                 default:
                     logi("Xbox: Unsupported page: 0x%04x, usage: 0x%04x, value=0x%x\n", usage_page, usage, value);
                     break;
@@ -338,8 +331,6 @@ static void parse_usage_firmware_v4_v5(uni_hid_device_t* d,
     uint8_t hat;
     uni_controller_t* ctl = &d->controller;
 
-    xboxone_instance_t* ins = get_xboxone_instance(d);
-
     switch (usage_page) {
         case HID_USAGE_PAGE_GENERIC_DESKTOP:
             switch (usage) {
@@ -470,10 +461,6 @@ static void parse_usage_firmware_v4_v5(uni_hid_device_t* d,
                     // Model 1914: Share button
                     // Model 1708: reports it but always 0
                     // FW 5.x
-                    if (ins->version != XBOXONE_FIRMWARE_V5) {
-                        ins->version = XBOXONE_FIRMWARE_V5;
-                        logi("Xbox: Assuming it is firmware v5.x\n");
-                    }
                     if (value)
                         ctl->gamepad.misc_buttons |= MISC_BUTTON_CAPTURE;
                     break;
@@ -553,14 +540,9 @@ void xboxone_play_quad_rumble(struct uni_hid_device_s* d,
 }
 
 void uni_hid_parser_xboxone_device_dump(uni_hid_device_t* d) {
-    static const char* versions[] = {
-        "v3.1",
-        "v4.8",
-        "v5.x",
-    };
     xboxone_instance_t* ins = get_xboxone_instance(d);
-    if (ins->version >= 0 && ins->version < ARRAY_SIZE(versions))
-        logi("\tXbox: FW version %s\n", versions[ins->version]);
+    if (ins->version >= 0 && ins->version < ARRAY_SIZE(firmware_names))
+        logi("\tXbox: FW version %s\n", firmware_names[ins->version]);
 }
 
 //
@@ -570,30 +552,66 @@ xboxone_instance_t* get_xboxone_instance(uni_hid_device_t* d) {
     return (xboxone_instance_t*)&d->parser_data[0];
 }
 
-static void xboxone_retry_cmd(uni_hid_device_t* d, xboxone_retry_cmd_t cmd) {
-    xboxone_instance_t* ins = get_xboxone_instance(d);
-    ins->rumble_timer_delayed_start.context = d;
-
-    switch (cmd) {
-        case XBOXONE_RETRY_CMD_RUMBLE_ON:
-            ins->rumble_timer_delayed_start.process = &on_xboxone_set_rumble_on;
-            ins->rumble_state = XBOXONE_STATE_RUMBLE_DELAYED;
-            btstack_run_loop_set_timer(&ins->rumble_timer_delayed_start, BLE_RETRY_MS);
-            btstack_run_loop_add_timer(&ins->rumble_timer_delayed_start);
-            break;
-        case XBOXONE_RETRY_CMD_RUMBLE_OFF:
-            ins->rumble_timer_duration.process = &on_xboxone_set_rumble_off;
-            ins->rumble_state = XBOXONE_STATE_RUMBLE_IN_PROGRESS;
-            btstack_run_loop_set_timer(&ins->rumble_timer_duration, BLE_RETRY_MS);
-            btstack_run_loop_add_timer(&ins->rumble_timer_duration);
-            break;
-        default:
+// Walks the HID descriptor items, looking for the usages that are specific to each firmware:
+// - v3.1: buttons 0x01 - 0x0a
+// - v4.8: buttons 0x01 - 0x0f, Android-like mappings
+// - v5.x: like v4.8, plus the "Record" consumer usage (Share button)
+static enum xboxone_firmware get_firmware_from_hid_descriptor(const uint8_t* descriptor, uint16_t len) {
+    uint16_t usage_page = 0;
+    uint16_t max_button = 0;
+    bool has_record = false;
+    int i = 0;
+
+    while (i < len) {
+        uint8_t prefix = descriptor[i++];
+
+        // Long item: data size, tag, data. Not used by Xbox, skip it.
+        if (prefix == 0xfe) {
+            if (i >= len)
+                break;
+            i += 2 + descriptor[i];
+            continue;
+        }
+
+        int size = prefix & 0x03;
+        if (size == 3)
+            size = 4;
+        if (i + size > len)
             break;
+        uint32_t data = 0;
+        for (int j = 0; j < size; j++)
+            data |= (uint32_t)descriptor[i + j] << (j * 8);
+        i += size;
+
+        // Item tag + type, without the size
+        switch (prefix & 0xfc) {
+            case 0x04:  // Usage Page (global)
+                usage_page = data;
+                break;
+            case 0x08:    // Usage (local)
+            case 0x28: {  // Usage Maximum (local)
+                // 4-byte usages include the usage page
+                uint16_t page = (size == 4) ? (data >> 16) : usage_page;
+                uint16_t usage = data & 0xffff;
+                if (page == HID_USAGE_PAGE_BUTTON && usage > max_button)
+                    max_button = usage;
+                else if (page == HID_USAGE_PAGE_CONSUMER && usage == HID_USAGE_RECORD)
+                    has_record = true;
+                break;
+            }
+            default:
+                break;
+        }
     }
+
+    if (has_record)
+        return XBOXONE_FIRMWARE_V5;
+    if (max_button >= 0x0f)
+        return XBOXONE_FIRMWARE_V4_8;
+    return XBOXONE_FIRMWARE_V3_1;
 }
 
 static void xboxone_stop_rumble_now(uni_hid_device_t* d) {
-    uint8_t status;
     xboxone_instance_t* ins = get_xboxone_instance(d);
 
     // No need to protect it with a mutex since it runs in the same main thread
@@ -614,19 +632,10 @@ static void xboxone_stop_rumble_now(uni_hid_device_t* d) {
     };
 
     if (ins->version == XBOXONE_FIRMWARE_V5) {
-        status = hids_client_send_write_report(d->hids_cid, XBOX_RUMBLE_REPORT_ID, HID_REPORT_TYPE_OUTPUT,
-                                               &ff.enable_actuators,  // skip the first type bytes,
-                                               sizeof(ff) - 2         // subtract the 2 bytes from total
+        uni_hid_device_send_le_report(d, XBOX_RUMBLE_REPORT_ID,
+                                      &ff.enable_actuators,  // skip the first type bytes,
+                                      sizeof(ff) - 2         // subtract the 2 bytes from total
         );
-        if (status == ERROR_CODE_COMMAND_DISALLOWED) {
-            logd("Xbox: Failed to turn off rumble, error=%#x, retrying...\n", status);
-            xboxone_retry_cmd(d, XBOXONE_RETRY_CMD_RUMBLE_OFF);
-            return;
-        } else if (status != ERROR_CODE_SUCCESS) {
-            // Do nothing, log the error
-            logi("Xbox: Failed to turn off rumble, error=%#x\n", status);
-        }
-        // else, SUCCESS
     } else {
         uni_hid_device_send_intr_report(d, (uint8_t*)&ff, sizeof(ff));
     }
@@ -638,7 +647,6 @@ static void xboxone_play_quad_rumble_now(uni_hid_device_t* d,
                                          uint8_t right_trigger,
                                          uint8_t weak_magnitude,
                                          uint8_t strong_magnitude) {
-    uint8_t status;
     uint8_t mask = 0;
 
     xboxone_instance_t* ins = get_xboxone_instance(d);
@@ -674,19 +682,11 @@ static void xboxone_play_quad_rumble_now(uni_hid_device_t* d,
     };
 
     if (ins->version == XBOXONE_FIRMWARE_V5) {
-        status = hids_client_send_write_report(d->hids_cid, XBOX_RUMBLE_REPORT_ID, HID_REPORT_TYPE_OUTPUT,
-                                               &ff.enable_actuators,  // skip the first two bytes,
-                                               sizeof(ff) - 2         // subtract the two bytes from total
+        // Queued if there is a write in flight. Sent as soon as it is acknowledged.
+        uni_hid_device_send_le_report(d, XBOX_RUMBLE_REPORT_ID,
+                                      &ff.enable_actuators,  // skip the first two bytes,
+                                      sizeof(ff) - 2         // subtract the two bytes from total
         );
-        if (status == ERROR_CODE_COMMAND_DISALLOWED) {
-            logd("Xbox: Failed to send rumble report, error=%#x, retrying...\n", status);
-            xboxone_retry_cmd(d, XBOXONE_RETRY_CMD_RUMBLE_ON);
-            return;
-        } else if (status != ERROR_CODE_SUCCESS) {
-            // Don't retry, log the error and return
-            logi("Xbox: Failed to send rumble report, error=%#x\n", status);
-            return;
-        }
     } else {
         uni_hid_device_send_intr_report(d, (uint8_t*)&ff, sizeof(ff));
     }
@@ -19,8 +19,8 @@
 #include <esp_ota_ops.h>
 #include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
-#include <freertos/event_groups.h>
 #include <freertos/queue.h>
+#include <freertos/semphr.h>
 #include <hal/gpio_types.h>
 
 #include "sdkconfig.h"
@@ -33,6 +33,7 @@
 #include "controller/uni_gamepad.h"
 #include "controller/uni_keyboard.h"
 #include "hid_usage.h"
+#include "parser/uni_hid_parser_keyboard.h"
 #include "platform/uni_platform.h"
 #include "platform/uni_platform_unijoysticle_2.h"
 #include "platform/uni_platform_unijoysticle_2plus.h"
@@ -41,11 +42,14 @@
 #include "platform/uni_platform_unijoysticle_c64.h"
 #include "platform/uni_platform_unijoysticle_msx.h"
 #include "platform/uni_platform_unijoysticle_singleport.h"
+#include "uni_autofire.h"
 #include "uni_common.h"
 #include "uni_config.h"
 #include "uni_gpio.h"
+#include "uni_gpio_port.h"
 #include "uni_hid_device.h"
 #include "uni_joystick.h"
+#include "uni_led_pattern.h"
 #include "uni_log.h"
 #include "uni_mouse_quadrature.h"
 #include "uni_property.h"
@@ -82,9 +86,8 @@
 #define AUTOFIRE_CPS_COMPETITION_PRO (62)  // ~8ms, ~1/2 frame
 #define AUTOFIRE_CPS_DEFAULT AUTOFIRE_CPS_QUICKGUN
 
-#define TASK_AUTOFIRE_PRIO (9)
-#define TASK_PUSH_BUTTON_PRIO (8)
-#define TASK_BLINK_LED_PRIO (7)
+// Push buttons: the level must be stable for this long.
+#define PUSH_BUTTON_DEBOUNCE_US (30 * 1000)
 
 // Unijoysticle properties: Keep them sorted
 #define UNI_PROPERTY_NAME_UNI_AUTOFIRE_CPS "bp.uni.autofire"
@@ -100,16 +103,6 @@
 // They need to be scaled down, otherwise the pointer moves too fast.
 #define GAMEPAD_AXIS_TO_MOUSE_DELTA_RATIO (50)
 
-enum {
-    // Push buttons
-    EVENT_BUTTON_0 = UNI_PLATFORM_UNIJOYSTICLE_PUSH_BUTTON_0,
-    EVENT_BUTTON_1 = UNI_PLATFORM_UNIJOYSTICLE_PUSH_BUTTON_1,
-
-    // Autofire group
-    EVENT_AUTOFIRE_TRIGGER = 0,
-    EVENT_AUTOFIRE_CONFIG = 1,
-};
-
 typedef enum {
     // Unknown model
     BOARD_MODEL_UNK,
@@ -155,14 +148,17 @@ typedef enum {
 // The "fixed" part is stored in ROM.
 struct push_button_state {
     bool enabled;
-    int64_t last_time_pressed_us;  // in microseconds
+    // Debounced level
+    bool pressed;
+    // Re-armed at every edge. When it fires, the level has been stable for PUSH_BUTTON_DEBOUNCE_US.
+    esp_timer_handle_t debounce_timer;
 };
 
 // --- Function declaration
 
 static board_model_t get_uni_model_from_pins();
 static void set_gamepad_seat(uni_hid_device_t* d, uni_gamepad_seat_t seat);
-static void process_joystick(uni_hid_device_t* d, uni_gamepad_seat_t seat, const uni_joystick_t* joy);
+static void process_joystick(uni_hid_device_t* d, uni_gamepad_seat_t seat, uni_joystick_bits_t joy);
 static void process_mouse(uni_hid_device_t* d,
                           uni_gamepad_seat_t seat,
                           int32_t delta_x,
@@ -171,15 +167,18 @@ static void process_mouse(uni_hid_device_t* d,
 static void process_gamepad(uni_hid_device_t* d, uni_gamepad_t* gp);
 static void process_balance_board(uni_hid_device_t* d, uni_balance_board_t* bb);
 static void process_keyboard(uni_hid_device_t* d, uni_keyboard_t* kb);
-static void joy_update_port(const uni_joystick_t* joy, const gpio_num_t* gpios);
+static void joy_update_port(uni_joystick_bits_t joy,
+                            uni_gamepad_seat_t seat,
+                            const uni_gpio_port_t* port,
+                            const gpio_num_t* gpios);
 static void init_quadrature_mouse(void);
 static int get_mouse_emulation_from_nvs(void);
-// Interrupt handlers
-static void handle_event_button(int button_idx);
 // GPIO Interrupt handlers
 static void gpio_isr_handler_button(void* arg);
-_Noreturn static void pushbutton_event_task(void* arg);
-_Noreturn static void auto_fire_task(void* arg);
+static void push_button_init(int button_idx);
+static void autofire_init(void);
+static void autofire_set_active(uni_gamepad_seat_t seat, uni_joystick_bits_t buttons);
+static uni_joystick_bits_t autofire_buttons_from_joy(uni_joystick_bits_t joy);
 static void maybe_enable_mouse_timers(void);
 // Commands or Event related
 static int cmd_swap_ports(int argc, char** argv);
@@ -193,7 +192,9 @@ static void set_next_gamepad_mode(uni_hid_device_t* d);
 static void set_gamepad_mode(uni_hid_device_t* d, uni_platform_unijoysticle_gamepad_mode_t mode);
 static void get_gamepad_mode(uni_hid_device_t* d);
 static void version(void);
-static void blink_bt_led(int times);
+static void bt_led_init(void);
+static void bt_led_set_idle_level(bool level);
+static void blink_bt_led(int times, uni_led_pattern_priority_t priority);
 static void maybe_enable_bluetooth(bool enabled);
 
 // --- Consts (ROM)
@@ -231,18 +232,26 @@ _Static_assert(ARRAY_SIZE(properties) == (UNI_PROPERTY_IDX_UNI_LAST - UNI_PROPER
 static const struct uni_platform_unijoysticle_variant* g_variant;
 // Used as cache of g_variant->gpio_config
 static const struct uni_platform_unijoysticle_gpio_config* g_gpio_config;
-
-static EventGroupHandle_t g_pushbutton_group;
-static EventGroupHandle_t g_autofire_group;
+// Joystick ports, with the set/clear masks precomputed from g_gpio_config
+static uni_gpio_port_t g_port_a;
+static uni_gpio_port_t g_port_b;
 
 struct push_button_state g_push_buttons_state[UNI_PLATFORM_UNIJOYSTICLE_PUSH_BUTTON_MAX] = {0};
 
-// Autofire
-static bool g_autofire_a_enabled;
-static bool g_autofire_b_enabled;
+// Autofire. The engine is driven by a one-shot timer that is re-armed at every edge.
+// The mutex protects both the engine and the timer, since they are updated from the
+// Bluetooth task, the console and the timer callback. The timer callback never waits for it.
+static uni_autofire_t g_autofire;
+static esp_timer_handle_t g_autofire_timer;
+static SemaphoreHandle_t g_autofire_mutex;
+
+// Bluetooth LED. Blink patterns are driven by a one-shot timer that is re-armed at every edge.
+// The LED goes back to the "idle" level, "discovery mode enabled", when no pattern is playing.
+static uni_led_pattern_queue_t g_bt_led;
+static esp_timer_handle_t g_bt_led_timer;
+static SemaphoreHandle_t g_bt_led_mutex;
 
 // Button "mode". Used in A500/C64/800XL
-static int s_bluetooth_led_on;  // Used as a cache
 static bool s_auto_enable_bluetooth = true;
 // TODO: The Bluetooth Event should have an originator, instead of using this hack.
 // When True, it means the "Unijosyticle" generated the Bluetooth-Enable event.
@@ -259,6 +268,9 @@ static struct {
 
 static struct {
     struct arg_int* value;
+    struct arg_int* port;
+    struct arg_int* duty;
+    struct arg_int* button;
     struct arg_end* end;
 } autofire_cps_args;
 
@@ -325,11 +337,18 @@ static void unijoysticle_init(int argc, const char** argv) {
 
     ESP_ERROR_CHECK(gpio_config(&io_conf));
 
-    // Set low all joystick GPIOs... just in case.
+    int gpios_a[UNI_PLATFORM_UNIJOYSTICLE_JOY_MAX];
+    int gpios_b[UNI_PLATFORM_UNIJOYSTICLE_JOY_MAX];
     for (int i = 0; i < UNI_PLATFORM_UNIJOYSTICLE_JOY_MAX; i++) {
-        ESP_ERROR_CHECK(uni_gpio_set_level(g_gpio_config->port_a[i], 0));
-        ESP_ERROR_CHECK(uni_gpio_set_level(g_gpio_config->port_b[i], 0));
+        gpios_a[i] = g_gpio_config->port_a[i];
+        gpios_b[i] = g_gpio_config->port_b[i];
     }
+    uni_gpio_port_init(&g_port_a, gpios_a, UNI_PLATFORM_UNIJOYSTICLE_JOY_MAX);
+    uni_gpio_port_init(&g_port_b, gpios_b, UNI_PLATFORM_UNIJOYSTICLE_JOY_MAX);
+
+    // Set low all joystick GPIOs... just in case.
+    uni_gpio_port_write(&g_port_a, 0, UNI_JOYSTICK_BIT_LINES_MASK);
+    uni_gpio_port_write(&g_port_b, 0, UNI_JOYSTICK_BIT_LINES_MASK);
 
     // Turn On Player LEDs
     uni_gpio_set_level(g_gpio_config->leds[UNI_PLATFORM_UNIJOYSTICLE_LED_J1], 1);
@@ -337,15 +356,8 @@ static void unijoysticle_init(int argc, const char** argv) {
     // Turn off Bluetooth LED
     uni_gpio_set_level(g_gpio_config->leds[UNI_PLATFORM_UNIJOYSTICLE_LED_BT], 0);
 
-    // Tasks should be created before the ISR, just in case an interrupt
-    // gets called before the Task-that-handles-the-ISR gets triggered.
-
-    // Split "events" from "auto_fire", since auto-fire is an ongoing event.
-    g_pushbutton_group = xEventGroupCreate();
-    xTaskCreate(pushbutton_event_task, "bp.uni.button", 4096, NULL, TASK_PUSH_BUTTON_PRIO, NULL);
-
-    g_autofire_group = xEventGroupCreate();
-    xTaskCreate(auto_fire_task, "bp.uni.autofire", 4096, NULL, TASK_AUTOFIRE_PRIO, NULL);
+    bt_led_init();
+    autofire_init();
 
     // Push Buttons
     ESP_ERROR_CHECK(gpio_install_isr_service(0));
@@ -361,7 +373,8 @@ static void unijoysticle_init(int argc, const char** argv) {
             (g_gpio_config->push_buttons[i].gpio < GPIO_NUM_34) ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE;
         io_conf.pin_bit_mask = BIT64(g_gpio_config->push_buttons[i].gpio);
         ESP_ERROR_CHECK(gpio_config(&io_conf));
-        // "i" must match EVENT_BUTTON_0, value, etc.
+        // The debounce timer must exist before the ISR is installed.
+        push_button_init(i);
         ESP_ERROR_CHECK(gpio_isr_handler_add(g_gpio_config->push_buttons[i].gpio, gpio_isr_handler_button, (void*)i));
     }
 
@@ -409,7 +422,7 @@ static void unijoysticle_on_device_connected(uni_hid_device_t* d) {
     }
 
     // Blink when a connection is started
-    blink_bt_led(1);
+    blink_bt_led(1, UNI_LED_PATTERN_PRIORITY_NORMAL);
 }
 
 static void unijoysticle_on_device_disconnected(uni_hid_device_t* d) {
@@ -550,33 +563,6 @@ static bool test_gamepad_misc_button_pressed(uni_hid_device_t* d, uni_gamepad_t*
     return false;
 }
 
-static bool test_keyboard_key_pressed(uni_hid_device_t* d, uni_keyboard_t* kb, uint8_t usage_key, uint32_t key_mask) {
-    uni_platform_unijoysticle_instance_t* ins = uni_platform_unijoysticle_get_instance(d);
-    bool already_pressed = ins->debouncer & key_mask;
-    bool found = false;
-
-    // Only return true the first time it is pressed.
-    // Next time will occur when the button is released and pressed again.
-    for (int i = 0; i < UNI_KEYBOARD_PRESSED_KEYS_MAX; i++) {
-        // Assume not found if value is between 0 and 3, which are all errors.
-        if (kb->pressed_keys[i] < HID_USAGE_KB_ERROR_UNDEFINED)
-            break;
-        if (kb->pressed_keys[i] == usage_key) {
-            found = true;
-            break;
-        }
-    }
-    if (found) {
-        if (already_pressed)
-            return false;
-        ins->debouncer |= key_mask;
-        return true;
-    } else {
-        ins->debouncer &= ~key_mask;
-    }
-    return false;
-}
-
 static void test_gamepad_select_button(uni_hid_device_t* d, uni_gamepad_t* gp) {
     if (test_gamepad_misc_button_pressed(d, gp, MISC_BUTTON_SELECT))
         try_swap_ports(d);
@@ -587,18 +573,26 @@ static void test_gamepad_start_button(uni_hid_device_t* d, uni_gamepad_t* gp) {
         set_next_gamepad_mode(d);
 }
 
-static void test_keyboard_esc_key(uni_hid_device_t* d, uni_keyboard_t* kb) {
-    // FIXME: BUTTON_A should not be mapped to ESC.
-    // Define BIT constants for 32 keys (size of the bitmask)
-    if (test_keyboard_key_pressed(d, kb, HID_USAGE_KB_ESCAPE, BUTTON_A))
-        try_swap_ports(d);
-}
+static void process_keyboard_events(uni_hid_device_t* d) {
+    uni_keyboard_event_t ev;
 
-static void test_keyboard_tab_key(uni_hid_device_t* d, uni_keyboard_t* kb) {
-    // FIXME: BUTTON_B should not be mapped to Tab.
-    // Define BIT constants for 32 keys (size of the bitmask)
-    if (test_keyboard_key_pressed(d, kb, HID_USAGE_KB_TAB, BUTTON_B))
-        set_next_gamepad_mode(d);
+    // Edge events: a quick tap is not lost, even if it happens between reports.
+    while (uni_hid_parser_keyboard_pop_event(d, &ev)) {
+        if (!ev.pressed)
+            continue;
+        switch (ev.usage) {
+            case HID_USAGE_KB_ESCAPE:
+                // Swap
+                try_swap_ports(d);
+                break;
+            case HID_USAGE_KB_TAB:
+                // Change mode
+                set_next_gamepad_mode(d);
+                break;
+            default:
+                break;
+        }
+    }
 }
 
 static void unijoysticle_on_controller_data(uni_hid_device_t* d, uni_controller_t* ctl) {
@@ -635,8 +629,7 @@ static void unijoysticle_on_oob_event(uni_platform_oob_event_t event, void* data
         case UNI_PLATFORM_OOB_BLUETOOTH_ENABLED: {
             // Turn on/off the BT led
             bool enabled = (bool)data;
-            uni_gpio_set_level(g_gpio_config->leds[UNI_PLATFORM_UNIJOYSTICLE_LED_BT], enabled);
-            s_bluetooth_led_on = enabled;
+            bt_led_set_idle_level(enabled);
 
             logi("unijoysticle: Bluetooth discovery mode is %s\n", enabled ? "enabled" : "disabled");
 
@@ -820,8 +813,11 @@ static void unijoysticle_register_cmds(void) {
     gamepad_mode_args.value = arg_str1(NULL, NULL, "<mode>", "valid options: 'normal', 'twinstick' or 'mouse'");
     gamepad_mode_args.end = arg_end(2);
 
-    autofire_cps_args.value = arg_int1(NULL, NULL, "<cps>", "clicks per second (cps)");
-    autofire_cps_args.end = arg_end(2);
+    autofire_cps_args.value = arg_int0(NULL, NULL, "<cps>", "clicks per second (cps)");
+    autofire_cps_args.port = arg_int0("p", "port", "<1|2>", "only for the given port. Not saved");
+    autofire_cps_args.duty = arg_int0("d", "duty", "<1-99>", "percentage of the period that fire is pressed");
+    autofire_cps_args.button = arg_int0("b", "button", "<1|2|3>", "only for the given button. Not saved");
+    autofire_cps_args.end = arg_end(5);
 
     const esp_console_cmd_t swap_ports = {
         .command = "swap_ports",
@@ -845,7 +841,8 @@ static void unijoysticle_register_cmds(void) {
         .command = "autofire_cps",
         .help =
             "Get/Set the autofire 'clicks per second' (cps)\n"
-            "Default: 7",
+            "  Without --port and --button, the value is saved and used for all of them\n"
+            "  Default: 7, duty 50%",
         .hint = NULL,
         .func = &cmd_autofire_cps,
         .argtable = &autofire_cps_args,
@@ -1015,48 +1012,38 @@ static void process_mouse(uni_hid_device_t* d,
 
     if (buttons != prev_buttons) {
         prev_buttons = buttons;
-        int fire, button2, button3;
-        if (seat == GAMEPAD_SEAT_A) {
-            fire = g_gpio_config->port_a[UNI_PLATFORM_UNIJOYSTICLE_JOY_FIRE];
-            button2 = g_gpio_config->port_a[UNI_PLATFORM_UNIJOYSTICLE_JOY_BUTTON2];
-            button3 = g_gpio_config->port_a[UNI_PLATFORM_UNIJOYSTICLE_JOY_BUTTON3];
-        } else {
-            fire = g_gpio_config->port_b[UNI_PLATFORM_UNIJOYSTICLE_JOY_FIRE];
-            button2 = g_gpio_config->port_b[UNI_PLATFORM_UNIJOYSTICLE_JOY_BUTTON2];
-            button3 = g_gpio_config->port_b[UNI_PLATFORM_UNIJOYSTICLE_JOY_BUTTON3];
-        }
-        if (fire != -1)
-            gpio_set_level(fire, (buttons & BUTTON_A) != 0);
-        if (button2 != -1)
-            gpio_set_level(button2, (buttons & BUTTON_B) != 0);
-        if (button3 != -1)
-            gpio_set_level(button3, (buttons & BUTTON_X) != 0);
+        uni_joystick_bits_t joy = 0;
+        if (buttons & BUTTON_A)
+            joy |= UNI_JOYSTICK_BIT_FIRE;
+        if (buttons & BUTTON_B)
+            joy |= UNI_JOYSTICK_BIT_BUTTON2;
+        if (buttons & BUTTON_X)
+            joy |= UNI_JOYSTICK_BIT_BUTTON3;
+        uni_gpio_port_write((seat == GAMEPAD_SEAT_A) ? &g_port_a : &g_port_b, joy,
+                            UNI_JOYSTICK_BIT_FIRE | UNI_JOYSTICK_BIT_POT_MASK);
     }
 }
 
-static void process_joystick(uni_hid_device_t* d, uni_gamepad_seat_t seat, const uni_joystick_t* joy) {
+static void process_joystick(uni_hid_device_t* d, uni_gamepad_seat_t seat, uni_joystick_bits_t joy) {
     ARG_UNUSED(d);
-    if (seat == GAMEPAD_SEAT_A) {
-        joy_update_port(joy, g_gpio_config->port_a);
-        g_autofire_a_enabled = joy->auto_fire;
-    } else if (seat == GAMEPAD_SEAT_B) {
-        joy_update_port(joy, g_gpio_config->port_b);
-        g_autofire_b_enabled = joy->auto_fire;
-    } else {
+    if (seat != GAMEPAD_SEAT_A && seat != GAMEPAD_SEAT_B) {
         loge("unijoysticle: process_joystick: invalid gamepad seat: %d\n", seat);
+        return;
     }
 
-    if (g_autofire_a_enabled || g_autofire_b_enabled) {
-        xEventGroupSetBits(g_autofire_group, BIT(EVENT_AUTOFIRE_TRIGGER));
-    }
+    // Before updating the port: once autofire is off, the button lines belong to joy_update_port().
+    autofire_set_active(seat, autofire_buttons_from_joy(joy));
+
+    if (seat == GAMEPAD_SEAT_A)
+        joy_update_port(joy, seat, &g_port_a, g_gpio_config->port_a);
+    else
+        joy_update_port(joy, seat, &g_port_b, g_gpio_config->port_b);
 }
 
 static void process_gamepad(uni_hid_device_t* d, uni_gamepad_t* gp) {
     uni_platform_unijoysticle_instance_t* ins = uni_platform_unijoysticle_get_instance(d);
 
-    uni_joystick_t joy, joy_ext;
-    memset(&joy, 0, sizeof(joy));
-    memset(&joy_ext, 0, sizeof(joy_ext));
+    uni_joystick_bits_t joy, joy_ext;
 
     switch (ins->gamepad_mode) {
         case UNI_PLATFORM_UNIJOYSTICLE_GAMEPAD_MODE_NORMAL:
@@ -1064,20 +1051,20 @@ static void process_gamepad(uni_hid_device_t* d, uni_gamepad_t* gp) {
             // Use it as regular joystick
             if (d->controller_type == CONTROLLER_TYPE_WiiController &&
                 d->controller_subtype == CONTROLLER_SUBTYPE_WIIMOTE_ACCEL)
-                uni_joy_to_single_from_wii_accel(gp, &joy);
+                joy = uni_joy_bits_single_from_wii_accel(gp, &d->joy_analog);
             else
-                uni_joy_to_single_joy_from_gamepad(
-                    gp, &joy, g_variant->flags & UNI_PLATFORM_UNIJOYSTICLE_VARIANT_FLAG_TWO_BUTTONS);
-            process_joystick(d, ins->seat, &joy);
+                joy = uni_joy_bits_single_from_gamepad(
+                    gp, g_variant->flags & UNI_PLATFORM_UNIJOYSTICLE_VARIANT_FLAG_TWO_BUTTONS, &d->joy_analog);
+            process_joystick(d, ins->seat, joy);
             break;
         case UNI_PLATFORM_UNIJOYSTICLE_GAMEPAD_MODE_TWINSTICK:
-            uni_joy_to_twinstick_from_gamepad(gp, &joy, &joy_ext);
+            uni_joy_bits_twinstick_from_gamepad(gp, &d->joy_analog, &joy, &joy_ext);
             if (ins->swap_ports_in_twinstick) {
-                process_joystick(d, GAMEPAD_SEAT_B, &joy);
-                process_joystick(d, GAMEPAD_SEAT_A, &joy_ext);
+                process_joystick(d, GAMEPAD_SEAT_B, joy);
+                process_joystick(d, GAMEPAD_SEAT_A, joy_ext);
             } else {
-                process_joystick(d, GAMEPAD_SEAT_A, &joy);
-                process_joystick(d, GAMEPAD_SEAT_B, &joy_ext);
+                process_joystick(d, GAMEPAD_SEAT_A, joy);
+                process_joystick(d, GAMEPAD_SEAT_B, joy_ext);
             }
             break;
         case UNI_PLATFORM_UNIJOYSTICLE_GAMEPAD_MODE_MOUSE:
@@ -1113,43 +1100,37 @@ static void process_gamepad(uni_hid_device_t* d, uni_gamepad_t* gp) {
 static void process_balance_board(uni_hid_device_t* d, uni_balance_board_t* bb) {
     uni_platform_unijoysticle_instance_t* ins = uni_platform_unijoysticle_get_instance(d);
     uni_balance_board_state_t* bb_state = &ins->bb_state;
-    uni_joystick_t joy;
-    memset(&joy, 0, sizeof(joy));
 
-    uni_joy_to_single_joy_from_balance_board(bb, bb_state, &joy);
+    uni_joystick_bits_t joy = uni_joy_bits_single_from_balance_board(bb, bb_state);
 
-    process_joystick(d, ins->seat, &joy);
+    process_joystick(d, ins->seat, joy);
 }
 
 static void process_keyboard(uni_hid_device_t* d, uni_keyboard_t* kb) {
     uni_platform_unijoysticle_instance_t* ins = uni_platform_unijoysticle_get_instance(d);
-    uni_joystick_t joy, joy_ext;
-    memset(&joy, 0, sizeof(joy));
-    memset(&joy_ext, 0, sizeof(joy_ext));
+    uni_joystick_bits_t joy, joy_ext;
 
     switch (ins->gamepad_mode) {
         case UNI_PLATFORM_UNIJOYSTICLE_GAMEPAD_MODE_NORMAL:
-            uni_joy_to_single_joy_from_keyboard(kb, &joy);
-            process_joystick(d, ins->seat, &joy);
+            joy = uni_joy_bits_single_from_keyboard(kb);
+            process_joystick(d, ins->seat, joy);
             break;
         case UNI_PLATFORM_UNIJOYSTICLE_GAMEPAD_MODE_TWINSTICK:
-            uni_joy_to_twinstick_from_keyboard(kb, &joy, &joy_ext);
+            uni_joy_bits_twinstick_from_keyboard(kb, &joy, &joy_ext);
             if (ins->swap_ports_in_twinstick) {
-                process_joystick(d, GAMEPAD_SEAT_B, &joy);
-                process_joystick(d, GAMEPAD_SEAT_A, &joy_ext);
+                process_joystick(d, GAMEPAD_SEAT_B, joy);
+                process_joystick(d, GAMEPAD_SEAT_A, joy_ext);
             } else {
-                process_joystick(d, GAMEPAD_SEAT_A, &joy);
-                process_joystick(d, GAMEPAD_SEAT_B, &joy_ext);
+                process_joystick(d, GAMEPAD_SEAT_A, joy);
+                process_joystick(d, GAMEPAD_SEAT_B, joy_ext);
             }
             break;
         default:
             loge("Unijoysticle: Mode %d not supported with keyboard\n", ins->gamepad_mode);
     }
 
-    // Swap ?
-    test_keyboard_esc_key(d, kb);
-    // Change mode ?
-    test_keyboard_tab_key(d, kb);
+    // Swap ? Change mode ?
+    process_keyboard_events(d);
 }
 
 static void set_gamepad_seat(uni_hid_device_t* d, uni_gamepad_seat_t seat) {
@@ -1195,136 +1176,173 @@ static void set_gamepad_seat(uni_hid_device_t* d, uni_gamepad_seat_t seat) {
     }
 }
 
-static void joy_update_port(const uni_joystick_t* joy, const gpio_num_t* gpios) {
-    logd("up=%d, down=%d, left=%d, right=%d, fire=%d, bt2=%d, bt3=%d\n", joy->up, joy->down, joy->left, joy->right,
-         joy->fire, joy->button2, joy->button3);
+static void joy_update_port(uni_joystick_bits_t joy,
+                            uni_gamepad_seat_t seat,
+                            const uni_gpio_port_t* port,
+                            const gpio_num_t* gpios) {
+    logd("joy bits=0x%02x\n", joy);
 
-    uni_gpio_set_level(gpios[UNI_PLATFORM_UNIJOYSTICLE_JOY_UP], joy->up);
-    uni_gpio_set_level(gpios[UNI_PLATFORM_UNIJOYSTICLE_JOY_DOWN], joy->down);
-    uni_gpio_set_level(gpios[UNI_PLATFORM_UNIJOYSTICLE_JOY_LEFT], joy->left);
-    uni_gpio_set_level(gpios[UNI_PLATFORM_UNIJOYSTICLE_JOY_RIGHT], joy->right);
+    uint32_t lines = UNI_JOYSTICK_BIT_DIR_MASK | UNI_JOYSTICK_BIT_FIRE;
 
-    // Only update fire if auto-fire is off. Otherwise, it will conflict.
-    if (!joy->auto_fire) {
-        uni_gpio_set_level(gpios[UNI_PLATFORM_UNIJOYSTICLE_JOY_FIRE], joy->fire);
+    // Pots might need special treatment, like in the C64.
+    if (g_variant->set_gpio_level_for_pot) {
+        g_variant->set_gpio_level_for_pot(gpios[UNI_PLATFORM_UNIJOYSTICLE_JOY_BUTTON2],
+                                          !!(joy & UNI_JOYSTICK_BIT_BUTTON2));
+        g_variant->set_gpio_level_for_pot(gpios[UNI_PLATFORM_UNIJOYSTICLE_JOY_BUTTON3],
+                                          !!(joy & UNI_JOYSTICK_BIT_BUTTON3));
+    } else {
+        lines |= UNI_JOYSTICK_BIT_POT_MASK;
     }
 
-    if (g_variant->set_gpio_level_for_pot) {
-        g_variant->set_gpio_level_for_pot(gpios[UNI_PLATFORM_UNIJOYSTICLE_JOY_BUTTON2], joy->button2);
-        g_variant->set_gpio_level_for_pot(gpios[UNI_PLATFORM_UNIJOYSTICLE_JOY_BUTTON3], joy->button3);
+    // Lines in autofire mode are owned by the autofire timer. Otherwise, it will conflict.
+    lines &= ~autofire_buttons_from_joy(joy);
+
+    // All the lines of the port are updated at the same time.
+    if (g_variant->write_joy_port) {
+        uint64_t set_mask, clear_mask;
+        uni_gpio_port_get_masks(port, joy, lines, &set_mask, &clear_mask);
+        g_variant->write_joy_port(seat, set_mask, clear_mask);
     } else {
-        uni_gpio_set_level(gpios[UNI_PLATFORM_UNIJOYSTICLE_JOY_BUTTON2], joy->button2);
-        uni_gpio_set_level(gpios[UNI_PLATFORM_UNIJOYSTICLE_JOY_BUTTON3], joy->button3);
+        uni_gpio_port_write(port, joy, lines);
     }
 }
 
-_Noreturn static void pushbutton_event_task(void* arg) {
-    // timeout of 100s
-    const TickType_t xTicksToWait = pdMS_TO_TICKS(100000);
-    while (1) {
-        EventBits_t bits = xEventGroupWaitBits(g_pushbutton_group, BIT(EVENT_BUTTON_0) | BIT(EVENT_BUTTON_1), pdTRUE,
-                                               pdFALSE, xTicksToWait);
+//
+// Autofire
+//
 
-        // timeout ?
-        if (bits == 0)
-            continue;
+// Must be called with g_autofire_mutex taken.
+static void autofire_run_locked(void) {
+    uni_joystick_bits_t levels[UNI_AUTOFIRE_PORT_MAX];
+    const uni_gpio_port_t* ports[UNI_AUTOFIRE_PORT_MAX] = {&g_port_a, &g_port_b};
 
-        if (bits & BIT(EVENT_BUTTON_0))
-            handle_event_button(EVENT_BUTTON_0);
+    uint32_t next_us = uni_autofire_run(&g_autofire, esp_timer_get_time(), levels);
 
-        if (bits & BIT(EVENT_BUTTON_1))
-            handle_event_button(EVENT_BUTTON_1);
+    // Only the lines in autofire mode are touched. The rest are owned by process_joystick().
+    for (int i = 0; i < UNI_AUTOFIRE_PORT_MAX; i++) {
+        if (g_autofire.active[i])
+            uni_gpio_port_write(ports[i], levels[i], g_autofire.active[i]);
     }
+
+    // Fails if the timer is not running. Safe to ignore.
+    esp_timer_stop(g_autofire_timer);
+    if (next_us)
+        ESP_ERROR_CHECK(esp_timer_start_once(g_autofire_timer, next_us));
 }
 
-_Noreturn static void auto_fire_task(void* arg) {
-    // timeout of 100s
-    const TickType_t timeout = pdMS_TO_TICKS(100000);
-    int ms = 1000 / get_autofire_cps_from_nvs() / 2;
-    TickType_t delay_ticks = pdMS_TO_TICKS(ms);
-    while (1) {
-        EventBits_t bits = xEventGroupWaitBits(
-            g_autofire_group, BIT(EVENT_AUTOFIRE_TRIGGER) | BIT(EVENT_AUTOFIRE_CONFIG), pdTRUE, pdFALSE, timeout);
+static void autofire_timer_cb(void* arg) {
+    ARG_UNUSED(arg);
+    // Don't block the esp_timer task: the other timers would be delayed as well.
+    // If the mutex is taken, the holder runs the engine and re-arms the timer before releasing it.
+    if (xSemaphoreTake(g_autofire_mutex, 0) != pdTRUE)
+        return;
+    autofire_run_locked();
+    xSemaphoreGive(g_autofire_mutex);
+}
 
-        // timeout ?
-        if (bits == 0)
-            continue;
+static void autofire_init(void) {
+    const esp_timer_create_args_t args = {
+        .callback = &autofire_timer_cb,
+        .name = "bp.uni.autofire",
+    };
 
-        if (bits & BIT(EVENT_AUTOFIRE_CONFIG)) {
-            ms = 1000 / get_autofire_cps_from_nvs() / 2;
-            delay_ticks = pdMS_TO_TICKS(ms);
-        }
+    uni_autofire_init(&g_autofire, get_autofire_cps_from_nvs());
+    g_autofire_mutex = xSemaphoreCreateMutex();
+    ESP_ERROR_CHECK(esp_timer_create(&args, &g_autofire_timer));
+}
 
-        if (bits & BIT(EVENT_AUTOFIRE_TRIGGER)) {
-            while (g_autofire_a_enabled || g_autofire_b_enabled) {
-                if (g_autofire_a_enabled)
-                    uni_gpio_set_level(g_gpio_config->port_a[UNI_PLATFORM_UNIJOYSTICLE_JOY_FIRE], 1);
-                if (g_autofire_b_enabled)
-                    uni_gpio_set_level(g_gpio_config->port_b[UNI_PLATFORM_UNIJOYSTICLE_JOY_FIRE], 1);
+// While "auto fire" is held, fire is toggled. And so are Button 2 / 3, while they are held as well.
+// Pots that need special treatment, like in the C64, are not toggled.
+static uni_joystick_bits_t autofire_buttons_from_joy(uni_joystick_bits_t joy) {
+    uni_joystick_bits_t buttons;
 
-                vTaskDelay(delay_ticks);
+    if (!(joy & UNI_JOYSTICK_BIT_AUTO_FIRE))
+        return 0;
 
-                if (g_autofire_a_enabled)
-                    uni_gpio_set_level(g_gpio_config->port_a[UNI_PLATFORM_UNIJOYSTICLE_JOY_FIRE], 0);
-                if (g_autofire_b_enabled)
-                    uni_gpio_set_level(g_gpio_config->port_b[UNI_PLATFORM_UNIJOYSTICLE_JOY_FIRE], 0);
+    buttons = UNI_JOYSTICK_BIT_FIRE;
+    if (!g_variant->set_gpio_level_for_pot)
+        buttons |= joy & UNI_JOYSTICK_BIT_POT_MASK;
+    return buttons;
+}
 
-                vTaskDelay(delay_ticks);
-            }
-        }
+static void autofire_set_active(uni_gamepad_seat_t seat, uni_joystick_bits_t buttons) {
+    int port_idx = (seat == GAMEPAD_SEAT_A) ? 0 : 1;
+
+    // Called for every report. Only reschedule when the buttons change.
+    if (g_autofire.active[port_idx] == buttons)
+        return;
+
+    xSemaphoreTake(g_autofire_mutex, portMAX_DELAY);
+    uni_autofire_set_active(&g_autofire, port_idx, buttons, esp_timer_get_time());
+    autofire_run_locked();
+    xSemaphoreGive(g_autofire_mutex);
+}
+
+// port_idx: -1 means both ports.
+// buttons: any of UNI_AUTOFIRE_BUTTONS_MASK.
+static int autofire_set_rate(int port_idx, uni_joystick_bits_t buttons, int cps, int duty) {
+    int ret = 0;
+
+    xSemaphoreTake(g_autofire_mutex, portMAX_DELAY);
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < UNI_AUTOFIRE_PORT_MAX; i++) {
+        if (port_idx != -1 && port_idx != i)
+            continue;
+        ret |= uni_autofire_set_rate(&g_autofire, i, buttons, cps, duty, now);
     }
+    // Apply the new rate immediately, even if fire is being held.
+    autofire_run_locked();
+    xSemaphoreGive(g_autofire_mutex);
+
+    return ret;
 }
 
 static void gpio_isr_handler_button(void* arg) {
     int button_idx = (int)arg;
-
-    // Stored din ROM
-    const struct uni_platform_unijoysticle_push_button* pb = &g_gpio_config->push_buttons[button_idx];
-    // Stored in RAM
     struct push_button_state* st = &g_push_buttons_state[button_idx];
 
-    // Button released?
-    if (gpio_get_level(pb->gpio)) {
-        st->last_time_pressed_us = esp_timer_get_time();
-        return;
-    }
-
-    // Button pressed
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    xEventGroupSetBitsFromISR(g_pushbutton_group, BIT(button_idx), &xHigherPriorityTaskWoken);
-    if (xHigherPriorityTaskWoken == pdTRUE)
-        portYIELD_FROM_ISR();
+    // Every edge restarts the debounce period. Both functions can be called from an ISR.
+    // Fails if the timer is not running. Safe to ignore.
+    esp_timer_stop(st->debounce_timer);
+    esp_timer_start_once(st->debounce_timer, PUSH_BUTTON_DEBOUNCE_US);
 }
 
-static void handle_event_button(int button_idx) {
-    // Basic software debouncer. If it fails, it could be improved with:
-    // https://hackaday.com/2015/12/10/embed-with-elliot-debounce-your-noisy-buttons-part-ii/
-    const int64_t button_threshold_time_us = 300 * 1000;  // 300ms
+static void push_button_timer_cb(void* arg) {
+    int button_idx = (int)arg;
 
     // Stored in ROM
     const struct uni_platform_unijoysticle_push_button* pb = &g_gpio_config->push_buttons[button_idx];
     // Stored in RAM
     struct push_button_state* st = &g_push_buttons_state[button_idx];
 
-    // Regardless of the state, ignore the event if not enough time passed.
-    int64_t now = esp_timer_get_time();
-    if ((now - st->last_time_pressed_us) < button_threshold_time_us)
+    // Stable for PUSH_BUTTON_DEBOUNCE_US. Active low.
+    bool pressed = !gpio_get_level(pb->gpio);
+    if (pressed == st->pressed)
         return;
+    st->pressed = pressed;
 
-    st->last_time_pressed_us = now;
-
-    // "up" button is released. Ignore event.
-    if (gpio_get_level(pb->gpio)) {
+    // Only "down" generates an event.
+    if (!pressed)
         return;
-    }
 
-    // "down", button pressed.
-    logi("handle_event_button(%d): %d -> %d\n", button_idx, st->enabled, !st->enabled);
+    logi("push button %d: %d -> %d\n", button_idx, st->enabled, !st->enabled);
 
     st->enabled = !st->enabled;
     pb->callback(button_idx);
 }
 
+static void push_button_init(int button_idx) {
+    const esp_timer_create_args_t args = {
+        .callback = &push_button_timer_cb,
+        .arg = (void*)button_idx,
+        .name = "bp.uni.button",
+    };
+    struct push_button_state* st = &g_push_buttons_state[button_idx];
+
+    st->pressed = !gpio_get_level(g_gpio_config->push_buttons[button_idx].gpio);
+    ESP_ERROR_CHECK(esp_timer_create(&args, &st->debounce_timer));
+}
+
 static void cmd_callback(void* context) {
     uni_platform_unijoysticle_cmd_t cmd = (uni_platform_unijoysticle_cmd_t)context;
     switch (cmd) {
@@ -1358,6 +1376,9 @@ static void cmd_callback(void* context) {
         case UNI_PLATFORM_UNIJOYSTICLE_CMD_SET_C64_POT_MODE_PADDLE:
             uni_platform_unijoysticle_c64_set_pot_mode(UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_PADDLE);
             break;
+        case UNI_PLATFORM_UNIJOYSTICLE_CMD_SET_C64_POT_MODE_SYNC:
+            uni_platform_unijoysticle_c64_set_pot_mode(UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_SYNC);
+            break;
         default:
             loge("Unijoysticle: invalid command: %d\n", cmd);
             break;
@@ -1528,13 +1549,13 @@ static void set_gamepad_mode(uni_hid_device_t* d, uni_platform_unijoysticle_game
 
                 // Reset to "normal" mode
                 ins->gamepad_mode = UNI_PLATFORM_UNIJOYSTICLE_GAMEPAD_MODE_NORMAL;
-                blink_bt_led(1);
+                blink_bt_led(1, UNI_LED_PATTERN_PRIORITY_HIGH);
                 logi("unijoysticle: Gamepad mode = normal\n");
                 break;
             }
 
             ins->gamepad_mode = UNI_PLATFORM_UNIJOYSTICLE_GAMEPAD_MODE_TWINSTICK;
-            blink_bt_led(3);
+            blink_bt_led(3, UNI_LED_PATTERN_PRIORITY_HIGH);
 
             ins->prev_seat = ins->seat;
             set_gamepad_seat(d, GAMEPAD_SEAT_A | GAMEPAD_SEAT_B);
@@ -1549,7 +1570,7 @@ static void set_gamepad_mode(uni_hid_device_t* d, uni_platform_unijoysticle_game
                 maybe_enable_bluetooth(num_devices < 2);
             }
             ins->gamepad_mode = UNI_PLATFORM_UNIJOYSTICLE_GAMEPAD_MODE_MOUSE;
-            blink_bt_led(2);
+            blink_bt_led(2, UNI_LED_PATTERN_PRIORITY_HIGH);
             logi("unijoysticle: Gamepad mode = mouse\n");
             break;
 
@@ -1559,7 +1580,7 @@ static void set_gamepad_mode(uni_hid_device_t* d, uni_platform_unijoysticle_game
                 maybe_enable_bluetooth(num_devices < 2);
             }
             ins->gamepad_mode = UNI_PLATFORM_UNIJOYSTICLE_GAMEPAD_MODE_NORMAL;
-            blink_bt_led(1);
+            blink_bt_led(1, UNI_LED_PATTERN_PRIORITY_HIGH);
             logi("unijoysticle: Gamepad mode = normal\n");
             break;
 
@@ -1619,7 +1640,7 @@ static void swap_ports(void) {
             if (ins->gamepad_mode == UNI_PLATFORM_UNIJOYSTICLE_GAMEPAD_MODE_TWINSTICK) {
                 // Swap is done in the "Twin Stick" mode driver.
                 ins->swap_ports_in_twinstick = !ins->swap_ports_in_twinstick;
-                blink_bt_led(1);
+                blink_bt_led(1, UNI_LED_PATTERN_PRIORITY_HIGH);
                 return;
             }
 
@@ -1631,14 +1652,12 @@ static void swap_ports(void) {
     }
 
     // Clear joystick after switch to avoid having a line "On".
-    uni_joystick_t joy;
-    memset(&joy, 0, sizeof(joy));
-    process_joystick(d, GAMEPAD_SEAT_A, &joy);
-    process_joystick(d, GAMEPAD_SEAT_B, &joy);
+    process_joystick(d, GAMEPAD_SEAT_A, 0);
+    process_joystick(d, GAMEPAD_SEAT_B, 0);
 
     maybe_enable_mouse_timers();
 
-    blink_bt_led(1);
+    blink_bt_led(1, UNI_LED_PATTERN_PRIORITY_HIGH);
 }
 
 // Call this function, instead of "swap_ports" when the user requested
@@ -1711,23 +1730,51 @@ static int cmd_swap_ports(int argc, char** argv) {
 }
 
 static int cmd_autofire_cps(int argc, char** argv) {
-    int cps;
+    // Console "button" numbers: 1 is fire, 2 and 3 are the pots.
+    static const uni_joystick_bits_t autofire_buttons[] = {UNI_JOYSTICK_BIT_FIRE, UNI_JOYSTICK_BIT_BUTTON2,
+                                                           UNI_JOYSTICK_BIT_BUTTON3};
 
     int nerrors = arg_parse(argc, argv, (void**)&autofire_cps_args);
-    if (nerrors != 0) {
-        arg_print_errors(stderr, autofire_cps_args.end, argv[0]);
-
-        // Don't treat as error, just print current value.
-        cps = get_autofire_cps_from_nvs();
-        logi("%d\n", cps);
+    if (nerrors != 0 || autofire_cps_args.value->count == 0) {
+        if (nerrors != 0)
+            arg_print_errors(stderr, autofire_cps_args.end, argv[0]);
+
+        // Don't treat as error, just print current values.
+        logi("%d\n", get_autofire_cps_from_nvs());
+        for (int i = 0; i < UNI_AUTOFIRE_PORT_MAX; i++) {
+            for (size_t j = 0; j < ARRAY_SIZE(autofire_buttons); j++) {
+                const uni_autofire_channel_t* ch = &g_autofire.channels[i][__builtin_ctz(autofire_buttons[j])];
+                logi("Port %c, button %d: period=%uus, on=%uus\n", 'A' + i, (int)j + 1, (unsigned)ch->period_us,
+                     (unsigned)ch->on_us);
+            }
+        }
         return 0;
     }
-    cps = autofire_cps_args.value->ival[0];
-    set_autofire_cps_to_nvs(cps);
 
-    logi("New autofire cps: %d\n", cps);
+    int cps = autofire_cps_args.value->ival[0];
+    int duty = autofire_cps_args.duty->count ? autofire_cps_args.duty->ival[0] : UNI_AUTOFIRE_DUTY_DEFAULT;
+    int port_idx = autofire_cps_args.port->count ? autofire_cps_args.port->ival[0] - 1 : -1;
+    if (autofire_cps_args.port->count && (port_idx < 0 || port_idx >= UNI_AUTOFIRE_PORT_MAX)) {
+        loge("Invalid port: %d\n", port_idx + 1);
+        return 1;
+    }
+    int button_idx = autofire_cps_args.button->count ? autofire_cps_args.button->ival[0] - 1 : -1;
+    if (autofire_cps_args.button->count && (button_idx < 0 || button_idx >= (int)ARRAY_SIZE(autofire_buttons))) {
+        loge("Invalid button: %d\n", button_idx + 1);
+        return 1;
+    }
+    uni_joystick_bits_t buttons = (button_idx == -1) ? UNI_AUTOFIRE_BUTTONS_MASK : autofire_buttons[button_idx];
+
+    if (autofire_set_rate(port_idx, buttons, cps, duty) != 0) {
+        loge("Invalid cps / duty: %d / %d\n", cps, duty);
+        return 1;
+    }
+
+    // Only the "all ports, all buttons" value is saved, and only the cps.
+    if (port_idx == -1 && button_idx == -1)
+        set_autofire_cps_to_nvs(cps);
 
-    xEventGroupSetBits(g_autofire_group, BIT(EVENT_AUTOFIRE_CONFIG));
+    logi("New autofire cps: %d, duty: %d%%\n", cps, duty);
     return 0;
 }
 
@@ -1769,23 +1816,62 @@ static void maybe_enable_mouse_timers(void) {
         uni_mouse_quadrature_pause(UNI_MOUSE_QUADRATURE_PORT_1);
 }
 
-static void task_blink_bt_led(void* arg) {
-    int times = (int)arg;
+//
+// Bluetooth LED
+//
 
-    while (times--) {
-        uni_gpio_set_level(g_gpio_config->leds[UNI_PLATFORM_UNIJOYSTICLE_LED_BT], 0);
-        vTaskDelay(pdMS_TO_TICKS(100));
-        uni_gpio_set_level(g_gpio_config->leds[UNI_PLATFORM_UNIJOYSTICLE_LED_BT], 1);
-        vTaskDelay(pdMS_TO_TICKS(100));
-    }
-    uni_gpio_set_level(g_gpio_config->leds[UNI_PLATFORM_UNIJOYSTICLE_LED_BT], s_bluetooth_led_on);
+// Must be called with g_bt_led_mutex taken.
+static void bt_led_run_locked(void) {
+    bool level;
+    uint32_t next_us = uni_led_pattern_run(&g_bt_led, esp_timer_get_time(), &level);
+
+    uni_gpio_set_level(g_gpio_config->leds[UNI_PLATFORM_UNIJOYSTICLE_LED_BT], level);
+
+    // Fails if the timer is not running. Safe to ignore.
+    esp_timer_stop(g_bt_led_timer);
+    if (next_us)
+        ESP_ERROR_CHECK(esp_timer_start_once(g_bt_led_timer, next_us));
+}
+
+static void bt_led_timer_cb(void* arg) {
+    ARG_UNUSED(arg);
+    // Same as autofire_timer_cb(): don't block the esp_timer task. The holder re-arms the timer.
+    if (xSemaphoreTake(g_bt_led_mutex, 0) != pdTRUE)
+        return;
+    bt_led_run_locked();
+    xSemaphoreGive(g_bt_led_mutex);
+}
+
+static void bt_led_init(void) {
+    const esp_timer_create_args_t args = {
+        .callback = &bt_led_timer_cb,
+        .name = "bp.uni.led",
+    };
 
-    // Kill itself
-    vTaskDelete(NULL);
+    // Off, until Bluetooth discovery is enabled.
+    uni_led_pattern_init(&g_bt_led, false);
+    g_bt_led_mutex = xSemaphoreCreateMutex();
+    ESP_ERROR_CHECK(esp_timer_create(&args, &g_bt_led_timer));
 }
 
-static void blink_bt_led(int times) {
-    xTaskCreate(task_blink_bt_led, "bp.uni.blink", 2048, (void*)times, TASK_BLINK_LED_PRIO, NULL);
+static void bt_led_set_idle_level(bool level) {
+    xSemaphoreTake(g_bt_led_mutex, portMAX_DELAY);
+    uni_led_pattern_set_idle_level(&g_bt_led, level);
+    // Only updates the LED if no pattern is playing.
+    bt_led_run_locked();
+    xSemaphoreGive(g_bt_led_mutex);
+}
+
+// User actions, like a gamepad mode change, should use "high" priority:
+// the number of blinks is the feedback, and it should not wait for other blinks.
+static void blink_bt_led(int times, uni_led_pattern_priority_t priority) {
+    uni_led_pattern_t pattern = uni_led_pattern_blink(times, priority);
+
+    xSemaphoreTake(g_bt_led_mutex, portMAX_DELAY);
+    if (uni_led_pattern_push(&g_bt_led, &pattern, esp_timer_get_time()) != 0)
+        logi("unijoysticle: BT LED queue full, blink dropped\n");
+    bt_led_run_locked();
+    xSemaphoreGive(g_bt_led_mutex);
 }
 
 static void maybe_enable_bluetooth(bool enabled) {
@@ -12,30 +12,46 @@
 #include <sys/cdefs.h>
 
 #include <argtable3/argtable3.h>
+#include <driver/timer.h>
 #include <esp_console.h>
 #include <esp_err.h>
+#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
-#include <freertos/event_groups.h>
+#include <freertos/task.h>
 
 #include "sdkconfig.h"
 
 #include "platform/uni_platform_unijoysticle.h"
 #include "uni_common.h"
 #include "uni_gpio.h"
+#include "uni_gpio_port.h"
 #include "uni_log.h"
+#include "uni_paddle.h"
+#include "uni_port_latch.h"
 #include "uni_property.h"
 
 #define TASK_SYNC_IRQ_PRIO (9)
-#define uS_MIN 3
-#define uS_MAX 243  // Larger values cause the interrupt to take too long
+
+// Paddle: the lines are released from a one-shot timer alarm, instead of busy-waiting in the ISR.
+// The mouse uses TIMER_GROUP_0, but C64 doesn't support it anyway.
+#define PADDLE_TIMER_GROUP TIMER_GROUP_1
+#define PADDLE_TIMER_IDX TIMER_0
+// APB clock runs at 80Mhz. 80Mhz / 80 = 1Mhz: one tick per microsecond.
+#define PADDLE_TIMER_DIVIDER 80
+// Time that the SID needs to discharge the capacitor.
+// According to the spec, this should be 320 microseconds.
+// With the ISR overhead and so on, this seems about right.
+#define PADDLE_DISCHARGE_US 220
+// Alarm when there is nothing pending. Far in the future.
+#define PADDLE_IDLE_US (60 * 1000 * 1000)
+#define PADDLE_GPIO_X GPIO_NUM_16
+#define PADDLE_GPIO_Y GPIO_NUM_33
 
 // CPU where the Pot task runs
 #define POT_TASK_CPU 1
 
-enum {
-    EVENT_SYNC_IRQ_0,
-    EVENT_SYNC_IRQ_1,
-};
+// Latched states are flushed if the syncs stop.
+#define SYNC_FLUSH_MS (UNI_PORT_LATCH_SYNC_TIMEOUT_US / 1000)
 
 // --- Function declaration
 static int get_c64_pot_mode_from_nvs(void);
@@ -43,9 +59,36 @@ static int get_c64_pot_mode_from_nvs(void);
 // GPIO Interrupt handlers
 _Noreturn static void sync_irq_event_task(void* arg);
 
-static volatile bool pot_x_leads = true;  // if false, y leads
-static volatile uint16_t pot_x_delay_us = uS_MAX;
-static volatile uint16_t pot_y_delay_us = uS_MAX;
+// Pot X in the high 16 bits, Pot Y in the low 16 bits. See uni_paddle_pack_delays().
+// Published with one 32-bit store, so the ISR never reads a torn pair.
+static volatile uint32_t pot_delays_us = (UNI_PADDLE_DELAY_MAX_US << 16) | UNI_PADDLE_DELAY_MAX_US;
+
+// Paddle state for the current SID sample. Times are in timer counter ticks: microseconds.
+// The GPIO ISR and the timer ISR might run on different CPUs, so it is protected by s_paddle_lock.
+static portMUX_TYPE s_paddle_lock = portMUX_INITIALIZER_UNLOCKED;
+static uni_paddle_t s_paddle;
+static bool s_paddle_timer_initialized;
+
+// Sync IRQ state, one per seat. Index 0 is Seat A, index 1 is Seat B.
+// Shared between the sync ISR, the sync task and the BTstack thread. Protected by s_sync_lock.
+static portMUX_TYPE s_sync_lock = portMUX_INITIALIZER_UNLOCKED;
+static struct {
+    // Joystick port state, written from the ISR.
+    uni_port_latch_t latch;
+
+    // Sync IRQs not delivered to the BTstack thread yet, in "rumble" mode. Never lost: the callback consumes all
+    // of them.
+    uint32_t pending;
+    uint64_t irq_us;
+    // One registration per seat. Only re-queued once the callback has run.
+    btstack_context_callback_registration_t registration;
+    volatile bool queued;
+
+    uint32_t delivered;
+    // Sync IRQs delivered together with another one
+    uint32_t coalesced;
+    uni_perf_histogram_t irq_to_main;
+} s_sync[UNI_PLATFORM_UNIJOYSTICLE_SYNC_IRQ_MAX];
 
 // --- Consts (ROM)
 
@@ -79,10 +122,11 @@ static const char* c64_pot_modes[] = {
     "3buttons",  // UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_3BUTTONS
     "5buttons",  // UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_5BUTTONS
     "rumble",    // UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_RUMBLE
+    "paddle",    // UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_PADDLE
+    "sync",      // UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_SYNC
 };
 
 // Globals to the file (RAM)
-static EventGroupHandle_t _sync_irq_group;
 static TaskHandle_t _sync_task;
 uni_platform_unijoysticle_c64_pot_mode_t _pot_mode = UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_INVALID;
 
@@ -91,8 +135,6 @@ static struct {
     struct arg_end* end;
 } c64_pot_mode_args;
 
-static btstack_context_callback_registration_t syncirq_callback_registration;
-
 //
 // Helpers
 //
@@ -112,8 +154,7 @@ static int get_c64_pot_mode_from_nvs(void) {
     return value.u8;
 }
 
-static void enable_rumble_callback(void* context) {
-    int seat = (int)context;
+static void enable_rumble(uni_gamepad_seat_t seat) {
     uni_hid_device_t* d;
 
     for (int i = 0; i < CONFIG_BLUEPAD32_MAX_DEVICES; i++) {
@@ -130,75 +171,161 @@ static void enable_rumble_callback(void* context) {
     }
 }
 
+// Runs in the BTstack thread
+static void sync_irq_callback(void* context) {
+    int sync_idx = (int)context;
+    uint32_t count;
+    uint64_t irq_us;
+
+    // Before consuming: IRQs that arrive after this point queue the callback again.
+    s_sync[sync_idx].queued = false;
+
+    portENTER_CRITICAL(&s_sync_lock);
+    count = s_sync[sync_idx].pending;
+    irq_us = s_sync[sync_idx].irq_us;
+    s_sync[sync_idx].pending = 0;
+    portEXIT_CRITICAL(&s_sync_lock);
+
+    if (count == 0)
+        return;
+
+    s_sync[sync_idx].delivered += count;
+    s_sync[sync_idx].coalesced += count - 1;
+    uni_perf_histogram_add(&s_sync[sync_idx].irq_to_main, (uint32_t)(esp_timer_get_time() - irq_us));
+
+    // One rumble is enough, even if several IRQs were coalesced.
+    enable_rumble(sync_idx == 0 ? GAMEPAD_SEAT_A : GAMEPAD_SEAT_B);
+}
+
+// Writes the latched states that didn't reach the port: the syncs stopped, or were disabled.
+static void flush_latches(bool only_stale) {
+    uint64_t now = esp_timer_get_time();
+    uint64_t set_mask, clear_mask;
+
+    for (int i = 0; i < UNI_PLATFORM_UNIJOYSTICLE_SYNC_IRQ_MAX; i++) {
+        portENTER_CRITICAL(&s_sync_lock);
+        if (!(only_stale && uni_port_latch_is_synced(&s_sync[i].latch, now)) &&
+            uni_port_latch_flush(&s_sync[i].latch, now, &set_mask, &clear_mask))
+            uni_gpio_port_apply(set_mask, clear_mask);
+        portEXIT_CRITICAL(&s_sync_lock);
+    }
+}
+
 _Noreturn static void sync_irq_event_task(void* arg) {
-    // timeout of 100s
-    const TickType_t xTicksToWait = pdMS_TO_TICKS(100000);
     while (1) {
-        EventBits_t bits = xEventGroupWaitBits(_sync_irq_group, BIT(EVENT_SYNC_IRQ_0) | BIT(EVENT_SYNC_IRQ_1), pdTRUE,
-                                               pdFALSE, xTicksToWait);
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, pdMS_TO_TICKS(SYNC_FLUSH_MS));
 
         // timeout ?
-        if (bits == 0)
+        if (bits == 0) {
+            flush_latches(true /* only stale */);
             continue;
-
-        // EVENT_SYNC_IRQ_ events come from the C64.
-        // They should be considered "hi" events.
-        if (bits & BIT(EVENT_SYNC_IRQ_0)) {
-            // gpio_set_level(g_gpio_config->leds[LED_J1], 1);
-            syncirq_callback_registration.callback = &enable_rumble_callback;
-            syncirq_callback_registration.context = (void*)(GAMEPAD_SEAT_A);
-            btstack_run_loop_execute_on_main_thread(&syncirq_callback_registration);
         }
 
-        if (bits & BIT(EVENT_SYNC_IRQ_1)) {
-            // gpio_set_level(g_gpio_config->leds[LED_J2], 1);
-            syncirq_callback_registration.callback = &enable_rumble_callback;
-            syncirq_callback_registration.context = (void*)(GAMEPAD_SEAT_B);
-            btstack_run_loop_execute_on_main_thread(&syncirq_callback_registration);
+        // Sync IRQ events come from the C64.
+        // They should be considered "hi" events.
+        for (int i = 0; i < UNI_PLATFORM_UNIJOYSTICLE_SYNC_IRQ_MAX; i++) {
+            if (!(bits & BIT(i)) || s_sync[i].queued)
+                continue;
+            s_sync[i].queued = true;
+            btstack_run_loop_execute_on_main_thread(&s_sync[i].registration);
         }
     }
 }
 
 static IRAM_ATTR void gpio_isr_handler_sync(void* arg) {
     int sync_idx = (int)arg;
+    uint64_t irq_us = esp_timer_get_time();
+    uint64_t set_mask, clear_mask;
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    bool rumble = _pot_mode == UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_RUMBLE;
+
+    portENTER_CRITICAL_ISR(&s_sync_lock);
+    // Just in time: the latest state reaches the port right before the C64 reads it.
+    if (uni_port_latch_on_sync(&s_sync[sync_idx].latch, irq_us, &set_mask, &clear_mask)) {
+        uni_gpio_port_apply(set_mask, clear_mask);
+        uni_perf_histogram_add(&s_sync[sync_idx].latch.irq_to_port, (uint32_t)(esp_timer_get_time() - irq_us));
+    }
+    // Only counted when the callback gets queued: nothing consumes them otherwise.
+    if (rumble) {
+        s_sync[sync_idx].pending++;
+        s_sync[sync_idx].irq_us = irq_us;
+    }
+    portEXIT_CRITICAL_ISR(&s_sync_lock);
+
+    // In "sync" mode everything is done. The task only flushes the latches if the syncs stop.
+    if (!rumble)
+        return;
 
-    xEventGroupSetBitsFromISR(_sync_irq_group, BIT(sync_idx), &xHigherPriorityTaskWoken);
+    // A direct notification: event groups would defer the wake-up to the timer task.
+    xTaskNotifyFromISR(_sync_task, BIT(sync_idx), eSetBits, &xHigherPriorityTaskWoken);
     if (xHigherPriorityTaskWoken == pdTRUE)
         portYIELD_FROM_ISR();
 }
 
-inline void delay_us(uint32_t delay) {
-#if ESP_IDF_VERSION_MAJOR == 4
-    ets_delay_us(delay);
-#else
-    esp_rom_delay_us(delay);
-#endif
+static void set_paddle_delays(int delay_x, int delay_y) {
+    pot_delays_us = uni_paddle_pack_delays(delay_x, delay_y);
+}
+
+// Must be called from an ISR, with s_paddle_lock taken.
+static IRAM_ATTR void paddle_set_alarm_in_isr(uint64_t counter, uint32_t next_us) {
+    timer_group_set_alarm_value_in_isr(PADDLE_TIMER_GROUP, PADDLE_TIMER_IDX,
+                                       counter + (next_us ? next_us : PADDLE_IDLE_US));
+    timer_group_enable_alarm_in_isr(PADDLE_TIMER_GROUP, PADDLE_TIMER_IDX);
+}
+
+static IRAM_ATTR bool paddle_timer_handler(void* arg) {
+    ARG_UNUSED(arg);
+    uint64_t clear_mask;
+
+    portENTER_CRITICAL_ISR(&s_paddle_lock);
+    uint64_t counter = timer_group_get_counter_value_in_isr(PADDLE_TIMER_GROUP, PADDLE_TIMER_IDX);
+    uint32_t next_us = uni_paddle_run(&s_paddle, counter, &clear_mask);
+    uni_gpio_port_apply(0, clear_mask);
+    paddle_set_alarm_in_isr(counter, next_us);
+    portEXIT_CRITICAL_ISR(&s_paddle_lock);
+    // No task was woken up
+    return false;
 }
 
 static IRAM_ATTR void gpio_isr_handler_paddle(void* arg) {
-    // From:
-    // https://github.com/LeifBloomquist/JoystickEmulator/blob/master/Arduino/PaddleEmulator/PaddleEmulator.ino
-    gpio_set_level(GPIO_NUM_16, 1);
-    gpio_set_level(GPIO_NUM_33, 1);
-
-    // Wait while the SID discharges the capacitor.
-    // According to the spec, this should be 320 microseconds.
-    // With function overhead and so on, this seems about right.
-    delay_us(220);
-
-    // Now, delay the amount required to represent the desired values.
-    if (pot_x_leads) {
-        delay_us(pot_x_delay_us);
-        gpio_set_level(GPIO_NUM_16, 0);
-        delay_us(pot_y_delay_us);  // This is a delta!
-        gpio_set_level(GPIO_NUM_33, 0);
-    } else {
-        delay_us(pot_y_delay_us);
-        gpio_set_level(GPIO_NUM_33, 0);
-        delay_us(pot_x_delay_us);  // This is a delta!
-        gpio_set_level(GPIO_NUM_16, 0);
-    }
+    // Instead of waiting in the ISR, the lines are released from the timer alarm. See uni_paddle.h.
+    uint64_t set_mask;
+
+    // One read: both values belong to the same update.
+    uint32_t delays = pot_delays_us;
+
+    portENTER_CRITICAL_ISR(&s_paddle_lock);
+    uint64_t counter = timer_group_get_counter_value_in_isr(PADDLE_TIMER_GROUP, PADDLE_TIMER_IDX);
+    uint32_t next_us = uni_paddle_on_sync(&s_paddle, delays, counter, &set_mask);
+    uni_gpio_port_apply(set_mask, 0);
+    paddle_set_alarm_in_isr(counter, next_us);
+    portEXIT_CRITICAL_ISR(&s_paddle_lock);
+}
+
+// Must be called from POT_TASK_CPU, since the timer ISR is attached to the CPU that registers it.
+static void paddle_timer_init(void) {
+    if (s_paddle_timer_initialized)
+        return;
+
+    // Free running up-counter. The alarm is moved to the next line to release.
+    timer_config_t config = {
+        .divider = PADDLE_TIMER_DIVIDER,
+        .counter_dir = TIMER_COUNT_UP,
+        .counter_en = TIMER_PAUSE,
+        .alarm_en = TIMER_ALARM_EN,
+        .auto_reload = TIMER_AUTORELOAD_DIS,
+    };
+
+    uni_paddle_init(&s_paddle, BIT64(PADDLE_GPIO_X), BIT64(PADDLE_GPIO_Y), PADDLE_DISCHARGE_US);
+
+    ESP_ERROR_CHECK(timer_init(PADDLE_TIMER_GROUP, PADDLE_TIMER_IDX, &config));
+    timer_set_counter_value(PADDLE_TIMER_GROUP, PADDLE_TIMER_IDX, 0);
+    timer_set_alarm_value(PADDLE_TIMER_GROUP, PADDLE_TIMER_IDX, PADDLE_IDLE_US);
+    timer_isr_callback_add(PADDLE_TIMER_GROUP, PADDLE_TIMER_IDX, paddle_timer_handler, NULL, 0);
+    timer_start(PADDLE_TIMER_GROUP, PADDLE_TIMER_IDX);
+
+    s_paddle_timer_initialized = true;
 }
 
 static void print_c64_pot_mode(void) {
@@ -232,9 +359,11 @@ static int cmd_c64_pot_mode(int argc, char** argv) {
         mode = UNI_PLATFORM_UNIJOYSTICLE_CMD_SET_C64_POT_MODE_RUMBLE;
     } else if (strcmp(c64_pot_mode_args.value->sval[0], "paddle") == 0) {
         mode = UNI_PLATFORM_UNIJOYSTICLE_CMD_SET_C64_POT_MODE_PADDLE;
+    } else if (strcmp(c64_pot_mode_args.value->sval[0], "sync") == 0) {
+        mode = UNI_PLATFORM_UNIJOYSTICLE_CMD_SET_C64_POT_MODE_SYNC;
     } else {
         loge("Invalid C64 Pot mode: : %s\n", c64_pot_mode_args.value->sval[0]);
-        loge("Valid values: '3buttons', '5buttons', 'rumble' or 'paddle'\n");
+        loge("Valid values: '3buttons', '5buttons', 'rumble', 'paddle' or 'sync'\n");
         return 1;
     }
 
@@ -260,12 +389,16 @@ static void set_pot_mode_from_cpu(void* m) {
     _pot_mode = mode;
     set_c64_pot_mode_to_nvs(mode);
 
+    // Only "sync" latches the joystick port.
+    if (mode != UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_SYNC)
+        flush_latches(false /* only stale */);
+
     gpio_config_t io_conf = {0};
 
     if (mode == UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_3BUTTONS ||
         mode == UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_5BUTTONS) {
         if (_sync_task == NULL) {
-            // Nothing to do. "rumble" was not initialized.
+            // Nothing to do. "rumble" / "sync" were not initialized.
             goto exit;
             return;
         }
@@ -281,20 +414,24 @@ static void set_pot_mode_from_cpu(void* m) {
             io_conf.pin_bit_mask = BIT64(sync_irq);
             ESP_ERROR_CHECK(gpio_config(&io_conf));
 
-            // "i" must match EVENT_SYNC_IRQ_0, etc.
+            // "i" is the index in s_sync: 0 for Seat A, 1 for Seat B.
             gpio_isr_handler_remove(sync_irq);
         }
         vTaskDelete(_sync_task);
         _sync_task = NULL;
 
-    } else if (mode == UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_RUMBLE) {
+    } else if (mode == UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_RUMBLE ||
+               mode == UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_SYNC) {
         if (_sync_task != NULL) {
-            // Nothing to do. "rumble" / "paddle" already enabled.
+            // Nothing to do. "rumble" / "sync" / "paddle" already enabled.
             goto exit;
             return;
         }
 
-        _sync_irq_group = xEventGroupCreate();
+        for (int i = 0; i < UNI_PLATFORM_UNIJOYSTICLE_SYNC_IRQ_MAX; i++) {
+            s_sync[i].registration.callback = &sync_irq_callback;
+            s_sync[i].registration.context = (void*)i;
+        }
         xTaskCreatePinnedToCore(sync_irq_event_task, "bp.uni.sync_irq", 2048, NULL, TASK_SYNC_IRQ_PRIO, &_sync_task,
                                 POT_TASK_CPU);
 
@@ -312,10 +449,14 @@ static void set_pot_mode_from_cpu(void* m) {
             io_conf.pull_up_en = (gpio < GPIO_NUM_34) ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE;
             io_conf.pin_bit_mask = BIT64(gpio);
             ESP_ERROR_CHECK(gpio_config(&io_conf));
-            // "i" must match EVENT_SYNC_IRQ_0, etc.
+            // "i" is the index in s_sync: 0 for Seat A, 1 for Seat B.
             ESP_ERROR_CHECK(gpio_isr_handler_add(gpio, gpio_isr_handler_sync, (void*)i));
         }
     } else if (mode == UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_PADDLE) {
+        set_paddle_delays(UNI_PADDLE_DELAY_MAX_US, UNI_PADDLE_DELAY_MAX_US);
+        // Timer should be ready before the first Sync IRQ
+        paddle_timer_init();
+
         // Sync IRQs
         for (int i = 0; i < 1; i++) {
             gpio_num_t gpio = gpio_config_univ2c64.sync_irq[i];
@@ -330,7 +471,7 @@ static void set_pot_mode_from_cpu(void* m) {
             io_conf.pull_up_en = (gpio < GPIO_NUM_34) ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE;
             io_conf.pin_bit_mask = BIT64(gpio);
             ESP_ERROR_CHECK(gpio_config(&io_conf));
-            // "i" must match EVENT_SYNC_IRQ_0, etc.
+            // "i" is the index in s_sync: 0 for Seat A, 1 for Seat B.
             ESP_ERROR_CHECK(gpio_isr_handler_add(gpio, gpio_isr_handler_paddle, (void*)i));
         }
     } else {
@@ -384,27 +525,8 @@ static void process_paddle(uni_hid_device_t* d, uni_gamepad_seat_t seat, uint8_t
     int delay_x = (1024 - gp->brake) / 4;
     int delay_y = (1024 - gp->throttle) / 4;
 
-    // Now the trick to keep everything in one interrupt.  Use the other delay as a delta!
-    if (delay_x < delay_y) {
-        pot_x_leads = true;
-        delay_y -= delay_x;
-    } else {
-        pot_x_leads = false;
-        delay_x -= delay_y;
-    }
-
-    if (delay_x > uS_MAX)
-        delay_x = uS_MAX;
-    else if (delay_x < uS_MIN)
-        delay_x = uS_MIN;
-
-    if (delay_y > uS_MAX)
-        delay_y = uS_MAX;
-    else if (delay_y < uS_MIN)
-        delay_y = uS_MIN;
-
-    pot_x_delay_us = delay_x;
-    pot_y_delay_us = delay_y;
+    // Both delays are absolute. The timer ISR releases each line on time.
+    set_paddle_delays(delay_x, delay_y);
 #endif
 }
 
@@ -417,7 +539,8 @@ static void set_gpio_level_for_pot_c64(gpio_num_t gpio_num, bool level) {
         _pot_mode == UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_5BUTTONS) {
         // C64 uses pull-ups for Pot-x, Pot-y, so the value needs to be "inverted" to be off.
         uni_gpio_set_level(gpio_num, !level);
-    } else if (_pot_mode == UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_RUMBLE) {
+    } else if (_pot_mode == UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_RUMBLE ||
+               _pot_mode == UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_SYNC) {
         // Leave it disabled to allow the SYNC to reach ESP32 without interference.
         uni_gpio_set_level(gpio_num, level);
     } else if (_pot_mode == UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_PADDLE) {
@@ -427,6 +550,17 @@ static void set_gpio_level_for_pot_c64(gpio_num_t gpio_num, bool level) {
     }
 }
 
+static void write_joy_port_c64(uni_gamepad_seat_t seat, uint64_t set_mask, uint64_t clear_mask) {
+    int idx = (seat == GAMEPAD_SEAT_A) ? 0 : 1;
+
+    portENTER_CRITICAL(&s_sync_lock);
+    // Latched until the next sync IRQ. Written now if there are no syncs.
+    if (_pot_mode != UNI_PLATFORM_UNIJOYSTICLE_C64_POT_MODE_SYNC ||
+        !uni_port_latch_write(&s_sync[idx].latch, set_mask, clear_mask, esp_timer_get_time()))
+        uni_gpio_port_apply(set_mask, clear_mask);
+    portEXIT_CRITICAL(&s_sync_lock);
+}
+
 static void on_init_complete_c64(void) {
     int mode = get_c64_pot_mode_from_nvs();
     uni_platform_unijoysticle_c64_set_pot_mode(mode);
@@ -443,9 +577,35 @@ static void on_init_complete_c64(void) {
     set_gpio_level_for_pot_c64(gpio_config_univ2c64.port_b[UNI_PLATFORM_UNIJOYSTICLE_JOY_BUTTON3], 0);
 }
 
+static int cmd_c64_sync(int argc, char** argv) {
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    for (int i = 0; i < UNI_PLATFORM_UNIJOYSTICLE_SYNC_IRQ_MAX; i++) {
+        uni_port_latch_t latch;
+        uint32_t delivered, coalesced;
+        uni_perf_histogram_t irq_to_main;
+
+        // Copy, so that the ISR is not blocked while printing.
+        portENTER_CRITICAL(&s_sync_lock);
+        latch = s_sync[i].latch;
+        delivered = s_sync[i].delivered;
+        coalesced = s_sync[i].coalesced;
+        irq_to_main = s_sync[i].irq_to_main;
+        portEXIT_CRITICAL(&s_sync_lock);
+
+        logi("Seat %c:\n", 'A' + i);
+        uni_port_latch_dump(&latch);
+        logi("  rumble: delivered=%u, coalesced=%u\n", (unsigned)delivered, (unsigned)coalesced);
+        logi("  sync IRQ to BTstack thread:\n");
+        uni_perf_histogram_dump(&irq_to_main);
+    }
+    return 0;
+}
+
 void register_console_cmds_c64(void) {
     c64_pot_mode_args.value =
-        arg_str1(NULL, NULL, "<mode>", "valid options: '3buttons', '5buttons', 'rumble' or 'paddle'");
+        arg_str1(NULL, NULL, "<mode>", "valid options: '3buttons', '5buttons', 'rumble', 'paddle' or 'sync'");
     c64_pot_mode_args.end = arg_end(2);
 
     const esp_console_cmd_t c64_pot_mode = {
@@ -458,7 +618,15 @@ void register_console_cmds_c64(void) {
         .argtable = &c64_pot_mode_args,
     };
 
+    const esp_console_cmd_t c64_sync = {
+        .command = "c64_sync",
+        .help = "Dump C64 sync IRQ stats: port latching and IRQ latencies",
+        .hint = NULL,
+        .func = &cmd_c64_sync,
+    };
+
     ESP_ERROR_CHECK(esp_console_cmd_register(&c64_pot_mode));
+    ESP_ERROR_CHECK(esp_console_cmd_register(&c64_sync));
 }
 
 static bool process_gamepad_misc_buttons_c64(uni_hid_device_t* d, uni_gamepad_seat_t seat, uint8_t misc_buttons) {
@@ -488,6 +656,7 @@ const struct uni_platform_unijoysticle_variant* uni_platform_unijoysticle_c64_cr
         .register_console_cmds = register_console_cmds_c64,
         .process_gamepad_misc_buttons = process_gamepad_misc_buttons_c64,
         .set_gpio_level_for_pot = set_gpio_level_for_pot_c64,
+        .write_joy_port = write_joy_port_c64,
         .preferred_seat_for_mouse = GAMEPAD_SEAT_A,
         .preferred_seat_for_joystick = GAMEPAD_SEAT_B,
     };
@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#include "uni_autofire.h"
+
+#include <string.h>
+
+#include "uni_common.h"
+
+//
+// Helpers
+//
+static void set_channel_rate(uni_autofire_channel_t* ch, uint32_t cps, uint8_t duty_pct) {
+    ch->period_us = 1000000 / cps;
+    ch->on_us = (uint32_t)(((uint64_t)ch->period_us * duty_pct) / 100);
+    // Both edges must exist
+    if (ch->on_us == 0)
+        ch->on_us = 1;
+    if (ch->on_us >= ch->period_us)
+        ch->on_us = ch->period_us - 1;
+}
+
+//
+// Public functions
+//
+void uni_autofire_init(uni_autofire_t* af, uint32_t cps) {
+    memset(af, 0, sizeof(*af));
+    if (cps == 0)
+        cps = 1;
+    for (int i = 0; i < UNI_AUTOFIRE_PORT_MAX; i++) {
+        for (size_t j = 0; j < ARRAY_SIZE(af->channels[i]); j++)
+            set_channel_rate(&af->channels[i][j], cps, UNI_AUTOFIRE_DUTY_DEFAULT);
+    }
+}
+
+int uni_autofire_set_rate(uni_autofire_t* af,
+                          int port_idx,
+                          uni_joystick_bits_t buttons,
+                          uint32_t cps,
+                          uint8_t duty_pct,
+                          uint64_t now_us) {
+    // 500 cps would be a 2ms period. Way beyond what any computer can read.
+    if (port_idx < 0 || port_idx >= UNI_AUTOFIRE_PORT_MAX || cps == 0 || cps > 500 || duty_pct == 0 ||
+        duty_pct >= 100)
+        return -1;
+
+    buttons &= UNI_AUTOFIRE_BUTTONS_MASK;
+    while (buttons) {
+        int bit = __builtin_ctz(buttons);
+        buttons &= buttons - 1;
+        uni_autofire_channel_t* ch = &af->channels[port_idx][bit];
+        set_channel_rate(ch, cps, duty_pct);
+        ch->start_us = now_us;
+    }
+    return 0;
+}
+
+void uni_autofire_set_active(uni_autofire_t* af, int port_idx, uni_joystick_bits_t buttons, uint64_t now_us) {
+    if (port_idx < 0 || port_idx >= UNI_AUTOFIRE_PORT_MAX)
+        return;
+
+    buttons &= UNI_AUTOFIRE_BUTTONS_MASK;
+    uni_joystick_bits_t started = buttons & ~af->active[port_idx];
+    while (started) {
+        int bit = __builtin_ctz(started);
+        started &= started - 1;
+        af->channels[port_idx][bit].start_us = now_us;
+    }
+    af->active[port_idx] = buttons;
+}
+
+uint32_t uni_autofire_run(const uni_autofire_t* af,
+                          uint64_t now_us,
+                          uni_joystick_bits_t out_levels[UNI_AUTOFIRE_PORT_MAX]) {
+    uint32_t next = 0;
+
+    for (int i = 0; i < UNI_AUTOFIRE_PORT_MAX; i++) {
+        uni_joystick_bits_t levels = 0;
+        uni_joystick_bits_t active = af->active[i];
+        while (active) {
+            int bit = __builtin_ctz(active);
+            active &= active - 1;
+
+            const uni_autofire_channel_t* ch = &af->channels[i][bit];
+            uint32_t pos = (uint32_t)((now_us - ch->start_us) % ch->period_us);
+            uint32_t until_edge;
+            if (pos < ch->on_us) {
+                levels |= BIT(bit);
+                until_edge = ch->on_us - pos;
+            } else {
+                until_edge = ch->period_us - pos;
+            }
+            if (next == 0 || until_edge < next)
+                next = until_edge;
+        }
+        out_levels[i] = levels;
+    }
+    return next;
+}
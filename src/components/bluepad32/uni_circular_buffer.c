@@ -39,6 +39,33 @@ uint8_t uni_circular_buffer_get(uni_circular_buffer_t* b, int16_t* cid, void** d
     return UNI_CIRCULAR_BUFFER_ERROR_OK;
 }
 
+uint8_t uni_circular_buffer_peek(uni_circular_buffer_t* b, int16_t* cid, void** data, int* len) {
+    if (uni_circular_buffer_is_empty(b)) {
+        return UNI_CIRCULAR_BUFFER_ERROR_BUFFER_EMPTY;
+    }
+    *data = &b->buffer[b->head_idx].data;
+    *len = b->buffer[b->head_idx].data_len;
+    *cid = b->buffer[b->head_idx].cid;
+    return UNI_CIRCULAR_BUFFER_ERROR_OK;
+}
+
+uint8_t uni_circular_buffer_replace(uni_circular_buffer_t* b, int16_t cid, const void* data, int len) {
+    if (len >= UNI_CIRCULAR_BUFFER_DATA_SIZE) {
+        return UNI_CIRCULAR_BUFFER_ERROR_BUFFER_TOO_BIG;
+    }
+    // Newest to oldest
+    int idx = b->tail_idx;
+    while (idx != b->head_idx) {
+        idx = (idx == 0) ? UNI_CIRCULAR_BUFFER_SIZE - 1 : idx - 1;
+        if (b->buffer[idx].cid == cid) {
+            memcpy(&b->buffer[idx].data, data, len);
+            b->buffer[idx].data_len = len;
+            return UNI_CIRCULAR_BUFFER_ERROR_OK;
+        }
+    }
+    return UNI_CIRCULAR_BUFFER_ERROR_NOT_FOUND;
+}
+
 uint8_t uni_circular_buffer_is_empty(uni_circular_buffer_t* b) {
     return (b->head_idx == b->tail_idx);
 }
@@ -47,6 +74,13 @@ uint8_t uni_circular_buffer_is_full(uni_circular_buffer_t* b) {
     return (b->tail_idx + 1 == b->head_idx) || (b->head_idx == 0 && b->tail_idx == UNI_CIRCULAR_BUFFER_SIZE - 1);
 }
 
+int uni_circular_buffer_count(const uni_circular_buffer_t* b) {
+    int count = b->tail_idx - b->head_idx;
+    if (count < 0)
+        count += UNI_CIRCULAR_BUFFER_SIZE;
+    return count;
+}
+
 void uni_circular_buffer_reset(uni_circular_buffer_t* b) {
     b->head_idx = b->tail_idx = 0;
 }
@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#include "uni_combo.h"
+
+#include <string.h>
+
+//
+// Helpers
+//
+static int pop_lowest_bit(uint32_t* mask) {
+    int idx = __builtin_ctz(*mask);
+    *mask &= *mask - 1;
+    return idx;
+}
+
+// Combos that use any of the buttons in "mask".
+static uint32_t get_combos_for_buttons(const uni_combo_table_t* t, uint32_t mask) {
+    uint32_t combos = 0;
+    while (mask)
+        combos |= t->by_button[pop_lowest_bit(&mask)];
+    return combos;
+}
+
+static bool is_chord_held(uint32_t buttons, uint32_t chord) {
+    return (buttons & chord) == chord;
+}
+
+static bool is_debouncing(const uni_combo_t* c, const uni_combo_state_t* st, int idx, uint32_t now_ms) {
+    return c->debounce_ms && (now_ms - st->time_ms[idx]) < c->debounce_ms;
+}
+
+// Returns true if the combo fired.
+static bool process_press(const uni_combo_table_t* t,
+                          uni_combo_state_t* st,
+                          int idx,
+                          uint32_t buttons,
+                          uint32_t pressed,
+                          uint32_t now_ms) {
+    const uni_combo_t* c = &t->combos[idx];
+    uint32_t bit = 1u << idx;
+
+    switch (c->type) {
+        case UNI_COMBO_TYPE_CHORD:
+            if ((st->held & bit) || !is_chord_held(buttons, c->steps[0]))
+                return false;
+            st->held |= bit;
+            if (is_debouncing(c, st, idx, now_ms))
+                return false;
+            st->time_ms[idx] = now_ms;
+            return true;
+
+        case UNI_COMBO_TYPE_LONG_PRESS:
+            if (((st->held | st->armed) & bit) || !is_chord_held(buttons, c->steps[0]))
+                return false;
+            if (is_debouncing(c, st, idx, now_ms))
+                return false;
+            // Fired from the deadline check
+            st->armed |= bit;
+            st->time_ms[idx] = now_ms;
+            return false;
+
+        case UNI_COMBO_TYPE_DOUBLE_TAP:
+            if ((st->held & bit) || !is_chord_held(buttons, c->steps[0]))
+                return false;
+            // Has to be released before the next tap.
+            st->held |= bit;
+            if ((st->in_progress & bit) && (now_ms - st->time_ms[idx]) <= c->time_ms) {
+                st->in_progress &= ~bit;
+                st->progress[idx] = 0;
+                st->time_ms[idx] = now_ms;
+                return true;
+            }
+            if (!(st->in_progress & bit) && is_debouncing(c, st, idx, now_ms))
+                return false;
+            // First tap, or the previous one expired.
+            st->in_progress |= bit;
+            st->progress[idx] = 1;
+            st->time_ms[idx] = now_ms;
+            return false;
+
+        case UNI_COMBO_TYPE_SEQUENCE:
+            if (st->in_progress & bit) {
+                uint32_t expected = c->steps[st->progress[idx]];
+                if ((pressed & ~expected) || (now_ms - st->time_ms[idx]) > c->time_ms) {
+                    // Wrong button, or too slow: restart. The press might be the first step.
+                    st->in_progress &= ~bit;
+                    st->progress[idx] = 0;
+                }
+            } else if (is_debouncing(c, st, idx, now_ms)) {
+                return false;
+            }
+            if (!is_chord_held(buttons, c->steps[st->progress[idx]]))
+                return false;
+            st->time_ms[idx] = now_ms;
+            if (++st->progress[idx] < c->steps_count) {
+                st->in_progress |= bit;
+                return false;
+            }
+            st->in_progress &= ~bit;
+            st->progress[idx] = 0;
+            return true;
+    }
+    return false;
+}
+
+//
+// Public functions
+//
+void uni_combo_table_init(uni_combo_table_t* t) {
+    memset(t, 0, sizeof(*t));
+}
+
+int uni_combo_table_add(uni_combo_table_t* t, const uni_combo_t* combo) {
+    uni_combo_t* c;
+    uint32_t used = 0;
+    int steps_count;
+    int idx;
+
+    if (t->count >= UNI_COMBO_MAX)
+        return -1;
+
+    steps_count = (combo->type == UNI_COMBO_TYPE_SEQUENCE) ? combo->steps_count : 1;
+    if (steps_count < 1 || steps_count > UNI_COMBO_SEQUENCE_MAX)
+        return -1;
+    for (int i = 0; i < steps_count; i++) {
+        if (combo->steps[i] == 0)
+            return -1;
+        used |= combo->steps[i];
+    }
+
+    idx = t->count++;
+    c = &t->combos[idx];
+    *c = *combo;
+    c->steps_count = steps_count;
+
+    // Compile: combo is evaluated only when one of its buttons changes.
+    while (used)
+        t->by_button[pop_lowest_bit(&used)] |= (1u << idx);
+    if (c->type == UNI_COMBO_TYPE_SEQUENCE)
+        t->sequences |= (1u << idx);
+    return idx;
+}
+
+void uni_combo_state_init(uni_combo_state_t* st) {
+    memset(st, 0, sizeof(*st));
+}
+
+uint32_t uni_combo_process(const uni_combo_table_t* t,
+                           uni_combo_state_t* st,
+                           uint32_t buttons,
+                           uint32_t now_ms,
+                           void* context) {
+    uint32_t changed = buttons ^ st->prev_buttons;
+    uint32_t fired = 0;
+    uint32_t next_ms = 0;
+    uint32_t mask;
+
+    if (changed) {
+        uint32_t pressed = buttons & changed;
+        uint32_t released = st->prev_buttons & changed;
+
+        // Releases: held chords and armed long presses that lost one of their buttons.
+        mask = get_combos_for_buttons(t, released) & (st->held | st->armed);
+        while (mask) {
+            int idx = pop_lowest_bit(&mask);
+            if (!is_chord_held(buttons, t->combos[idx].steps[0])) {
+                st->held &= ~(1u << idx);
+                st->armed &= ~(1u << idx);
+            }
+        }
+
+        // Presses: combos that use the pressed buttons, plus sequences in progress, since any
+        // other button restarts them.
+        if (pressed) {
+            mask = get_combos_for_buttons(t, pressed) | (st->in_progress & t->sequences);
+            while (mask) {
+                int idx = pop_lowest_bit(&mask);
+                if (process_press(t, st, idx, buttons, pressed, now_ms))
+                    fired |= (1u << idx);
+            }
+        }
+        st->prev_buttons = buttons;
+    }
+
+    // Long-press deadlines
+    mask = st->armed;
+    while (mask) {
+        int idx = pop_lowest_bit(&mask);
+        uint32_t elapsed = now_ms - st->time_ms[idx];
+        uint32_t time_ms = t->combos[idx].time_ms;
+        if (elapsed >= time_ms) {
+            st->armed &= ~(1u << idx);
+            st->held |= (1u << idx);
+            st->time_ms[idx] = now_ms;
+            fired |= (1u << idx);
+        } else if (next_ms == 0 || time_ms - elapsed < next_ms) {
+            next_ms = time_ms - elapsed;
+        }
+    }
+
+    // Callbacks are called once the state is updated, since they might reset it.
+    // E.g: the device gets disconnected.
+    while (fired) {
+        const uni_combo_t* c = &t->combos[pop_lowest_bit(&fired)];
+        if (c->callback)
+            c->callback(context, c->id);
+    }
+    return next_ms;
+}
@@ -0,0 +1,580 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#include <btstack.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#include "bt/uni_bt.h"
+#include "bt/uni_bt_allowlist.h"
+#include "bt/uni_bt_le.h"
+#include "bt/uni_bt_reconnect.h"
+#include "uni_common.h"
+#include "uni_console.h"
+#include "uni_hid_device.h"
+#include "uni_joystick.h"
+#include "uni_keymap.h"
+#include "uni_log.h"
+#include "uni_property.h"
+#include "uni_system.h"
+#include "uni_virtual_device.h"
+
+// Max number of arguments, including the command name
+#define ARGV_MAX 8
+
+// Commands that access the device state. See device_cmd_safe().
+typedef enum {
+    DEVICE_CMD_JOY_ANALOG_DUMP,
+    DEVICE_CMD_JOY_ANALOG_SET,
+    DEVICE_CMD_PERF,
+    DEVICE_CMD_PERF_RESET,
+    DEVICE_CMD_LATENCY,
+    DEVICE_CMD_QUEUES,
+} device_cmd_t;
+
+static btstack_context_callback_registration_t device_cmd_registration;
+// Argument of DEVICE_CMD_JOY_ANALOG_SET. Doesn't fit in the callback context.
+static uni_joy_analog_config_t pending_joy_analog_config;
+
+//
+// Helpers
+//
+static bool parse_int(const char* str, int* out) {
+    char* end;
+    long v = strtol(str, &end, 0);
+    if (end == str || *end != '\0')
+        return false;
+    *out = (int)v;
+    return true;
+}
+
+// Returns true if the argument was valid. Prints the usage otherwise.
+static bool parse_int_arg(int argc, char** argv, int idx, int* out) {
+    if (idx >= argc || !parse_int(argv[idx], out)) {
+        loge("%s: invalid or missing argument\n", argv[0]);
+        return false;
+    }
+    return true;
+}
+
+static bool parse_addr_arg(int argc, char** argv, bd_addr_t addr) {
+    if (argc < 2 || sscanf_bd_addr(argv[1], addr) == 0) {
+        loge("%s: invalid address. Format: 01:23:45:67:89:ab\n", argv[0]);
+        return false;
+    }
+    return true;
+}
+
+static bool is_device_connected(uni_hid_device_t* d) {
+    return d != NULL && uni_bt_conn_is_connected(&d->conn);
+}
+
+//
+// Commands
+//
+static int list_devices(int argc, char** argv) {
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    // FIXME: Should not belong to "bluetooth"
+    uni_bt_dump_devices_safe();
+    uni_console_wait_for_output();
+    return 0;
+}
+
+static int disconnect_device(int argc, char** argv) {
+    int idx;
+
+    if (!parse_int_arg(argc, argv, 1, &idx))
+        return 1;
+    if (idx < 0 || idx >= CONFIG_BLUEPAD32_MAX_DEVICES) {
+        loge("Invalid device index: %d. Valid range: 0 - %d\n", idx, CONFIG_BLUEPAD32_MAX_DEVICES - 1);
+        return 1;
+    }
+
+    uni_bt_disconnect_device_safe(idx);
+    return 0;
+}
+
+static int gap_security_level(int argc, char** argv) {
+    int gap;
+
+    if (argc < 2) {
+        // Just print current value.
+        logi("%d\n", uni_bt_get_gap_security_level());
+        return 0;
+    }
+    if (!parse_int_arg(argc, argv, 1, &gap))
+        return 1;
+
+    uni_bt_set_gap_security_level(gap);
+    logi("Done. Restart required. Type 'restart' + Enter\n");
+    return 0;
+}
+
+static int gap_periodic_inquiry(int argc, char** argv) {
+    int min, max, len;
+
+    if (argc < 4) {
+        // Just print current values.
+        logi("GAP max periodic len: %d, min periodic len: %d, inquiry len: %d\n",
+             uni_bt_get_gap_max_periodic_length(), uni_bt_get_gap_min_periodic_length(),
+             uni_bt_get_gap_inquiry_length());
+        return 0;
+    }
+    if (!parse_int_arg(argc, argv, 1, &max) || !parse_int_arg(argc, argv, 2, &min) ||
+        !parse_int_arg(argc, argv, 3, &len))
+        return 1;
+
+    uni_bt_set_gap_max_peridic_length(max);
+    uni_bt_set_gap_min_peridic_length(min);
+    uni_bt_set_gap_inquiry_length(len);
+    logi("Done. Restart required. Type 'restart' + Enter\n");
+    return 0;
+}
+
+static int list_bluetooth_keys(int argc, char** argv) {
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    uni_bt_list_keys_safe();
+    uni_console_wait_for_output();
+    return 0;
+}
+
+static int del_bluetooth_keys(int argc, char** argv) {
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    uni_bt_del_keys_safe();
+    uni_console_wait_for_output();
+    return 0;
+}
+
+static int incoming_connections_enable(int argc, char** argv) {
+    int enabled;
+
+    if (argc < 2) {
+        logi("Incoming connections: %s\n", uni_bt_enable_new_connections_is_enabled() ? "Enabled" : "Disabled");
+        return 0;
+    }
+    if (!parse_int_arg(argc, argv, 1, &enabled))
+        return 1;
+
+    uni_bt_enable_new_connections_safe(!!enabled);
+    return 0;
+}
+
+static int ble_enable(int argc, char** argv) {
+    int enabled;
+
+    if (argc < 2) {
+        logi("BLE: %s\n", uni_bt_le_is_enabled() ? "Enabled" : "Disabled");
+        return 0;
+    }
+    if (!parse_int_arg(argc, argv, 1, &enabled))
+        return 1;
+
+    uni_bt_le_set_enabled(!!enabled);
+    logi("Done. Restart required. Type 'restart' + Enter\n");
+    return 0;
+}
+
+static int allowlist_list(int argc, char** argv) {
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    uni_bt_allowlist_list();
+    return 0;
+}
+
+static int allowlist_add_addr(int argc, char** argv) {
+    bd_addr_t addr;
+
+    if (!parse_addr_arg(argc, argv, addr))
+        return 1;
+    uni_bt_allowlist_add_addr(addr);
+    return 0;
+}
+
+static int allowlist_remove_addr(int argc, char** argv) {
+    bd_addr_t addr;
+
+    if (!parse_addr_arg(argc, argv, addr))
+        return 1;
+    uni_bt_allowlist_remove_addr(addr);
+    return 0;
+}
+
+static int allowlist_enable(int argc, char** argv) {
+    int enabled;
+
+    if (argc < 2) {
+        logi("Bluetooth Allowlist: %s\n", uni_bt_allowlist_is_enabled() ? "Enabled" : "Disabled");
+        return 0;
+    }
+    if (!parse_int_arg(argc, argv, 1, &enabled))
+        return 1;
+
+    uni_bt_allowlist_set_enabled(!!enabled);
+    return 0;
+}
+
+static int reconnect(int argc, char** argv) {
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    uni_bt_reconnect_safe();
+    return 0;
+}
+
+static int reconnect_list(int argc, char** argv) {
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    uni_bt_reconnect_list();
+    return 0;
+}
+
+static int reconnect_enable(int argc, char** argv) {
+    int enabled;
+
+    if (argc < 2) {
+        logi("Reconnect at boot: %s\n", uni_bt_reconnect_is_enabled() ? "Enabled" : "Disabled");
+        return 0;
+    }
+    if (!parse_int_arg(argc, argv, 1, &enabled))
+        return 1;
+
+    uni_bt_reconnect_set_enabled(!!enabled);
+    return 0;
+}
+
+static int virtual_device_enable(int argc, char** argv) {
+    int enabled;
+
+    if (argc < 2) {
+        logi("Virtual Device: %s\n", uni_virtual_device_is_enabled() ? "Enabled" : "Disabled");
+        return 0;
+    }
+    if (!parse_int_arg(argc, argv, 1, &enabled))
+        return 1;
+
+    uni_virtual_device_set_enabled(!!enabled);
+    return 0;
+}
+
+static int getprop(int argc, char** argv) {
+    if (argc < 2) {
+        uni_property_dump_all();
+        return 0;
+    }
+
+    const uni_property_t* p = uni_property_get_property_by_name(argv[1]);
+    if (!p) {
+        loge("Property not found: %s\n", argv[1]);
+        return 1;
+    }
+    uni_property_dump_property(p);
+    return 0;
+}
+
+static int keymap(int argc, char** argv) {
+    if (argc < 2) {
+        for (int i = 0; i < UNI_KEYMAP_ID_COUNT; i++)
+            uni_keymap_dump(i);
+        return 0;
+    }
+
+    if (uni_keymap_set_profile(argv[1]) != 0) {
+        loge("Invalid keymap profile\n");
+        return 1;
+    }
+    return 0;
+}
+
+static void dump_joy_analog_config(const char* prefix, const uni_joy_analog_config_t* c) {
+    logi("%s: deadzone=%d, hysteresis=%d, ways=%d, accel threshold=%d\n", prefix, c->deadzone, c->hysteresis, c->ways,
+         c->accel_threshold);
+}
+
+// The device state is owned by the BTstack thread. The commands that read or write it run there, like
+// uni_bt_dump_devices_safe(). The console might run on its own task, e.g. the ESP32 console.
+static void joy_analog_dump_unsafe(void) {
+    uni_joy_analog_config_t config = uni_joy_analog_get_default_config();
+
+    dump_joy_analog_config("default", &config);
+    for (int i = 0; i < CONFIG_BLUEPAD32_MAX_DEVICES; i++) {
+        uni_hid_device_t* d = uni_hid_device_get_instance_for_idx(i);
+        if (!is_device_connected(d))
+            continue;
+        logi("idx=%d, %s: ", i, d->name);
+        dump_joy_analog_config("config", &d->joy_analog.config);
+    }
+}
+
+// "idx" -1: new default, applied to the connected devices as well. Otherwise, only that device, and not stored.
+static void joy_analog_set_unsafe(const uni_joy_analog_config_t* config, int idx) {
+    if (idx >= 0) {
+        uni_hid_device_t* d = uni_hid_device_get_instance_for_idx(idx);
+        if (!is_device_connected(d)) {
+            loge("Invalid device index: %d\n", idx);
+            return;
+        }
+        d->joy_analog.config = *config;
+        return;
+    }
+
+    uni_joy_analog_set_default_config(config);
+    for (int i = 0; i < CONFIG_BLUEPAD32_MAX_DEVICES; i++) {
+        uni_hid_device_t* d = uni_hid_device_get_instance_for_idx(i);
+        if (is_device_connected(d))
+            d->joy_analog.config = *config;
+    }
+}
+
+static void perf_unsafe(bool reset) {
+    for (int i = 0; i < CONFIG_BLUEPAD32_MAX_DEVICES; i++) {
+        uni_hid_device_t* d = uni_hid_device_get_instance_for_idx(i);
+        if (!is_device_connected(d))
+            continue;
+        if (reset) {
+            memset(&d->perf, 0, sizeof(d->perf));
+            continue;
+        }
+        const uni_perf_device_t* p = &d->perf;
+        logi("idx=%d, %s: in=%u, in invalid=%u, out=%u, out queued=%u, out collapsed=%u, out dropped=%u\n", i,
+             d->name, (unsigned)p->input_reports, (unsigned)p->input_invalid, (unsigned)p->output_reports,
+             (unsigned)p->output_queued, (unsigned)p->output_collapsed, (unsigned)p->output_dropped);
+    }
+}
+
+static void latency_unsafe(void) {
+    for (int i = 0; i < CONFIG_BLUEPAD32_MAX_DEVICES; i++) {
+        uni_hid_device_t* d = uni_hid_device_get_instance_for_idx(i);
+        if (!is_device_connected(d))
+            continue;
+        logi("idx=%d, %s: input report processing time\n", i, d->name);
+        uni_perf_histogram_dump(&d->perf.input_latency);
+        if (d->perf.output_latency.count > 0) {
+            logi("idx=%d, %s: output report write-to-ack time\n", i, d->name);
+            uni_perf_histogram_dump(&d->perf.output_latency);
+        }
+    }
+}
+
+static void queues_unsafe(void) {
+    for (int i = 0; i < CONFIG_BLUEPAD32_MAX_DEVICES; i++) {
+        uni_hid_device_t* d = uni_hid_device_get_instance_for_idx(i);
+        if (!is_device_connected(d))
+            continue;
+        logi("idx=%d, %s: output queue: %d/%d, max=%d, write in flight=%d\n", i, d->name,
+             uni_circular_buffer_count(&d->outgoing_buffer), UNI_CIRCULAR_BUFFER_SIZE - 1, d->perf.output_queue_max,
+             d->outgoing_le_in_flight);
+        if (d->led_anim.frames_sent > 0)
+            logi("idx=%d, %s: LED animation: playing=%d, reports sent=%u, frames skipped (queue busy)=%u\n", i,
+                 d->name, d->led_anim.playing, (unsigned)d->led_anim.frames_sent,
+                 (unsigned)d->led_anim.frames_skipped);
+    }
+}
+
+static void device_cmd_callback(void* context) {
+    unsigned long ctx = (unsigned long)context;
+    uint16_t cmd = ctx & 0xffff;
+    int16_t arg = (int16_t)((ctx >> 16) & 0xffff);
+
+    switch (cmd) {
+        case DEVICE_CMD_JOY_ANALOG_DUMP:
+            joy_analog_dump_unsafe();
+            break;
+        case DEVICE_CMD_JOY_ANALOG_SET:
+            joy_analog_set_unsafe(&pending_joy_analog_config, arg);
+            break;
+        case DEVICE_CMD_PERF:
+            perf_unsafe(false);
+            break;
+        case DEVICE_CMD_PERF_RESET:
+            perf_unsafe(true);
+            break;
+        case DEVICE_CMD_LATENCY:
+            latency_unsafe();
+            break;
+        case DEVICE_CMD_QUEUES:
+            queues_unsafe();
+            break;
+        default:
+            loge("Unknown device command: %#x\n", cmd);
+            break;
+    }
+}
+
+static void device_cmd_safe(device_cmd_t cmd, int arg) {
+    unsigned long a = (unsigned long)(arg & 0xffff);
+    device_cmd_registration.callback = &device_cmd_callback;
+    device_cmd_registration.context = (void*)(cmd | (a << 16));
+    btstack_run_loop_execute_on_main_thread(&device_cmd_registration);
+}
+
+static int joy_analog(int argc, char** argv) {
+    uni_joy_analog_config_t config;
+    int v[4];
+    int idx = -1;
+
+    if (argc < 2) {
+        device_cmd_safe(DEVICE_CMD_JOY_ANALOG_DUMP, 0);
+        return 0;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        if (!parse_int_arg(argc, argv, i + 1, &v[i]))
+            return 1;
+    }
+    if (argc > 5 && !parse_int_arg(argc, argv, 5, &idx))
+        return 1;
+    if (idx >= CONFIG_BLUEPAD32_MAX_DEVICES) {
+        loge("Invalid device index: %d\n", idx);
+        return 1;
+    }
+
+    config.deadzone = v[0];
+    config.hysteresis = v[1];
+    config.ways = v[2];
+    config.accel_threshold = v[3];
+    if (v[0] < 1 || v[0] > 511 || v[1] < 0 || v[1] >= v[0] || v[3] < 1 || v[3] > 255 ||
+        !uni_joy_analog_is_valid_config(&config)) {
+        loge("Invalid config. deadzone: 1-511, hysteresis: smaller than deadzone, ways: 4 or 8, accel: 1-255\n");
+        return 1;
+    }
+
+    pending_joy_analog_config = config;
+    device_cmd_safe(DEVICE_CMD_JOY_ANALOG_SET, idx < 0 ? -1 : idx);
+    return 0;
+}
+
+static int perf(int argc, char** argv) {
+    bool reset = (argc >= 2 && strcmp(argv[1], "reset") == 0);
+
+    device_cmd_safe(reset ? DEVICE_CMD_PERF_RESET : DEVICE_CMD_PERF, 0);
+    return 0;
+}
+
+static int latency(int argc, char** argv) {
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    device_cmd_safe(DEVICE_CMD_LATENCY, 0);
+    return 0;
+}
+
+static int queues(int argc, char** argv) {
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    device_cmd_safe(DEVICE_CMD_QUEUES, 0);
+    return 0;
+}
+
+static int mem(int argc, char** argv) {
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+    uni_system_memory_t m;
+
+    uni_system_get_memory(&m);
+    logi("Heap: free=%u, used=%u, min free=%u\n", (unsigned)m.heap_free, (unsigned)m.heap_used,
+         (unsigned)m.heap_min_free);
+    logi("Devices: %u bytes (%d x %u)\n", (unsigned)(sizeof(uni_hid_device_t) * CONFIG_BLUEPAD32_MAX_DEVICES),
+         CONFIG_BLUEPAD32_MAX_DEVICES, (unsigned)sizeof(uni_hid_device_t));
+    return 0;
+}
+
+static const uni_console_cmd_t cmds[] = {
+    {"list_devices", "List info about connected devices", NULL, list_devices},
+    {"disconnect", "Disconnects a gamepad/mouse/etc.", "<device idx>", disconnect_device},
+    {"gap_security_level",
+     "Get/Set GAP security level. Default: 2\n"
+     "  Recommended values: 0, 1 or 2",
+     "[<value>]", gap_security_level},
+    {"gap_periodic_inquiry",
+     "Get/Set GAP periodic inquiry mode. Default: 5 4 3.\n"
+     "  Used for new connections / reconnections.\n"
+     "  1 unit == 1.28 seconds\n"
+     "  See Section 7.1.3 'Periodic Inquiry Mode Command' from Bluetooth spec",
+     "[<max> <min> <len>]", gap_periodic_inquiry},
+    {"list_bluetooth_keys", "List stored Bluetooth keys", NULL, list_bluetooth_keys},
+    {"del_bluetooth_keys", "Delete stored Bluetooth keys. 'Unpairs' devices", NULL, del_bluetooth_keys},
+    {"incoming_connections_enable", "Get/Set whether Bluetooth incoming connections are enabled", "[<0 | 1>]",
+     incoming_connections_enable},
+    {"ble_enable", "Get/Set whether Bluetooth Low Energy (BLE) is enabled", "[<0 | 1>]", ble_enable},
+    {"allowlist_list", "List allowlist addresses", NULL, allowlist_list},
+    {"allowlist_add", "Add address to allowlist list", "<address>", allowlist_add_addr},
+    {"allowlist_remove", "Remove address from allowlist list", "<address>", allowlist_remove_addr},
+    {"allowlist_enable", "Enables/Disables allowlist addresses", "[<0 | 1>]", allowlist_enable},
+    {"reconnect", "Reconnect to the recently used BR/EDR controllers", NULL, reconnect},
+    {"reconnect_list", "List the controllers used by reconnect", NULL, reconnect_list},
+    {"reconnect_enable", "Enables/Disables reconnect at boot", "[<0 | 1>]", reconnect_enable},
+    {"virtual_device_enable", "Enables/Disables virtual devices", "[<0 | 1>]", virtual_device_enable},
+    {"getprop", "Get property or all properties", "[<property_name>]", getprop},
+    {"keymap", "Set keyboard keymap overrides, or list keymaps", "[<profile>]", keymap},
+    {"joy_analog",
+     "Get/Set the analog stick to joystick conversion. Default: 128 32 8 26\n"
+     "  Without device idx, it is the default for all the devices, and it is stored",
+     "[<deadzone> <hysteresis> <ways> <accel threshold> [<device idx>]]", joy_analog},
+    {"perf", "Report counters per device. 'reset' clears them, including the latency", "[reset]", perf},
+    {"latency", "Input report processing time per device, as a histogram", NULL, latency},
+    {"queues", "Output queue depth per device, and LED animation reports", NULL, queues},
+    {"mem", "Memory usage", NULL, mem},
+};
+
+//
+// Public functions
+//
+const uni_console_cmd_t* uni_console_get_cmds(int* count) {
+    *count = ARRAY_SIZE(cmds);
+    return cmds;
+}
+
+int uni_console_run_line(char* line) {
+    char* argv[ARGV_MAX];
+    int argc = 0;
+    char* p = line;
+
+    // Arguments are separated by spaces. Double quotes group words, like in: keymap "single:2c=j1.b2"
+    while (*p && argc < ARGV_MAX) {
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+            p++;
+        if (*p == '\0')
+            break;
+        if (*p == '"') {
+            argv[argc++] = ++p;
+            while (*p && *p != '"')
+                p++;
+        } else {
+            argv[argc++] = p;
+            while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+                p++;
+        }
+        if (*p)
+            *p++ = '\0';
+    }
+
+    if (argc == 0)
+        return 0;
+
+    if (strcmp(argv[0], "help") == 0) {
+        for (size_t i = 0; i < ARRAY_SIZE(cmds); i++)
+            logi("%s %s\n  %s\n\n", cmds[i].command, cmds[i].hint ? cmds[i].hint : "", cmds[i].help);
+        return 0;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(cmds); i++) {
+        if (strcmp(argv[0], cmds[i].command) == 0)
+            return cmds[i].func(argc, argv);
+    }
+
+    loge("Unknown command: %s. Type 'help' to list the commands\n", argv[0]);
+    return -1;
+}
@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#include "uni_gpio_port.h"
+
+#include <string.h>
+
+#include "sdkconfig.h"
+#include "uni_common.h"
+#include "uni_log.h"
+
+#ifdef CONFIG_IDF_TARGET
+#include <soc/gpio_reg.h>
+#include <soc/soc.h>
+#include <soc/soc_caps.h>
+#else
+static uint64_t s_mock_levels;
+static uint32_t s_mock_write_count;
+#endif  // CONFIG_IDF_TARGET
+
+void uni_gpio_port_init(uni_gpio_port_t* port, const int* gpios, int count) {
+    memset(port, 0, sizeof(*port));
+
+    if (count > UNI_GPIO_PORT_LINES_MAX) {
+        loge("uni_gpio_port_init: too many lines: %d, max=%d\n", count, UNI_GPIO_PORT_LINES_MAX);
+        count = UNI_GPIO_PORT_LINES_MAX;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (gpios[i] < 0)
+            continue;
+        port->line_masks[i] = BIT64(gpios[i]);
+        port->valid_lines |= BIT(i);
+    }
+}
+
+void uni_gpio_port_get_masks(const uni_gpio_port_t* port,
+                             uint32_t bits,
+                             uint32_t lines_mask,
+                             uint64_t* out_set_mask,
+                             uint64_t* out_clear_mask) {
+    uint64_t set_mask = 0;
+    uint64_t clear_mask = 0;
+
+    lines_mask &= port->valid_lines;
+    while (lines_mask) {
+        int line = __builtin_ctz(lines_mask);
+        lines_mask &= lines_mask - 1;
+
+        if (bits & BIT(line))
+            set_mask |= port->line_masks[line];
+        else
+            clear_mask |= port->line_masks[line];
+    }
+
+    *out_set_mask = set_mask;
+    *out_clear_mask = clear_mask;
+}
+
+void uni_gpio_port_write(const uni_gpio_port_t* port, uint32_t bits, uint32_t lines_mask) {
+    uint64_t set_mask, clear_mask;
+
+    uni_gpio_port_get_masks(port, bits, lines_mask, &set_mask, &clear_mask);
+    uni_gpio_port_apply(set_mask, clear_mask);
+}
+
+#ifdef CONFIG_IDF_TARGET
+
+void uni_gpio_port_apply(uint64_t set_mask, uint64_t clear_mask) {
+    // GPIOs 0-31 and 32-39 live in different registers.
+    // W1TS / W1TC only touch the written bits, so it is safe to use them
+    // even if other GPIOs are being updated from a different task / ISR.
+    uint32_t set_lo = (uint32_t)set_mask;
+    uint32_t clear_lo = (uint32_t)clear_mask;
+    if (set_lo)
+        REG_WRITE(GPIO_OUT_W1TS_REG, set_lo);
+    if (clear_lo)
+        REG_WRITE(GPIO_OUT_W1TC_REG, clear_lo);
+
+#if SOC_GPIO_PIN_COUNT > 32
+    uint32_t set_hi = (uint32_t)(set_mask >> 32);
+    uint32_t clear_hi = (uint32_t)(clear_mask >> 32);
+    if (set_hi)
+        REG_WRITE(GPIO_OUT1_W1TS_REG, set_hi);
+    if (clear_hi)
+        REG_WRITE(GPIO_OUT1_W1TC_REG, clear_hi);
+#endif  // SOC_GPIO_PIN_COUNT > 32
+}
+
+#else  // !CONFIG_IDF_TARGET
+
+void uni_gpio_port_apply(uint64_t set_mask, uint64_t clear_mask) {
+    // Same semantics as the real one: one "write" per non-empty register.
+    // GPIOs 0-31 and 32-63 are in different registers.
+    s_mock_write_count += ((uint32_t)set_mask != 0) + ((set_mask >> 32) != 0);
+    s_mock_write_count += ((uint32_t)clear_mask != 0) + ((clear_mask >> 32) != 0);
+
+    s_mock_levels |= set_mask;
+    s_mock_levels &= ~clear_mask;
+}
+
+uint64_t uni_gpio_port_mock_get_levels(void) {
+    return s_mock_levels;
+}
+
+uint32_t uni_gpio_port_mock_get_write_count(void) {
+    return s_mock_write_count;
+}
+
+void uni_gpio_port_mock_reset(void) {
+    s_mock_levels = 0;
+    s_mock_write_count = 0;
+}
+
+#endif  // !CONFIG_IDF_TARGET
@@ -13,6 +13,8 @@
 #include "bt/uni_bt_bredr.h"
 #include "bt/uni_bt_defines.h"
 #include "bt/uni_bt_le.h"
+#include "bt/uni_bt_link_policy.h"
+#include "bt/uni_bt_reconnect.h"
 #include "bt/uni_bt_service.h"
 #include "controller/uni_controller_type.h"
 #include "parser/uni_hid_parser_8bitdo.h"
@@ -35,9 +37,13 @@
 #include "parser/uni_hid_parser_wii.h"
 #include "parser/uni_hid_parser_xboxone.h"
 #include "platform/uni_platform.h"
+#include "uni_combo.h"
 #include "uni_common.h"
 #include "uni_config.h"
 #include "uni_log.h"
+#include "uni_metrics.h"
+#include "uni_system.h"
+#include "uni_trace.h"
 #include "uni_virtual_device.h"
 
 enum {
@@ -50,36 +56,73 @@ enum {
     FLAGS_HAS_CONTROLLER_TYPE = BIT(13),
 };
 
-#define MISC_BUTTON_DELAY_MS 200
+// Nintendo Switch family of controllers: each time you press the "system" button it generates
+// two events automatically: press button + release button
+#define SYSTEM_BUTTON_DEBOUNCE_MS 200
+
+// Admission control: when the device table is full, a half-open device can be evicted
+// by a candidate with a higher score.
+#define ADMISSION_SCORE_CONNECTING 16  // Remote device is connecting, or directed reconnect
+#define ADMISSION_SCORE_ALLOWLISTED 8
+#define ADMISSION_SCORE_BONDED 8
+#define ADMISSION_SCORE_COD_GAMEPAD 4  // Gamepad or joystick
+#define ADMISSION_SCORE_COD_PERIPHERAL 2
+// Plus 0-3 points for the RSSI
+// When the HIDS client is busy, and no "report written" event is expected
+#define LE_REPORT_RETRY_MS 50
 
 static uni_hid_device_t g_devices[CONFIG_BLUEPAD32_MAX_DEVICES];
 static const bd_addr_t zero_addr = {0, 0, 0, 0, 0, 0};
+// Shared by all the devices. Each device has its own state.
+static uni_combo_table_t g_combos;
 
-static void process_misc_button_system(uni_hid_device_t* d);
-static void process_misc_button_home(uni_hid_device_t* d);
-static void misc_button_enable_callback(btstack_timer_source_t* ts);
+static void on_combo_system_button(void* context, int id);
+static void on_combo_home_button(void* context, int id);
+static void process_combos(uni_hid_device_t* d);
+static void on_combo_timer(btstack_timer_source_t* ts);
 static void device_connection_timeout(btstack_timer_source_t* ts);
 static void start_connection_timeout(uni_hid_device_t* d);
+static void send_queued_le_report(uni_hid_device_t* d);
+static void on_le_report_retry(btstack_timer_source_t* ts);
+static void start_le_report_retry(uni_hid_device_t* d);
+static int get_admission_score(bd_addr_t addr, uint32_t cod, uint8_t rssi, bool connecting);
+static uni_hid_device_t* create_device(bd_addr_t address, int score);
 
 void uni_hid_device_setup(void) {
+    const uni_combo_t system_button = {
+        .type = UNI_COMBO_TYPE_CHORD,
+        .steps = {UNI_COMBO_MISC(MISC_BUTTON_SYSTEM)},
+        .debounce_ms = SYSTEM_BUTTON_DEBOUNCE_MS,
+        .callback = on_combo_system_button,
+    };
+    // Dumps uni_hid_device debug info in the console.
+    const uni_combo_t home_button = {
+        .type = UNI_COMBO_TYPE_CHORD,
+        .steps = {UNI_COMBO_MISC(MISC_BUTTON_START)},
+        .callback = on_combo_home_button,
+    };
+
     for (int i = 0; i < CONFIG_BLUEPAD32_MAX_DEVICES; i++)
         uni_hid_device_init(&g_devices[i]);
+
+    uni_combo_table_init(&g_combos);
+    uni_combo_table_add(&g_combos, &system_button);
+    uni_combo_table_add(&g_combos, &home_button);
 }
 
-uni_hid_device_t* uni_hid_device_create(bd_addr_t address) {
-    for (int i = 0; i < CONFIG_BLUEPAD32_MAX_DEVICES; i++) {
-        if (bd_addr_cmp(g_devices[i].conn.btaddr, zero_addr) == 0) {
-            logi("Creating device: %s (idx=%d)\n", bd_addr_to_str(address), i);
+int uni_hid_device_add_combo(const uni_combo_t* combo) {
+    int idx = uni_combo_table_add(&g_combos, combo);
+    if (idx < 0)
+        loge("Failed to add combo: invalid, or no more slots available\n");
+    return idx;
+}
 
-            memset(&g_devices[i], 0, sizeof(g_devices[i]));
-            bd_addr_copy(g_devices[i].conn.btaddr, address);
+uni_hid_device_t* uni_hid_device_create(bd_addr_t address) {
+    return create_device(address, get_admission_score(address, 0, 0, true));
+}
 
-            // Delete device if it doesn't have a connection
-            start_connection_timeout(&g_devices[i]);
-            return &g_devices[i];
-        }
-    }
-    return NULL;
+uni_hid_device_t* uni_hid_device_create_discovered(bd_addr_t address, uint32_t cod, uint8_t rssi) {
+    return create_device(address, get_admission_score(address, cod, rssi, false));
 }
 
 uni_hid_device_t* uni_hid_device_create_virtual(uni_hid_device_t* parent) {
@@ -125,6 +168,7 @@ void uni_hid_device_init(uni_hid_device_t* d) {
     }
     memset(d, 0, sizeof(*d));
     d->hids_cid = 0xffff;
+    uni_joy_analog_init(&d->joy_analog);
 
     uni_bt_conn_init(&d->conn);
 }
@@ -217,6 +261,9 @@ void uni_hid_device_set_ready(uni_hid_device_t* d) {
 
     uni_bt_conn_set_state(&d->conn, UNI_BT_CONN_STATE_DEVICE_PENDING_READY);
 
+    if (!uni_hid_device_is_virtual_device(d))
+        uni_trace_record_device(d, UNI_TRACE_RECORD_DEVICE);
+
     // Each "parser" is responsible to call uni_hid_device_set_ready() once the
     // "parser" is ready.
     if (d->report_parser.setup)
@@ -247,6 +294,7 @@ bool uni_hid_device_set_ready_complete(uni_hid_device_t* d) {
     // Platform can reject the connection.
     if (uni_get_platform()->on_device_ready(d) != UNI_ERROR_SUCCESS) {
         loge("Platform declined controller, deleting it\n");
+        uni_metrics_inc(UNI_METRICS_COUNTER_CONNECTIONS_REJECTED);
         uni_hid_device_disconnect(d);
         uni_hid_device_delete(d);
         /* 'd' is destroyed after this call, don't use it */
@@ -254,6 +302,11 @@ bool uni_hid_device_set_ready_complete(uni_hid_device_t* d) {
     }
 
     uni_bt_service_on_device_ready(d);
+    uni_metrics_on_device_ready(d);
+    if (IS_ENABLED(UNI_ENABLE_BREDR)) {
+        uni_bt_reconnect_on_device_ready(d);
+        uni_bt_link_policy_apply(d);
+    }
 
     uni_bt_conn_set_state(&d->conn, UNI_BT_CONN_STATE_DEVICE_READY);
     return true;
@@ -387,13 +440,46 @@ void uni_hid_device_set_hid_descriptor(uni_hid_device_t* d, const uint8_t* descr
     }
 
     int min = btstack_min(HID_MAX_DESCRIPTOR_LEN, len);
-    memcpy(d->hid_descriptor, descriptor, len);
+    memcpy(d->hid_descriptor, descriptor, min);
     d->hid_descriptor_len = min;
     d->flags |= FLAGS_HAS_HID_DESCRIPTOR;
 
     //    printf_hexdump(descriptor, len);
 }
 
+void uni_hid_device_set_le_service_descriptors(uni_hid_device_t* d,
+                                               const uint8_t* const* descriptors,
+                                               const uint16_t* lens,
+                                               int count) {
+    uint16_t offset = 0;
+
+    if (d == NULL) {
+        loge("ERROR: Invalid device\n");
+        return;
+    }
+
+    if (count > HID_DEVICE_MAX_LE_SERVICES) {
+        loge("BLE: device has %d HID services, only the first %d are used\n", count, HID_DEVICE_MAX_LE_SERVICES);
+        count = HID_DEVICE_MAX_LE_SERVICES;
+    }
+
+    for (int i = 0; i < count; i++) {
+        uni_hid_device_le_service_t* s = &d->le_services[i];
+        s->offset = offset;
+        s->len = 0;
+        if (offset + lens[i] > HID_DEVICE_MAX_DESCRIPTORS_LEN) {
+            loge("BLE: HID descriptor of service %d doesn't fit (len=%d)\n", i, lens[i]);
+            continue;
+        }
+        memcpy(&d->hid_descriptor[offset], descriptors[i], lens[i]);
+        s->len = lens[i];
+        offset += lens[i];
+    }
+    d->le_services_count = count;
+    d->hid_descriptor_len = offset;
+    d->flags |= FLAGS_HAS_HID_DESCRIPTOR;
+}
+
 bool uni_hid_device_has_hid_descriptor(uni_hid_device_t* d) {
     if (d == NULL) {
         loge("ERROR: Invalid device\n");
@@ -500,8 +586,16 @@ void uni_hid_device_delete(uni_hid_device_t* d) {
     else
         logi("Deleting device: %s\n", bd_addr_to_str(d->conn.btaddr));
 
-    // Remove the timer. If it was still running, it will crash if the handler gets called.
+    // Remove the timers. If they were still running, it will crash if the handler gets called.
     btstack_run_loop_remove_timer(&d->connection_timer);
+    btstack_run_loop_remove_timer(&d->outgoing_le_retry_timer);
+    btstack_run_loop_remove_timer(&d->combo_timer);
+    uni_led_anim_on_device_deleted(d);
+
+    // Keep the report counters, before they get reset
+    uni_metrics_on_device_deleted(d);
+    if (!uni_hid_device_is_virtual_device(d))
+        uni_trace_record_device(d, UNI_TRACE_RECORD_DISCONNECT);
 
     uni_hid_device_init(d);
 }
@@ -536,6 +630,10 @@ void uni_hid_device_dump_device(uni_hid_device_t* d) {
         "incoming=%d\n",
         d->conn.handle, conn_type, d->hids_cid, d->conn.control_cid, d->conn.interrupt_cid, d->cod, d->flags,
         d->conn.incoming);
+    if (IS_ENABLED(UNI_ENABLE_BREDR))
+        uni_bt_link_policy_dump_device(d);
+    for (int i = 0; i < d->le_services_count; i++)
+        logi("\tHID service %d: descriptor offset=%d, len=%d\n", i, d->le_services[i].offset, d->le_services[i].len);
     logi("\tmodel: vid=0x%04x, pid=0x%04x, model='%s', name='%s'\n", d->vendor_id, d->product_id,
          uni_gamepad_get_model_name(d->controller_type), d->name);
     logi("\tbattery: %d / 255, type=%s\n", d->controller.battery,
@@ -671,6 +769,8 @@ void uni_hid_device_guess_controller_type_from_pid_vid(uni_hid_device_t* d) {
             d->report_parser.setup = uni_hid_parser_ds4_setup;
             d->report_parser.init_report = uni_hid_parser_ds4_init_report;
             d->report_parser.parse_input_report = uni_hid_parser_ds4_parse_input_report;
+            if (IS_ENABLED(CONFIG_BLUEPAD32_ENABLE_DS_INPUT_CRC_CHECK))
+                d->report_parser.validate_input_report = uni_hid_parser_ds4_validate_input_report;
             d->report_parser.parse_feature_report = uni_hid_parser_ds4_parse_feature_report;
             d->report_parser.set_lightbar_color = uni_hid_parser_ds4_set_lightbar_color;
             d->report_parser.play_dual_rumble = uni_hid_parser_ds4_play_dual_rumble;
@@ -681,6 +781,8 @@ void uni_hid_device_guess_controller_type_from_pid_vid(uni_hid_device_t* d) {
             d->report_parser.init_report = uni_hid_parser_ds5_init_report;
             d->report_parser.setup = uni_hid_parser_ds5_setup;
             d->report_parser.parse_input_report = uni_hid_parser_ds5_parse_input_report;
+            if (IS_ENABLED(CONFIG_BLUEPAD32_ENABLE_DS_INPUT_CRC_CHECK))
+                d->report_parser.validate_input_report = uni_hid_parser_ds5_validate_input_report;
             d->report_parser.parse_feature_report = uni_hid_parser_ds5_parse_feature_report;
             d->report_parser.set_player_leds = uni_hid_parser_ds5_set_player_leds;
             d->report_parser.set_lightbar_color = uni_hid_parser_ds5_set_lightbar_color;
@@ -743,6 +845,7 @@ void uni_hid_device_guess_controller_type_from_pid_vid(uni_hid_device_t* d) {
             d->report_parser.parse_input_report = uni_hid_parser_keyboard_parse_input_report;
             d->report_parser.init_report = uni_hid_parser_keyboard_init_report;
             d->report_parser.parse_usage = uni_hid_parser_keyboard_parse_usage;
+            d->report_parser.finish_report = uni_hid_parser_keyboard_finish_report;
             d->report_parser.device_dump = uni_hid_parser_keyboard_device_dump;
             logi("Device detected as Keyboard: 0x%02x\n", type);
             break;
@@ -787,9 +890,66 @@ void uni_hid_device_process_controller(uni_hid_device_t* d) {
         // Deprecated: should implement only on_controller_data
         uni_get_platform()->on_gamepad_data(d, &d->controller.gamepad);
 
-    // FIXME: each backend should decide what to do with misc buttons
-    process_misc_button_system(d);
-    process_misc_button_home(d);
+    if (d->controller.klass == UNI_CONTROLLER_CLASS_GAMEPAD)
+        process_combos(d);
+}
+
+// "service_index" is the BLE HID service that sent the report. Zero on BR/EDR.
+static void on_input_report(uni_hid_device_t* d,
+                            uint8_t service_index,
+                            const uint8_t* descriptor,
+                            uint16_t descriptor_len,
+                            const uint8_t* report,
+                            uint16_t len) {
+    uint64_t start = uni_system_get_time_us();
+
+    if (d->conn.protocol == UNI_BT_CONN_PROTOCOL_BLE)
+        uni_trace_record_le_input_report(d, service_index, report, len);
+    else
+        uni_trace_record_report(d, UNI_TRACE_RECORD_INPUT, UNI_TRACE_CHANNEL_INTERRUPT, report, len);
+
+    if (d->report_parser.validate_input_report && !d->report_parser.validate_input_report(d, report, len)) {
+        logd("Invalid input report, dropping it\n");
+        d->perf.input_invalid++;
+        return;
+    }
+
+    uni_hid_parse_input_report(d, descriptor, descriptor_len, report, len);
+    uni_hid_device_process_controller(d);
+
+    d->perf.input_reports++;
+    uni_perf_histogram_add(&d->perf.input_latency, (uint32_t)(uni_system_get_time_us() - start));
+}
+
+void uni_hid_device_on_input_report(uni_hid_device_t* d, const uint8_t* report, uint16_t len) {
+    on_input_report(d, 0, d->hid_descriptor, d->hid_descriptor_len, report, len);
+}
+
+void uni_hid_device_on_le_input_report(uni_hid_device_t* d,
+                                      uint8_t service_index,
+                                      const uint8_t* report,
+                                      uint16_t len) {
+    const uni_hid_device_le_service_t* s;
+
+    // No per-service layout: there is only one descriptor.
+    if (d->le_services_count == 0) {
+        on_input_report(d, service_index, d->hid_descriptor, d->hid_descriptor_len, report, len);
+        return;
+    }
+
+    if (service_index >= d->le_services_count || d->le_services[service_index].len == 0) {
+        // Only the parsers that use the HID usages need the descriptor. The rest parse the raw report.
+        if (d->report_parser.parse_usage) {
+            logd("BLE: no HID descriptor for service %d, dropping report\n", service_index);
+            d->perf.input_invalid++;
+            return;
+        }
+        on_input_report(d, service_index, NULL, 0, report, len);
+        return;
+    }
+
+    s = &d->le_services[service_index];
+    on_input_report(d, service_index, &d->hid_descriptor[s->offset], s->len, report, len);
 }
 
 // Try to send the report now. If it can't, queue it and send it in the next
@@ -814,7 +974,15 @@ void uni_hid_device_send_report(uni_hid_device_t* d, uint16_t cid, const uint8_t
         logd("Could not send report (error=0x%04x). Adding it to queue\n", err);
         if (uni_circular_buffer_put(&d->outgoing_buffer, cid, report, len) != 0) {
             loge("ERROR: circular buffer full. Cannot queue report\n");
+            d->perf.output_dropped++;
+        } else {
+            d->perf.output_queued++;
+            int count = uni_circular_buffer_count(&d->outgoing_buffer);
+            if (count > d->perf.output_queue_max)
+                d->perf.output_queue_max = count;
         }
+    } else {
+        d->perf.output_reports++;
     }
     // Even, if it can send the report, trigger a "can send now event" in case a report was queued.
     // TODO: Is this really needed?
@@ -827,6 +995,7 @@ void uni_hid_device_send_intr_report(uni_hid_device_t* d, const uint8_t* report,
         loge("Invalid device\n");
         return;
     }
+    uni_trace_record_report(d, UNI_TRACE_RECORD_OUTPUT, UNI_TRACE_CHANNEL_INTERRUPT, report, len);
     uni_hid_device_send_report(d, d->conn.interrupt_cid, report, len);
 }
 
@@ -837,6 +1006,7 @@ void uni_hid_device_send_ctrl_report(uni_hid_device_t* d, const uint8_t* report,
         loge("Invalid device\n");
         return;
     }
+    uni_trace_record_report(d, UNI_TRACE_RECORD_OUTPUT, UNI_TRACE_CHANNEL_CONTROL, report, len);
     uni_hid_device_send_report(d, d->conn.control_cid, report, len);
 }
 
@@ -862,6 +1032,68 @@ void uni_hid_device_send_queued_reports(uni_hid_device_t* d) {
     uni_hid_device_send_report(d, cid, data, data_len);
 }
 
+// BLE: Writes the output report now. If a write is in flight, or the HIDS client is busy, it is queued
+// and written once the previous one is acknowledged.
+// A queued report with the same report ID is replaced, since it was superseded. E.g: rumble on / off.
+void uni_hid_device_send_le_report(uni_hid_device_t* d, uint8_t report_id, const uint8_t* report, uint16_t len) {
+    if (d == NULL) {
+        loge("Invalid device\n");
+        return;
+    }
+    if (!report || len <= 0) {
+        loge("Send LE report: Invalid report\n");
+        return;
+    }
+    uni_trace_record_report(d, UNI_TRACE_RECORD_OUTPUT, UNI_TRACE_CHANNEL_GATT, report, len);
+
+    // Keep the order: if there are queued reports, they go first.
+    if (!d->outgoing_le_in_flight && uni_circular_buffer_is_empty(&d->outgoing_buffer)) {
+        uint8_t status = hids_client_send_write_report(d->hids_cid, report_id, HID_REPORT_TYPE_OUTPUT, report, len);
+        if (status == ERROR_CODE_SUCCESS) {
+            d->outgoing_le_in_flight = true;
+            d->outgoing_le_start_us = uni_system_get_time_us();
+            d->perf.output_reports++;
+            return;
+        }
+        if (status != ERROR_CODE_COMMAND_DISALLOWED) {
+            loge("Send LE report: failed to write report id %#x, error=%#x\n", report_id, status);
+            d->perf.output_dropped++;
+            return;
+        }
+        // HIDS client busy with a different request. Queue it, and retry later.
+        start_le_report_retry(d);
+    }
+
+    // The report ID is used as the "cid" in the queue.
+    if (uni_circular_buffer_replace(&d->outgoing_buffer, report_id, report, len) == UNI_CIRCULAR_BUFFER_ERROR_OK) {
+        d->perf.output_collapsed++;
+        return;
+    }
+    if (uni_circular_buffer_put(&d->outgoing_buffer, report_id, report, len) != UNI_CIRCULAR_BUFFER_ERROR_OK) {
+        loge("ERROR: circular buffer full. Cannot queue LE report\n");
+        d->perf.output_dropped++;
+        return;
+    }
+    d->perf.output_queued++;
+    int count = uni_circular_buffer_count(&d->outgoing_buffer);
+    if (count > d->perf.output_queue_max)
+        d->perf.output_queue_max = count;
+}
+
+// BLE: Called when GATTSERVICE_SUBEVENT_HID_REPORT_WRITTEN is received. Writes the next queued report, if any.
+void uni_hid_device_on_le_report_written(uni_hid_device_t* d) {
+    if (d == NULL) {
+        loge("Invalid device\n");
+        return;
+    }
+    if (d->outgoing_le_in_flight) {
+        d->outgoing_le_in_flight = false;
+        uni_perf_histogram_add(&d->perf.output_latency,
+                               (uint32_t)(uni_system_get_time_us() - d->outgoing_le_start_us));
+    }
+    send_queued_le_report(d);
+}
+
 bool uni_hid_device_does_require_hid_descriptor(uni_hid_device_t* d) {
     if (d == NULL) {
         loge("uni_hid_device_does_require_hid_descriptor: failed, device is NULL\n");
@@ -909,62 +1141,48 @@ bool uni_hid_device_is_virtual_device(uni_hid_device_t* d) {
 
 // Helpers
 
-static void misc_button_enable_callback(btstack_timer_source_t* ts) {
-    uni_hid_device_t* d = btstack_run_loop_get_timer_context(ts);
-    d->misc_button_wait_delay &= ~MISC_BUTTON_SYSTEM;
+static void on_combo_system_button(void* context, int id) {
+    ARG_UNUSED(id);
+    uni_get_platform()->on_oob_event(UNI_PLATFORM_OOB_GAMEPAD_SYSTEM_BUTTON, context);
 }
 
-// process_mic_button_system
-static void process_misc_button_system(uni_hid_device_t* d) {
-    if ((d->controller.gamepad.misc_buttons & MISC_BUTTON_SYSTEM) == 0) {
-        // System button released?
-        d->misc_button_wait_release &= ~MISC_BUTTON_SYSTEM;
-        return;
-    }
-
-    if (d->misc_button_wait_release & MISC_BUTTON_SYSTEM)
-        return;
+static void on_combo_home_button(void* context, int id) {
+    ARG_UNUSED(context);
+    ARG_UNUSED(id);
+    uni_hid_device_dump_all();
+}
 
-    // Needed only for Nintendo Switch family of controllers.
-    // This is because each time you press the "system" button it generates two events
-    // automatically:  press button + release button
-    // We artificially add a delay.
-    bool requires_delay = (d->controller_type == CONTROLLER_TYPE_SwitchProController ||
-                           d->controller_type == CONTROLLER_TYPE_SwitchJoyConLeft ||
-                           d->controller_type == CONTROLLER_TYPE_SwitchJoyConRight);
+static void process_combos(uni_hid_device_t* d) {
+    uint32_t next_ms;
 
-    if (requires_delay && (d->misc_button_wait_delay & MISC_BUTTON_SYSTEM))
+    btstack_run_loop_remove_timer(&d->combo_timer);
+    next_ms = uni_combo_process(&g_combos, &d->combo, uni_combo_buttons_from_gamepad(&d->controller.gamepad),
+                                (uint32_t)(uni_system_get_time_us() / 1000), d);
+    // Callbacks might have deleted the device.
+    if (next_ms == 0 || uni_bt_conn_get_state(&d->conn) != UNI_BT_CONN_STATE_DEVICE_READY)
         return;
 
-    d->misc_button_wait_release |= MISC_BUTTON_SYSTEM;
-
-    uni_get_platform()->on_oob_event(UNI_PLATFORM_OOB_GAMEPAD_SYSTEM_BUTTON, d);
-
-    if (requires_delay) {
-        d->misc_button_wait_delay |= MISC_BUTTON_SYSTEM;
-        btstack_run_loop_set_timer_context(&d->misc_button_delay_timer, d);
-        btstack_run_loop_set_timer_handler(&d->misc_button_delay_timer, &misc_button_enable_callback);
-        btstack_run_loop_set_timer(&d->misc_button_delay_timer, MISC_BUTTON_DELAY_MS);
-        btstack_run_loop_add_timer(&d->misc_button_delay_timer);
-    }
+    // Long press pending: it must fire even if no more reports arrive.
+    btstack_run_loop_set_timer_context(&d->combo_timer, d);
+    btstack_run_loop_set_timer_handler(&d->combo_timer, &on_combo_timer);
+    btstack_run_loop_set_timer(&d->combo_timer, next_ms);
+    btstack_run_loop_add_timer(&d->combo_timer);
 }
 
-// process_misc_button_home dumps uni_hid_device debug info in the console.
-static void process_misc_button_home(uni_hid_device_t* d) {
-    if ((d->controller.gamepad.misc_buttons & MISC_BUTTON_START) == 0) {
-        // Home button released? Clear "wait" flag.
-        d->misc_button_wait_release &= ~MISC_BUTTON_START;
-        return;
-    }
+static void on_combo_timer(btstack_timer_source_t* ts) {
+    uni_hid_device_t* d = btstack_run_loop_get_timer_context(ts);
+    uint32_t next_ms;
 
-    // "Wait" flag present? Return.
-    if (d->misc_button_wait_release & MISC_BUTTON_START)
+    if (uni_bt_conn_get_state(&d->conn) != UNI_BT_CONN_STATE_DEVICE_READY)
         return;
 
-    // Update "wait" flag.
-    d->misc_button_wait_release |= MISC_BUTTON_START;
-
-    uni_hid_device_dump_all();
+    // Same buttons as the last report: only the deadlines are evaluated.
+    next_ms = uni_combo_process(&g_combos, &d->combo, d->combo.prev_buttons,
+                                (uint32_t)(uni_system_get_time_us() / 1000), d);
+    if (next_ms == 0 || uni_bt_conn_get_state(&d->conn) != UNI_BT_CONN_STATE_DEVICE_READY)
+        return;
+    btstack_run_loop_set_timer(&d->combo_timer, next_ms);
+    btstack_run_loop_add_timer(&d->combo_timer);
 }
 
 static void device_connection_timeout(btstack_timer_source_t* ts) {
@@ -982,6 +1200,157 @@ static void device_connection_timeout(btstack_timer_source_t* ts) {
     /* 'd'' is destroyed after this call, don't use it */
 }
 
+static bool is_bonded(bd_addr_t addr) {
+    if (IS_ENABLED(UNI_ENABLE_BREDR) && uni_bt_bredr_is_bonded(addr))
+        return true;
+    if (IS_ENABLED(UNI_ENABLE_BLE) && uni_bt_le_is_bonded(addr))
+        return true;
+    return false;
+}
+
+static int get_admission_score(bd_addr_t addr, uint32_t cod, uint8_t rssi, bool connecting) {
+    int score = 0;
+    int dbm = (int8_t)rssi;
+
+    if (connecting)
+        score += ADMISSION_SCORE_CONNECTING;
+    if (uni_bt_allowlist_is_enabled() && uni_bt_allowlist_is_allowed_addr(addr))
+        score += ADMISSION_SCORE_ALLOWLISTED;
+    if (is_bonded(addr))
+        score += ADMISSION_SCORE_BONDED;
+
+    if ((cod & UNI_BT_COD_MAJOR_MASK) == UNI_BT_COD_MAJOR_PERIPHERAL) {
+        if (cod & (UNI_BT_COD_MINOR_GAMEPAD | UNI_BT_COD_MINOR_JOYSTICK))
+            score += ADMISSION_SCORE_COD_GAMEPAD;
+        else
+            score += ADMISSION_SCORE_COD_PERIPHERAL;
+    }
+
+    // RSSI is in dBm, as a signed 8-bit value. 0 and 255 are used when it is not available.
+    if (rssi != 0 && rssi != 255) {
+        if (dbm >= -50)
+            score += 3;
+        else if (dbm >= -65)
+            score += 2;
+        else if (dbm >= -80)
+            score += 1;
+    }
+    return score;
+}
+
+// Half-open: created, but it didn't open any channel yet. E.g: waiting for the name, or never answered.
+// BLE devices are not evicted: a pending LE connection cannot be associated with another device.
+static bool is_evictable(uni_hid_device_t* d) {
+    if (uni_hid_device_is_virtual_device(d) || d->conn.protocol == UNI_BT_CONN_PROTOCOL_BLE)
+        return false;
+    if (d->conn.control_cid != 0 || d->conn.interrupt_cid != 0)
+        return false;
+
+    switch (uni_bt_conn_get_state(&d->conn)) {
+        case UNI_BT_CONN_STATE_DEVICE_NONE:
+        case UNI_BT_CONN_STATE_DEVICE_DISCOVERED:
+        case UNI_BT_CONN_STATE_REMOTE_NAME_REQUEST:
+        case UNI_BT_CONN_STATE_REMOTE_NAME_INQUIRED:
+        case UNI_BT_CONN_STATE_REMOTE_NAME_FETCHED:
+            return true;
+        default:
+            // SDP queries and L2CAP connections in progress are not interrupted.
+            return false;
+    }
+}
+
+static uni_hid_device_t* create_device(bd_addr_t address, int score) {
+    uni_hid_device_t* victim = NULL;
+    int victim_score = 0;
+    uni_hid_device_t* d;
+
+    for (int i = 0; i < CONFIG_BLUEPAD32_MAX_DEVICES; i++) {
+        d = &g_devices[i];
+        if (bd_addr_cmp(d->conn.btaddr, zero_addr) != 0) {
+            if (is_evictable(d)) {
+                int s = get_admission_score(d->conn.btaddr, d->cod, d->conn.rssi, uni_hid_device_is_incoming(d));
+                if (victim == NULL || s < victim_score) {
+                    victim = d;
+                    victim_score = s;
+                }
+            }
+            continue;
+        }
+
+        logi("Creating device: %s (idx=%d, score=%d)\n", bd_addr_to_str(address), i, score);
+
+        memset(d, 0, sizeof(*d));
+        bd_addr_copy(d->conn.btaddr, address);
+
+        // Delete device if it doesn't have a connection
+        start_connection_timeout(d);
+        return d;
+    }
+
+    // No free slots. Evict the worst half-open device, but only for a better candidate.
+    if (victim == NULL || victim_score >= score) {
+        logi("Device table full, rejecting %s (score=%d)\n", bd_addr_to_str(address), score);
+        uni_metrics_inc(UNI_METRICS_COUNTER_DEVICES_REJECTED);
+        return NULL;
+    }
+
+    // bd_addr_to_str() uses a static buffer, can't be called twice in the same log
+    logi("Device table full, evicting %s (score=%d), ", bd_addr_to_str(victim->conn.btaddr), victim_score);
+    logi("for %s (score=%d)\n", bd_addr_to_str(address), score);
+    uni_metrics_inc(UNI_METRICS_COUNTER_DEVICES_EVICTED);
+    uni_hid_device_disconnect(victim);
+    uni_hid_device_delete(victim);
+    /* 'victim' is destroyed after this call, don't use it */
+
+    // The slot is free now.
+    return create_device(address, score);
+}
+
+static void send_queued_le_report(uni_hid_device_t* d) {
+    void* data;
+    int data_len;
+    int16_t report_id;
+
+    if (d->outgoing_le_in_flight)
+        return;
+    if (uni_circular_buffer_peek(&d->outgoing_buffer, &report_id, &data, &data_len) != UNI_CIRCULAR_BUFFER_ERROR_OK)
+        return;
+
+    uint8_t status = hids_client_send_write_report(d->hids_cid, report_id, HID_REPORT_TYPE_OUTPUT, data, data_len);
+    if (status == ERROR_CODE_COMMAND_DISALLOWED) {
+        // HIDS client busy with a different request. Keep it queued, and retry later.
+        start_le_report_retry(d);
+        return;
+    }
+
+    // Remove it from the queue
+    uni_circular_buffer_get(&d->outgoing_buffer, &report_id, &data, &data_len);
+
+    if (status != ERROR_CODE_SUCCESS) {
+        loge("Send LE report: failed to write report id %#x, error=%#x\n", report_id, status);
+        d->perf.output_dropped++;
+        // Try with the next one
+        send_queued_le_report(d);
+        return;
+    }
+    d->outgoing_le_in_flight = true;
+    d->outgoing_le_start_us = uni_system_get_time_us();
+    d->perf.output_reports++;
+}
+
+static void on_le_report_retry(btstack_timer_source_t* ts) {
+    uni_hid_device_t* d = btstack_run_loop_get_timer_context(ts);
+    send_queued_le_report(d);
+}
+
+static void start_le_report_retry(uni_hid_device_t* d) {
+    btstack_run_loop_remove_timer(&d->outgoing_le_retry_timer);
+    btstack_run_loop_set_timer_context(&d->outgoing_le_retry_timer, d);
+    btstack_run_loop_set_timer_handler(&d->outgoing_le_retry_timer, &on_le_report_retry);
+    btstack_run_loop_set_timer(&d->outgoing_le_retry_timer, LE_REPORT_RETRY_MS);
+    btstack_run_loop_add_timer(&d->outgoing_le_retry_timer);
+}
+
 static void start_connection_timeout(uni_hid_device_t* d) {
     btstack_run_loop_set_timer_context(&d->connection_timer, d);
     btstack_run_loop_set_timer_handler(&d->connection_timer, &device_connection_timeout);
@@ -12,8 +12,12 @@
 #include "uni_config.h"
 #include "uni_console.h"
 #include "uni_hid_device.h"
+#include "uni_joystick.h"
+#include "uni_keymap.h"
 #include "uni_log.h"
+#include "uni_metrics.h"
 #include "uni_property.h"
+#include "uni_trace.h"
 #include "uni_version.h"
 #include "uni_virtual_device.h"
 
@@ -28,17 +32,25 @@ int uni_init(int argc, const char** argv) {
     loge("BTstack: Copyright (C) 2017 BlueKitchen GmbH.\n");
 
     uni_property_init();
+    uni_keymap_init();
+    uni_joystick_init();
     uni_platform_init(argc, argv);
     uni_hid_device_setup();
+    uni_trace_init();
 
     // Continue with bluetooth setup.
     uni_bt_setup();
     uni_bt_allowlist_init();
     uni_virtual_device_init();
 
-#if CONFIG_BLUEPAD32_USB_CONSOLE_ENABLE
+    // Opt-in. ESP32: CONFIG_BLUEPAD32_USB_CONSOLE_ENABLE. Linux and Pico W: CONFIG_BLUEPAD32_CONSOLE_ENABLE.
+#if defined(CONFIG_BLUEPAD32_USB_CONSOLE_ENABLE) || defined(CONFIG_BLUEPAD32_CONSOLE_ENABLE)
     uni_console_init();
-#endif  // CONFIG_BLUEPAD32_CONSOLE_ENABLE
+#endif
+
+#ifdef CONFIG_TARGET_POSIX
+    uni_metrics_exporter_init();
+#endif  // CONFIG_TARGET_POSIX
 
     uni_balance_board_init();
 
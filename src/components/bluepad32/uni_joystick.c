@@ -7,148 +7,319 @@
 #include <string.h>
 
 #include "hid_usage.h"
+#include "uni_keymap.h"
 #include "uni_log.h"
+#include "uni_property.h"
 
 // When accelerometer mode is enabled, it will use it as if it were
 // in the Nintendo Wii Wheel.
 #define ENABLE_ACCEL_WHEEL_MODE 1
 
-static void to_single_joy(const uni_gamepad_t* gp, uni_joystick_t* out_joy) {
+// Sector boundaries, as "256 * tan(angle)", where the angle is measured from the boundary to the axis.
+// A stick at (a, b), "a" being the axis, is inside the sector if: b * k < a * 256.
+// 8 ways: the axis is "on" up to 67.5 degrees away from it. 72.5 if it was "on" already.
+#define SECTOR_8_ENTER 106  // tan(22.5)
+#define SECTOR_8_KEEP 81    // tan(17.5)
+// 4 ways: the axis is "on" up to 45 degrees away from it. 50 if it was "on" already.
+#define SECTOR_4_ENTER 256  // tan(45)
+#define SECTOR_4_KEEP 215   // tan(40)
+#define SECTOR_4_LEAVE 305  // tan(50)
+
+static uni_joy_analog_config_t default_config = {
+    .deadzone = UNI_JOY_ANALOG_DEADZONE_DEFAULT,
+    .hysteresis = UNI_JOY_ANALOG_HYSTERESIS_DEFAULT,
+    .ways = UNI_JOY_ANALOG_WAYS_DEFAULT,
+    .accel_threshold = UNI_JOY_ANALOG_ACCEL_THRESHOLD_DEFAULT,
+};
+
+//
+// Helpers
+//
+static bool in_sector(int a, int b, int k) {
+    return b * k < a * 256;
+}
+
+// One axis, with hysteresis: once on, it stays on until "keep".
+static uni_joystick_bits_t axis_to_dir(int v,
+                                       int on,
+                                       int keep,
+                                       uni_joystick_bits_t prev,
+                                       uni_joystick_bits_t neg,
+                                       uni_joystick_bits_t pos) {
+    if (v < -((prev & neg) ? keep : on))
+        return neg;
+    if (v > ((prev & pos) ? keep : on))
+        return pos;
+    return 0;
+}
+
+static uni_joystick_bits_t stick_to_dir(uni_joy_analog_t* a, bool right, int x, int y) {
+    uni_joystick_bits_t* prev;
+
+    if (!a)
+        return uni_joy_analog_to_dir(&default_config, 0, x, y);
+
+    prev = right ? &a->right_dir : &a->left_dir;
+    *prev = uni_joy_analog_to_dir(&a->config, *prev, x, y);
+    return *prev;
+}
+
+static uni_joystick_bits_t to_single_joy(const uni_gamepad_t* gp, uni_joy_analog_t* analog) {
+    uni_joystick_bits_t bits = 0;
+
     // Button A is "fire"
-    out_joy->fire |= ((gp->buttons & BUTTON_A) != 0);
     // Thumb left is "fire"
-    out_joy->fire |= ((gp->buttons & BUTTON_THUMB_L) != 0);
+    if (gp->buttons & (BUTTON_A | BUTTON_THUMB_L))
+        bits |= UNI_JOYSTICK_BIT_FIRE;
 
     // Shoulder right is "auto fire"
-    out_joy->auto_fire |= ((gp->buttons & BUTTON_SHOULDER_R) != 0);
+    if (gp->buttons & BUTTON_SHOULDER_R)
+        bits |= UNI_JOYSTICK_BIT_AUTO_FIRE;
 
     // Dpad
     if (gp->dpad & DPAD_UP)
-        out_joy->up |= 1;
+        bits |= UNI_JOYSTICK_BIT_UP;
     if (gp->dpad & DPAD_DOWN)
-        out_joy->down |= 1;
+        bits |= UNI_JOYSTICK_BIT_DOWN;
     if (gp->dpad & DPAD_RIGHT)
-        out_joy->right |= 1;
+        bits |= UNI_JOYSTICK_BIT_RIGHT;
     if (gp->dpad & DPAD_LEFT)
-        out_joy->left |= 1;
+        bits |= UNI_JOYSTICK_BIT_LEFT;
 
     // Axis: X and Y
-    out_joy->left |= (gp->axis_x < -AXIS_THRESHOLD);
-    out_joy->right |= (gp->axis_x > AXIS_THRESHOLD);
-    out_joy->up |= (gp->axis_y < -AXIS_THRESHOLD);
-    out_joy->down |= (gp->axis_y > AXIS_THRESHOLD);
+    bits |= stick_to_dir(analog, false /* right */, gp->axis_x, gp->axis_y);
 
     // 2nd & 3rd buttons
-    out_joy->button2 = (gp->brake >> 2);     // convert from 1024 to 256
-    out_joy->button3 = (gp->throttle >> 2);  // convert from 1024 to 256
+    // Convert from 1024 to 256. Anything that is not zero is "pressed".
+    if (gp->brake >> 2)
+        bits |= UNI_JOYSTICK_BIT_BUTTON2;
+    if (gp->throttle >> 2)
+        bits |= UNI_JOYSTICK_BIT_BUTTON3;
+
+    return bits;
+}
+
+//
+// Public functions
+//
+void uni_joystick_init(void) {
+    uni_joy_analog_config_t config;
+
+    config.accel_threshold = uni_property_get(UNI_PROPERTY_IDX_JOY_ACCEL_THRESHOLD).u8;
+    config.deadzone = uni_property_get(UNI_PROPERTY_IDX_JOY_DEADZONE).u32;
+    config.hysteresis = uni_property_get(UNI_PROPERTY_IDX_JOY_HYSTERESIS).u32;
+    config.ways = uni_property_get(UNI_PROPERTY_IDX_JOY_WAYS).u8;
+
+    if (!uni_joy_analog_is_valid_config(&config)) {
+        loge("Joystick: invalid stored analog config, using defaults\n");
+        return;
+    }
+    default_config = config;
+}
+
+bool uni_joy_analog_is_valid_config(const uni_joy_analog_config_t* config) {
+    return config->deadzone > 0 && config->deadzone < 512 && config->hysteresis < config->deadzone &&
+           (config->ways == 4 || config->ways == 8) && config->accel_threshold > 0;
+}
+
+int uni_joy_analog_set_default_config(const uni_joy_analog_config_t* config) {
+    uni_property_value_t val;
+
+    if (!uni_joy_analog_is_valid_config(config))
+        return -1;
+
+    val.u8 = config->accel_threshold;
+    uni_property_set(UNI_PROPERTY_IDX_JOY_ACCEL_THRESHOLD, val);
+    val.u32 = config->deadzone;
+    uni_property_set(UNI_PROPERTY_IDX_JOY_DEADZONE, val);
+    val.u32 = config->hysteresis;
+    uni_property_set(UNI_PROPERTY_IDX_JOY_HYSTERESIS, val);
+    val.u8 = config->ways;
+    uni_property_set(UNI_PROPERTY_IDX_JOY_WAYS, val);
+
+    default_config = *config;
+    return 0;
+}
+
+uni_joy_analog_config_t uni_joy_analog_get_default_config(void) {
+    return default_config;
+}
+
+void uni_joy_analog_init(uni_joy_analog_t* a) {
+    memset(a, 0, sizeof(*a));
+    a->config = default_config;
+}
+
+uni_joystick_bits_t uni_joy_analog_to_dir(const uni_joy_analog_config_t* config,
+                                          uni_joystick_bits_t prev,
+                                          int x,
+                                          int y) {
+    uni_joystick_bits_t bits = 0;
+    int ax = (x < 0) ? -x : x;
+    int ay = (y < 0) ? -y : y;
+    bool prev_x = prev & (UNI_JOYSTICK_BIT_LEFT | UNI_JOYSTICK_BIT_RIGHT);
+    bool prev_y = prev & (UNI_JOYSTICK_BIT_UP | UNI_JOYSTICK_BIT_DOWN);
+    bool on_x, on_y;
+
+    // Radial deadzone. Max radius squared is ~2^19: no overflow.
+    int radius = (prev_x || prev_y) ? config->deadzone - config->hysteresis : config->deadzone;
+    if (ax * ax + ay * ay <= radius * radius)
+        return 0;
+
+    if (config->ways == 4) {
+        // Only the dominant axis. Ties go to X, unless Y was on.
+        int k = prev_x ? SECTOR_4_KEEP : (prev_y ? SECTOR_4_LEAVE : SECTOR_4_ENTER);
+        on_x = in_sector(ax, ay, k) || (k == SECTOR_4_ENTER && ax == ay);
+        on_y = !on_x;
+    } else {
+        on_x = in_sector(ax, ay, prev_x ? SECTOR_8_KEEP : SECTOR_8_ENTER);
+        on_y = in_sector(ay, ax, prev_y ? SECTOR_8_KEEP : SECTOR_8_ENTER);
+    }
+
+    if (on_x)
+        bits |= (x < 0) ? UNI_JOYSTICK_BIT_LEFT : UNI_JOYSTICK_BIT_RIGHT;
+    if (on_y)
+        bits |= (y < 0) ? UNI_JOYSTICK_BIT_UP : UNI_JOYSTICK_BIT_DOWN;
+    return bits;
 }
 
 // Basic Mode: One gamepad controls one joystick
-void uni_joy_to_single_joy_from_gamepad(const uni_gamepad_t* gp, uni_joystick_t* out_joy, int use_two_buttons) {
-    to_single_joy(gp, out_joy);
+uni_joystick_bits_t uni_joy_bits_single_from_gamepad(const uni_gamepad_t* gp,
+                                                     int use_two_buttons,
+                                                     uni_joy_analog_t* analog) {
+    uni_joystick_bits_t bits = to_single_joy(gp, analog);
 
     if (!use_two_buttons) {
         // Buttom B is "jump". Good for C64 games
-        out_joy->up |= ((gp->buttons & BUTTON_B) != 0);
+        if (gp->buttons & BUTTON_B)
+            bits |= UNI_JOYSTICK_BIT_UP;
     } else {
         // Buttom B is second joystick button, as in MSX
-        out_joy->button2 = ((gp->buttons & BUTTON_B) != 0);
+        bits &= ~UNI_JOYSTICK_BIT_BUTTON2;
+        if (gp->buttons & BUTTON_B)
+            bits |= UNI_JOYSTICK_BIT_BUTTON2;
     }
 
     // 2nd & 3rd buttons
-    out_joy->button2 |= ((gp->buttons & BUTTON_X) != 0);
-    out_joy->button3 |= ((gp->buttons & BUTTON_Y) != 0);
+    if (gp->buttons & BUTTON_X)
+        bits |= UNI_JOYSTICK_BIT_BUTTON2;
+    if (gp->buttons & BUTTON_Y)
+        bits |= UNI_JOYSTICK_BIT_BUTTON3;
+
+    return bits;
 }
 
 // Twin Stick mode: One gamepad controls two joysticks
-void uni_joy_to_twinstick_from_gamepad(const uni_gamepad_t* gp, uni_joystick_t* out_joy1, uni_joystick_t* out_joy2) {
-    to_single_joy(gp, out_joy2);
+void uni_joy_bits_twinstick_from_gamepad(const uni_gamepad_t* gp,
+                                         uni_joy_analog_t* analog,
+                                         uni_joystick_bits_t* out_joy1,
+                                         uni_joystick_bits_t* out_joy2) {
+    uni_joystick_bits_t joy1 = 0;
+    uni_joystick_bits_t joy2 = to_single_joy(gp, analog);
 
-    out_joy2->button2 |= ((gp->buttons & BUTTON_X) != 0);
+    if (gp->buttons & BUTTON_X)
+        joy2 |= UNI_JOYSTICK_BIT_BUTTON2;
 
     // Button B is "fire"
-    out_joy1->fire |= ((gp->buttons & BUTTON_B) != 0);
     // Thumb right is "fire"
-    out_joy1->fire |= ((gp->buttons & BUTTON_THUMB_R) != 0);
+    if (gp->buttons & (BUTTON_B | BUTTON_THUMB_R))
+        joy1 |= UNI_JOYSTICK_BIT_FIRE;
 
-    out_joy1->button2 |= ((gp->buttons & BUTTON_Y) != 0);
+    if (gp->buttons & BUTTON_Y)
+        joy1 |= UNI_JOYSTICK_BIT_BUTTON2;
 
     // Swap "auto fire" in Twin Stick
     // "left" belongs to joy1 while "right" to joy2.
-    out_joy2->auto_fire = ((gp->buttons & BUTTON_SHOULDER_L) != 0);
-    out_joy1->auto_fire = ((gp->buttons & BUTTON_SHOULDER_R) != 0);
+    joy2 &= ~UNI_JOYSTICK_BIT_AUTO_FIRE;
+    if (gp->buttons & BUTTON_SHOULDER_L)
+        joy2 |= UNI_JOYSTICK_BIT_AUTO_FIRE;
+    if (gp->buttons & BUTTON_SHOULDER_R)
+        joy1 |= UNI_JOYSTICK_BIT_AUTO_FIRE;
 
     // Axis: RX and RY
-    out_joy1->left |= (gp->axis_rx < -AXIS_THRESHOLD);
-    out_joy1->right |= (gp->axis_rx > AXIS_THRESHOLD);
-    out_joy1->up |= (gp->axis_ry < -AXIS_THRESHOLD);
-    out_joy1->down |= (gp->axis_ry > AXIS_THRESHOLD);
-}
+    joy1 |= stick_to_dir(analog, true /* right */, gp->axis_rx, gp->axis_ry);
 
-void uni_joy_to_single_from_wii_accel(const uni_gamepad_t* gp, uni_joystick_t* out_joy) {
-    // Button "1" is Brake (down), and button "2" is Throttle (up)
-    // Buttons "1" and "2" can override values from Dpad.
+    *out_joy1 = joy1;
+    *out_joy2 = joy2;
+}
 
-    const int16_t accel_threshold = 26;
+uni_joystick_bits_t uni_joy_bits_single_from_wii_accel(const uni_gamepad_t* gp, uni_joy_analog_t* analog) {
+    const uni_joy_analog_config_t* config = analog ? &analog->config : &default_config;
+    uni_joystick_bits_t prev = analog ? analog->accel_dir : 0;
+    int on = config->accel_threshold;
+    int keep = mult_frac(on, 3, 4);
 
     int sx = gp->accel[0];
     int sy = gp->accel[1];
 
-    memset(out_joy, 0, sizeof(*out_joy));
+    uni_joystick_bits_t bits = 0;
+    uni_joystick_bits_t accel_bits = 0;
 
 #ifdef ENABLE_ACCEL_WHEEL_MODE
     // Is the wheel in resting position, don't read accelerometer
-    if (sx > -accel_threshold && sx < accel_threshold) {
+    int rest = (analog && analog->accel_active) ? keep : on;
+    if (sx > -rest && sx < rest) {
         // Accelerometer reading disabled.
         // logd("Wii: Wheel in resting position, do nothing");
-    } else {
-        // Preserve Dpad values... they are used to navigate menus.
-        out_joy->up |= (gp->dpad & DPAD_UP) ? 1 : 0;
-        out_joy->down |= (gp->dpad & DPAD_DOWN) ? 1 : 0;
-        out_joy->left |= (gp->dpad & DPAD_LEFT) ? 1 : 0;
-        out_joy->right |= (gp->dpad & DPAD_RIGHT) ? 1 : 0;
-
-        // Button "1" is Brake (down), and button "2" is Throttle (up)
-        // Buttons "1" and "2" can override values from Dpad.
-        out_joy->down |= (gp->buttons & BUTTON_A) ? DPAD_DOWN : 0;
-        out_joy->up |= (gp->buttons & BUTTON_B) ? DPAD_UP : 0;
-
-        // Either "A" or "trigger" is used as fire
-        out_joy->fire = (gp->buttons & BUTTON_X) ? 1 : 0;
-        out_joy->fire |= (gp->buttons & BUTTON_Y) ? 1 : 0;
-
-        // Accelerometer overrides Dpad values.
-        if (sy > accel_threshold) {
-            out_joy->left = 1;
-            out_joy->right = 0;
-        } else if (sy < -accel_threshold) {
-            out_joy->right = 1;
-            out_joy->left = 0;
+        if (analog) {
+            analog->accel_active = false;
+            analog->accel_dir = 0;
         }
+        return bits;
     }
+    if (analog)
+        analog->accel_active = true;
+
+    // Preserve Dpad values... they are used to navigate menus.
+    if (gp->dpad & DPAD_UP)
+        bits |= UNI_JOYSTICK_BIT_UP;
+    if (gp->dpad & DPAD_DOWN)
+        bits |= UNI_JOYSTICK_BIT_DOWN;
+    if (gp->dpad & DPAD_LEFT)
+        bits |= UNI_JOYSTICK_BIT_LEFT;
+    if (gp->dpad & DPAD_RIGHT)
+        bits |= UNI_JOYSTICK_BIT_RIGHT;
+
+    // Button "1" is Brake (down), and button "2" is Throttle (up)
+    // Buttons "1" and "2" can override values from Dpad.
+    if (gp->buttons & BUTTON_A)
+        bits |= UNI_JOYSTICK_BIT_DOWN;
+    if (gp->buttons & BUTTON_B)
+        bits |= UNI_JOYSTICK_BIT_UP;
+
+    // Either "A" or "trigger" is used as fire
+    if (gp->buttons & (BUTTON_X | BUTTON_Y))
+        bits |= UNI_JOYSTICK_BIT_FIRE;
+
+    // Accelerometer overrides Dpad values.
+    accel_bits = axis_to_dir(sy, on, keep, prev, UNI_JOYSTICK_BIT_RIGHT, UNI_JOYSTICK_BIT_LEFT);
+    if (accel_bits)
+        bits &= ~(UNI_JOYSTICK_BIT_LEFT | UNI_JOYSTICK_BIT_RIGHT);
 
 #else   // !ENABLE_ACCEL_WHEEL_MODE
-    if (sx < -accel_threshold) {
-        out_joy->left = 1;
-    } else if (sx > accel_threshold) {
-        out_joy->right = 1;
-    }
-    if (sy < -accel_threshold) {
-        out_joy->up = 1;
-    } else if (sy > (accel_threshold / 2)) {
-        // Threshold for down is 50% because it is not as easy to tilt the
-        // device down as it is it to tilt it up.
-        out_joy->down = 1;
-    }
+    accel_bits = axis_to_dir(sx, on, keep, prev, UNI_JOYSTICK_BIT_LEFT, UNI_JOYSTICK_BIT_RIGHT);
+    // Threshold for down is 50% because it is not as easy to tilt the
+    // device down as it is it to tilt it up.
+    if (sy < -((prev & UNI_JOYSTICK_BIT_UP) ? keep : on))
+        accel_bits |= UNI_JOYSTICK_BIT_UP;
+    else if (sy > ((prev & UNI_JOYSTICK_BIT_DOWN) ? keep : on) / 2)
+        accel_bits |= UNI_JOYSTICK_BIT_DOWN;
 #endif  // ! ENABLE_ACCEL_WHEEL_MODE
+
+    if (analog)
+        analog->accel_dir = accel_bits;
+    return bits | accel_bits;
 }
 
-static void to_joy_from_keyboard(const uni_keyboard_t* kb, uni_joystick_t* out_joy1, uni_joystick_t* out_joy2) {
-    // Sanity check. Joy1 must be valid, joy2 can be null
-    if (!out_joy1) {
-        loge("Joystick: Invalid joy1 for keyboard\n");
-        return;
-    }
+// Per-key translation is a lookup in the compiled keymap. See uni_keymap.c for the default bindings.
+static void to_joy_from_keyboard(const uni_keyboard_t* kb,
+                                 const uni_keymap_t* km,
+                                 uni_joystick_bits_t* out_joy1,
+                                 uni_joystick_bits_t* out_joy2) {
+    // Bits for UNI_KEYMAP_TARGET_NONE, UNI_KEYMAP_TARGET_JOY1 and UNI_KEYMAP_TARGET_JOY2
+    _Static_assert(UNI_KEYMAP_TARGET_NONE == 0 && UNI_KEYMAP_TARGET_JOY1 == 1 && UNI_KEYMAP_TARGET_JOY2 == 2,
+                   "Invalid keymap targets");
+    uni_joystick_bits_t joys[3] = {0};
 
     // Keys
     for (int i = 0; i < UNI_KEYBOARD_PRESSED_KEYS_MAX; i++) {
@@ -156,125 +327,69 @@ static void to_joy_from_keyboard(const uni_keyboard_t* kb, uni_joystick_t* out_j
         const uint8_t key = kb->pressed_keys[i];
         if (key <= HID_USAGE_KB_ERROR_UNDEFINED)
             break;
-        switch (key) {
-            // Valid for both "single" and "twin stick" modes
-            // 1st joystick: Arrow keys
-            case HID_USAGE_KB_LEFT_ARROW:
-                out_joy1->left = 1;
-                break;
-            case HID_USAGE_KB_RIGHT_ARROW:
-                out_joy1->right = 1;
-                break;
-            case HID_USAGE_KB_UP_ARROW:
-                out_joy1->up = 1;
-                break;
-            case HID_USAGE_KB_DOWN_ARROW:
-                out_joy1->down = 1;
-                break;
-
-            // Only valid in "single" mode
-            // 1st joystick: Buttons
-            case HID_USAGE_KB_SPACEBAR:
-            case HID_USAGE_KB_Z:
-                if (out_joy2 == NULL)
-                    out_joy1->fire = 1;
-                break;
-            case HID_USAGE_KB_X:
-                if (out_joy2 == NULL)
-                    out_joy1->button2 = 1;
-                break;
-            case HID_USAGE_KB_C:
-                if (out_joy2 == NULL)
-                    out_joy1->button3 = 1;
-                break;
-
-            // Only valid in "twin stick" mode
-            // 2nd joystick: WASD and buttons (Q, E, R)
-            case HID_USAGE_KB_W:
-                if (out_joy2)
-                    out_joy2->up = 1;
-                break;
-
-            case HID_USAGE_KB_A:
-                if (out_joy2)
-                    out_joy2->left = 1;
-                break;
-
-            case HID_USAGE_KB_S:
-                if (out_joy2)
-                    out_joy2->down = 1;
-                break;
-
-            case HID_USAGE_KB_D:
-                if (out_joy2)
-                    out_joy2->right = 1;
-                break;
-
-            case HID_USAGE_KB_Q:
-                if (out_joy2)
-                    out_joy2->button2 = 1;
-                break;
-
-            case HID_USAGE_KB_E:
-                if (out_joy2)
-                    out_joy2->fire = 1;
-                break;
-
-            case HID_USAGE_KB_R:
-                if (out_joy2)
-                    out_joy2->button3 = 1;
-                break;
-
-            default:
-                break;
-        }
+        const uni_keymap_entry_t* e = uni_keymap_lookup(km, key);
+        // Keyboards report the "pressed" keys, so "release" entries make no sense here.
+        if (e->target <= UNI_KEYMAP_TARGET_JOY2 && e->action != UNI_KEYMAP_ACTION_RELEASE)
+            joys[e->target] |= e->value;
     }
 
-    // Joystick 1 buttons from Modifiers
-    if (out_joy2 == NULL) {
-        // Left modifiers only valid when in "single" mode
-        out_joy1->fire |= (kb->modifiers & UNI_KEYBOARD_MODIFIER_LEFT_CONTROL) ? 1 : 0;
-        out_joy1->button2 |= (kb->modifiers & UNI_KEYBOARD_MODIFIER_LEFT_ALT) ? 1 : 0;
-        out_joy1->button3 |= (kb->modifiers & UNI_KEYBOARD_MODIFIER_LEFT_SHIFT) ? 1 : 0;
-    } else {
-        // Right modifiers only valid when in "twin stick" mode
-        out_joy1->fire |= (kb->modifiers & UNI_KEYBOARD_MODIFIER_RIGHT_ALT) ? 1 : 0;
-        out_joy1->button2 |= (kb->modifiers & UNI_KEYBOARD_MODIFIER_RIGHT_CONTROL) ? 1 : 0;
-        out_joy1->button3 |= (kb->modifiers & UNI_KEYBOARD_MODIFIER_RIGHT_SHIFT) ? 1 : 0;
+    // Modifiers: HID usages 0xe0 - 0xe7
+    for (uint8_t mods = kb->modifiers, usage = HID_USAGE_KB_LEFT_CONTROL; mods; mods >>= 1, usage++) {
+        if (!(mods & 1))
+            continue;
+        const uni_keymap_entry_t* e = uni_keymap_lookup(km, usage);
+        if (e->target <= UNI_KEYMAP_TARGET_JOY2 && e->action != UNI_KEYMAP_ACTION_RELEASE)
+            joys[e->target] |= e->value;
     }
+
+    *out_joy1 = joys[UNI_KEYMAP_TARGET_JOY1];
+    if (out_joy2)
+        *out_joy2 = joys[UNI_KEYMAP_TARGET_JOY2];
 }
-void uni_joy_to_single_joy_from_keyboard(const uni_keyboard_t* kb, uni_joystick_t* out_joy) {
-    to_joy_from_keyboard(kb, out_joy, NULL);
+
+uni_joystick_bits_t uni_joy_bits_single_from_keyboard(const uni_keyboard_t* kb) {
+    uni_joystick_bits_t bits = 0;
+    to_joy_from_keyboard(kb, uni_keymap_get(UNI_KEYMAP_ID_JOY_SINGLE), &bits, NULL);
+    return bits;
 }
 
 // Twin Stick: One keyboard controls two joysticks
-void uni_joy_to_twinstick_from_keyboard(const uni_keyboard_t* kb, uni_joystick_t* out_joy1, uni_joystick_t* out_joy2) {
-    to_joy_from_keyboard(kb, out_joy2, out_joy1);
+void uni_joy_bits_twinstick_from_keyboard(const uni_keyboard_t* kb,
+                                          uni_joystick_bits_t* out_joy1,
+                                          uni_joystick_bits_t* out_joy2) {
+    to_joy_from_keyboard(kb, uni_keymap_get(UNI_KEYMAP_ID_JOY_TWINSTICK), out_joy1, out_joy2);
 }
 
-void uni_joy_to_single_joy_from_balance_board(const uni_balance_board_t* bb,
-                                              uni_balance_board_state_t* bb_state,
-                                              uni_joystick_t* out_joy) {
+uni_joystick_bits_t uni_joy_bits_single_from_balance_board(const uni_balance_board_t* bb,
+                                                           uni_balance_board_state_t* bb_state) {
+    uni_joystick_bits_t bits = 0;
     uni_balance_board_threshold_t bb_threshold = uni_balance_board_get_threshold();
 
-    // Low pass filter, assuming values arrive at the same framespeed
-    bb_state->smooth_down = mult_frac((bb->bl + bb->br) - bb_state->smooth_down, 6, 100);
-    bb_state->smooth_top = mult_frac((bb->tl + bb->tr) - bb_state->smooth_top, 6, 100);
-    bb_state->smooth_left = mult_frac((bb->tl + bb->bl) - bb_state->smooth_left, 6, 100);
-    bb_state->smooth_right = mult_frac((bb->tr + bb->br) - bb_state->smooth_right, 6, 100);
+    // Filtered values are computed by the parser. See uni_balance_board_filter_process().
+    const uni_balance_board_filtered_t* f = &bb->filtered;
+    int down = f->bl + f->br;
+    int top = f->tl + f->tr;
+    int left = f->tl + f->bl;
+    int right = f->tr + f->br;
 
-    logd("l=%d, r=%d, t=%d, d=%d\n", bb_state->smooth_left, bb_state->smooth_right, bb_state->smooth_top,
-         bb_state->smooth_down);
+    logd("l=%d, r=%d, t=%d, d=%d\n", left, right, top, down);
 
-    if ((bb_state->smooth_top - bb_state->smooth_down) > bb_threshold.move)
-        out_joy->up = 1;
-    else if ((bb_state->smooth_down - bb_state->smooth_top) > bb_threshold.move)
-        out_joy->down = 1;
+    // Hysteresis: a direction that is already on, stays on until the diff goes below 3/4 of the threshold.
+    int on = bb_threshold.move;
+    int keep = mult_frac(bb_threshold.move, 3, 4);
+    uint8_t prev = bb_state->dir_bits;
 
-    if ((bb_state->smooth_right - bb_state->smooth_left) > bb_threshold.move)
-        out_joy->right = 1;
-    else if ((bb_state->smooth_left - bb_state->smooth_right) > bb_threshold.move)
-        out_joy->left = 1;
+    if ((top - down) > ((prev & UNI_JOYSTICK_BIT_UP) ? keep : on))
+        bits |= UNI_JOYSTICK_BIT_UP;
+    else if ((down - top) > ((prev & UNI_JOYSTICK_BIT_DOWN) ? keep : on))
+        bits |= UNI_JOYSTICK_BIT_DOWN;
+
+    if ((right - left) > ((prev & UNI_JOYSTICK_BIT_RIGHT) ? keep : on))
+        bits |= UNI_JOYSTICK_BIT_RIGHT;
+    else if ((left - right) > ((prev & UNI_JOYSTICK_BIT_LEFT) ? keep : on))
+        bits |= UNI_JOYSTICK_BIT_LEFT;
+
+    bb_state->dir_bits = bits;
 
     // State machine to detect whether we can trigger fire
     int sum = bb->tl + bb->tr + bb->bl + bb->br;
@@ -310,7 +425,7 @@ void uni_joy_to_single_joy_from_balance_board(const uni_balance_board_t* bb,
         case UNI_BALANCE_BOARD_STATE_IN_AIR:
             // Once in Air, it must be at least 2 frames in the air
             if (bb_state->fire_counter > 2) {
-                out_joy->fire = 1;
+                bits |= UNI_JOYSTICK_BIT_FIRE;
                 bb_state->fire_state = UNI_BALANCE_BOARD_STATE_FIRE;
                 bb_state->fire_counter = 0;
                 break;
@@ -322,7 +437,7 @@ void uni_joy_to_single_joy_from_balance_board(const uni_balance_board_t* bb,
             }
             break;
         case UNI_BALANCE_BOARD_STATE_FIRE:
-            out_joy->fire = 1;
+            bits |= UNI_JOYSTICK_BIT_FIRE;
             // Maintain "fire" pressed for 10 frames
             if (bb_state->fire_counter > 10) {
                 bb_state->fire_state = UNI_BALANCE_BOARD_STATE_RESET;
@@ -333,4 +448,78 @@ void uni_joy_to_single_joy_from_balance_board(const uni_balance_board_t* bb,
             loge("Joystick: Unexpected balance board state: %d\n", bb_state->fire_state);
             break;
     }
+    return bits;
+}
+
+uni_joystick_bits_t uni_joy_bits_from_joystick(const uni_joystick_t* joy) {
+    uni_joystick_bits_t bits = 0;
+
+    if (joy->up)
+        bits |= UNI_JOYSTICK_BIT_UP;
+    if (joy->down)
+        bits |= UNI_JOYSTICK_BIT_DOWN;
+    if (joy->left)
+        bits |= UNI_JOYSTICK_BIT_LEFT;
+    if (joy->right)
+        bits |= UNI_JOYSTICK_BIT_RIGHT;
+    if (joy->fire)
+        bits |= UNI_JOYSTICK_BIT_FIRE;
+    if (joy->button2)
+        bits |= UNI_JOYSTICK_BIT_BUTTON2;
+    if (joy->button3)
+        bits |= UNI_JOYSTICK_BIT_BUTTON3;
+    if (joy->auto_fire)
+        bits |= UNI_JOYSTICK_BIT_AUTO_FIRE;
+    return bits;
+}
+
+// Lines that are already "on" in out_joy are preserved, like the legacy converters did.
+void uni_joy_bits_to_joystick(uni_joystick_bits_t bits, uni_joystick_t* out_joy) {
+    out_joy->up |= !!(bits & UNI_JOYSTICK_BIT_UP);
+    out_joy->down |= !!(bits & UNI_JOYSTICK_BIT_DOWN);
+    out_joy->left |= !!(bits & UNI_JOYSTICK_BIT_LEFT);
+    out_joy->right |= !!(bits & UNI_JOYSTICK_BIT_RIGHT);
+    out_joy->fire |= !!(bits & UNI_JOYSTICK_BIT_FIRE);
+    out_joy->button2 |= !!(bits & UNI_JOYSTICK_BIT_BUTTON2);
+    out_joy->button3 |= !!(bits & UNI_JOYSTICK_BIT_BUTTON3);
+    out_joy->auto_fire |= !!(bits & UNI_JOYSTICK_BIT_AUTO_FIRE);
+}
+
+//
+// Legacy API: "one byte per line" converters.
+//
+
+void uni_joy_to_single_joy_from_gamepad(const uni_gamepad_t* gp, uni_joystick_t* out_joy, int use_two_buttons) {
+    uni_joy_bits_to_joystick(uni_joy_bits_single_from_gamepad(gp, use_two_buttons, NULL), out_joy);
+}
+
+void uni_joy_to_twinstick_from_gamepad(const uni_gamepad_t* gp, uni_joystick_t* out_joy1, uni_joystick_t* out_joy2) {
+    uni_joystick_bits_t joy1, joy2;
+
+    uni_joy_bits_twinstick_from_gamepad(gp, NULL, &joy1, &joy2);
+    uni_joy_bits_to_joystick(joy1, out_joy1);
+    uni_joy_bits_to_joystick(joy2, out_joy2);
+}
+
+void uni_joy_to_single_from_wii_accel(const uni_gamepad_t* gp, uni_joystick_t* out_joy) {
+    memset(out_joy, 0, sizeof(*out_joy));
+    uni_joy_bits_to_joystick(uni_joy_bits_single_from_wii_accel(gp, NULL), out_joy);
+}
+
+void uni_joy_to_single_joy_from_keyboard(const uni_keyboard_t* kb, uni_joystick_t* out_joy) {
+    uni_joy_bits_to_joystick(uni_joy_bits_single_from_keyboard(kb), out_joy);
+}
+
+void uni_joy_to_twinstick_from_keyboard(const uni_keyboard_t* kb, uni_joystick_t* out_joy1, uni_joystick_t* out_joy2) {
+    uni_joystick_bits_t joy1, joy2;
+
+    uni_joy_bits_twinstick_from_keyboard(kb, &joy1, &joy2);
+    uni_joy_bits_to_joystick(joy1, out_joy1);
+    uni_joy_bits_to_joystick(joy2, out_joy2);
+}
+
+void uni_joy_to_single_joy_from_balance_board(const uni_balance_board_t* bb,
+                                              uni_balance_board_state_t* bb_state,
+                                              uni_joystick_t* out_joy) {
+    uni_joy_bits_to_joystick(uni_joy_bits_single_from_balance_board(bb, bb_state), out_joy);
 }
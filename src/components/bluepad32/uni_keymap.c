@@ -0,0 +1,338 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#include "uni_keymap.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hid_usage.h"
+#include "uni_common.h"
+#include "uni_joystick.h"
+#include "uni_log.h"
+#include "uni_property.h"
+
+typedef struct {
+    uint8_t usage;
+    uni_keymap_entry_t entry;
+} keymap_binding_t;
+
+typedef struct {
+    const keymap_binding_t* bindings;
+    int count;
+} keymap_defaults_t;
+
+typedef struct {
+    const char* name;
+    uni_keymap_target_t target;
+    uint16_t value;
+} keymap_target_name_t;
+
+// Regular keyboard key: "on" while pressed.
+#define HOLD(_usage, _target, _value) {_usage, {UNI_KEYMAP_TARGET_##_target, UNI_KEYMAP_ACTION_HOLD, _value}}
+// iCade style: one key turns it "on", another key turns it "off".
+#define ON_OFF(_on, _off, _target, _value)                                  \
+    {_on, {UNI_KEYMAP_TARGET_##_target, UNI_KEYMAP_ACTION_PRESS, _value}}, \
+        {_off, {UNI_KEYMAP_TARGET_##_target, UNI_KEYMAP_ACTION_RELEASE, _value}}
+
+// Keyboard "single" mode: One keyboard controls one joystick.
+// Arrow keys + Space / Z / X / C, or Arrow keys + Left Control / Left Alt / Left Shift.
+static const keymap_binding_t joy_single_defaults[] = {
+    HOLD(HID_USAGE_KB_UP_ARROW, JOY1, UNI_JOYSTICK_BIT_UP),
+    HOLD(HID_USAGE_KB_DOWN_ARROW, JOY1, UNI_JOYSTICK_BIT_DOWN),
+    HOLD(HID_USAGE_KB_LEFT_ARROW, JOY1, UNI_JOYSTICK_BIT_LEFT),
+    HOLD(HID_USAGE_KB_RIGHT_ARROW, JOY1, UNI_JOYSTICK_BIT_RIGHT),
+    HOLD(HID_USAGE_KB_SPACEBAR, JOY1, UNI_JOYSTICK_BIT_FIRE),
+    HOLD(HID_USAGE_KB_Z, JOY1, UNI_JOYSTICK_BIT_FIRE),
+    HOLD(HID_USAGE_KB_X, JOY1, UNI_JOYSTICK_BIT_BUTTON2),
+    HOLD(HID_USAGE_KB_C, JOY1, UNI_JOYSTICK_BIT_BUTTON3),
+    HOLD(HID_USAGE_KB_LEFT_CONTROL, JOY1, UNI_JOYSTICK_BIT_FIRE),
+    HOLD(HID_USAGE_KB_LEFT_ALT, JOY1, UNI_JOYSTICK_BIT_BUTTON2),
+    HOLD(HID_USAGE_KB_LEFT_SHIFT, JOY1, UNI_JOYSTICK_BIT_BUTTON3),
+};
+
+// Keyboard "twin stick" mode: One keyboard controls two joysticks.
+// Port 2: Arrow keys + Right Alt / Right Control / Right Shift.
+// Port 1: WASD + E / Q / R.
+static const keymap_binding_t joy_twinstick_defaults[] = {
+    HOLD(HID_USAGE_KB_UP_ARROW, JOY2, UNI_JOYSTICK_BIT_UP),
+    HOLD(HID_USAGE_KB_DOWN_ARROW, JOY2, UNI_JOYSTICK_BIT_DOWN),
+    HOLD(HID_USAGE_KB_LEFT_ARROW, JOY2, UNI_JOYSTICK_BIT_LEFT),
+    HOLD(HID_USAGE_KB_RIGHT_ARROW, JOY2, UNI_JOYSTICK_BIT_RIGHT),
+    HOLD(HID_USAGE_KB_RIGHT_ALT, JOY2, UNI_JOYSTICK_BIT_FIRE),
+    HOLD(HID_USAGE_KB_RIGHT_CONTROL, JOY2, UNI_JOYSTICK_BIT_BUTTON2),
+    HOLD(HID_USAGE_KB_RIGHT_SHIFT, JOY2, UNI_JOYSTICK_BIT_BUTTON3),
+    HOLD(HID_USAGE_KB_W, JOY1, UNI_JOYSTICK_BIT_UP),
+    HOLD(HID_USAGE_KB_S, JOY1, UNI_JOYSTICK_BIT_DOWN),
+    HOLD(HID_USAGE_KB_A, JOY1, UNI_JOYSTICK_BIT_LEFT),
+    HOLD(HID_USAGE_KB_D, JOY1, UNI_JOYSTICK_BIT_RIGHT),
+    HOLD(HID_USAGE_KB_E, JOY1, UNI_JOYSTICK_BIT_FIRE),
+    HOLD(HID_USAGE_KB_Q, JOY1, UNI_JOYSTICK_BIT_BUTTON2),
+    HOLD(HID_USAGE_KB_R, JOY1, UNI_JOYSTICK_BIT_BUTTON3),
+};
+
+// iCade Cabinet. See uni_hid_parser_icade.c for the layout.
+static const keymap_binding_t icade_cabinet_defaults[] = {
+    ON_OFF(HID_USAGE_KB_W, HID_USAGE_KB_E, DPAD, DPAD_UP),
+    ON_OFF(HID_USAGE_KB_D, HID_USAGE_KB_C, DPAD, DPAD_RIGHT),
+    ON_OFF(HID_USAGE_KB_X, HID_USAGE_KB_Z, DPAD, DPAD_DOWN),
+    ON_OFF(HID_USAGE_KB_A, HID_USAGE_KB_Q, DPAD, DPAD_LEFT),
+    ON_OFF(HID_USAGE_KB_Y, HID_USAGE_KB_T, BUTTONS, BUTTON_A),
+    ON_OFF(HID_USAGE_KB_H, HID_USAGE_KB_R, BUTTONS, BUTTON_B),
+    ON_OFF(HID_USAGE_KB_U, HID_USAGE_KB_F, BUTTONS, BUTTON_X),
+    ON_OFF(HID_USAGE_KB_J, HID_USAGE_KB_N, BUTTONS, BUTTON_Y),
+    ON_OFF(HID_USAGE_KB_I, HID_USAGE_KB_M, MISC_BUTTONS, MISC_BUTTON_START),
+    ON_OFF(HID_USAGE_KB_K, HID_USAGE_KB_P, BUTTONS, BUTTON_SHOULDER_L),
+    ON_OFF(HID_USAGE_KB_O, HID_USAGE_KB_G, MISC_BUTTONS, MISC_BUTTON_SYSTEM),
+    ON_OFF(HID_USAGE_KB_L, HID_USAGE_KB_V, BUTTONS, BUTTON_SHOULDER_R),
+};
+
+// iCade 8-Bitty. See uni_hid_parser_icade.c for the layout.
+static const keymap_binding_t icade_8bitty_defaults[] = {
+    ON_OFF(HID_USAGE_KB_W, HID_USAGE_KB_E, DPAD, DPAD_UP),
+    ON_OFF(HID_USAGE_KB_D, HID_USAGE_KB_C, DPAD, DPAD_RIGHT),
+    ON_OFF(HID_USAGE_KB_X, HID_USAGE_KB_Z, DPAD, DPAD_DOWN),
+    ON_OFF(HID_USAGE_KB_A, HID_USAGE_KB_Q, DPAD, DPAD_LEFT),
+    ON_OFF(HID_USAGE_KB_H, HID_USAGE_KB_R, BUTTONS, BUTTON_SHOULDER_L),
+    ON_OFF(HID_USAGE_KB_J, HID_USAGE_KB_N, BUTTONS, BUTTON_SHOULDER_R),
+    ON_OFF(HID_USAGE_KB_I, HID_USAGE_KB_M, BUTTONS, BUTTON_X),
+    ON_OFF(HID_USAGE_KB_O, HID_USAGE_KB_G, BUTTONS, BUTTON_Y),
+    ON_OFF(HID_USAGE_KB_K, HID_USAGE_KB_P, BUTTONS, BUTTON_A),
+    ON_OFF(HID_USAGE_KB_L, HID_USAGE_KB_V, BUTTONS, BUTTON_B),
+    ON_OFF(HID_USAGE_KB_Y, HID_USAGE_KB_T, MISC_BUTTONS, MISC_BUTTON_SYSTEM),
+    ON_OFF(HID_USAGE_KB_U, HID_USAGE_KB_F, MISC_BUTTONS, MISC_BUTTON_START),
+};
+
+static const keymap_defaults_t keymap_defaults[] = {
+    [UNI_KEYMAP_ID_JOY_SINGLE] = {joy_single_defaults, ARRAY_SIZE(joy_single_defaults)},
+    [UNI_KEYMAP_ID_JOY_TWINSTICK] = {joy_twinstick_defaults, ARRAY_SIZE(joy_twinstick_defaults)},
+    [UNI_KEYMAP_ID_ICADE_CABINET] = {icade_cabinet_defaults, ARRAY_SIZE(icade_cabinet_defaults)},
+    [UNI_KEYMAP_ID_ICADE_8BITTY] = {icade_8bitty_defaults, ARRAY_SIZE(icade_8bitty_defaults)},
+};
+_Static_assert(ARRAY_SIZE(keymap_defaults) == UNI_KEYMAP_ID_COUNT, "Invalid keymap defaults size");
+
+// Used in the user profile
+static const char* keymap_names[] = {
+    [UNI_KEYMAP_ID_JOY_SINGLE] = "single",
+    [UNI_KEYMAP_ID_JOY_TWINSTICK] = "twin",
+    [UNI_KEYMAP_ID_ICADE_CABINET] = "cabinet",
+    [UNI_KEYMAP_ID_ICADE_8BITTY] = "8bitty",
+};
+_Static_assert(ARRAY_SIZE(keymap_names) == UNI_KEYMAP_ID_COUNT, "Invalid keymap names size");
+
+static const keymap_target_name_t target_names[] = {
+    {"none", UNI_KEYMAP_TARGET_NONE, 0},
+    {"j1.up", UNI_KEYMAP_TARGET_JOY1, UNI_JOYSTICK_BIT_UP},
+    {"j1.down", UNI_KEYMAP_TARGET_JOY1, UNI_JOYSTICK_BIT_DOWN},
+    {"j1.left", UNI_KEYMAP_TARGET_JOY1, UNI_JOYSTICK_BIT_LEFT},
+    {"j1.right", UNI_KEYMAP_TARGET_JOY1, UNI_JOYSTICK_BIT_RIGHT},
+    {"j1.fire", UNI_KEYMAP_TARGET_JOY1, UNI_JOYSTICK_BIT_FIRE},
+    {"j1.b2", UNI_KEYMAP_TARGET_JOY1, UNI_JOYSTICK_BIT_BUTTON2},
+    {"j1.b3", UNI_KEYMAP_TARGET_JOY1, UNI_JOYSTICK_BIT_BUTTON3},
+    {"j2.up", UNI_KEYMAP_TARGET_JOY2, UNI_JOYSTICK_BIT_UP},
+    {"j2.down", UNI_KEYMAP_TARGET_JOY2, UNI_JOYSTICK_BIT_DOWN},
+    {"j2.left", UNI_KEYMAP_TARGET_JOY2, UNI_JOYSTICK_BIT_LEFT},
+    {"j2.right", UNI_KEYMAP_TARGET_JOY2, UNI_JOYSTICK_BIT_RIGHT},
+    {"j2.fire", UNI_KEYMAP_TARGET_JOY2, UNI_JOYSTICK_BIT_FIRE},
+    {"j2.b2", UNI_KEYMAP_TARGET_JOY2, UNI_JOYSTICK_BIT_BUTTON2},
+    {"j2.b3", UNI_KEYMAP_TARGET_JOY2, UNI_JOYSTICK_BIT_BUTTON3},
+    {"dpad.up", UNI_KEYMAP_TARGET_DPAD, DPAD_UP},
+    {"dpad.down", UNI_KEYMAP_TARGET_DPAD, DPAD_DOWN},
+    {"dpad.left", UNI_KEYMAP_TARGET_DPAD, DPAD_LEFT},
+    {"dpad.right", UNI_KEYMAP_TARGET_DPAD, DPAD_RIGHT},
+    {"btn.a", UNI_KEYMAP_TARGET_BUTTONS, BUTTON_A},
+    {"btn.b", UNI_KEYMAP_TARGET_BUTTONS, BUTTON_B},
+    {"btn.x", UNI_KEYMAP_TARGET_BUTTONS, BUTTON_X},
+    {"btn.y", UNI_KEYMAP_TARGET_BUTTONS, BUTTON_Y},
+    {"btn.l", UNI_KEYMAP_TARGET_BUTTONS, BUTTON_SHOULDER_L},
+    {"btn.r", UNI_KEYMAP_TARGET_BUTTONS, BUTTON_SHOULDER_R},
+    {"btn.zl", UNI_KEYMAP_TARGET_BUTTONS, BUTTON_TRIGGER_L},
+    {"btn.zr", UNI_KEYMAP_TARGET_BUTTONS, BUTTON_TRIGGER_R},
+    {"btn.thumb_l", UNI_KEYMAP_TARGET_BUTTONS, BUTTON_THUMB_L},
+    {"btn.thumb_r", UNI_KEYMAP_TARGET_BUTTONS, BUTTON_THUMB_R},
+    {"misc.system", UNI_KEYMAP_TARGET_MISC_BUTTONS, MISC_BUTTON_SYSTEM},
+    {"misc.select", UNI_KEYMAP_TARGET_MISC_BUTTONS, MISC_BUTTON_SELECT},
+    {"misc.start", UNI_KEYMAP_TARGET_MISC_BUTTONS, MISC_BUTTON_START},
+    {"misc.capture", UNI_KEYMAP_TARGET_MISC_BUTTONS, MISC_BUTTON_CAPTURE},
+};
+
+// 1KB per keymap. Compiled in uni_keymap_init() and when the profile changes.
+static uni_keymap_t keymaps[UNI_KEYMAP_ID_COUNT];
+
+//
+// Helpers
+//
+static void compile_defaults(void) {
+    memset(keymaps, 0, sizeof(keymaps));
+    for (int i = 0; i < UNI_KEYMAP_ID_COUNT; i++) {
+        const keymap_defaults_t* def = &keymap_defaults[i];
+        for (int j = 0; j < def->count; j++)
+            keymaps[i].entries[def->bindings[j].usage] = def->bindings[j].entry;
+    }
+}
+
+static int find_keymap_by_name(const char* name, size_t len) {
+    for (int i = 0; i < UNI_KEYMAP_ID_COUNT; i++) {
+        if (strlen(keymap_names[i]) == len && strncmp(keymap_names[i], name, len) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static const keymap_target_name_t* find_target_by_name(const char* name, size_t len) {
+    for (size_t i = 0; i < ARRAY_SIZE(target_names); i++) {
+        if (strlen(target_names[i].name) == len && strncmp(target_names[i].name, name, len) == 0)
+            return &target_names[i];
+    }
+    return NULL;
+}
+
+static const char* get_target_name(const uni_keymap_entry_t* e) {
+    for (size_t i = 0; i < ARRAY_SIZE(target_names); i++) {
+        if (target_names[i].target == e->target && target_names[i].value == e->value)
+            return target_names[i].name;
+    }
+    return "<unknown>";
+}
+
+// Parses the profile. When "apply" is false, it only validates it.
+static int parse_profile(const char* profile, bool apply) {
+    const char* p = profile;
+
+    while (*p) {
+        // "<keymap>:"
+        const char* colon = strchr(p, ':');
+        if (!colon) {
+            loge("keymap: missing ':' in '%s'\n", p);
+            return -1;
+        }
+        int id = find_keymap_by_name(p, colon - p);
+        if (id < 0) {
+            loge("keymap: invalid keymap name in '%s'\n", p);
+            return -1;
+        }
+        p = colon + 1;
+
+        // "<usage>=[+|-]<target>,..."
+        while (*p && *p != ';') {
+            char* end;
+            unsigned long usage = strtoul(p, &end, 16);
+            if (end == p || *end != '=' || usage >= UNI_KEYMAP_ENTRIES_MAX) {
+                loge("keymap: invalid usage in '%s'\n", p);
+                return -1;
+            }
+            p = end + 1;
+
+            uni_keymap_action_t action = UNI_KEYMAP_ACTION_HOLD;
+            if (*p == '+') {
+                action = UNI_KEYMAP_ACTION_PRESS;
+                p++;
+            } else if (*p == '-') {
+                action = UNI_KEYMAP_ACTION_RELEASE;
+                p++;
+            }
+
+            size_t len = strcspn(p, ",;");
+            const keymap_target_name_t* t = find_target_by_name(p, len);
+            if (!t) {
+                loge("keymap: invalid target in '%s'\n", p);
+                return -1;
+            }
+            if (apply) {
+                uni_keymap_entry_t* e = &keymaps[id].entries[usage];
+                e->target = t->target;
+                e->action = (t->target == UNI_KEYMAP_TARGET_NONE) ? UNI_KEYMAP_ACTION_HOLD : action;
+                e->value = t->value;
+            }
+            p += len;
+            if (*p == ',')
+                p++;
+        }
+        if (*p == ';')
+            p++;
+    }
+    return 0;
+}
+
+static void compile(const char* profile) {
+    compile_defaults();
+    if (profile && profile[0] != 0)
+        parse_profile(profile, true);
+}
+
+//
+// Public functions
+//
+void uni_keymap_init(void) {
+    uni_property_value_t val = uni_property_get(UNI_PROPERTY_IDX_KEYBOARD_KEYMAP);
+
+    if (val.str && parse_profile(val.str, false) != 0) {
+        loge("keymap: invalid stored profile, using defaults\n");
+        val.str = NULL;
+    }
+    compile(val.str);
+}
+
+const uni_keymap_t* uni_keymap_get(uni_keymap_id_t id) {
+    if (id >= UNI_KEYMAP_ID_COUNT)
+        id = UNI_KEYMAP_ID_JOY_SINGLE;
+    return &keymaps[id];
+}
+
+void uni_keymap_apply_to_gamepad(const uni_keymap_entry_t* e, uni_gamepad_t* gp) {
+    bool on = (e->action != UNI_KEYMAP_ACTION_RELEASE);
+
+    switch (e->target) {
+        case UNI_KEYMAP_TARGET_DPAD:
+            gp->dpad = on ? (gp->dpad | e->value) : (gp->dpad & ~e->value);
+            break;
+        case UNI_KEYMAP_TARGET_BUTTONS:
+            gp->buttons = on ? (gp->buttons | e->value) : (gp->buttons & ~e->value);
+            break;
+        case UNI_KEYMAP_TARGET_MISC_BUTTONS:
+            gp->misc_buttons = on ? (gp->misc_buttons | e->value) : (gp->misc_buttons & ~e->value);
+            break;
+        default:
+            // Joystick targets are not valid for gamepads
+            break;
+    }
+}
+
+int uni_keymap_set_profile(const char* profile) {
+    uni_property_value_t val;
+
+    if (!profile)
+        profile = "";
+
+    if (strlen(profile) >= UNI_PROPERTY_STRING_MAX_LEN) {
+        loge("keymap: profile too long: %d, max %d\n", (int)strlen(profile), UNI_PROPERTY_STRING_MAX_LEN - 1);
+        return -1;
+    }
+
+    if (parse_profile(profile, false) != 0)
+        return -1;
+
+    val.str = profile;
+    uni_property_set(UNI_PROPERTY_IDX_KEYBOARD_KEYMAP, val);
+    compile(profile);
+    return 0;
+}
+
+void uni_keymap_dump(uni_keymap_id_t id) {
+    if (id >= UNI_KEYMAP_ID_COUNT)
+        return;
+
+    logi("keymap '%s':\n", keymap_names[id]);
+    for (int i = 0; i < UNI_KEYMAP_ENTRIES_MAX; i++) {
+        const uni_keymap_entry_t* e = &keymaps[id].entries[i];
+        if (e->target == UNI_KEYMAP_TARGET_NONE)
+            continue;
+        logi("  0x%02x -> %s%s\n", i,
+             e->action == UNI_KEYMAP_ACTION_PRESS     ? "+"
+             : e->action == UNI_KEYMAP_ACTION_RELEASE ? "-"
+                                                      : "",
+             get_target_name(e));
+    }
+}
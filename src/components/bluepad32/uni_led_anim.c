@@ -0,0 +1,253 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#include "uni_led_anim.h"
+
+#include <string.h>
+
+#include "uni_common.h"
+#include "uni_hid_device.h"
+#include "uni_log.h"
+#include "uni_system.h"
+
+// Color changes smaller than this are not sent: a slow fade would send a report for each step.
+// 6 bits per channel.
+#define COLOR_QUANTIZE_SHIFT 2
+
+static uint8_t max_rate_hz = UNI_LED_ANIM_DEFAULT_MAX_RATE_HZ;
+
+static void on_timer(btstack_timer_source_t* ts);
+
+//
+// Helpers
+//
+static uint32_t get_now_ms(void) {
+    return (uint32_t)(uni_system_get_time_us() / 1000);
+}
+
+static uint8_t lerp(uint8_t a, uint8_t b, uint32_t t, uint32_t duration) {
+    return (uint8_t)((int)a + ((int)b - (int)a) * (int)t / (int)duration);
+}
+
+static bool is_same_color(const uni_led_anim_frame_t* a, const uni_led_anim_frame_t* b, int shift) {
+    return (a->r >> shift) == (b->r >> shift) && (a->g >> shift) == (b->g >> shift) &&
+           (a->b >> shift) == (b->b >> shift);
+}
+
+// Output reports are queued, or a BLE write is waiting for its acknowledgement.
+static bool is_link_busy(uni_hid_device_t* d) {
+    return d->outgoing_le_in_flight || !uni_circular_buffer_is_empty(&d->outgoing_buffer);
+}
+
+static void schedule_next_frame(uni_hid_device_t* d) {
+    btstack_run_loop_remove_timer(&d->led_anim_timer);
+    btstack_run_loop_set_timer_context(&d->led_anim_timer, d);
+    btstack_run_loop_set_timer_handler(&d->led_anim_timer, &on_timer);
+    btstack_run_loop_set_timer(&d->led_anim_timer, 1000 / max_rate_hz);
+    btstack_run_loop_add_timer(&d->led_anim_timer);
+}
+
+// At most one output report per frame.
+static void process_frame(uni_hid_device_t* d) {
+    uni_led_anim_state_t* st = &d->led_anim;
+    uni_led_anim_frame_t f;
+    bool finished;
+
+    finished = uni_led_anim_eval(st->keyframes, st->keyframes_count, st->loop, get_now_ms() - st->start_ms, &f);
+
+    if (is_link_busy(d)) {
+        st->frames_skipped++;
+        schedule_next_frame(d);
+        return;
+    }
+
+    // Once finished, the last keyframe is sent as is, not quantized.
+    if ((st->outputs & UNI_LED_ANIM_OUTPUT_LIGHTBAR) &&
+        (!st->lightbar_sent || !is_same_color(&f, &st->last, finished ? 0 : COLOR_QUANTIZE_SHIFT))) {
+        st->last.r = f.r;
+        st->last.g = f.g;
+        st->last.b = f.b;
+        st->lightbar_sent = true;
+        st->frames_sent++;
+        d->report_parser.set_lightbar_color(d, f.r, f.g, f.b);
+        // Player LEDs, if changed, are sent in the next frame.
+        schedule_next_frame(d);
+        return;
+    }
+
+    if ((st->outputs & UNI_LED_ANIM_OUTPUT_PLAYER_LEDS) &&
+        (!st->player_leds_sent || f.player_leds != st->last.player_leds)) {
+        st->last.player_leds = f.player_leds;
+        st->player_leds_sent = true;
+        st->frames_sent++;
+        d->report_parser.set_player_leds(d, f.player_leds);
+        schedule_next_frame(d);
+        return;
+    }
+
+    if (finished) {
+        st->playing = false;
+        return;
+    }
+    schedule_next_frame(d);
+}
+
+static void on_timer(btstack_timer_source_t* ts) {
+    uni_hid_device_t* d = btstack_run_loop_get_timer_context(ts);
+
+    if (!d->led_anim.playing)
+        return;
+    process_frame(d);
+}
+
+//
+// Public functions
+//
+bool uni_led_anim_eval(const uni_led_anim_keyframe_t* keyframes,
+                       int count,
+                       bool loop,
+                       uint32_t elapsed_ms,
+                       uni_led_anim_frame_t* out) {
+    const uni_led_anim_keyframe_t* k;
+    uint32_t duration;
+    int i;
+
+    duration = keyframes[count - 1].time_ms;
+    if (elapsed_ms >= duration) {
+        if (!loop || duration == 0) {
+            k = &keyframes[count - 1];
+            *out = (uni_led_anim_frame_t){.r = k->r, .g = k->g, .b = k->b, .player_leds = k->player_leds};
+            return true;
+        }
+        elapsed_ms %= duration;
+    }
+
+    // Last keyframe that started. Few keyframes, a linear search is fine.
+    i = 0;
+    while (i < count - 1 && keyframes[i + 1].time_ms <= elapsed_ms)
+        i++;
+    k = &keyframes[i];
+    out->player_leds = k->player_leds;
+    if (i == count - 1) {
+        out->r = k->r;
+        out->g = k->g;
+        out->b = k->b;
+        return false;
+    }
+    uint32_t t = elapsed_ms - k->time_ms;
+    uint32_t segment = keyframes[i + 1].time_ms - k->time_ms;
+    out->r = lerp(k->r, keyframes[i + 1].r, t, segment);
+    out->g = lerp(k->g, keyframes[i + 1].g, t, segment);
+    out->b = lerp(k->b, keyframes[i + 1].b, t, segment);
+    return false;
+}
+
+bool uni_led_anim_play(uni_hid_device_t* d, const uni_led_anim_t* anim) {
+    uni_led_anim_state_t* st = &d->led_anim;
+    uint8_t outputs = anim->outputs;
+
+    if (anim->keyframes_count == 0 || anim->keyframes_count > UNI_LED_ANIM_MAX_KEYFRAMES) {
+        loge("LED anim: invalid number of keyframes: %d\n", anim->keyframes_count);
+        return false;
+    }
+    for (int i = 1; i < anim->keyframes_count; i++) {
+        if (anim->keyframes[i].time_ms < anim->keyframes[i - 1].time_ms) {
+            loge("LED anim: keyframes must be in order\n");
+            return false;
+        }
+    }
+
+    if (d->report_parser.set_lightbar_color == NULL)
+        outputs &= ~UNI_LED_ANIM_OUTPUT_LIGHTBAR;
+    if (d->report_parser.set_player_leds == NULL)
+        outputs &= ~UNI_LED_ANIM_OUTPUT_PLAYER_LEDS;
+    if (outputs == 0) {
+        logi("LED anim: %s doesn't support the animation outputs\n", d->name);
+        return false;
+    }
+
+    memcpy(st->keyframes, anim->keyframes, anim->keyframes_count * sizeof(anim->keyframes[0]));
+    st->keyframes_count = anim->keyframes_count;
+    st->outputs = outputs;
+    st->loop = anim->loop;
+    st->start_ms = get_now_ms();
+    st->playing = true;
+    // The platform might have changed them since the last animation.
+    st->lightbar_sent = false;
+    st->player_leds_sent = false;
+
+    process_frame(d);
+    return true;
+}
+
+void uni_led_anim_stop(uni_hid_device_t* d) {
+    d->led_anim.playing = false;
+    btstack_run_loop_remove_timer(&d->led_anim_timer);
+}
+
+bool uni_led_anim_is_playing(uni_hid_device_t* d) {
+    return d->led_anim.playing;
+}
+
+bool uni_led_anim_breathe(uni_hid_device_t* d, uint8_t r, uint8_t g, uint8_t b, uint16_t period_ms) {
+    const uni_led_anim_keyframe_t keyframes[] = {
+        {.time_ms = 0},
+        {.time_ms = period_ms / 2, .r = r, .g = g, .b = b},
+        {.time_ms = period_ms},
+    };
+    const uni_led_anim_t anim = {
+        .keyframes = keyframes,
+        .keyframes_count = ARRAY_SIZE(keyframes),
+        .outputs = UNI_LED_ANIM_OUTPUT_LIGHTBAR,
+        .loop = true,
+    };
+    return uni_led_anim_play(d, &anim);
+}
+
+bool uni_led_anim_pulse(uni_hid_device_t* d, uint8_t r, uint8_t g, uint8_t b, uint16_t period_ms) {
+    const uni_led_anim_keyframe_t keyframes[] = {
+        {.time_ms = 0, .r = r, .g = g, .b = b},
+        {.time_ms = period_ms / 4},
+        {.time_ms = period_ms},
+    };
+    const uni_led_anim_t anim = {
+        .keyframes = keyframes,
+        .keyframes_count = ARRAY_SIZE(keyframes),
+        .outputs = UNI_LED_ANIM_OUTPUT_LIGHTBAR,
+        .loop = true,
+    };
+    return uni_led_anim_play(d, &anim);
+}
+
+bool uni_led_anim_battery_warning(uni_hid_device_t* d) {
+    static const uni_led_anim_keyframe_t keyframes[] = {
+        {.time_ms = 0, .r = 0xff, .player_leds = 0x0f},
+        {.time_ms = 500, .r = 0xff, .player_leds = 0x0f},
+        {.time_ms = 500},
+        {.time_ms = 1000},
+    };
+    const uni_led_anim_t anim = {
+        .keyframes = keyframes,
+        .keyframes_count = ARRAY_SIZE(keyframes),
+        .outputs = UNI_LED_ANIM_OUTPUT_LIGHTBAR | UNI_LED_ANIM_OUTPUT_PLAYER_LEDS,
+        .loop = true,
+    };
+    return uni_led_anim_play(d, &anim);
+}
+
+void uni_led_anim_set_max_rate(uint8_t hz) {
+    if (hz == 0 || hz > 100) {
+        loge("LED anim: invalid max rate: %d. Valid range: 1 - 100\n", hz);
+        return;
+    }
+    max_rate_hz = hz;
+}
+
+uint8_t uni_led_anim_get_max_rate(void) {
+    return max_rate_hz;
+}
+
+void uni_led_anim_on_device_deleted(uni_hid_device_t* d) {
+    uni_led_anim_stop(d);
+}
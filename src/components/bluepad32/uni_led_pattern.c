@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#include "uni_led_pattern.h"
+
+#include <string.h>
+
+#define BLINK_DEFAULT_MS 100
+
+//
+// Helpers
+//
+static void remove_at(uni_led_pattern_queue_t* q, int idx) {
+    memmove(&q->queue[idx], &q->queue[idx + 1], (q->count - idx - 1) * sizeof(q->queue[0]));
+    q->count--;
+}
+
+//
+// Public functions
+//
+void uni_led_pattern_init(uni_led_pattern_queue_t* q, bool idle_level) {
+    memset(q, 0, sizeof(*q));
+    q->idle_level = idle_level;
+}
+
+void uni_led_pattern_set_idle_level(uni_led_pattern_queue_t* q, bool level) {
+    q->idle_level = level;
+}
+
+int uni_led_pattern_push(uni_led_pattern_queue_t* q, const uni_led_pattern_t* pattern, uint64_t now_us) {
+    int idx;
+
+    if (pattern->times == 0 || (pattern->off_ms == 0 && pattern->on_ms == 0))
+        return -1;
+
+    if (q->count == UNI_LED_PATTERN_QUEUE_SIZE) {
+        q->dropped++;
+        // The last one has the lowest priority, and it is the newest one with that priority.
+        if (pattern->priority <= q->queue[q->count - 1].priority)
+            return -1;
+        q->count--;
+    }
+
+    // After the ones with the same or higher priority.
+    for (idx = 0; idx < q->count; idx++) {
+        if (pattern->priority > q->queue[idx].priority)
+            break;
+    }
+    memmove(&q->queue[idx + 1], &q->queue[idx], (q->count - idx) * sizeof(q->queue[0]));
+    q->queue[idx] = *pattern;
+    q->count++;
+
+    // Either the queue was empty, or it preempts the one that was playing.
+    if (idx == 0)
+        q->start_us = now_us;
+    return 0;
+}
+
+void uni_led_pattern_clear(uni_led_pattern_queue_t* q) {
+    q->count = 0;
+}
+
+uint32_t uni_led_pattern_run(uni_led_pattern_queue_t* q, uint64_t now_us, bool* out_level) {
+    while (q->count > 0) {
+        const uni_led_pattern_t* p = &q->queue[0];
+        uint64_t period_us = ((uint32_t)p->off_ms + p->on_ms) * 1000;
+        uint64_t elapsed_us = now_us - q->start_us;
+
+        if (elapsed_us >= period_us * p->times) {
+            // Done. The next one, if any, starts now. A preempted one starts from the beginning.
+            q->start_us = now_us;
+            remove_at(q, 0);
+            continue;
+        }
+
+        uint32_t pos_us = (uint32_t)(elapsed_us % period_us);
+        uint32_t off_us = p->off_ms * 1000;
+        if (pos_us < off_us) {
+            *out_level = false;
+            return off_us - pos_us;
+        }
+        *out_level = true;
+        return (uint32_t)period_us - pos_us;
+    }
+
+    *out_level = q->idle_level;
+    return 0;
+}
+
+uni_led_pattern_t uni_led_pattern_blink(uint8_t times, uni_led_pattern_priority_t priority) {
+    uni_led_pattern_t p = {
+        .off_ms = BLINK_DEFAULT_MS,
+        .on_ms = BLINK_DEFAULT_MS,
+        .times = times,
+        .priority = priority,
+    };
+    return p;
+}
@@ -0,0 +1,279 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#include "uni_metrics.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <btstack.h>
+
+#include "bt/uni_bt_conn.h"
+#include "uni_log.h"
+#include "uni_system.h"
+
+// Addresses of the devices that connected since boot. Used to detect reconnections.
+#define SEEN_ADDR_MAX 16
+
+static uint32_t s_counters[UNI_METRICS_COUNTER_COUNT];
+
+// Report counters of the devices that were deleted
+static uint64_t s_retired_input_reports;
+static uint64_t s_retired_output_reports;
+static uint64_t s_retired_output_dropped;
+
+static bd_addr_t s_seen_addr[SEEN_ADDR_MAX];
+static int s_seen_count;
+static int s_seen_next;
+
+static const struct {
+    const char* name;
+    const char* help;
+} counter_info[UNI_METRICS_COUNTER_COUNT] = {
+    [UNI_METRICS_COUNTER_CONNECTIONS] = {"bluepad32_connections_total", "Devices that completed the setup"},
+    [UNI_METRICS_COUNTER_RECONNECTIONS] = {"bluepad32_reconnections_total",
+                                           "Connections of devices already connected since boot"},
+    [UNI_METRICS_COUNTER_CONNECTIONS_REJECTED] = {"bluepad32_connections_rejected_total",
+                                                  "Connections declined by the platform"},
+    [UNI_METRICS_COUNTER_DISCONNECTIONS] = {"bluepad32_disconnections_total", "Disconnections of known devices"},
+    [UNI_METRICS_COUNTER_LINK_LOSSES] = {"bluepad32_link_losses_total", "Disconnections by supervision timeout"},
+    [UNI_METRICS_COUNTER_DEVICES_REJECTED] = {"bluepad32_devices_rejected_total",
+                                              "Devices not created because the device table was full"},
+    [UNI_METRICS_COUNTER_DEVICES_EVICTED] = {"bluepad32_devices_evicted_total",
+                                             "Half-open devices evicted by a better candidate"},
+};
+
+// Per-device metrics. Counters restart when the device reconnects.
+typedef enum {
+    DEVICE_METRIC_INPUT_REPORTS,
+    DEVICE_METRIC_OUTPUT_REPORTS,
+    DEVICE_METRIC_OUTPUT_DROPPED,
+    DEVICE_METRIC_RSSI,
+    DEVICE_METRIC_BATTERY,
+
+    DEVICE_METRIC_COUNT,
+} device_metric_t;
+
+static const struct {
+    const char* name;
+    const char* type;
+    const char* help;
+} device_metric_info[DEVICE_METRIC_COUNT] = {
+    [DEVICE_METRIC_INPUT_REPORTS] = {"bluepad32_device_input_reports_total", "counter",
+                                     "Input reports received from the device"},
+    [DEVICE_METRIC_OUTPUT_REPORTS] = {"bluepad32_device_output_reports_total", "counter",
+                                      "Output reports sent to the device"},
+    [DEVICE_METRIC_OUTPUT_DROPPED] = {"bluepad32_device_output_dropped_total", "counter",
+                                      "Output reports dropped because the queue was full"},
+    [DEVICE_METRIC_RSSI] = {"bluepad32_device_rssi", "gauge", "RSSI, as reported by HCI Read RSSI"},
+    [DEVICE_METRIC_BATTERY] = {"bluepad32_device_battery", "gauge", "Battery: 0=empty, 254=full, 255=not available"},
+};
+
+//
+// Helpers
+//
+static bool was_seen(bd_addr_t addr) {
+    for (int i = 0; i < s_seen_count; i++) {
+        if (bd_addr_cmp(s_seen_addr[i], addr) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void add_seen(bd_addr_t addr) {
+    // Oldest entry gets replaced
+    bd_addr_copy(s_seen_addr[s_seen_next], addr);
+    s_seen_next = (s_seen_next + 1) % SEEN_ADDR_MAX;
+    if (s_seen_count < SEEN_ADDR_MAX)
+        s_seen_count++;
+}
+
+// Appends to buf, and advances the offset. Returns false if there is no space left.
+static bool append(char* buf, size_t len, size_t* off, const char* fmt, ...) __attribute__((format(printf, 4, 5)));
+static bool append(char* buf, size_t len, size_t* off, const char* fmt, ...) {
+    va_list args;
+
+    if (*off >= len)
+        return false;
+
+    va_start(args, fmt);
+    int n = vsnprintf(buf + *off, len - *off, fmt, args);
+    va_end(args);
+
+    if (n < 0 || (size_t)n >= len - *off)
+        return false;
+    *off += n;
+    return true;
+}
+
+// Label values must escape backslash, double-quote and line feed.
+static void escape_label(char* out, size_t len, const char* in) {
+    size_t j = 0;
+    for (size_t i = 0; in[i] != '\0' && j + 2 < len; i++) {
+        char c = in[i];
+        if (c == '\\' || c == '"') {
+            out[j++] = '\\';
+            out[j++] = c;
+        } else if (c == '\n') {
+            out[j++] = '\\';
+            out[j++] = 'n';
+        } else {
+            out[j++] = c;
+        }
+    }
+    out[j] = '\0';
+}
+
+// Same format as bd_addr_to_str(). The exporter runs on its own thread, and bd_addr_to_str() uses
+// a static buffer shared with the BTstack thread.
+static void format_addr(char* out, size_t len, const bd_addr_t addr) {
+    snprintf(out, len, "%02X:%02X:%02X:%02X:%02X:%02X", addr[0], addr[1], addr[2], addr[3], addr[4], addr[5]);
+}
+
+static long device_metric_value(const uni_metrics_device_t* dev, device_metric_t metric) {
+    switch (metric) {
+        case DEVICE_METRIC_INPUT_REPORTS:
+            return dev->input_reports;
+        case DEVICE_METRIC_OUTPUT_REPORTS:
+            return dev->output_reports;
+        case DEVICE_METRIC_OUTPUT_DROPPED:
+            return dev->output_dropped;
+        case DEVICE_METRIC_RSSI:
+            return dev->rssi;
+        case DEVICE_METRIC_BATTERY:
+            return dev->battery;
+        default:
+            return 0;
+    }
+}
+
+static bool append_device_metric(char* buf,
+                                 size_t len,
+                                 size_t* off,
+                                 const uni_metrics_snapshot_t* snap,
+                                 device_metric_t metric) {
+    const char* name = device_metric_info[metric].name;
+    char label[UNI_METRICS_NAME_LEN * 2];
+    char addr[18];
+
+    if (!append(buf, len, off, "# HELP %s %s\n# TYPE %s %s\n", name, device_metric_info[metric].help, name,
+                device_metric_info[metric].type))
+        return false;
+
+    for (int i = 0; i < snap->device_count; i++) {
+        const uni_metrics_device_t* dev = &snap->devices[i];
+        escape_label(label, sizeof(label), dev->name);
+        format_addr(addr, sizeof(addr), dev->addr);
+        if (!append(buf, len, off, "%s{addr=\"%s\",name=\"%s\",vid=\"0x%04x\",pid=\"0x%04x\"} %ld\n", name, addr,
+                    label, dev->vendor_id, dev->product_id, device_metric_value(dev, metric)))
+            return false;
+    }
+    return true;
+}
+
+//
+// Public functions
+//
+void uni_metrics_inc(uni_metrics_counter_t counter) {
+    if (counter >= UNI_METRICS_COUNTER_COUNT)
+        return;
+    s_counters[counter]++;
+}
+
+void uni_metrics_on_device_ready(uni_hid_device_t* d) {
+    if (uni_hid_device_is_virtual_device(d))
+        return;
+
+    s_counters[UNI_METRICS_COUNTER_CONNECTIONS]++;
+    if (was_seen(d->conn.btaddr))
+        s_counters[UNI_METRICS_COUNTER_RECONNECTIONS]++;
+    else
+        add_seen(d->conn.btaddr);
+}
+
+void uni_metrics_on_device_deleted(uni_hid_device_t* d) {
+    s_retired_input_reports += d->perf.input_reports;
+    s_retired_output_reports += d->perf.output_reports;
+    s_retired_output_dropped += d->perf.output_dropped;
+}
+
+void uni_metrics_take_snapshot(uni_metrics_snapshot_t* out) {
+    memset(out, 0, sizeof(*out));
+
+    out->uptime_us = uni_system_get_time_us();
+    memcpy(out->counters, s_counters, sizeof(out->counters));
+    out->input_reports = s_retired_input_reports;
+    out->output_reports = s_retired_output_reports;
+    out->output_dropped = s_retired_output_dropped;
+
+    for (int i = 0; i < CONFIG_BLUEPAD32_MAX_DEVICES; i++) {
+        uni_hid_device_t* d = uni_hid_device_get_instance_for_idx(i);
+        if (d == NULL || uni_hid_device_is_virtual_device(d) ||
+            uni_bt_conn_get_state(&d->conn) != UNI_BT_CONN_STATE_DEVICE_READY)
+            continue;
+
+        out->input_reports += d->perf.input_reports;
+        out->output_reports += d->perf.output_reports;
+        out->output_dropped += d->perf.output_dropped;
+
+        uni_metrics_device_t* dev = &out->devices[out->device_count++];
+        memcpy(dev->addr, d->conn.btaddr, sizeof(dev->addr));
+        strncpy(dev->name, d->name, sizeof(dev->name) - 1);
+        dev->vendor_id = d->vendor_id;
+        dev->product_id = d->product_id;
+        dev->input_reports = d->perf.input_reports;
+        dev->output_reports = d->perf.output_reports;
+        dev->output_dropped = d->perf.output_dropped;
+        dev->rssi = (int8_t)d->conn.rssi;
+        dev->battery = d->controller.battery;
+
+        // Result arrives as GAP_EVENT_RSSI_MEASUREMENT, and it is stored in conn.rssi
+        gap_read_rssi(d->conn.handle);
+    }
+}
+
+int uni_metrics_format_prometheus(const uni_metrics_snapshot_t* snap, char* buf, size_t len) {
+    size_t off = 0;
+    bool ok = true;
+
+    ok = ok && append(buf, len, &off,
+                      "# HELP bluepad32_uptime_seconds Time since boot\n"
+                      "# TYPE bluepad32_uptime_seconds gauge\n"
+                      "bluepad32_uptime_seconds %llu.%06llu\n",
+                      (unsigned long long)(snap->uptime_us / 1000000), (unsigned long long)(snap->uptime_us % 1000000));
+    ok = ok && append(buf, len, &off,
+                      "# HELP bluepad32_devices_connected Devices that completed the setup\n"
+                      "# TYPE bluepad32_devices_connected gauge\n"
+                      "bluepad32_devices_connected %d\n",
+                      snap->device_count);
+
+    for (int i = 0; ok && i < UNI_METRICS_COUNTER_COUNT; i++) {
+        ok = append(buf, len, &off, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n", counter_info[i].name,
+                    counter_info[i].help, counter_info[i].name, counter_info[i].name,
+                    (unsigned long)snap->counters[i]);
+    }
+
+    ok = ok && append(buf, len, &off,
+                      "# HELP bluepad32_input_reports_total Input reports, all devices since boot\n"
+                      "# TYPE bluepad32_input_reports_total counter\n"
+                      "bluepad32_input_reports_total %llu\n"
+                      "# HELP bluepad32_output_reports_total Output reports, all devices since boot\n"
+                      "# TYPE bluepad32_output_reports_total counter\n"
+                      "bluepad32_output_reports_total %llu\n"
+                      "# HELP bluepad32_output_dropped_total Output reports dropped, all devices since boot\n"
+                      "# TYPE bluepad32_output_dropped_total counter\n"
+                      "bluepad32_output_dropped_total %llu\n",
+                      (unsigned long long)snap->input_reports, (unsigned long long)snap->output_reports,
+                      (unsigned long long)snap->output_dropped);
+
+    for (int i = 0; ok && i < DEVICE_METRIC_COUNT; i++)
+        ok = append_device_metric(buf, len, &off, snap, i);
+
+    if (!ok) {
+        loge("Metrics: buffer too small: %d bytes\n", (int)len);
+        return -1;
+    }
+    return (int)off;
+}
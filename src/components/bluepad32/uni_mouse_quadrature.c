@@ -10,143 +10,74 @@
 
 #include <math.h>
 #include <stdbool.h>
-#include <string.h>
-#include <sys/cdefs.h>
 
-#include <driver/gpio.h>
 #include <driver/timer.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 
+#include "uni_common.h"
+#include "uni_gpio_port.h"
 #include "uni_log.h"
+#include "uni_mouse_quadrature_engine.h"
 #include "uni_property.h"
 
-// Probably I could use a smaller divider, and only do "1 tick per 80us".
-// That would work Ok except that it will lose resolution when we divide "128 steps by delta".
-// APB clock runs at 80Mhz.
-//   Option A:
-//   80Mhz / 80 = 1Mhz = tick every 1us
-// #define TIMER_DIVIDER (80)
-// #define TICKS_PER_80US (80)  // How many ticks are in 80us
-// #define ONE_SECOND (1000000)
+// Thin ESP32 adapter for the quadrature engine.
+// The phase generation and scheduling is done in uni_mouse_quadrature_engine.c.
+//
+// All the encoders are driven by one timer, in alarm mode:
+// the ISR runs the engine, writes all the GPIOs at once, and sets the alarm for the next due step.
 //
-//   Option B:
+// APB clock runs at 80Mhz.
 //   80Mhz / 6400 = 12500Hz = tick every 80us
 #define TIMER_DIVIDER (80 * 80)
-#define TICKS_PER_80US (1)  // How many ticks are in 80us
-#define ONE_SECOND (12500)
-
-#define TASK_TIMER_STACK_SIZE (2048)
-#define TASK_TIMER_PRIO (10)
-
-// Default scale factor for the mouse movement
-#define DETAULT_SCALE_FACTOR (1)
-
-enum direction {
-    PHASE_DIRECTION_NEG,
-    PHASE_DIRECTION_POS,
-};
-
-// A mouse has two encoders.
-struct quadrature_state {
-    // horizontal or vertical encoder?
-    int encoder;
-    // Current direction
-    enum direction dir;
-    // Current value
-    int value;
-    // Current quadrature phase
-    int phase;
+_Static_assert(80000000 / TIMER_DIVIDER == UNI_MOUSE_QUADRATURE_ENGINE_TICKS_PER_SECOND, "Invalid timer divider");
 
-    // Which group timer/timer is being used
-    int timer_group;
-    timer_idx_t timer_idx;
+#define TIMER_GROUP TIMER_GROUP_0
+#define TIMER_IDX TIMER_0
 
-    // GPIOs used
-    struct uni_mouse_quadrature_encoder_gpios gpios;
-};
+// When there are no pending steps
+#define IDLE_TICKS (UNI_MOUSE_QUADRATURE_ENGINE_TICKS_PER_SECOND * 60)
 
-static struct quadrature_state s_quadratures[UNI_MOUSE_QUADRATURE_PORT_MAX][UNI_MOUSE_QUADRATURE_ENCODER_MAX];
-// Cache to prevent enabling/disabling timers that were already enabled/disabled
-static bool timer_started[UNI_MOUSE_QUADRATURE_PORT_MAX];
-
-static TaskHandle_t s_timer_tasks[UNI_MOUSE_QUADRATURE_PORT_MAX][UNI_MOUSE_QUADRATURE_ENCODER_MAX];
+#define TASK_TIMER_STACK_SIZE (2048)
+#define TASK_TIMER_PRIO (10)
 
-// "Scale factor" for mouse movement. To make the mouse move faster or slower.
-// Bigger means slower movement.
-static float s_scale_factor;
+static uni_mouse_quadrature_engine_t s_engine;
+// Protects the engine: it is updated from the Bluetooth task, and run from the ISR.
+static portMUX_TYPE s_engine_lock = portMUX_INITIALIZER_UNLOCKED;
 
 static bool initialized;
 
-static void process_quadrature(struct quadrature_state* q) {
-    int a, b;
-
-    if (q->value <= 0) {
-        return;
-    }
-    q->value--;
-
-    if (q->dir == PHASE_DIRECTION_NEG) {
-        q->phase--;
-        if (q->phase < 0)
-            q->phase = 3;
-    } else /* PHASE_DIRECTION_POS */ {
-        q->phase++;
-        if (q->phase > 3)
-            q->phase = 0;
-    }
-
-    switch (q->phase) {
-        case 0:
-            a = 0;
-            b = 0;
-            break;
-        case 1:
-            a = 1;
-            b = 0;
-            break;
-        case 2:
-            a = 1;
-            b = 1;
-            break;
-        case 3:
-            a = 0;
-            b = 1;
-            break;
-        default:
-            loge("%s: invalid phase value: %d", __func__, q->phase);
-            a = b = 0;
-            break;
-    }
-
-    int gpio_a = q->gpios.a;
-    int gpio_b = q->gpios.b;
-    gpio_set_level(gpio_a, a);
-    gpio_set_level(gpio_b, b);
-    logd("value: %d, quadrature phase: %d, a=%d, b=%d (%d,%d)\n", q->value, q->phase, a, b, gpio_a, gpio_b);
+static void set_scale_to_engine(float scale) {
+    if (scale < 0)
+        scale = 0;
+    portENTER_CRITICAL(&s_engine_lock);
+    uni_mouse_quadrature_engine_set_scale(&s_engine, (uint32_t)lroundf(scale * UNI_MOUSE_QUADRATURE_ENGINE_SCALE_ONE));
+    portEXIT_CRITICAL(&s_engine_lock);
 }
 
-// Don't be confused, that is just one task.
-// Actually, this callback is called from 4 different tasks.
-static void timer_task(void* arg) {
-    uint32_t a = (uint32_t)arg;
-    uint16_t port_idx = (a >> 16);
-    uint16_t encoder_idx = (a & 0xffff);
-
-    while (true) {
-        ulTaskNotifyTake(true, portMAX_DELAY);
-        process_quadrature(&s_quadratures[port_idx][encoder_idx]);
-    }
+static bool timer_handler(void* arg) {
+    ARG_UNUSED(arg);
+    uint64_t set, clear;
+
+    portENTER_CRITICAL_ISR(&s_engine_lock);
+    uint64_t counter = timer_group_get_counter_value_in_isr(TIMER_GROUP, TIMER_IDX);
+    // The engine uses 32-bit ticks, and it is wrap-around safe
+    uint32_t delay = uni_mouse_quadrature_engine_run(&s_engine, (uint32_t)counter, &set, &clear);
+    uni_gpio_port_apply(set, clear);
+    timer_group_set_alarm_value_in_isr(TIMER_GROUP, TIMER_IDX, counter + (delay ? delay : IDLE_TICKS));
+    portEXIT_CRITICAL_ISR(&s_engine_lock);
+
+    // No task was woken up
+    return false;
 }
 
-static bool timer_handler(void* arg) {
-    uint32_t a = (uint32_t)arg;
-    uint16_t port_idx = (a >> 16);
-    uint16_t encoder_idx = (a & 0xffff);
+// Must be called with the lock taken.
+static void reschedule_locked(void) {
+    uint64_t counter;
 
-    BaseType_t higher_priority_task_woken = false;
-    vTaskNotifyGiveFromISR(s_timer_tasks[port_idx][encoder_idx], &higher_priority_task_woken);
-    return higher_priority_task_woken;
+    timer_get_counter_value(TIMER_GROUP, TIMER_IDX, &counter);
+    uint32_t delay = uni_mouse_quadrature_engine_next_delay(&s_engine, (uint32_t)counter);
+    timer_set_alarm_value(TIMER_GROUP, TIMER_IDX, counter + (delay ? delay : IDLE_TICKS));
 }
 
 static void init_from_cpu_task() {
@@ -154,105 +85,34 @@ static void init_from_cpu_task() {
     // "Register Timer interrupt handler, the handler is an ISR.
     // The handler will be attached to the same CPU core that this function is running on."
 
-    // Create timers
-    /* Select and initialize basic parameters of the timer */
+    // Free running up-counter. The alarm is moved to the next due step.
     timer_config_t config = {
         .divider = TIMER_DIVIDER,
-        .counter_dir = TIMER_COUNT_DOWN,
+        .counter_dir = TIMER_COUNT_UP,
         .counter_en = TIMER_PAUSE,
         .alarm_en = TIMER_ALARM_EN,
-        .auto_reload = TIMER_AUTORELOAD_EN,
+        .auto_reload = TIMER_AUTORELOAD_DIS,
     };
 
-    for (int i = 0; i < UNI_MOUSE_QUADRATURE_PORT_MAX; i++) {
-        for (int j = 0; j < UNI_MOUSE_QUADRATURE_ENCODER_MAX; j++) {
-            uint32_t arg = (i << 16) | j;
-            char name[32];
-            ESP_ERROR_CHECK(timer_init(s_quadratures[i][j].timer_group, s_quadratures[i][j].timer_idx, &config));
-            timer_set_counter_value(s_quadratures[i][j].timer_group, s_quadratures[i][j].timer_idx, ONE_SECOND * 60);
-            timer_isr_callback_add(s_quadratures[i][j].timer_group, s_quadratures[i][j].timer_idx, timer_handler,
-                                   (void*)arg, 0);
-            // Don't start timer automatically. They should be started on demand.
-            // timer_start(s_quadratures[i][j].timer_group, s_quadratures[i][j].timer_idx);
-
-            // Create timer tasks
-            sprintf(name, "bp.quad.timer%d%c", i, (j == 0) ? 'H' : 'V');
-            xTaskCreatePinnedToCore(timer_task, name, TASK_TIMER_STACK_SIZE, (void*)arg, TASK_TIMER_PRIO,
-                                    &s_timer_tasks[i][j], xPortGetCoreID());
-        }
-    }
+    ESP_ERROR_CHECK(timer_init(TIMER_GROUP, TIMER_IDX, &config));
+    timer_set_counter_value(TIMER_GROUP, TIMER_IDX, 0);
+    timer_set_alarm_value(TIMER_GROUP, TIMER_IDX, IDLE_TICKS);
+    timer_isr_callback_add(TIMER_GROUP, TIMER_IDX, timer_handler, NULL, 0);
+    timer_start(TIMER_GROUP, TIMER_IDX);
 
     // Kill itself
     vTaskDelete(NULL);
 }
 
-static void process_update(struct quadrature_state* q, int32_t delta) {
-    uint64_t units;
-    int32_t abs_delta = (delta < 0) ? -delta : delta;
-
-    if (delta != 0) {
-        // Hack to make the movement smoother with "small deltas". It guarantees that
-        // at least two phases (out of 4) of the quadrature will be run.
-        // if (abs_delta < 2)
-        //     abs_delta = 2;
-        /* Don't update the phase, it should start from the previous phase */
-        q->value = abs_delta;
-        q->dir = (delta < 0) ? PHASE_DIRECTION_NEG : PHASE_DIRECTION_POS;
-
-        // SmallyMouse2 mentions that 100-120 reports are received per second.
-        // According to my test, they are ~90, which is in the same order.
-        // For simplicity, I'll use 100. It means that, at most, reports are received
-        // every 10ms (1 second / 100 reports = 10ms per report).
-        //
-        // "delta" is a "somewhat normalized" value that goes from 0 to 127.
-        // So we should split 10 milliseconds (ms) in 128 steps = ~80 microseconds (us).
-        // That's good because the minimum "ISR" in ESP32 is 50us.
-        // So the ESP32 timer is configured as:
-        // - down timer
-        // - ticks every 1us
-        // - when it reaches 0, triggers the ISR.
-        //
-        // But a quadrature has 4 states (hence the name). So takes 4 "ticks" to have
-        // complete "state.", which is represented with "s_scale_factor",
-        // kind of "hand tuned" so that the mice movement feels "good" (to me).
-        //
-        // The smaller "units" is, the faster the mouse moves.
-        //
-        // But to avoid a "division" in the mouse driver, and a multiplication here,
-        // (which will lose precision), we just use a "s_scale_factor" of 1 instead of 4,
-        // and we don't divide by 4 here.
-        // Alternative: Do not divide the time, and use a constant "tick" time. But if we do so,
-        // the movement will have "jank".
-        // Perhaps for small deltas we can have a predefined "unit time".
-        //
-        // s_scale_factor is used as a divisor to honor the "scale" name:
-        // smaller numbers make it slower, high number faster
-        float max_ticks = 128 * TICKS_PER_80US;
-        float delta_f = abs_delta;
-        float units_f = max_ticks / (delta_f * s_scale_factor);
-        if (units_f < TICKS_PER_80US)
-            units_f = TICKS_PER_80US;
-        units = roundf(units_f);
-    } else {
-        // If there is no update, set timer to update less frequently
-        units = ONE_SECOND * 60;
-    }
-    timer_set_counter_value(q->timer_group, q->timer_idx, units);
+static uint64_t gpio_mask(int gpio) {
+    return (gpio >= 0) ? BIT64(gpio) : 0;
 }
 
 void uni_mouse_quadrature_init(int cpu_id) {
-    memset(s_quadratures, 0, sizeof(s_quadratures));
-
-    for (int i = 0; i < UNI_MOUSE_QUADRATURE_PORT_MAX; i++) {
-        timer_started[i] = false;
-        for (int j = 0; j < UNI_MOUSE_QUADRATURE_ENCODER_MAX; j++) {
-            s_quadratures[i][j].timer_group = TIMER_GROUP_0 + i;
-            s_quadratures[i][j].timer_idx = TIMER_0 + j;
-        }
-    }
+    uni_mouse_quadrature_engine_init(&s_engine);
 
     // Default value that can be overridden from the console
-    s_scale_factor = uni_mouse_quadrature_get_scale_factor();
+    set_scale_to_engine(uni_mouse_quadrature_get_scale_factor());
 
     // Create tasks
     xTaskCreatePinnedToCore(init_from_cpu_task, "uni.init_timers", TASK_TIMER_STACK_SIZE, NULL, TASK_TIMER_PRIO, NULL,
@@ -268,27 +128,26 @@ void uni_mouse_quadrature_setup_port(int port_idx,
         loge("%s: Invalid port idx=%d\n", __func__, port_idx);
         return;
     }
-    s_quadratures[port_idx][UNI_MOUSE_QUADRATURE_ENCODER_H].gpios = h;
-    s_quadratures[port_idx][UNI_MOUSE_QUADRATURE_ENCODER_V].gpios = v;
+    portENTER_CRITICAL(&s_engine_lock);
+    uni_mouse_quadrature_engine_setup_encoder(&s_engine, port_idx, UNI_MOUSE_QUADRATURE_ENCODER_H, gpio_mask(h.a),
+                                              gpio_mask(h.b));
+    uni_mouse_quadrature_engine_setup_encoder(&s_engine, port_idx, UNI_MOUSE_QUADRATURE_ENCODER_V, gpio_mask(v.a),
+                                              gpio_mask(v.b));
+    portEXIT_CRITICAL(&s_engine_lock);
 }
 
 void uni_mouse_quadrature_deinit(void) {
-    // Stop the timers
-    for (int i = 0; i < UNI_MOUSE_QUADRATURE_PORT_MAX; i++) {
-        for (int j = 0; j < UNI_MOUSE_QUADRATURE_ENCODER_MAX; j++) {
-            timer_deinit(s_quadratures[i][j].timer_group, s_quadratures[i][j].timer_idx);
-            // Delete the tasks
-            vTaskDelete(s_timer_tasks[i][j]);
-            s_timer_tasks[i][j] = NULL;
-        }
-    }
+    // Stop the timer
+    timer_pause(TIMER_GROUP, TIMER_IDX);
+    timer_isr_callback_remove(TIMER_GROUP, TIMER_IDX);
+    timer_deinit(TIMER_GROUP, TIMER_IDX);
 
     initialized = false;
 }
 
 void uni_mouse_quadrature_start(int port_idx) {
     if (!initialized) {
-        loge("%s: Error, Not initialized\n");
+        loge("%s: Error, Not initialized\n", __func__);
         return;
     }
 
@@ -297,18 +156,14 @@ void uni_mouse_quadrature_start(int port_idx) {
         return;
     }
 
-    if (timer_started[port_idx])
-        return;
-
-    for (int j = 0; j < UNI_MOUSE_QUADRATURE_ENCODER_MAX; j++)
-        timer_start(s_quadratures[port_idx][j].timer_group, s_quadratures[port_idx][j].timer_idx);
-
-    timer_started[port_idx] = true;
+    portENTER_CRITICAL(&s_engine_lock);
+    uni_mouse_quadrature_engine_set_enabled(&s_engine, port_idx, true);
+    portEXIT_CRITICAL(&s_engine_lock);
 }
 
 void uni_mouse_quadrature_pause(int port_idx) {
     if (!initialized) {
-        loge("%s: Error, Not initialized\n");
+        loge("%s: Error, Not initialized\n", __func__);
         return;
     }
 
@@ -317,36 +172,40 @@ void uni_mouse_quadrature_pause(int port_idx) {
         return;
     }
 
-    if (!timer_started[port_idx])
-        return;
-
-    for (int j = 0; j < UNI_MOUSE_QUADRATURE_ENCODER_MAX; j++)
-        timer_pause(s_quadratures[port_idx][j].timer_group, s_quadratures[port_idx][j].timer_idx);
-
-    timer_started[port_idx] = false;
+    portENTER_CRITICAL(&s_engine_lock);
+    uni_mouse_quadrature_engine_set_enabled(&s_engine, port_idx, false);
+    portEXIT_CRITICAL(&s_engine_lock);
 }
 
 // Should be called everytime that mouse report is received.
 void uni_mouse_quadrature_update(int port_idx, int32_t dx, int32_t dy) {
+    uint64_t counter;
+
     if (!initialized) {
-        loge("%s: Error, Not initialized\n");
+        loge("%s: Error, Not initialized\n", __func__);
         return;
     }
     if (port_idx < 0 || port_idx >= UNI_MOUSE_QUADRATURE_PORT_MAX) {
         loge("%s: Invalid port idx=%d\n", __func__, port_idx);
         return;
     }
-    process_update(&s_quadratures[port_idx][UNI_MOUSE_QUADRATURE_ENCODER_H], dx);
+
+    portENTER_CRITICAL(&s_engine_lock);
+    timer_get_counter_value(TIMER_GROUP, TIMER_IDX, &counter);
+    uni_mouse_quadrature_engine_update(&s_engine, port_idx, UNI_MOUSE_QUADRATURE_ENCODER_H, dx, (uint32_t)counter);
     // Invert delta Y so that mouse goes the right direction.
     // This is based on empiric evidence. Also, it seems that SmallyMouse is doing the same thing
-    process_update(&s_quadratures[port_idx][UNI_MOUSE_QUADRATURE_ENCODER_V], -dy);
+    uni_mouse_quadrature_engine_update(&s_engine, port_idx, UNI_MOUSE_QUADRATURE_ENCODER_V, -dy, (uint32_t)counter);
+    // The new steps might be due before the current alarm
+    reschedule_locked();
+    portEXIT_CRITICAL(&s_engine_lock);
 }
 
 void uni_mouse_quadrature_set_scale_factor(float scale) {
     uni_property_value_t value;
     value.f32 = scale;
 
-    s_scale_factor = scale;
+    set_scale_to_engine(scale);
     uni_property_set(UNI_PROPERTY_IDX_MOUSE_SCALE, value);
 }
 
@@ -354,6 +213,5 @@ float uni_mouse_quadrature_get_scale_factor(void) {
     uni_property_value_t value;
 
     value = uni_property_get(UNI_PROPERTY_IDX_MOUSE_SCALE);
-    s_scale_factor = value.f32;
     return value.f32;
 }
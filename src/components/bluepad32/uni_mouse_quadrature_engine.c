@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+/*
+ * Based on SmallyMouse2 by Simon Inns
+ * https://github.com/simoninns/SmallyMouse2
+ */
+#include "uni_mouse_quadrature_engine.h"
+
+#include <string.h>
+
+// Ticks in which "max delta" steps should be completed. See uni_mouse_quadrature_engine_update().
+#define MAX_DELTA_TICKS 128
+
+// Level of A and B for each phase: 00, 10, 11, 01
+static const uint8_t phase_a[4] = {0, 1, 1, 0};
+static const uint8_t phase_b[4] = {0, 0, 1, 1};
+
+//
+// Helpers
+//
+static bool is_due(uint32_t tick, uint32_t now) {
+    // Wrap-around safe
+    return (int32_t)(tick - now) <= 0;
+}
+
+static bool is_valid(int port_idx, int encoder_idx) {
+    return port_idx >= 0 && port_idx < UNI_MOUSE_QUADRATURE_PORT_MAX && encoder_idx >= 0 &&
+           encoder_idx < UNI_MOUSE_QUADRATURE_ENCODER_MAX;
+}
+
+//
+// Public functions
+//
+void uni_mouse_quadrature_engine_init(uni_mouse_quadrature_engine_t* eng) {
+    memset(eng, 0, sizeof(*eng));
+    eng->scale_q8 = UNI_MOUSE_QUADRATURE_ENGINE_SCALE_ONE;
+}
+
+void uni_mouse_quadrature_engine_setup_encoder(uni_mouse_quadrature_engine_t* eng,
+                                               int port_idx,
+                                               int encoder_idx,
+                                               uint64_t mask_a,
+                                               uint64_t mask_b) {
+    if (!is_valid(port_idx, encoder_idx))
+        return;
+    eng->encoders[port_idx][encoder_idx].mask_a = mask_a;
+    eng->encoders[port_idx][encoder_idx].mask_b = mask_b;
+}
+
+void uni_mouse_quadrature_engine_set_scale(uni_mouse_quadrature_engine_t* eng, uint32_t scale_q8) {
+    // Zero would mean "infinite" interval
+    eng->scale_q8 = scale_q8 ? scale_q8 : 1;
+}
+
+void uni_mouse_quadrature_engine_set_enabled(uni_mouse_quadrature_engine_t* eng, int port_idx, bool enabled) {
+    if (port_idx < 0 || port_idx >= UNI_MOUSE_QUADRATURE_PORT_MAX)
+        return;
+    eng->enabled[port_idx] = enabled;
+}
+
+void uni_mouse_quadrature_engine_update(uni_mouse_quadrature_engine_t* eng,
+                                        int port_idx,
+                                        int encoder_idx,
+                                        int32_t delta,
+                                        uint32_t now) {
+    if (!is_valid(port_idx, encoder_idx))
+        return;
+
+    uni_mouse_quadrature_encoder_t* q = &eng->encoders[port_idx][encoder_idx];
+
+    if (delta == 0) {
+        q->remaining = 0;
+        return;
+    }
+
+    uint32_t abs_delta = (delta < 0) ? -(uint32_t)delta : (uint32_t)delta;
+
+    // SmallyMouse2 mentions that 100-120 reports are received per second.
+    // According to my test, they are ~90, which is in the same order.
+    // For simplicity, I'll use 100. It means that, at most, reports are received
+    // every 10ms (1 second / 100 reports = 10ms per report).
+    //
+    // "delta" is a "somewhat normalized" value that goes from 0 to 127.
+    // So we should split 10 milliseconds (ms) in 128 steps = ~80 microseconds (us), which is one tick.
+    //
+    // The scale factor is a divisor: smaller numbers make it slower, higher numbers faster.
+    //   interval = round(128 / (delta * scale))
+    // Computed in 8.8 fixed point, so no floats are needed.
+    uint64_t divisor = (uint64_t)abs_delta * eng->scale_q8;
+    uint64_t interval = ((uint64_t)MAX_DELTA_TICKS * UNI_MOUSE_QUADRATURE_ENGINE_SCALE_ONE + divisor / 2) / divisor;
+    if (interval < 1)
+        interval = 1;
+
+    // Don't update the phase, it should start from the previous phase
+    q->remaining = (abs_delta > INT32_MAX) ? INT32_MAX : (int32_t)abs_delta;
+    q->dir = (delta < 0) ? -1 : 1;
+    q->interval = (uint32_t)interval;
+    q->next_tick = now + q->interval;
+}
+
+uint32_t uni_mouse_quadrature_engine_run(uni_mouse_quadrature_engine_t* eng,
+                                         uint32_t now,
+                                         uint64_t* set_mask,
+                                         uint64_t* clear_mask) {
+    uint64_t set = 0;
+    uint64_t clear = 0;
+
+    for (int i = 0; i < UNI_MOUSE_QUADRATURE_PORT_MAX; i++) {
+        if (!eng->enabled[i])
+            continue;
+        for (int j = 0; j < UNI_MOUSE_QUADRATURE_ENCODER_MAX; j++) {
+            uni_mouse_quadrature_encoder_t* q = &eng->encoders[i][j];
+            if (q->remaining <= 0 || !is_due(q->next_tick, now))
+                continue;
+
+            q->remaining--;
+            q->phase = (q->phase + q->dir) & 0x03;
+
+            set |= (phase_a[q->phase] ? q->mask_a : 0) | (phase_b[q->phase] ? q->mask_b : 0);
+            clear |= (phase_a[q->phase] ? 0 : q->mask_a) | (phase_b[q->phase] ? 0 : q->mask_b);
+
+            // Keep the cadence. But if it is lagging behind, don't try to catch up with a burst.
+            q->next_tick += q->interval;
+            if (is_due(q->next_tick, now))
+                q->next_tick = now + q->interval;
+        }
+    }
+
+    *set_mask = set;
+    *clear_mask = clear;
+    return uni_mouse_quadrature_engine_next_delay(eng, now);
+}
+
+uint32_t uni_mouse_quadrature_engine_next_delay(const uni_mouse_quadrature_engine_t* eng, uint32_t now) {
+    uint32_t delay = 0;
+
+    for (int i = 0; i < UNI_MOUSE_QUADRATURE_PORT_MAX; i++) {
+        if (!eng->enabled[i])
+            continue;
+        for (int j = 0; j < UNI_MOUSE_QUADRATURE_ENCODER_MAX; j++) {
+            const uni_mouse_quadrature_encoder_t* q = &eng->encoders[i][j];
+            if (q->remaining <= 0)
+                continue;
+            uint32_t d = is_due(q->next_tick, now) ? 1 : q->next_tick - now;
+            if (delay == 0 || d < delay)
+                delay = d;
+        }
+    }
+    return delay;
+}
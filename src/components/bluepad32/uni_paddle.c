@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+// Paddle code based on:
+// https://github.com/LeifBloomquist/JoystickEmulator/blob/master/Arduino/PaddleEmulator/PaddleEmulator.ino
+// But instead of waiting in the ISR, the lines are released when their delay expires.
+
+#include "uni_paddle.h"
+
+#include <string.h>
+
+//
+// Helpers
+//
+static int clamp_delay(int delay_us) {
+    if (delay_us > UNI_PADDLE_DELAY_MAX_US)
+        return UNI_PADDLE_DELAY_MAX_US;
+    if (delay_us < UNI_PADDLE_DELAY_MIN_US)
+        return UNI_PADDLE_DELAY_MIN_US;
+    return delay_us;
+}
+
+// Updates "next" with the time until "at", or adds the line to "clear" if it is due.
+static void check_line(uint64_t mask, uint64_t at, uint64_t now_us, uint64_t* clear, uint32_t* next) {
+    if (now_us >= at) {
+        *clear |= mask;
+        return;
+    }
+    uint32_t d = (uint32_t)(at - now_us);
+    if (*next == 0 || d < *next)
+        *next = d;
+}
+
+//
+// Public functions
+//
+void uni_paddle_init(uni_paddle_t* p, uint64_t mask_x, uint64_t mask_y, uint32_t discharge_us) {
+    memset(p, 0, sizeof(*p));
+    p->mask_x = mask_x;
+    p->mask_y = mask_y;
+    p->discharge_us = discharge_us;
+}
+
+uint32_t uni_paddle_pack_delays(int x_us, int y_us) {
+    return ((uint32_t)clamp_delay(x_us) << 16) | (uint32_t)clamp_delay(y_us);
+}
+
+uint32_t uni_paddle_on_sync(uni_paddle_t* p, uint32_t delays, uint64_t now_us, uint64_t* out_set_mask) {
+    uint64_t clear;
+
+    p->start_us = now_us + p->discharge_us;
+    p->x_us = delays >> 16;
+    p->y_us = delays & 0xffff;
+    p->pending = p->mask_x | p->mask_y;
+
+    *out_set_mask = p->pending;
+    // Nothing can be due yet: the discharge hasn't finished.
+    return uni_paddle_run(p, now_us, &clear);
+}
+
+uint32_t uni_paddle_run(uni_paddle_t* p, uint64_t now_us, uint64_t* out_clear_mask) {
+    uint64_t clear = 0;
+    uint32_t next = 0;
+
+    if (p->pending & p->mask_x)
+        check_line(p->mask_x, p->start_us + p->x_us, now_us, &clear, &next);
+    if (p->pending & p->mask_y)
+        check_line(p->mask_y, p->start_us + p->y_us, now_us, &clear, &next);
+
+    p->pending &= ~clear;
+    *out_clear_mask = clear;
+    return next;
+}
@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#include "uni_perf.h"
+
+#include "uni_log.h"
+
+void uni_perf_histogram_add(uni_perf_histogram_t* h, uint32_t us) {
+    int idx = 0;
+    uint32_t limit = UNI_PERF_HISTOGRAM_FIRST_US;
+
+    while (idx < UNI_PERF_HISTOGRAM_BUCKETS - 1 && us >= limit) {
+        idx++;
+        limit <<= 1;
+    }
+
+    h->buckets[idx]++;
+    h->count++;
+    h->total_us += us;
+    if (us > h->max_us)
+        h->max_us = us;
+}
+
+void uni_perf_histogram_dump(const uni_perf_histogram_t* h) {
+    if (h->count == 0) {
+        logi("    no samples\n");
+        return;
+    }
+
+    logi("    count=%u, avg=%uus, max=%uus\n", (unsigned)h->count, (unsigned)(h->total_us / h->count),
+         (unsigned)h->max_us);
+
+    uint32_t from = 0;
+    uint32_t to = UNI_PERF_HISTOGRAM_FIRST_US;
+    for (int i = 0; i < UNI_PERF_HISTOGRAM_BUCKETS; i++) {
+        if (i == UNI_PERF_HISTOGRAM_BUCKETS - 1)
+            logi("    >= %5uus: %u\n", (unsigned)from, (unsigned)h->buckets[i]);
+        else
+            logi("    < %6uus: %u\n", (unsigned)to, (unsigned)h->buckets[i]);
+        from = to;
+        to <<= 1;
+    }
+}
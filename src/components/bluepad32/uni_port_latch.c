@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#include "uni_port_latch.h"
+
+#include <string.h>
+
+#include "uni_log.h"
+
+//
+// Helpers
+//
+static bool take_pending(uni_port_latch_t* l, uint64_t now_us, uint64_t* out_set_mask, uint64_t* out_clear_mask) {
+    if (!l->pending)
+        return false;
+
+    *out_set_mask = l->set_mask;
+    *out_clear_mask = l->clear_mask;
+    l->pending = false;
+    uni_perf_histogram_add(&l->state_age, (uint32_t)(now_us - l->latched_us));
+    return true;
+}
+
+//
+// Public functions
+//
+void uni_port_latch_init(uni_port_latch_t* l) {
+    memset(l, 0, sizeof(*l));
+}
+
+bool uni_port_latch_is_synced(const uni_port_latch_t* l, uint64_t now_us) {
+    return l->last_sync_us != 0 && now_us - l->last_sync_us < UNI_PORT_LATCH_SYNC_TIMEOUT_US;
+}
+
+bool uni_port_latch_write(uni_port_latch_t* l, uint64_t set_mask, uint64_t clear_mask, uint64_t now_us) {
+    if (!uni_port_latch_is_synced(l, now_us)) {
+        // The new state supersedes the latched one, if any.
+        l->pending = false;
+        l->immediate++;
+        return false;
+    }
+
+    if (l->pending)
+        l->coalesced++;
+    l->set_mask = set_mask;
+    l->clear_mask = clear_mask;
+    l->latched_us = now_us;
+    l->pending = true;
+    return true;
+}
+
+bool uni_port_latch_on_sync(uni_port_latch_t* l, uint64_t now_us, uint64_t* out_set_mask, uint64_t* out_clear_mask) {
+    l->syncs++;
+    l->last_sync_us = now_us;
+    return take_pending(l, now_us, out_set_mask, out_clear_mask);
+}
+
+bool uni_port_latch_flush(uni_port_latch_t* l, uint64_t now_us, uint64_t* out_set_mask, uint64_t* out_clear_mask) {
+    l->last_sync_us = 0;
+    return take_pending(l, now_us, out_set_mask, out_clear_mask);
+}
+
+void uni_port_latch_dump(const uni_port_latch_t* l) {
+    logi("  syncs=%u, immediate=%u, coalesced=%u\n", (unsigned)l->syncs, (unsigned)l->immediate,
+         (unsigned)l->coalesced);
+    logi("  sync IRQ to port:\n");
+    uni_perf_histogram_dump(&l->irq_to_port);
+    logi("  state age at port write:\n");
+    uni_perf_histogram_dump(&l->state_age);
+}
@@ -10,6 +10,7 @@
 #include "bt/uni_bt_defines.h"
 #include "platform/uni_platform.h"
 #include "sdkconfig.h"
+#include "uni_joystick.h"
 #include "uni_log.h"
 #include "uni_version.h"
 
@@ -39,7 +40,24 @@ static const uni_property_t properties[] = {
      .default_value.u8 = UNI_BT_MAX_PERIODIC_LENGTH},
     {UNI_PROPERTY_IDX_GAP_MIN_PERIODIC_LEN, UNI_PROPERTY_NAME_GAP_MIN_PERIODIC_LEN, UNI_PROPERTY_TYPE_U8,
      .default_value.u8 = UNI_BT_MIN_PERIODIC_LENGTH},
+    // See uni_joystick.h for the analog to digital conversion
+    {UNI_PROPERTY_IDX_JOY_ACCEL_THRESHOLD, UNI_PROPERTY_NAME_JOY_ACCEL_THRESHOLD, UNI_PROPERTY_TYPE_U8,
+     .default_value.u8 = UNI_JOY_ANALOG_ACCEL_THRESHOLD_DEFAULT},
+    {UNI_PROPERTY_IDX_JOY_DEADZONE, UNI_PROPERTY_NAME_JOY_DEADZONE, UNI_PROPERTY_TYPE_U32,
+     .default_value.u32 = UNI_JOY_ANALOG_DEADZONE_DEFAULT},
+    {UNI_PROPERTY_IDX_JOY_HYSTERESIS, UNI_PROPERTY_NAME_JOY_HYSTERESIS, UNI_PROPERTY_TYPE_U32,
+     .default_value.u32 = UNI_JOY_ANALOG_HYSTERESIS_DEFAULT},
+    {UNI_PROPERTY_IDX_JOY_WAYS, UNI_PROPERTY_NAME_JOY_WAYS, UNI_PROPERTY_TYPE_U8,
+     .default_value.u8 = UNI_JOY_ANALOG_WAYS_DEFAULT},
+    // See uni_keymap.h for the format
+    {UNI_PROPERTY_IDX_KEYBOARD_KEYMAP, UNI_PROPERTY_NAME_KEYBOARD_KEYMAP, UNI_PROPERTY_TYPE_STRING,
+     .default_value.str = NULL},
     {UNI_PROPERTY_IDX_MOUSE_SCALE, UNI_PROPERTY_NAME_MOUSE_SCALE, UNI_PROPERTY_TYPE_FLOAT, .default_value.f32 = 1.0f},
+    {UNI_PROPERTY_IDX_RECONNECT_ENABLED, UNI_PROPERTY_NAME_RECONNECT_ENABLED, UNI_PROPERTY_TYPE_BOOL,
+     .default_value.boolean = false},
+    // See uni_bt_reconnect.c for the format
+    {UNI_PROPERTY_IDX_RECONNECT_LIST, UNI_PROPERTY_NAME_RECONNECT_LIST, UNI_PROPERTY_TYPE_STRING,
+     .default_value.str = NULL},
     {UNI_PROPERTY_IDX_VERSION, UNI_PROPERTY_NAME_VERSION, UNI_PROPERTY_TYPE_STRING, .default_value.str = UNI_VERSION,
      .flags = UNI_PROPERTY_FLAG_READ_ONLY},
     {UNI_PROPERTY_IDX_VIRTUAL_DEVICE_ENABLED, UNI_PROPERTY_NAME_VIRTUAL_DEVICE_ENABLED, UNI_PROPERTY_TYPE_BOOL,
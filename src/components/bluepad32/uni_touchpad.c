@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+#include "uni_touchpad.h"
+
+#include <string.h>
+
+//
+// Helpers
+//
+static bool is_same_finger(const uni_touchpad_finger_t* prev, const uni_touchpad_finger_t* cur) {
+    return prev->active && cur->active && prev->id == cur->id;
+}
+
+//
+// Public functions
+//
+void uni_touchpad_init(uni_touchpad_t* tp) {
+    memset(tp, 0, sizeof(*tp));
+}
+
+void uni_touchpad_begin(uni_touchpad_t* tp) {
+    tp->delta_x = 0;
+    tp->delta_y = 0;
+    tp->scroll = 0;
+    tp->frames = 0;
+}
+
+void uni_touchpad_add_frame(uni_touchpad_t* tp, const uni_touchpad_finger_t fingers[UNI_TOUCHPAD_FINGERS_MAX]) {
+    const uni_touchpad_finger_t* f0 = &fingers[0];
+    const uni_touchpad_finger_t* f1 = &fingers[1];
+    bool same0 = is_same_finger(&tp->prev[0], f0);
+    bool same1 = is_same_finger(&tp->prev[1], f1);
+
+    if (f0->active && f1->active) {
+        // Two fingers: scroll. Use the motion of the middle point, and only when both fingers
+        // were already touching. Otherwise the second finger "landing" would scroll.
+        if (same0 && same1) {
+            int32_t dy = ((f0->y + f1->y) - (tp->prev[0].y + tp->prev[1].y)) / 2;
+            // Natural scrolling: fingers going down scrolls up.
+            tp->scroll_remainder += dy;
+            int32_t steps = tp->scroll_remainder / UNI_TOUCHPAD_SCROLL_STEP;
+            tp->scroll += steps;
+            tp->scroll_remainder -= steps * UNI_TOUCHPAD_SCROLL_STEP;
+        }
+    } else {
+        tp->scroll_remainder = 0;
+        // One finger. It could be the second one, if the first one was lifted.
+        if (same0) {
+            tp->delta_x += f0->x - tp->prev[0].x;
+            tp->delta_y += f0->y - tp->prev[0].y;
+        } else if (same1) {
+            tp->delta_x += f1->x - tp->prev[1].x;
+            tp->delta_y += f1->y - tp->prev[1].y;
+        }
+    }
+
+    tp->prev[0] = *f0;
+    tp->prev[1] = *f1;
+    tp->frames++;
+}
+
+void uni_touchpad_end(uni_touchpad_t* tp, uni_mouse_t* ms) {
+    ms->delta_x = tp->delta_x;
+    ms->delta_y = tp->delta_y;
+    if (tp->scroll > INT8_MAX)
+        ms->scroll_wheel = INT8_MAX;
+    else if (tp->scroll < INT8_MIN)
+        ms->scroll_wheel = INT8_MIN;
+    else
+        ms->scroll_wheel = (int8_t)tp->scroll;
+}
+
+bool uni_touchpad_get_position(const uni_touchpad_t* tp, uint16_t* x, uint16_t* y) {
+    *x = tp->prev[0].x;
+    *y = tp->prev[0].y;
+    return tp->prev[0].active;
+}
@@ -0,0 +1,313 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+// Decodes the report traces recorded by Bluepad32. See uni_trace.h.
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "uni_trace_format.h"
+
+#define ALIGN_UP(x, a) (((x) + (a)-1) & ~((a)-1))
+
+typedef struct {
+    uint8_t* map;
+    size_t size;
+    const uni_trace_file_header_t* hdr;
+    const uint8_t* devices;
+    const uint8_t* data;
+} trace_t;
+
+// Callback for each record. Returns false to stop.
+typedef bool (*record_cb_t)(const uni_trace_record_header_t* r, const uint8_t* payload, void* ctx);
+
+static const char* type_names[] = {
+    [UNI_TRACE_RECORD_WRAP] = "wrap",       [UNI_TRACE_RECORD_INPUT] = "input",
+    [UNI_TRACE_RECORD_OUTPUT] = "output",   [UNI_TRACE_RECORD_FEATURE] = "feature",
+    [UNI_TRACE_RECORD_DEVICE] = "device",   [UNI_TRACE_RECORD_DISCONNECT] = "disconnect",
+};
+
+static const char* channel_names[] = {
+    [UNI_TRACE_CHANNEL_NONE] = "-",
+    [UNI_TRACE_CHANNEL_INTERRUPT] = "intr",
+    [UNI_TRACE_CHANNEL_CONTROL] = "ctrl",
+    [UNI_TRACE_CHANNEL_GATT] = "gatt",
+};
+
+static const char* type_name(uint8_t type) {
+    if (type < sizeof(type_names) / sizeof(type_names[0]))
+        return type_names[type];
+    return "unknown";
+}
+
+static const char* channel_name(uint8_t channel) {
+    if (channel < sizeof(channel_names) / sizeof(channel_names[0]))
+        return channel_names[channel];
+    return "?";
+}
+
+static int trace_open(trace_t* t, const char* path) {
+    struct stat st;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        return -1;
+    }
+    t->size = st.st_size;
+    t->map = mmap(NULL, t->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (t->map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    t->hdr = (const uni_trace_file_header_t*)t->map;
+    if (t->size < sizeof(*t->hdr) || memcmp(t->hdr->magic, UNI_TRACE_MAGIC, UNI_TRACE_MAGIC_LEN) != 0) {
+        fprintf(stderr, "%s: not a Bluepad32 trace\n", path);
+        return -1;
+    }
+    if (t->hdr->version != UNI_TRACE_VERSION || t->hdr->header_size != sizeof(*t->hdr)) {
+        fprintf(stderr, "%s: unsupported version: %u\n", path, t->hdr->version);
+        return -1;
+    }
+    if (t->hdr->device_slot_size < sizeof(uni_trace_device_slot_t) ||
+        (uint64_t)t->hdr->device_slots * t->hdr->device_slot_size + t->hdr->data_size > t->size - sizeof(*t->hdr) ||
+        t->hdr->tail >= t->hdr->data_size) {
+        fprintf(stderr, "%s: truncated or corrupted file\n", path);
+        return -1;
+    }
+    t->devices = t->map + t->hdr->header_size;
+    t->data = t->devices + t->hdr->device_slots * t->hdr->device_slot_size;
+    return 0;
+}
+
+// Returns the device slot, or NULL if it is empty
+static const uni_trace_device_slot_t* trace_get_device_slot(const trace_t* t, uint32_t idx) {
+    const uni_trace_device_slot_t* slot = (const uni_trace_device_slot_t*)(t->devices + idx * t->hdr->device_slot_size);
+    if (!slot->valid || slot->len > t->hdr->device_slot_size - sizeof(*slot))
+        return NULL;
+    return slot;
+}
+
+// Iterates the records from the oldest to the newest
+static int trace_foreach(const trace_t* t, record_cb_t cb, void* ctx) {
+    uint32_t data_size = t->hdr->data_size;
+    uint32_t offset = t->hdr->tail;
+
+    for (uint32_t i = 0; i < t->hdr->records; i++) {
+        if (data_size - offset < sizeof(uni_trace_record_header_t))
+            offset = 0;
+        const uni_trace_record_header_t* r = (const uni_trace_record_header_t*)(t->data + offset);
+        if (r->type == UNI_TRACE_RECORD_WRAP) {
+            offset = 0;
+            r = (const uni_trace_record_header_t*)t->data;
+        }
+        if (r->len > data_size - offset - sizeof(*r)) {
+            fprintf(stderr, "Corrupted record at offset %u\n", offset);
+            return -1;
+        }
+        if (!cb(r, (const uint8_t*)(r + 1), ctx))
+            break;
+        offset += ALIGN_UP(sizeof(*r) + r->len, UNI_TRACE_RECORD_ALIGN);
+    }
+    return 0;
+}
+
+static void print_hex(const uint8_t* data, int len) {
+    for (int i = 0; i < len; i++)
+        printf("%02x%s", data[i], (i % 16 == 15 && i != len - 1) ? "\n                                          " : " ");
+    printf("\n");
+}
+
+// "payload" is the one of a DEVICE record, or of a device slot
+static void print_device(const uint8_t* payload, uint16_t len) {
+    uni_trace_device_t info;
+
+    if (len < sizeof(info)) {
+        print_hex(payload, len);
+        return;
+    }
+    memcpy(&info, payload, sizeof(info));
+    info.name[sizeof(info.name) - 1] = '\0';
+    printf("%02x:%02x:%02x:%02x:%02x:%02x vid=0x%04x pid=0x%04x type=0x%02x protocol=%u cod=0x%06x name='%s'\n",
+           info.addr[0], info.addr[1], info.addr[2], info.addr[3], info.addr[4], info.addr[5], info.vendor_id,
+           info.product_id, info.controller_type, info.protocol, info.cod, info.name);
+    if (info.descriptor_len == 0 || info.descriptor_len > len - sizeof(info))
+        return;
+
+    if (info.services == 0) {
+        printf("%42s", "descriptor: ");
+        print_hex(payload + sizeof(info), info.descriptor_len);
+        return;
+    }
+
+    // BLE: one descriptor per HID service, back to back
+    uint16_t offset = 0;
+    for (int i = 0; i < info.services && i < UNI_TRACE_SERVICES_MAX; i++) {
+        uint16_t service_len = info.service_descriptor_len[i];
+        if (service_len > info.descriptor_len - offset)
+            service_len = info.descriptor_len - offset;
+        char label[32];
+        snprintf(label, sizeof(label), "descriptor svc=%d: ", i);
+        printf("%42s", label);
+        if (service_len == 0)
+            printf("(none)\n");
+        else
+            print_hex(payload + sizeof(info) + offset, service_len);
+        offset += service_len;
+    }
+}
+
+//
+// "info" command
+//
+typedef struct {
+    uint32_t count[UNI_TRACE_RECORD_DISCONNECT + 1];
+    uint64_t first_us;
+    uint64_t last_us;
+} info_ctx_t;
+
+static bool info_cb(const uni_trace_record_header_t* r, const uint8_t* payload, void* ctx) {
+    info_ctx_t* info = ctx;
+    (void)payload;
+
+    if (info->first_us == 0)
+        info->first_us = r->timestamp_us;
+    info->last_us = r->timestamp_us;
+    if (r->type <= UNI_TRACE_RECORD_DISCONNECT)
+        info->count[r->type]++;
+    return true;
+}
+
+static int cmd_info(const trace_t* t) {
+    info_ctx_t info = {0};
+
+    if (trace_foreach(t, info_cb, &info) < 0)
+        return EXIT_FAILURE;
+
+    int devices = 0;
+    for (uint32_t i = 0; i < t->hdr->device_slots; i++)
+        devices += trace_get_device_slot(t, i) != NULL;
+
+    printf("Ring size: %u bytes\n", t->hdr->data_size);
+    printf("Devices connected before the oldest record: %d\n", devices);
+    printf("Records: %u (%u overwritten)\n", t->hdr->records, t->hdr->records_total - t->hdr->records);
+    printf("Duration: %.3f seconds\n", (info.last_us - info.first_us) / 1000000.0);
+    for (int i = UNI_TRACE_RECORD_INPUT; i <= UNI_TRACE_RECORD_DISCONNECT; i++)
+        printf("  %-10s %u\n", type_name(i), info.count[i]);
+    return EXIT_SUCCESS;
+}
+
+//
+// "dump" command
+//
+typedef struct {
+    int device_idx;  // -1: all
+    int type;        // -1: all
+    uint64_t first_us;
+} dump_ctx_t;
+
+static bool dump_cb(const uni_trace_record_header_t* r, const uint8_t* payload, void* ctx) {
+    dump_ctx_t* dump = ctx;
+
+    if (dump->first_us == 0)
+        dump->first_us = r->timestamp_us;
+    if (dump->device_idx >= 0 && r->device_idx != dump->device_idx)
+        return true;
+    if (dump->type >= 0 && r->type != dump->type)
+        return true;
+
+    printf("%12.6f dev=%d %-10s %-4s len=%-3u ", (r->timestamp_us - dump->first_us) / 1000000.0, r->device_idx,
+           type_name(r->type), channel_name(r->channel), r->len);
+
+    if (r->type == UNI_TRACE_RECORD_DEVICE) {
+        print_device(payload, r->len);
+        return true;
+    }
+
+    if (r->type == UNI_TRACE_RECORD_INPUT && r->channel == UNI_TRACE_CHANNEL_GATT)
+        printf("svc=%u ", r->service_index);
+    print_hex(payload, r->len);
+    return true;
+}
+
+static int cmd_dump(const trace_t* t, int device_idx, int type) {
+    dump_ctx_t dump = {.device_idx = device_idx, .type = type};
+
+    // The device table goes first: its DEVICE records were overwritten.
+    for (uint32_t i = 0; i < t->hdr->device_slots; i++) {
+        const uni_trace_device_slot_t* slot = trace_get_device_slot(t, i);
+        if (!slot || (device_idx >= 0 && (int)i != device_idx) || (type >= 0 && type != UNI_TRACE_RECORD_DEVICE))
+            continue;
+        printf("%12s dev=%u %-10s %-4s len=%-3u ", "table", i, type_name(UNI_TRACE_RECORD_DEVICE),
+               channel_name(UNI_TRACE_CHANNEL_NONE), slot->len);
+        print_device((const uint8_t*)(slot + 1), slot->len);
+    }
+
+    return trace_foreach(t, dump_cb, &dump) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s info <file>\n"
+            "       %s dump [-d device_idx] [-t input|output|feature|device|disconnect] <file>\n",
+            name, name);
+}
+
+int main(int argc, char* argv[]) {
+    trace_t t;
+    int device_idx = -1;
+    int type = -1;
+    int opt;
+
+    if (argc < 3) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char* cmd = argv[1];
+    optind = 2;
+    while ((opt = getopt(argc, argv, "d:t:")) != -1) {
+        switch (opt) {
+            case 'd':
+                device_idx = atoi(optarg);
+                break;
+            case 't':
+                for (int i = UNI_TRACE_RECORD_INPUT; i <= UNI_TRACE_RECORD_DISCONNECT; i++) {
+                    if (strcmp(optarg, type_name(i)) == 0)
+                        type = i;
+                }
+                if (type < 0) {
+                    fprintf(stderr, "Invalid type: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (trace_open(&t, argv[optind]) < 0)
+        return EXIT_FAILURE;
+
+    if (strcmp(cmd, "info") == 0)
+        return cmd_info(&t);
+    if (strcmp(cmd, "dump") == 0)
+        return cmd_dump(&t, device_idx, type);
+
+    usage(argv[0]);
+    return EXIT_FAILURE;
+}
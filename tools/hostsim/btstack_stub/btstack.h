@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+// Minimal BTstack API, enough to build some parsers and the POSIX example helpers on the host.
+// The functions are implemented by the tests: e.g. steam_gatt_sim.c simulates the GATT client.
+// The event layout is not the real BTstack one, only the accessors are the same.
+
+#ifndef HOSTSIM_BTSTACK_H
+#define HOSTSIM_BTSTACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "btstack_run_loop.h"
+
+typedef uint8_t bd_addr_t[6];
+typedef uint16_t hci_con_handle_t;
+typedef enum { HCI_ROLE_MASTER = 0, HCI_ROLE_SLAVE = 1, HCI_ROLE_INVALID = 0xff } hci_role_t;
+
+void bd_addr_copy(bd_addr_t dest, const bd_addr_t src);
+const char* bd_addr_to_str(const bd_addr_t addr);
+void gap_local_bd_addr(bd_addr_t address_buffer);
+
+typedef struct btstack_timer_source {
+    btstack_linked_item_t item;
+    uint32_t timeout;
+    void (*process)(struct btstack_timer_source* ts);
+    void* context;
+} btstack_timer_source_t;
+
+typedef void (*btstack_packet_handler_t)(uint8_t packet_type, uint16_t channel, uint8_t* packet, uint16_t size);
+
+#define HCI_EVENT_PACKET 0x04
+#define ERROR_CODE_SUCCESS 0x00
+#define GATT_CLIENT_IN_WRONG_STATE 0x91
+#define ATT_ERROR_SUCCESS 0x00
+
+#define GATT_EVENT_QUERY_COMPLETE 0xa0
+#define GATT_EVENT_SERVICE_QUERY_RESULT 0xa1
+#define GATT_EVENT_CHARACTERISTIC_QUERY_RESULT 0xa2
+
+typedef struct {
+    uint16_t start_group_handle;
+    uint16_t end_group_handle;
+    uint16_t uuid16;
+    uint8_t uuid128[16];
+} gatt_client_service_t;
+
+typedef struct {
+    uint16_t start_handle;
+    uint16_t value_handle;
+    uint16_t end_handle;
+    uint16_t properties;
+    uint16_t uuid16;
+    uint8_t uuid128[16];
+} gatt_client_characteristic_t;
+
+// Event layout: type, connection handle (little endian), ATT status or result.
+static inline uint8_t hci_event_packet_get_type(const uint8_t* event) {
+    return event[0];
+}
+
+static inline hci_con_handle_t hostsim_event_get_handle(const uint8_t* event) {
+    return (hci_con_handle_t)(event[1] | (event[2] << 8));
+}
+
+#define gatt_event_service_query_result_get_handle hostsim_event_get_handle
+#define gatt_event_characteristic_query_result_get_handle hostsim_event_get_handle
+#define gatt_event_query_complete_get_handle hostsim_event_get_handle
+
+static inline uint8_t gatt_event_query_complete_get_att_status(const uint8_t* event) {
+    return event[3];
+}
+
+static inline void gatt_event_service_query_result_get_service(const uint8_t* event, gatt_client_service_t* service) {
+    memcpy(service, &event[3], sizeof(*service));
+}
+
+static inline void gatt_event_characteristic_query_result_get_characteristic(
+    const uint8_t* event,
+    gatt_client_characteristic_t* characteristic) {
+    memcpy(characteristic, &event[3], sizeof(*characteristic));
+}
+
+uint8_t gatt_client_discover_primary_services_by_uuid128(btstack_packet_handler_t callback,
+                                                         hci_con_handle_t con_handle,
+                                                         const uint8_t* uuid128);
+uint8_t gatt_client_discover_characteristics_for_service_by_uuid128(btstack_packet_handler_t callback,
+                                                                    hci_con_handle_t con_handle,
+                                                                    gatt_client_service_t* service,
+                                                                    const uint8_t* uuid128);
+uint8_t gatt_client_write_value_of_characteristic(btstack_packet_handler_t callback,
+                                                  hci_con_handle_t con_handle,
+                                                  uint16_t value_handle,
+                                                  uint16_t value_length,
+                                                  uint8_t* value);
+
+#endif  // HOSTSIM_BTSTACK_H
@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+// Minimal BTstack run loop API: data sources only. Implemented by the tests.
+
+#ifndef HOSTSIM_BTSTACK_RUN_LOOP_H
+#define HOSTSIM_BTSTACK_RUN_LOOP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct btstack_linked_item {
+    struct btstack_linked_item* next;
+} btstack_linked_item_t;
+
+typedef enum {
+    DATA_SOURCE_CALLBACK_POLL = 1 << 0,
+    DATA_SOURCE_CALLBACK_READ = 1 << 1,
+    DATA_SOURCE_CALLBACK_WRITE = 1 << 2,
+} btstack_data_source_callback_type_t;
+
+typedef struct btstack_data_source {
+    btstack_linked_item_t item;
+    union {
+        int fd;
+        void* handle;
+    } source;
+    void (*process)(struct btstack_data_source* ds, btstack_data_source_callback_type_t callback_type);
+    uint16_t flags;
+} btstack_data_source_t;
+
+void btstack_run_loop_set_data_source_fd(btstack_data_source_t* data_source, int fd);
+void btstack_run_loop_set_data_source_handler(btstack_data_source_t* data_source,
+                                              void (*process)(btstack_data_source_t* data_source,
+                                                              btstack_data_source_callback_type_t callback_type));
+void btstack_run_loop_enable_data_source_callbacks(btstack_data_source_t* data_source, uint16_t callbacks);
+void btstack_run_loop_add_data_source(btstack_data_source_t* data_source);
+bool btstack_run_loop_remove_data_source(btstack_data_source_t* data_source);
+
+#endif  // HOSTSIM_BTSTACK_RUN_LOOP_H
@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+// Timing simulation of the C64 joystick port, latched on the sync IRQ.
+//
+// Plays the role of the controller, of the C64 and of the sync task: controller reports arrive
+// every 7-9ms, the C64 pulses the sync line every frame and reads the port 200us later.
+// Each state written to the port is tagged, so that the reads can tell whether the port changed
+// between the sync and the read ("torn"), and how old the state that was read is.
+// Compares writing each state immediately with latching it until the next sync, like the
+// Unijoysticle C64 platform does, and checks the fallback when the syncs stop.
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "uni_gpio_port.h"
+#include "uni_port_latch.h"
+
+// PAL frame
+#define FRAME_US 20000
+#define READ_AFTER_SYNC_US 200
+#define REPORT_MIN_US 7000
+#define REPORT_MAX_US 9000
+// Same as the sync task in the C64 platform
+#define FLUSH_PERIOD_US 100000
+#define STEP_US 10
+#define SIM_US (60ULL * 1000 * 1000)
+// The state is a 16-bit tag, written to the lower port bits
+#define STATE_MASK 0xffff
+
+typedef struct {
+    uint32_t reads;
+    uint32_t torn;
+    uint64_t age_total_us;
+    uint32_t age_max_us;
+    uint32_t last_state;
+    bool last_state_on_port;
+} result_t;
+
+static uni_port_latch_t latch;
+// When each state was produced
+static uint64_t state_us[STATE_MASK + 1];
+static uint32_t rand_state = 0x12345678;
+static int failures;
+
+static void check(bool ok, const char* what) {
+    printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Deterministic, so that every run is the same.
+static uint32_t rand_range(uint32_t min, uint32_t max) {
+    rand_state = rand_state * 1664525 + 1013904223;
+    return min + (rand_state >> 16) % (max - min + 1);
+}
+
+//
+// What the latch needs from Bluepad32
+//
+void uni_log(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+//
+// Simulation
+//
+
+// Same as gpio_isr_handler_sync(), without the spinlock.
+static void sync_isr(uint64_t now_us) {
+    uint64_t set_mask, clear_mask;
+
+    if (uni_port_latch_on_sync(&latch, now_us, &set_mask, &clear_mask)) {
+        uni_gpio_port_apply(set_mask, clear_mask);
+        uni_perf_histogram_add(&latch.irq_to_port, 0);
+    }
+}
+
+// Runs for "sim_us". The syncs stop at "syncs_stop_us".
+static void run(bool latched, uint64_t sim_us, uint64_t syncs_stop_us, result_t* r) {
+    uint64_t next_report_us = 3000;
+    uint64_t next_sync_us = FRAME_US;
+    uint64_t read_us = 0;
+    uint64_t levels_at_sync = 0;
+    uint32_t state = 0;
+
+    uni_port_latch_init(&latch);
+    uni_gpio_port_mock_reset();
+    rand_state = 0x12345678;
+    memset(r, 0, sizeof(*r));
+
+    for (uint64_t t = STEP_US; t < sim_us; t += STEP_US) {
+        // BTstack thread: new controller state
+        if (t >= next_report_us) {
+            uint64_t set_mask, clear_mask;
+            state = (state + 1) & STATE_MASK;
+            state_us[state] = t;
+            set_mask = state;
+            clear_mask = ~set_mask & STATE_MASK;
+            if (!latched || !uni_port_latch_write(&latch, set_mask, clear_mask, t))
+                uni_gpio_port_apply(set_mask, clear_mask);
+            next_report_us = t + rand_range(REPORT_MIN_US, REPORT_MAX_US);
+        }
+
+        // C64: sync, and the read that follows it
+        if (t >= next_sync_us && t < syncs_stop_us) {
+            if (latched)
+                sync_isr(t);
+            levels_at_sync = uni_gpio_port_mock_get_levels();
+            read_us = t + READ_AFTER_SYNC_US;
+            next_sync_us = t + FRAME_US;
+        }
+        if (t == read_us) {
+            uint64_t levels = uni_gpio_port_mock_get_levels();
+            uint32_t age = (uint32_t)(t - state_us[levels & STATE_MASK]);
+            r->reads++;
+            if (levels != levels_at_sync)
+                r->torn++;
+            r->age_total_us += age;
+            if (age > r->age_max_us)
+                r->age_max_us = age;
+        }
+
+        // Sync task
+        if (latched && t % FLUSH_PERIOD_US == 0 && !uni_port_latch_is_synced(&latch, t)) {
+            uint64_t set_mask, clear_mask;
+            if (uni_port_latch_flush(&latch, t, &set_mask, &clear_mask))
+                uni_gpio_port_apply(set_mask, clear_mask);
+        }
+    }
+
+    r->last_state = state;
+    r->last_state_on_port = (uni_gpio_port_mock_get_levels() & STATE_MASK) == state;
+}
+
+static uint32_t age_avg(const result_t* r) {
+    return r->reads ? (uint32_t)(r->age_total_us / r->reads) : 0;
+}
+
+int main(void) {
+    char what[160];
+    result_t immediate, latched, stopped;
+    double t0, t1;
+
+    run(false, SIM_US, SIM_US, &immediate);
+    snprintf(what, sizeof(what), "immediate writes: the port changed between sync and read in %u of %u frames",
+             immediate.torn, immediate.reads);
+    check(immediate.torn > 0, what);
+
+    t0 = now_s();
+    run(true, SIM_US, SIM_US, &latched);
+    t1 = now_s();
+    snprintf(what, sizeof(what), "latched writes: the port changed between sync and read in %u of %u frames",
+             latched.torn, latched.reads);
+    check(latched.reads == immediate.reads && latched.torn == 0, what);
+
+    snprintf(what, sizeof(what),
+             "state age at read: avg %u us latched, %u us immediate. Max %u us: at most one report interval + the "
+             "read delay",
+             age_avg(&latched), age_avg(&immediate), latched.age_max_us);
+    check(latched.age_max_us <= REPORT_MAX_US + READ_AFTER_SYNC_US, what);
+
+    check(!latched.last_state_on_port && latch.pending, "latched writes: the last state waits for the next sync");
+    sync_isr(SIM_US);
+    check((uni_gpio_port_mock_get_levels() & STATE_MASK) == latched.last_state,
+          "latched writes: the next sync writes the last state to the port");
+
+    printf("bench: %u syncs, %u states replaced before reaching the port. %.1f ns per simulated step on the host\n",
+           latch.syncs, latch.coalesced, (t1 - t0) / (SIM_US / STEP_US) * 1e9);
+    printf("bench: state age at port write, latched:\n");
+    uni_perf_histogram_dump(&latch.state_age);
+
+    run(true, SIM_US, SIM_US / 2, &stopped);
+    snprintf(what, sizeof(what),
+             "syncs stop half way: no torn reads before, %u states written immediately after, and the last one "
+             "reaches the port",
+             latch.immediate);
+    check(stopped.torn == 0 && latch.immediate > 0 && stopped.last_state_on_port, what);
+
+    printf("c64_sync_sim: %s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,400 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+// Timeline test and benchmark of the uni_combo recognizer.
+//
+// Each test feeds a timeline of button reports, and checks when the combos fire: chord debounce,
+// long-press deadline and the returned "next_ms", double-tap window, sequence restarts, and a
+// callback that resets the state.
+// The benchmark feeds the same reports to a table with one combo and to a table with 24 combos.
+// The reports only change the buttons of the first combo, so both tables should cost the same.
+// The reports are generated with a fixed seed, so that every run is the same.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "uni_combo.h"
+
+#define SYSTEM UNI_COMBO_MISC(MISC_BUTTON_SYSTEM)
+#define START UNI_COMBO_MISC(MISC_BUTTON_START)
+#define SELECT UNI_COMBO_MISC(MISC_BUTTON_SELECT)
+#define UP UNI_COMBO_DPAD(DPAD_UP)
+#define DOWN UNI_COMBO_DPAD(DPAD_DOWN)
+#define LEFT UNI_COMBO_DPAD(DPAD_LEFT)
+#define A UNI_COMBO_BUTTONS(BUTTON_A)
+#define B UNI_COMBO_BUTTONS(BUTTON_B)
+#define X UNI_COMBO_BUTTONS(BUTTON_X)
+#define Y UNI_COMBO_BUTTONS(BUTTON_Y)
+
+#define TAP_MS 20
+#define BENCH_COMBOS 24
+#define BENCH_REPORTS 200000
+#define BENCH_RUNS 5
+// A report every 8ms
+#define REPORT_MS 8
+
+static int failures;
+static uint32_t rand_state = 0x12345678;
+static int fired[UNI_COMBO_MAX];
+static uni_combo_table_t table;
+static uni_combo_state_t state;
+
+static void check(bool ok, const char* what) {
+    printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Deterministic, so that every run is the same.
+static uint32_t rand_range(uint32_t min, uint32_t max) {
+    rand_state = rand_state * 1664525 + 1013904223;
+    return min + (rand_state >> 16) % (max - min + 1);
+}
+
+static void on_combo(void* context, int id) {
+    ARG_UNUSED(context);
+    fired[id]++;
+}
+
+static void on_combo_reset(void* context, int id) {
+    fired[id]++;
+    uni_combo_state_init(context);
+}
+
+// New table and state, with a single combo.
+static void setup(const uni_combo_t* combo) {
+    uni_combo_table_init(&table);
+    uni_combo_state_init(&state);
+    memset(fired, 0, sizeof(fired));
+    uni_combo_table_add(&table, combo);
+}
+
+static uint32_t report(uint32_t buttons, uint32_t now_ms) {
+    return uni_combo_process(&table, &state, buttons, now_ms, &state);
+}
+
+// Press and release.
+static void tap(uint32_t buttons, uint32_t now_ms) {
+    report(buttons, now_ms);
+    report(0, now_ms + TAP_MS);
+}
+
+//
+// Tests
+//
+static void test_chord_debounce(void) {
+    const uni_combo_t combo = {
+        .type = UNI_COMBO_TYPE_CHORD,
+        .steps = {SYSTEM | A},
+        .debounce_ms = 200,
+        .callback = on_combo,
+    };
+    setup(&combo);
+
+    // The state starts with the combo fired at time 0: start past its debounce.
+    report(SYSTEM, 1000);
+    check(fired[0] == 0, "chord: one of two buttons: not fired");
+    report(SYSTEM | A, 1010);
+    report(SYSTEM | A, 1020);
+    report(SYSTEM | A, 1030);
+    check(fired[0] == 1, "chord: both buttons, then held: fired once");
+
+    // Switch-style press / release / press
+    report(SYSTEM, 1040);
+    report(SYSTEM | A, 1050);
+    check(fired[0] == 1, "chord: pressed again 40ms after firing: debounced");
+    report(SYSTEM | A, 1300);
+    check(fired[0] == 1, "chord: debounced press, held past the debounce: not fired");
+    report(SYSTEM, 1310);
+    report(SYSTEM | A, 1320);
+    check(fired[0] == 2, "chord: pressed again 310ms after firing: fired");
+}
+
+static void test_long_press(void) {
+    const uni_combo_t combo = {
+        .type = UNI_COMBO_TYPE_LONG_PRESS,
+        .steps = {START},
+        .time_ms = 500,
+        .callback = on_combo,
+    };
+    uint32_t next_ms;
+    setup(&combo);
+
+    next_ms = report(START, 1000);
+    check(next_ms == 500 && fired[0] == 0, "long press: pressed: not fired, next_ms is 500");
+    next_ms = report(START, 1200);
+    check(next_ms == 300 && fired[0] == 0, "long press: held 200ms: not fired, next_ms is 300");
+    next_ms = report(START, 1499);
+    check(next_ms == 1 && fired[0] == 0, "long press: held 499ms: not fired, next_ms is 1");
+    // No report at the deadline: the timer armed with "next_ms" calls it with the same buttons.
+    next_ms = report(START, 1500);
+    check(next_ms == 0 && fired[0] == 1, "long press: deadline, with no button change: fired, next_ms is 0");
+    next_ms = report(START, 3000);
+    check(next_ms == 0 && fired[0] == 1, "long press: held after firing: not fired again");
+
+    report(0, 3100);
+    report(START, 4000);
+    next_ms = report(0, 4400);
+    check(next_ms == 0 && fired[0] == 1, "long press: released before the deadline: not fired, next_ms is 0");
+    next_ms = report(0, 5000);
+    check(next_ms == 0 && fired[0] == 1, "long press: old deadline: not fired");
+}
+
+static void test_double_tap(void) {
+    const uni_combo_t combo = {
+        .type = UNI_COMBO_TYPE_DOUBLE_TAP,
+        .steps = {SELECT},
+        .time_ms = 300,
+        .callback = on_combo,
+    };
+    setup(&combo);
+
+    tap(SELECT, 0);
+    check(fired[0] == 0, "double tap: first tap: not fired");
+    report(SELECT, 200);
+    check(fired[0] == 1, "double tap: second tap 200ms later: fired");
+    report(SELECT, 250);
+    report(0, 260);
+    check(fired[0] == 1, "double tap: held, then released: not fired again");
+
+    tap(SELECT, 1000);
+    tap(SELECT, 1400);
+    check(fired[0] == 1, "double tap: second tap 400ms later: window expired, not fired");
+    report(SELECT, 1600);
+    check(fired[0] == 2, "double tap: expired tap counts as the first one: third tap 200ms later fired");
+    report(0, 1620);
+
+    tap(SELECT, 3000);
+    tap(SELECT, 3300);
+    check(fired[0] == 3, "double tap: second tap on the window edge: fired");
+}
+
+static void test_sequence(void) {
+    const uni_combo_t combo = {
+        .type = UNI_COMBO_TYPE_SEQUENCE,
+        .steps = {UP, UP, DOWN, DOWN},
+        .steps_count = 4,
+        .time_ms = 300,
+        .callback = on_combo,
+    };
+    setup(&combo);
+
+    tap(UP, 0);
+    tap(UP, 100);
+    tap(DOWN, 200);
+    check(fired[0] == 0, "sequence: three of four steps: not fired");
+    tap(DOWN, 300);
+    check(fired[0] == 1, "sequence: four steps: fired");
+
+    // Wrong button
+    tap(UP, 1000);
+    tap(UP, 1100);
+    tap(LEFT, 1200);
+    tap(DOWN, 1300);
+    tap(DOWN, 1400);
+    check(fired[0] == 1, "sequence: wrong button in step 3: restarted, not fired");
+
+    tap(UP, 2000);
+    tap(UP, 2100);
+    tap(A, 2200);
+    tap(DOWN, 2300);
+    tap(DOWN, 2400);
+    check(fired[0] == 1, "sequence: button that is not in the sequence in step 3: restarted, not fired");
+
+    // Too slow: the slow press is the first step of the restarted sequence.
+    tap(UP, 3000);
+    tap(UP, 3400);
+    tap(UP, 3500);
+    tap(DOWN, 3600);
+    check(fired[0] == 1, "sequence: step 2 after 400ms: restarted, not fired");
+    tap(DOWN, 3700);
+    check(fired[0] == 2, "sequence: the slow step starts the sequence again: fired");
+
+    // Wrong button that is also the first step
+    tap(UP, 5000);
+    tap(DOWN, 5100);
+    tap(UP, 5200);
+    tap(DOWN, 5300);
+    tap(DOWN, 5400);
+    check(fired[0] == 2, "sequence: UP DOWN UP DOWN DOWN: not fired");
+    tap(UP, 6000);
+    tap(UP, 6100);
+    tap(UP, 6200);
+    tap(UP, 6300);
+    tap(DOWN, 6400);
+    tap(DOWN, 6500);
+    check(fired[0] == 3, "sequence: UP UP UP UP DOWN DOWN: fired, the wrong step restarts as step 1");
+}
+
+static void test_callback_reset(void) {
+    const uni_combo_t reset = {
+        .type = UNI_COMBO_TYPE_CHORD,
+        .steps = {SYSTEM},
+        .callback = on_combo_reset,
+        .id = 0,
+    };
+    const uni_combo_t other = {
+        .type = UNI_COMBO_TYPE_CHORD,
+        .steps = {SYSTEM | B},
+        .callback = on_combo,
+        .id = 1,
+    };
+    const uni_combo_t long_press = {
+        .type = UNI_COMBO_TYPE_LONG_PRESS,
+        .steps = {X},
+        .time_ms = 500,
+        .callback = on_combo,
+        .id = 2,
+    };
+    uni_combo_state_t empty;
+    uint32_t next_ms;
+
+    setup(&reset);
+    uni_combo_table_add(&table, &other);
+    uni_combo_table_add(&table, &long_press);
+    uni_combo_state_init(&empty);
+
+    report(B, 0);
+    report(B | X, 10);
+    check(state.armed != 0, "callback reset: long press armed");
+    // Same report fires both chords. The first one resets the state, like a disconnect.
+    next_ms = report(SYSTEM | B | X, 20);
+    check(fired[0] == 1 && fired[1] == 1, "callback reset: both combos of the report fired");
+    check(memcmp(&state, &empty, sizeof(state)) == 0, "callback reset: state not touched after the callback");
+    check(next_ms == 500 - 10, "callback reset: next_ms computed before the callback");
+    report(0, 1000);
+    check(fired[2] == 0, "callback reset: long press armed before the reset: not fired");
+}
+
+static void test_table(void) {
+    uni_combo_t combo = {
+        .type = UNI_COMBO_TYPE_CHORD,
+        .steps = {A},
+    };
+    int idx = 0;
+
+    uni_combo_table_init(&table);
+    for (int i = 0; i < UNI_COMBO_MAX; i++)
+        idx = uni_combo_table_add(&table, &combo);
+    check(idx == UNI_COMBO_MAX - 1 && uni_combo_table_add(&table, &combo) == -1,
+          "table: UNI_COMBO_MAX combos added, then full");
+
+    uni_combo_table_init(&table);
+    combo.steps[0] = 0;
+    check(uni_combo_table_add(&table, &combo) == -1, "table: chord with no buttons rejected");
+    combo.type = UNI_COMBO_TYPE_SEQUENCE;
+    combo.steps_count = UNI_COMBO_SEQUENCE_MAX + 1;
+    combo.steps[0] = A;
+    check(uni_combo_table_add(&table, &combo) == -1, "table: sequence with too many steps rejected");
+}
+
+//
+// Benchmark
+//
+
+// The System chord, plus "count - 1" chords of two buttons that don't use System.
+static void bench_setup(uni_combo_table_t* t, int count) {
+    static const uint32_t buttons[] = {A, B, X, Y, UP, DOWN, LEFT, START, SELECT};
+    const int n = sizeof(buttons) / sizeof(buttons[0]);
+    uni_combo_t combo = {
+        .type = UNI_COMBO_TYPE_CHORD,
+        .steps = {SYSTEM},
+        .debounce_ms = 200,
+        .callback = on_combo,
+    };
+    int added = 0;
+
+    uni_combo_table_init(t);
+    uni_combo_table_add(t, &combo);
+    for (int i = 0; i < n && added < count - 1; i++) {
+        for (int j = i + 1; j < n && added < count - 1; j++) {
+            combo.steps[0] = buttons[i] | buttons[j];
+            combo.id = ++added;
+            uni_combo_table_add(t, &combo);
+        }
+    }
+}
+
+// Reports of a player holding X, and tapping System every few seconds.
+static void bench_generate(uint32_t* reports) {
+    uint32_t buttons = X;
+    rand_state = 0x12345678;
+    for (int i = 0; i < BENCH_REPORTS; i++) {
+        if (rand_range(0, 255) == 0)
+            buttons ^= SYSTEM;
+        reports[i] = buttons;
+    }
+}
+
+// Best of a few runs, in ns per report. Fires are stored in "fired".
+static double bench_run(const uni_combo_table_t* t, const uint32_t* reports) {
+    double best = 0;
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        double t0, elapsed;
+        uni_combo_state_init(&state);
+        memset(fired, 0, sizeof(fired));
+
+        t0 = now_s();
+        for (int i = 0; i < BENCH_REPORTS; i++)
+            uni_combo_process(t, &state, reports[i], (uint32_t)i * REPORT_MS, &state);
+        elapsed = (now_s() - t0) / BENCH_REPORTS * 1e9;
+        if (run == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+static void bench(void) {
+    static uint32_t reports[BENCH_REPORTS];
+    static uni_combo_table_t one, many;
+    int fired_one, fired_many, fired_others = 0;
+    double ns_one, ns_many;
+    char what[160];
+
+    bench_setup(&one, 1);
+    bench_setup(&many, BENCH_COMBOS);
+    bench_generate(reports);
+    snprintf(what, sizeof(what), "bench: %d combos registered", many.count);
+    check(one.count == 1 && many.count == BENCH_COMBOS, what);
+
+    ns_one = bench_run(&one, reports);
+    fired_one = fired[0];
+    ns_many = bench_run(&many, reports);
+    fired_many = fired[0];
+    for (int i = 1; i < BENCH_COMBOS; i++)
+        fired_others += fired[i];
+
+    snprintf(what, sizeof(what), "bench: System chord fired %d times with 1 combo, %d times with %d combos",
+             fired_one, fired_many, BENCH_COMBOS);
+    check(fired_one > 0 && fired_one == fired_many, what);
+    check(fired_others == 0, "bench: the other combos never fired");
+
+    printf("bench: %.1f ns per report with 1 combo, %.1f ns with %d combos, on the host\n", ns_one, ns_many,
+           BENCH_COMBOS);
+    // Same work: generous, since the host might be busy.
+    snprintf(what, sizeof(what), "bench: %d combos cost the same as 1 combo (%.2fx)", BENCH_COMBOS, ns_many / ns_one);
+    check(ns_many < ns_one * 2, what);
+}
+
+int main(void) {
+    test_chord_debounce();
+    test_long_press();
+    test_double_tap();
+    test_sequence();
+    test_callback_reset();
+    test_table();
+    bench();
+
+    printf("combo_test: %s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
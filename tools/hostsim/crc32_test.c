@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+// Known-vector test and benchmark of uni_crc32_le().
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "uni_utils.h"
+
+#define REPORT_LEN 78  // DualShock4 input report 0x11, including the CRC
+
+static int failures;
+
+static void check(bool ok, const char* what) {
+    printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+// The bit-by-bit version that uni_crc32_le() replaced. Used as reference.
+static uint32_t crc32_bitwise(uint32_t crc, const uint8_t* data, size_t len) {
+    while (len--) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+    }
+    return crc;
+}
+
+static uint32_t crc32_str(const char* s) {
+    return ~uni_crc32_le(0xffffffff, (const uint8_t*)s, strlen(s));
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill_ps_report(uint8_t* report) {
+    uint8_t seed = 0xa1;
+    uint32_t crc;
+
+    for (int i = 0; i < REPORT_LEN - 4; i++)
+        report[i] = i * 37 + 1;
+    crc = ~uni_crc32_le(uni_crc32_le(0xffffffff, &seed, 1), report, REPORT_LEN - 4);
+    report[REPORT_LEN - 4] = crc;
+    report[REPORT_LEN - 3] = crc >> 8;
+    report[REPORT_LEN - 2] = crc >> 16;
+    report[REPORT_LEN - 1] = crc >> 24;
+}
+
+int main(void) {
+    uint8_t buf[256];
+    uint8_t report[REPORT_LEN];
+    bool same = true;
+    volatile uint32_t sink = 0;
+    const int n = 1000000;
+    double t0, t1, t2;
+
+    // Standard CRC-32 (ISO-HDLC) check values
+    check(crc32_str("") == 0x00000000, "\"\" = 0x00000000");
+    check(crc32_str("a") == 0xe8b7be43, "\"a\" = 0xe8b7be43");
+    check(crc32_str("123456789") == 0xcbf43926, "\"123456789\" = 0xcbf43926");
+    check(crc32_str("The quick brown fox jumps over the lazy dog") == 0x414fa339,
+          "\"The quick brown fox jumps over the lazy dog\" = 0x414fa339");
+
+    // Same as the reference for every length and a few seeds
+    for (size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = (uint8_t)(i * 131 + 7);
+    for (size_t len = 0; len <= sizeof(buf); len++) {
+        const uint32_t seeds[] = {0, 0xffffffff, 0x12345678};
+        for (size_t s = 0; s < sizeof(seeds) / sizeof(seeds[0]); s++)
+            same &= uni_crc32_le(seeds[s], buf, len) == crc32_bitwise(seeds[s], buf, len);
+    }
+    check(same, "same as bitwise CRC32, lengths 0-256");
+
+    // Incremental == one shot
+    check(uni_crc32_le(uni_crc32_le(0xffffffff, buf, 100), buf + 100, 156) == uni_crc32_le(0xffffffff, buf, 256),
+          "incremental");
+
+    fill_ps_report(report);
+    check(uni_crc32_is_ps_report_valid(0xa1, report, REPORT_LEN), "PS report: valid CRC");
+    report[10] ^= 0x01;
+    check(!uni_crc32_is_ps_report_valid(0xa1, report, REPORT_LEN), "PS report: one bit flipped");
+    report[10] ^= 0x01;
+    check(!uni_crc32_is_ps_report_valid(0xa2, report, REPORT_LEN), "PS report: wrong seed");
+    check(!uni_crc32_is_ps_report_valid(0xa1, report, 3), "PS report: too short");
+
+    // Benchmark: one DS4 report
+    t0 = now_s();
+    for (int i = 0; i < n; i++)
+        sink += crc32_bitwise(i, report, REPORT_LEN - 4);
+    t1 = now_s();
+    for (int i = 0; i < n; i++)
+        sink += uni_crc32_le(i, report, REPORT_LEN - 4);
+    t2 = now_s();
+    printf("bench: %d-byte report: bitwise %.1f ns, table %.1f ns (x%.1f)\n", REPORT_LEN - 4, (t1 - t0) / n * 1e9,
+           (t2 - t1) / n * 1e9, (t1 - t0) / (t2 - t1));
+
+    printf("crc32_test: %s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
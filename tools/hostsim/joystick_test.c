@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+// Known-vector test and benchmark of uni_joy_analog_to_dir().
+//
+// The known vectors are at the deadzone, hysteresis and sector boundaries, with the default
+// config: deadzone 128, hysteresis 32. The benchmark feeds noisy stick positions, and counts the
+// direction changes compared with the fixed per-axis threshold that it replaced.
+// The input data is generated with a fixed seed, so that every run is the same.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "controller/uni_balance_board.h"
+#include "uni_joystick.h"
+#include "uni_keymap.h"
+#include "uni_property.h"
+
+#define LEFT UNI_JOYSTICK_BIT_LEFT
+#define RIGHT UNI_JOYSTICK_BIT_RIGHT
+#define UP UNI_JOYSTICK_BIT_UP
+#define DOWN UNI_JOYSTICK_BIT_DOWN
+
+// Threshold of the per-axis conversion that uni_joy_analog_to_dir() replaced
+#define AXIS_THRESHOLD 128
+#define NOISE 16
+#define SAMPLES 20000
+#define SWEEP_TURNS 10
+
+typedef struct {
+    uint8_t ways;
+    uni_joystick_bits_t prev;
+    int x;
+    int y;
+    uni_joystick_bits_t expected;
+    const char* what;
+} vector_t;
+
+typedef struct {
+    const char* name;
+    uint8_t ways;
+    // Stick position, before the noise. Angle in degrees, clockwise from right, since Y grows down.
+    double radius;
+    double angle;
+    // Degrees per sample. Zero: the stick rests at "angle".
+    double sweep;
+} scenario_t;
+
+// clang-format off
+static const vector_t vectors[] = {
+    // Radial deadzone
+    {8, 0, 128, 0, 0, "on the deadzone: centered"},
+    {8, 0, 129, 0, RIGHT, "just past the deadzone: right"},
+    {8, 0, 0, -129, UP, "just past the deadzone: up"},
+    {8, 0, 90, 90, 0, "(90, 90) is inside the circle, but outside the old square"},
+    {8, 0, 91, 91, RIGHT | DOWN, "(91, 91) is outside the circle: diagonal"},
+    // Release at "deadzone - hysteresis"
+    {8, RIGHT, 97, 0, RIGHT, "pressed, past the release radius: kept"},
+    {8, RIGHT, 96, 0, 0, "pressed, on the release radius: released"},
+    {8, 0, 97, 0, 0, "not pressed, between release radius and deadzone: centered"},
+    // 8 ways: the Y sector starts at 22.5 degrees from X, and is kept up to 17.5 degrees
+    {8, 0, 256, 106, RIGHT, "8-way: on the 22.5 degree boundary: right"},
+    {8, 0, 256, 107, RIGHT | DOWN, "8-way: past the 22.5 degree boundary: diagonal"},
+    {8, 0, -256, -107, LEFT | UP, "8-way: past the 22.5 degree boundary, negative: diagonal"},
+    {8, RIGHT, 256, 82, RIGHT, "8-way: right, inside the widened sector: Y needs 22.5 degrees to get on"},
+    {8, RIGHT | DOWN, 256, 82, RIGHT | DOWN, "8-way: diagonal, inside the widened sector: kept"},
+    {8, RIGHT | DOWN, 256, 81, RIGHT, "8-way: diagonal, on the 17.5 degree boundary: Y released"},
+    // 4 ways: dominant axis, 45 degrees. Kept up to 50 degrees
+    {4, 0, 200, 200, RIGHT, "4-way: on the diagonal: ties go to X"},
+    {4, 0, 200, 201, DOWN, "4-way: past the diagonal: down"},
+    {4, DOWN, 200, 200, DOWN, "4-way: down, on the diagonal: kept"},
+    {4, DOWN, 256, 215, DOWN, "4-way: down, inside the widened sector: kept"},
+    {4, DOWN, 256, 214, RIGHT, "4-way: down, past the 50 degree boundary: right"},
+    {4, RIGHT, 216, 256, RIGHT, "4-way: right, inside the widened sector: kept"},
+    {4, RIGHT, 215, 256, DOWN, "4-way: right, on the 50 degree boundary: down"},
+    {4, 0, 216, 256, DOWN, "4-way: no previous direction: down"},
+};
+
+static const scenario_t scenarios[] = {
+    {"resting on the threshold", 8, AXIS_THRESHOLD, 0, 0},
+    {"held on the 8-way boundary (22.5 deg)", 8, 400, 22.5, 0},
+    {"held on the 4-way diagonal", 4, 400, 45, 0},
+    {"full-circle sweeps at r=450", 8, 450, 0, 360.0 * SWEEP_TURNS / SAMPLES},
+};
+// clang-format on
+
+static int failures;
+static uint32_t rand_state = 0x12345678;
+
+static void check(bool ok, const char* what) {
+    printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Deterministic, so that every run is the same.
+static int rand_range(int min, int max) {
+    rand_state = rand_state * 1664525 + 1013904223;
+    return min + (int)((rand_state >> 16) % (uint32_t)(max - min + 1));
+}
+
+// The per-axis conversion that uni_joy_analog_to_dir() replaced. Used as reference.
+static uni_joystick_bits_t threshold_to_dir(int x, int y) {
+    uni_joystick_bits_t bits = 0;
+
+    if (x < -AXIS_THRESHOLD)
+        bits |= LEFT;
+    if (x > AXIS_THRESHOLD)
+        bits |= RIGHT;
+    if (y < -AXIS_THRESHOLD)
+        bits |= UP;
+    if (y > AXIS_THRESHOLD)
+        bits |= DOWN;
+    return bits;
+}
+
+//
+// What uni_joystick.c needs from Bluepad32
+//
+void uni_log(const char* fmt, ...) {
+    ARG_UNUSED(fmt);
+}
+
+uni_property_value_t uni_property_get(uni_property_idx_t idx) {
+    uni_property_value_t val = {0};
+    ARG_UNUSED(idx);
+    return val;
+}
+
+void uni_property_set(uni_property_idx_t idx, uni_property_value_t value) {
+    ARG_UNUSED(idx);
+    ARG_UNUSED(value);
+}
+
+const uni_keymap_t* uni_keymap_get(uni_keymap_id_t id) {
+    ARG_UNUSED(id);
+    return NULL;
+}
+
+uni_balance_board_threshold_t uni_balance_board_get_threshold(void) {
+    uni_balance_board_threshold_t threshold = {0};
+    return threshold;
+}
+
+//
+// Tests
+//
+static void test_vectors(void) {
+    char what[160];
+    uni_joy_analog_config_t config = uni_joy_analog_get_default_config();
+
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        const vector_t* v = &vectors[i];
+        config.ways = v->ways;
+        uni_joystick_bits_t bits = uni_joy_analog_to_dir(&config, v->prev, v->x, v->y);
+        snprintf(what, sizeof(what), "(%4d, %4d) prev=0x%x -> 0x%x. %s", v->x, v->y, v->prev, bits, v->what);
+        check(bits == v->expected, what);
+    }
+}
+
+// Stick positions of a scenario, with noise.
+static void generate(const scenario_t* s, int* xs, int* ys) {
+    rand_state = 0x12345678;
+    for (int i = 0; i < SAMPLES; i++) {
+        double angle = (s->angle + s->sweep * i) * M_PI / 180;
+        xs[i] = (int)(s->radius * cos(angle)) + rand_range(-NOISE, NOISE);
+        ys[i] = (int)(s->radius * sin(angle)) + rand_range(-NOISE, NOISE);
+    }
+}
+
+static void bench(void) {
+    static int xs[SAMPLES], ys[SAMPLES];
+    char what[160];
+    double elapsed = 0;
+    int calls = 0;
+
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        const scenario_t* s = &scenarios[i];
+        uni_joy_analog_config_t config = uni_joy_analog_get_default_config();
+        uni_joystick_bits_t prev_threshold = 0, prev = 0;
+        int changes_threshold = 0, changes = 0;
+        double t0;
+
+        config.ways = s->ways;
+        generate(s, xs, ys);
+
+        for (int j = 0; j < SAMPLES; j++) {
+            uni_joystick_bits_t bits = threshold_to_dir(xs[j], ys[j]);
+            changes_threshold += bits != prev_threshold;
+            prev_threshold = bits;
+        }
+
+        t0 = now_s();
+        for (int j = 0; j < SAMPLES; j++) {
+            uni_joystick_bits_t bits = uni_joy_analog_to_dir(&config, prev, xs[j], ys[j]);
+            changes += bits != prev;
+            prev = bits;
+        }
+        elapsed += now_s() - t0;
+        calls += SAMPLES;
+
+        snprintf(what, sizeof(what), "%s, +/-%d noise: %d direction changes, %d with a fixed threshold", s->name,
+                 NOISE, changes, changes_threshold);
+        // Resting: at most the first press. Sweeping: the first press, then one per sector.
+        check(changes <= (s->sweep ? 1 + s->ways * SWEEP_TURNS : 1), what);
+    }
+
+    printf("bench: %.1f ns per uni_joy_analog_to_dir() call on the host\n", elapsed / calls * 1e9);
+}
+
+int main(void) {
+    test_vectors();
+    bench();
+
+    printf("joystick_test: %s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,257 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+// Simulated controllers on several radios, for the POSIX example multi-radio support.
+//
+// multi_radio_start() forks one process per radio, like in the POSIX example. Each child plays
+// the role of Bluepad32 + BTstack: when the parent enables scanning on it, it "discovers" a controller,
+// which connects and gets ready. Then each ready controller sends reports. The parent checks that
+// the controllers are spread among the radios, and the unified controller data stream: global index,
+// order, and that nothing arrives from devices that are not ready or already disconnected.
+
+#include <poll.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "multi_radio.h"
+
+#define RADIOS 3
+#define DEVICES_PER_RADIO 2
+#define ROUNDS 20
+#define ROUND_MS 25
+#define REPORTS 50
+#define GLOBAL_IDX(radio, idx) ((radio) * CONFIG_BLUEPAD32_MAX_DEVICES + (idx))
+
+// Child
+static int radio;
+static btstack_data_source_t* data_source;
+static bool scanning;
+static uni_hid_device_t devices[CONFIG_BLUEPAD32_MAX_DEVICES];
+
+// Parent
+static int reports[RADIOS * CONFIG_BLUEPAD32_MAX_DEVICES];
+static int wrong_payload;
+static int out_of_order;
+static uint64_t latency_total_us;
+static uint32_t latency_max_us;
+static int failures;
+
+static void check(bool ok, const char* what) {
+    printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//
+// What multi_radio.c needs from Bluepad32 and BTstack, in the child
+//
+void uni_log(const char* fmt, ...) {
+    ARG_UNUSED(fmt);
+}
+
+void bd_addr_copy(bd_addr_t dest, const bd_addr_t src) {
+    memcpy(dest, src, sizeof(bd_addr_t));
+}
+
+const char* bd_addr_to_str(const bd_addr_t addr) {
+    static char str[18];
+    snprintf(str, sizeof(str), "%02X:%02X:%02X:%02X:%02X:%02X", addr[0], addr[1], addr[2], addr[3], addr[4],
+             addr[5]);
+    return str;
+}
+
+void gap_local_bd_addr(bd_addr_t address_buffer) {
+    memset(address_buffer, 0, sizeof(bd_addr_t));
+    address_buffer[5] = radio;
+}
+
+int uni_hid_device_get_idx_for_instance(const uni_hid_device_t* d) {
+    return (int)(d - devices);
+}
+
+void uni_bt_enable_new_connections_unsafe(bool enabled) {
+    scanning = enabled;
+}
+
+void btstack_run_loop_set_data_source_fd(btstack_data_source_t* ds, int fd) {
+    ds->source.fd = fd;
+}
+
+void btstack_run_loop_set_data_source_handler(btstack_data_source_t* ds,
+                                              void (*process)(btstack_data_source_t* ds,
+                                                              btstack_data_source_callback_type_t callback_type)) {
+    ds->process = process;
+}
+
+void btstack_run_loop_enable_data_source_callbacks(btstack_data_source_t* ds, uint16_t callbacks) {
+    ds->flags = callbacks;
+}
+
+void btstack_run_loop_add_data_source(btstack_data_source_t* ds) {
+    data_source = ds;
+}
+
+bool btstack_run_loop_remove_data_source(btstack_data_source_t* ds) {
+    ARG_UNUSED(ds);
+    data_source = NULL;
+    return true;
+}
+
+//
+// Child: simulated radio
+//
+
+// Runs the run loop for "ms" milliseconds: processes the messages from the parent.
+static void run_loop(int ms) {
+    uint64_t end = now_us() + (uint64_t)ms * 1000;
+    uint64_t now;
+
+    while (data_source && (now = now_us()) < end) {
+        struct pollfd pfd = {.fd = data_source->source.fd, .events = POLLIN};
+        if (poll(&pfd, 1, (int)((end - now + 999) / 1000)) > 0)
+            data_source->process(data_source, DATA_SOURCE_CALLBACK_READ);
+    }
+}
+
+static uni_hid_device_t* connect_device(int idx, bool ready) {
+    uni_hid_device_t* d = &devices[idx];
+
+    d->conn.btaddr[0] = 0x10 + radio;
+    d->conn.btaddr[5] = idx;
+    snprintf(d->name, sizeof(d->name), "pad %d-%d", radio, idx);
+    multi_radio_on_device_connected(d);
+    if (ready)
+        multi_radio_on_device_ready(d);
+    return d;
+}
+
+static void send_report(uni_hid_device_t* d, int seq) {
+    uni_controller_t ctl = {.klass = UNI_CONTROLLER_CLASS_GAMEPAD};
+
+    // Who sent it, its order, and when
+    ctl.gamepad.buttons = radio * 16 + uni_hid_device_get_idx_for_instance(d) + 1;
+    ctl.gamepad.axis_x = seq;
+    ctl.gamepad.axis_y = (int32_t)(now_us() & 0x7fffffff);
+    multi_radio_on_controller_data(d, &ctl);
+}
+
+static void run_child(void) {
+    int connected = 0;
+
+    multi_radio_on_init_complete();
+
+    // Connects a controller each round, while the parent lets this radio scan.
+    for (int round = 0; round < ROUNDS; round++) {
+        run_loop(ROUND_MS);
+        if (scanning && connected < DEVICES_PER_RADIO) {
+            connect_device(connected, true);
+            connected++;
+        }
+    }
+
+    // Reports, interleaved among the devices. Plus one device that connects but never gets ready.
+    uni_hid_device_t* not_ready = connect_device(DEVICES_PER_RADIO, false);
+    for (int seq = 0; seq < REPORTS; seq++) {
+        for (int i = 0; i < connected; i++)
+            send_report(&devices[i], seq);
+        send_report(not_ready, seq);
+        // Like real controllers, not all at once. Also, so that the socket buffer doesn't fill up.
+        usleep(1000);
+    }
+
+    // Reports that arrive after a disconnect are dropped.
+    if (radio == 1 && connected > 0) {
+        multi_radio_on_device_disconnected(&devices[0]);
+        send_report(&devices[0], REPORTS);
+    }
+    run_loop(50);
+}
+
+//
+// Parent: checks
+//
+static void on_controller_data(int idx, const uni_controller_t* ctl) {
+    int r = idx / CONFIG_BLUEPAD32_MAX_DEVICES;
+    int i = idx % CONFIG_BLUEPAD32_MAX_DEVICES;
+    uint32_t latency = (uint32_t)(((now_us() & 0x7fffffff) - (uint32_t)ctl->gamepad.axis_y) & 0x7fffffff);
+
+    if (r >= RADIOS || ctl->gamepad.buttons != (uint32_t)(r * 16 + i + 1)) {
+        wrong_payload++;
+        return;
+    }
+    if (ctl->gamepad.axis_x != reports[idx])
+        out_of_order++;
+    reports[idx]++;
+
+    latency_total_us += latency;
+    if (latency > latency_max_us)
+        latency_max_us = latency;
+}
+
+// The parent exits from multi_radio_start(), once all the radios are done.
+static void check_results(void) {
+    char what[160];
+    int total = 0;
+    bool balanced = true;
+    bool complete = true;
+    bool not_ready = false;
+
+    if (multi_radio_is_child())
+        return;
+
+    for (int r = 0; r < RADIOS; r++) {
+        int devices_with_data = 0;
+        for (int i = 0; i < CONFIG_BLUEPAD32_MAX_DEVICES; i++) {
+            int n = reports[GLOBAL_IDX(r, i)];
+            total += n;
+            if (i < DEVICES_PER_RADIO) {
+                devices_with_data += n > 0;
+                complete &= n == REPORTS;
+            } else if (n > 0) {
+                not_ready = true;
+            }
+        }
+        balanced &= devices_with_data == DEVICES_PER_RADIO;
+    }
+
+    snprintf(what, sizeof(what), "%d controllers spread among %d radios: %d each", RADIOS * DEVICES_PER_RADIO,
+             RADIOS, DEVICES_PER_RADIO);
+    check(balanced, what);
+    snprintf(what, sizeof(what), "%d reports per controller, with the global index, in order", REPORTS);
+    check(complete && wrong_payload == 0 && out_of_order == 0, what);
+    check(!not_ready, "no reports from controllers that are not ready");
+    check(reports[GLOBAL_IDX(1, 0)] == REPORTS, "no reports after a disconnect");
+
+    printf("bench: %d reports forwarded, latency from child to parent callback: avg %.1f us, max %u us\n", total,
+           total ? (double)latency_total_us / total : 0.0, latency_max_us);
+    printf("multi_radio_sim: %s\n", failures ? "FAILED" : "passed");
+    fflush(stdout);
+    _exit(failures ? 1 : 0);
+}
+
+int main(void) {
+    check(multi_radio_pick_scanning_radio((const int[]){1, 0, 0}, (const bool[]){true, true, true}, 3, 4) == 1,
+          "pick: the radio with the fewest devices, ties go to the lowest index");
+    check(multi_radio_pick_scanning_radio((const int[]){4, 4, 4}, (const bool[]){true, true, true}, 3, 4) == -1,
+          "pick: none when all the radios are full");
+    check(multi_radio_pick_scanning_radio((const int[]){2, 1, 1}, (const bool[]){true, false, true}, 3, 4) == 2,
+          "pick: radios that are down are skipped");
+
+    fflush(stdout);
+    atexit(check_results);
+    radio = multi_radio_start(RADIOS, &on_controller_data);
+    run_child();
+    return 0;
+}
@@ -0,0 +1,167 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+// Timing simulation of the C64 paddle engine.
+//
+// Plays the role of the SID, the sync GPIO ISR and the one-shot timer alarm, with random
+// interrupt latencies. For every SID sample it checks when each Pot line is released,
+// compared with the value that was requested, and whether it fits in the SID sampling window.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "uni_paddle.h"
+
+// One SID sample: 256 cycles discharging the capacitor + 256 cycles measuring. ~1us per cycle.
+#define SID_SAMPLE_US 512
+// Same as in the C64 platform
+#define DISCHARGE_US 220
+#define MASK_X (1ULL << 16)
+#define MASK_Y (1ULL << 33)
+#define SAMPLES 100000
+
+// Interrupt latency, from the edge / alarm until the handler reads the timer.
+#define GPIO_ISR_LATENCY_MIN_US 2
+#define GPIO_ISR_LATENCY_MAX_US 8
+#define TIMER_ISR_LATENCY_MIN_US 1
+#define TIMER_ISR_LATENCY_MAX_US 4
+
+static int failures;
+static uint32_t rand_state = 0x12345678;
+
+static void check(bool ok, const char* what) {
+    printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Deterministic, so that every run is the same.
+static uint32_t rand_range(uint32_t min, uint32_t max) {
+    rand_state = rand_state * 1664525 + 1013904223;
+    return min + (rand_state >> 16) % (max - min + 1);
+}
+
+int main(void) {
+    char what[160];
+    uni_paddle_t p;
+    uint64_t levels = 0;
+    // Time from the expected release until the real one
+    uint32_t late_min = UINT32_MAX, late_max = 0;
+    // Same, but compared with the sync edge: what the SID measures on top of the requested value
+    uint32_t err_min = UINT32_MAX, err_max = 0;
+    uint32_t last_release_max = 0;
+    bool early = false;
+    bool stuck = false;
+    uint32_t isr_calls = 0;
+    uint32_t isr_calls_max = 0;
+    uint64_t busy_wait_us = 0;
+    double t0, t1;
+
+    check(uni_paddle_pack_delays(0, 1000) == ((UNI_PADDLE_DELAY_MIN_US << 16) | UNI_PADDLE_DELAY_MAX_US),
+          "delays are clamped to the valid range");
+    check(uni_paddle_pack_delays(100, 200) == ((100 << 16) | 200), "X in the high 16 bits, Y in the low ones");
+
+    uni_paddle_init(&p, MASK_X, MASK_Y, DISCHARGE_US);
+
+    t0 = now_s();
+    for (uint32_t i = 0; i < SAMPLES; i++) {
+        uint64_t sync_us = 1000 + (uint64_t)i * SID_SAMPLE_US;
+        int x = (int)rand_range(UNI_PADDLE_DELAY_MIN_US, UNI_PADDLE_DELAY_MAX_US);
+        // Some samples with both values equal, or one apart
+        int y = (i % 3 == 0) ? x : (i % 3 == 1) ? x + 1 : (int)rand_range(0, 300);
+        uint32_t delays = uni_paddle_pack_delays(x, y);
+        uint64_t release_x = 0, release_y = 0;
+        uint64_t set_mask, clear_mask;
+        uint32_t calls = 1;
+
+        // Sync ISR
+        uint64_t now = sync_us + rand_range(GPIO_ISR_LATENCY_MIN_US, GPIO_ISR_LATENCY_MAX_US);
+        uint64_t start = now + DISCHARGE_US;
+        uint32_t next = uni_paddle_on_sync(&p, delays, now, &set_mask);
+        levels |= set_mask;
+        if (levels != (MASK_X | MASK_Y))
+            stuck = true;
+
+        // Timer alarms
+        while (next) {
+            uint64_t alarm = now + next;
+            now = alarm + rand_range(TIMER_ISR_LATENCY_MIN_US, TIMER_ISR_LATENCY_MAX_US);
+            next = uni_paddle_run(&p, now, &clear_mask);
+            calls++;
+            levels &= ~clear_mask;
+            if (clear_mask & MASK_X)
+                release_x = now;
+            if (clear_mask & MASK_Y)
+                release_y = now;
+        }
+        if (levels != 0 || release_x == 0 || release_y == 0) {
+            stuck = true;
+            continue;
+        }
+
+        // The values of this sample, once clamped
+        int cx = (x < UNI_PADDLE_DELAY_MIN_US) ? UNI_PADDLE_DELAY_MIN_US : x;
+        int cy = (y < UNI_PADDLE_DELAY_MIN_US) ? UNI_PADDLE_DELAY_MIN_US
+                 : (y > UNI_PADDLE_DELAY_MAX_US) ? UNI_PADDLE_DELAY_MAX_US
+                                                 : y;
+        uint64_t due[2] = {start + cx, start + cy};
+        uint64_t rel[2] = {release_x, release_y};
+        for (int l = 0; l < 2; l++) {
+            if (rel[l] < due[l]) {
+                early = true;
+                continue;
+            }
+            uint32_t late = (uint32_t)(rel[l] - due[l]);
+            uint32_t err = (uint32_t)(rel[l] - (sync_us + DISCHARGE_US + (l == 0 ? cx : cy)));
+            if (late < late_min)
+                late_min = late;
+            if (late > late_max)
+                late_max = late;
+            if (err < err_min)
+                err_min = err;
+            if (err > err_max)
+                err_max = err;
+            if (rel[l] - sync_us > last_release_max)
+                last_release_max = (uint32_t)(rel[l] - sync_us);
+        }
+
+        isr_calls += calls;
+        if (calls > isr_calls_max)
+            isr_calls_max = calls;
+        // The previous implementation busy-waited in the sync ISR for the discharge + the longest delay.
+        busy_wait_us += DISCHARGE_US + (cx > cy ? cx : cy);
+    }
+    t1 = now_s();
+
+    check(!stuck, "every sample raises both lines, and releases both of them");
+    check(!early, "no line is released before its delay");
+
+    snprintf(what, sizeof(what), "release is late by %u-%u us: at most the timer ISR latency (%d us)", late_min,
+             late_max, TIMER_ISR_LATENCY_MAX_US);
+    check(late_max <= TIMER_ISR_LATENCY_MAX_US, what);
+
+    snprintf(what, sizeof(what), "SID error %u-%u us: sync ISR + timer ISR latency (max %d us)", err_min, err_max,
+             GPIO_ISR_LATENCY_MAX_US + TIMER_ISR_LATENCY_MAX_US);
+    check(err_max <= GPIO_ISR_LATENCY_MAX_US + TIMER_ISR_LATENCY_MAX_US, what);
+
+    snprintf(what, sizeof(what), "last release at %u us after the sync, within the %d us SID sample",
+             last_release_max, SID_SAMPLE_US);
+    check(last_release_max < SID_SAMPLE_US, what);
+
+    snprintf(what, sizeof(what), "at most %u ISRs per sample: one sync + one alarm per line", isr_calls_max);
+    check(isr_calls_max <= 3, what);
+
+    printf("bench: %.1f ISRs per sample, %.1f ns per ISR on the host. Previous busy-wait: %.0f us per sample\n",
+           (double)isr_calls / SAMPLES, (t1 - t0) / isr_calls * 1e9, (double)busy_wait_us / SAMPLES);
+
+    printf("paddle_sim: %s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
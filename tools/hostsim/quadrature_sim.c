@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+// Timing simulation of the quadrature mouse engine.
+//
+// Plays the role of the one-shot timer: time advances by the delay that the engine returns,
+// and the returned set / clear masks are applied to a simulated GPIO register, which is
+// decoded back into mouse steps, like the Amiga / Atari ST would do.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "uni_mouse_quadrature_engine.h"
+
+#define TICKS_PER_SECOND UNI_MOUSE_QUADRATURE_ENGINE_TICKS_PER_SECOND
+// ~90 reports per second, as measured with real mice. See uni_mouse_quadrature_engine_update().
+#define REPORT_TICKS (TICKS_PER_SECOND / 90)
+#define ENCODERS (UNI_MOUSE_QUADRATURE_PORT_MAX * UNI_MOUSE_QUADRATURE_ENCODER_MAX)
+
+typedef struct {
+    uni_mouse_quadrature_engine_t eng;
+    uint64_t gpios;
+    uint32_t now;
+    // Decoded position, and ticks of the last edge, per encoder
+    int32_t pos[ENCODERS];
+    uint32_t last_edge[ENCODERS];
+    uint32_t min_gap[ENCODERS];
+    uint32_t max_gap[ENCODERS];
+    int edges[ENCODERS];
+    bool invalid_transition;
+    // Timer callbacks, and how many of them changed no GPIO
+    int isr_calls;
+    int isr_idle;
+} sim_t;
+
+static int failures;
+
+static void check(bool ok, const char* what) {
+    printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t mask_a(int enc) {
+    return 1ULL << (enc * 2);
+}
+
+static uint64_t mask_b(int enc) {
+    return 1ULL << (enc * 2 + 1);
+}
+
+// Gray code: 00, 10, 11, 01 -> 0, 1, 2, 3
+static int phase_of(uint64_t gpios, int enc) {
+    static const int phases[4] = {0, 1, 3, 2};
+    int a = (gpios & mask_a(enc)) ? 1 : 0;
+    int b = (gpios & mask_b(enc)) ? 1 : 0;
+    return phases[a | (b << 1)];
+}
+
+static void sim_init(sim_t* s, uint32_t start) {
+    *s = (sim_t){0};
+    s->now = start;
+    uni_mouse_quadrature_engine_init(&s->eng);
+    for (int p = 0; p < UNI_MOUSE_QUADRATURE_PORT_MAX; p++) {
+        uni_mouse_quadrature_engine_set_enabled(&s->eng, p, true);
+        for (int e = 0; e < UNI_MOUSE_QUADRATURE_ENCODER_MAX; e++) {
+            int enc = p * UNI_MOUSE_QUADRATURE_ENCODER_MAX + e;
+            uni_mouse_quadrature_engine_setup_encoder(&s->eng, p, e, mask_a(enc), mask_b(enc));
+            s->min_gap[enc] = UINT32_MAX;
+        }
+    }
+}
+
+static void sim_decode(sim_t* s, uint64_t old_gpios) {
+    for (int enc = 0; enc < ENCODERS; enc++) {
+        int old_phase = phase_of(old_gpios, enc);
+        int new_phase = phase_of(s->gpios, enc);
+        if (old_phase == new_phase)
+            continue;
+        int diff = (new_phase - old_phase) & 0x03;
+        if (diff == 1)
+            s->pos[enc]++;
+        else if (diff == 3)
+            s->pos[enc]--;
+        else
+            // Both A and B changed at once: the host can't decode it
+            s->invalid_transition = true;
+
+        if (s->edges[enc] > 0) {
+            uint32_t gap = s->now - s->last_edge[enc];
+            if (gap < s->min_gap[enc])
+                s->min_gap[enc] = gap;
+            if (gap > s->max_gap[enc])
+                s->max_gap[enc] = gap;
+        }
+        s->last_edge[enc] = s->now;
+        s->edges[enc]++;
+    }
+}
+
+// Runs the timer until "end", or until there are no pending steps.
+static void sim_run_until(sim_t* s, uint32_t end) {
+    uint32_t delay = uni_mouse_quadrature_engine_next_delay(&s->eng, s->now);
+
+    while (delay != 0 && (int32_t)(s->now + delay - end) <= 0) {
+        uint64_t set, clear;
+        uint64_t old_gpios = s->gpios;
+
+        s->now += delay;
+        delay = uni_mouse_quadrature_engine_run(&s->eng, s->now, &set, &clear);
+        s->isr_calls++;
+        s->gpios = (s->gpios | set) & ~clear;
+        if (s->gpios == old_gpios)
+            s->isr_idle++;
+        sim_decode(s, old_gpios);
+    }
+    s->now = end;
+}
+
+// One encoder, one report: all the steps must be evenly spaced, and done before the next report.
+static void test_single_report(int32_t delta) {
+    char what[128];
+    sim_t s;
+    uint32_t expected = (128 + abs(delta) / 2) / abs(delta);
+
+    sim_init(&s, 0);
+    uni_mouse_quadrature_engine_update(&s.eng, 0, UNI_MOUSE_QUADRATURE_ENCODER_H, delta, s.now);
+    sim_run_until(&s, REPORT_TICKS);
+
+    snprintf(what, sizeof(what), "delta %4d: %d steps, interval %u-%u ticks (expected %u), done at tick %u", delta,
+             s.pos[0], s.edges[0] > 1 ? s.min_gap[0] : expected, s.edges[0] > 1 ? s.max_gap[0] : expected, expected,
+             s.last_edge[0]);
+    check(s.pos[0] == delta && !s.invalid_transition && (s.edges[0] <= 1 || s.min_gap[0] == s.max_gap[0]) &&
+              (s.edges[0] <= 1 || s.min_gap[0] == expected) && s.last_edge[0] <= REPORT_TICKS,
+          what);
+}
+
+// A new report discards the pending steps, but the phase continues from where it was.
+static void test_phase_continuity(void) {
+    sim_t s;
+
+    sim_init(&s, 0);
+    for (int i = 0; i < 20; i++) {
+        int32_t delta = (i & 1) ? -7 : 13;
+        uni_mouse_quadrature_engine_update(&s.eng, 0, UNI_MOUSE_QUADRATURE_ENCODER_V, delta, s.now);
+        sim_run_until(&s, s.now + 40);
+    }
+    check(!s.invalid_transition, "interrupted reports: every edge is a valid quadrature transition");
+}
+
+// The tick counter wraps around every ~95 hours.
+static void test_wrap_around(void) {
+    sim_t s;
+
+    sim_init(&s, 0xffffffc0);
+    uni_mouse_quadrature_engine_update(&s.eng, 1, UNI_MOUSE_QUADRATURE_ENCODER_H, -100, s.now);
+    sim_run_until(&s, s.now + REPORT_TICKS);
+    check(s.pos[2] == -100 && s.min_gap[2] == s.max_gap[2], "tick counter wrap-around: -100 steps, even spacing");
+}
+
+// Two mice, both axis at max speed, for one second. Measures the timer callbacks and the cost of each one.
+static void test_max_speed(void) {
+    char what[128];
+    sim_t s;
+    int32_t expected[ENCODERS] = {0};
+    bool all_steps = true;
+    int reports = 0;
+    double t0, t1;
+
+    sim_init(&s, 0);
+    t0 = now_s();
+    while (s.now < TICKS_PER_SECOND) {
+        for (int p = 0; p < UNI_MOUSE_QUADRATURE_PORT_MAX; p++) {
+            for (int e = 0; e < UNI_MOUSE_QUADRATURE_ENCODER_MAX; e++) {
+                int32_t delta = ((p + e) & 1) ? -127 : 127;
+                uni_mouse_quadrature_engine_update(&s.eng, p, e, delta, s.now);
+                expected[p * UNI_MOUSE_QUADRATURE_ENCODER_MAX + e] += delta;
+            }
+        }
+        sim_run_until(&s, s.now + REPORT_TICKS);
+        reports++;
+    }
+    t1 = now_s();
+
+    for (int enc = 0; enc < ENCODERS; enc++)
+        all_steps &= s.pos[enc] == expected[enc];
+    snprintf(what, sizeof(what), "max speed: %d reports, all the steps of the %d encoders delivered", reports,
+             ENCODERS);
+    check(all_steps && !s.invalid_transition, what);
+
+    // The four encoders share the callback: at most one per tick, instead of one per encoder.
+    snprintf(what, sizeof(what), "max speed: %d timer callbacks/s (limit %d), %d without GPIO changes", s.isr_calls,
+             TICKS_PER_SECOND, s.isr_idle);
+    check(s.isr_calls <= TICKS_PER_SECOND && s.isr_idle == 0, what);
+
+    printf("bench: max speed: %.1f ns per callback on the host, %.3f%% of one CPU per simulated second\n",
+           (t1 - t0) / s.isr_calls * 1e9, (t1 - t0) * 100.0);
+}
+
+int main(void) {
+    const int32_t deltas[] = {1, 2, 3, 5, 10, 30, 60, 100, 127, -1, -10, -127};
+
+    for (size_t i = 0; i < sizeof(deltas) / sizeof(deltas[0]); i++)
+        test_single_report(deltas[i]);
+    test_phase_continuity();
+    test_wrap_around();
+    test_max_speed();
+
+    printf("quadrature_sim: %s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,328 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+// Simulated GATT server for the Steam Controller setup.
+//
+// Plays the role of the BTstack GATT client and of the controllers: like BTstack, only one
+// request can be pending per connection, and requests made while one is pending are refused.
+// Results and GATT_EVENT_QUERY_COMPLETE are delivered one connection interval later.
+// Writes can be refused, or completed with an ATT error, to check that the setup never stalls.
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "parser/uni_hid_parser_steam.h"
+#include "uni_hid_device.h"
+#include "uni_log.h"
+#include "uni_system.h"
+
+#define LINKS_MAX 4
+#define WRITES_MAX 8
+#define WRITE_LEN_MAX 32
+// BLE connection interval used by the Steam Controller
+#define CONN_INTERVAL_US 7500
+
+typedef enum {
+    REQ_NONE,
+    REQ_SERVICES,
+    REQ_CHARACTERISTICS,
+    REQ_WRITE,
+} req_t;
+
+typedef struct {
+    uni_hid_device_t device;
+    btstack_packet_handler_t callback;
+    req_t pending;
+    uint16_t value_handle;
+    // Setup commands received by the controller
+    uint8_t writes[WRITES_MAX][WRITE_LEN_MAX];
+    uint16_t write_len[WRITES_MAX];
+    int write_count;
+    // Calls to gatt_client_write_value_of_characteristic()
+    int write_calls;
+    // Fault injection: bitmask of write calls to refuse, and of writes to complete with an ATT error
+    uint32_t refuse_writes;
+    uint32_t att_error_writes;
+    // Requests made while another one was pending. Not allowed by ATT.
+    int overlapping;
+    // Writes to a handle that is not the characteristic of this controller
+    int wrong_handle;
+    int round_trips;
+    int ready;
+    uint64_t ready_us;
+} link_t;
+
+static link_t links[LINKS_MAX];
+static int links_count;
+static uint64_t sim_now_us;
+static int events;
+static int errors_logged;
+static int failures;
+
+// Known vectors: what the controller must receive
+static const uint8_t expected_clear_mappings[] = {0xc0, 0x81, 0x01};
+static const uint8_t expected_disable_lizard[] = {0xc0, 0x87, 0x0f, 0x30, 0x00, 0x00, 0x07, 0x07, 0x00,
+                                                  0x08, 0x07, 0x00, 0x18, 0x00, 0x00, 0x2d, 0x64, 0x00};
+
+static void check(bool ok, const char* what) {
+    printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//
+// What the parser needs from Bluepad32
+//
+void uni_log(const char* fmt, ...) {
+    ARG_UNUSED(fmt);
+    // Errors are expected in the fault injection tests. Only count them.
+    errors_logged++;
+}
+
+uint64_t uni_system_get_time_us(void) {
+    return sim_now_us;
+}
+
+uni_hid_device_t* uni_hid_device_get_instance_for_connection_handle(hci_con_handle_t handle) {
+    for (int i = 0; i < links_count; i++) {
+        if (links[i].device.conn.handle == handle)
+            return &links[i].device;
+    }
+    return NULL;
+}
+
+bool uni_hid_device_set_ready_complete(uni_hid_device_t* d) {
+    for (int i = 0; i < links_count; i++) {
+        if (&links[i].device == d) {
+            links[i].ready++;
+            links[i].ready_us = sim_now_us;
+        }
+    }
+    return true;
+}
+
+//
+// Simulated GATT client
+//
+static link_t* link_for_handle(hci_con_handle_t handle) {
+    uni_hid_device_t* d = uni_hid_device_get_instance_for_connection_handle(handle);
+    return d ? (link_t*)d : NULL;
+}
+
+static uint8_t request(hci_con_handle_t handle, btstack_packet_handler_t callback, req_t req) {
+    link_t* l = link_for_handle(handle);
+    if (l == NULL)
+        return GATT_CLIENT_IN_WRONG_STATE;
+    if (l->pending != REQ_NONE) {
+        l->overlapping++;
+        return GATT_CLIENT_IN_WRONG_STATE;
+    }
+    l->pending = req;
+    l->callback = callback;
+    return ERROR_CODE_SUCCESS;
+}
+
+uint8_t gatt_client_discover_primary_services_by_uuid128(btstack_packet_handler_t callback,
+                                                         hci_con_handle_t con_handle,
+                                                         const uint8_t* uuid128) {
+    ARG_UNUSED(uuid128);
+    return request(con_handle, callback, REQ_SERVICES);
+}
+
+uint8_t gatt_client_discover_characteristics_for_service_by_uuid128(btstack_packet_handler_t callback,
+                                                                    hci_con_handle_t con_handle,
+                                                                    gatt_client_service_t* service,
+                                                                    const uint8_t* uuid128) {
+    ARG_UNUSED(service);
+    ARG_UNUSED(uuid128);
+    return request(con_handle, callback, REQ_CHARACTERISTICS);
+}
+
+uint8_t gatt_client_write_value_of_characteristic(btstack_packet_handler_t callback,
+                                                  hci_con_handle_t con_handle,
+                                                  uint16_t value_handle,
+                                                  uint16_t value_length,
+                                                  uint8_t* value) {
+    link_t* l = link_for_handle(con_handle);
+    if (l == NULL)
+        return GATT_CLIENT_IN_WRONG_STATE;
+
+    int call = l->write_calls++;
+    if (l->refuse_writes & (1 << call))
+        return GATT_CLIENT_IN_WRONG_STATE;
+
+    uint8_t status = request(con_handle, callback, REQ_WRITE);
+    if (status != ERROR_CODE_SUCCESS)
+        return status;
+
+    if (value_handle != l->value_handle)
+        l->wrong_handle++;
+    if (l->write_count < WRITES_MAX && value_length <= WRITE_LEN_MAX) {
+        memcpy(l->writes[l->write_count], value, value_length);
+        l->write_len[l->write_count] = value_length;
+    }
+    l->write_count++;
+    return ERROR_CODE_SUCCESS;
+}
+
+static void send_event(link_t* l, uint8_t* event, uint16_t len) {
+    events++;
+    l->callback(HCI_EVENT_PACKET, 0, event, len);
+}
+
+// Delivers the result of the pending request, if any. Returns whether there was one.
+static bool deliver(link_t* l) {
+    uint8_t event[3 + sizeof(gatt_client_characteristic_t)] = {0};
+    req_t req = l->pending;
+    uint8_t att_status = 0;
+
+    if (req == REQ_NONE)
+        return false;
+
+    event[1] = l->device.conn.handle & 0xff;
+    event[2] = l->device.conn.handle >> 8;
+    l->round_trips++;
+
+    if (req == REQ_SERVICES) {
+        gatt_client_service_t service = {.start_group_handle = 0x10, .end_group_handle = 0x20};
+        event[0] = GATT_EVENT_SERVICE_QUERY_RESULT;
+        memcpy(&event[3], &service, sizeof(service));
+        send_event(l, event, 3 + sizeof(service));
+    } else if (req == REQ_CHARACTERISTICS) {
+        gatt_client_characteristic_t characteristic = {.value_handle = l->value_handle};
+        event[0] = GATT_EVENT_CHARACTERISTIC_QUERY_RESULT;
+        memcpy(&event[3], &characteristic, sizeof(characteristic));
+        send_event(l, event, 3 + sizeof(characteristic));
+    } else if (l->att_error_writes & (1 << (l->write_count - 1))) {
+        // Write Not Permitted
+        att_status = 0x03;
+    }
+
+    // Like BTstack: the request is done before the completion is reported, so a new one can be made from it.
+    l->pending = REQ_NONE;
+    event[0] = GATT_EVENT_QUERY_COMPLETE;
+    event[3] = att_status;
+    send_event(l, event, 4);
+    return true;
+}
+
+static void sim_init(int count) {
+    memset(links, 0, sizeof(links));
+    links_count = count;
+    sim_now_us = 0;
+    errors_logged = 0;
+    for (int i = 0; i < count; i++) {
+        links[i].device.conn.handle = 0x40 + i;
+        // Each controller has a different handle, to catch state shared between them
+        links[i].value_handle = 0x100 + i * 0x10;
+    }
+}
+
+// Sets up all the controllers at the same time. Every connection interval, each link delivers its pending request.
+static void sim_run(void) {
+    for (int i = 0; i < links_count; i++)
+        uni_hid_parser_steam_setup(&links[i].device);
+
+    bool busy = true;
+    while (busy) {
+        busy = false;
+        sim_now_us += CONN_INTERVAL_US;
+        for (int i = 0; i < links_count; i++)
+            busy |= deliver(&links[i]);
+    }
+}
+
+static bool link_ok(const link_t* l) {
+    return l->ready == 1 && l->overlapping == 0 && l->wrong_handle == 0;
+}
+
+static bool got_write(const link_t* l, int idx, const uint8_t* data, uint16_t len) {
+    return idx < l->write_count && l->write_len[idx] == len && memcmp(l->writes[idx], data, len) == 0;
+}
+
+static void test_single(void) {
+    sim_init(1);
+    sim_run();
+    check(link_ok(&links[0]) && links[0].write_count == 2 &&
+              got_write(&links[0], 0, expected_clear_mappings, sizeof(expected_clear_mappings)) &&
+              got_write(&links[0], 1, expected_disable_lizard, sizeof(expected_disable_lizard)),
+          "one controller: clear mappings + disable lizard written in order, then ready");
+}
+
+static void test_concurrent(void) {
+    char what[128];
+    bool ok = true;
+
+    sim_init(LINKS_MAX);
+    sim_run();
+    for (int i = 0; i < LINKS_MAX; i++) {
+        ok &= link_ok(&links[i]) && links[i].write_count == 2 &&
+              got_write(&links[i], 0, expected_clear_mappings, sizeof(expected_clear_mappings)) &&
+              got_write(&links[i], 1, expected_disable_lizard, sizeof(expected_disable_lizard));
+    }
+    snprintf(what, sizeof(what),
+             "%d controllers at the same time: each one gets its own commands, one request at a time, then ready",
+             LINKS_MAX);
+    check(ok, what);
+}
+
+static void test_refused_write(void) {
+    sim_init(1);
+    // The first write can't be issued: no completion will come for it
+    links[0].refuse_writes = 1 << 0;
+    sim_run();
+    check(link_ok(&links[0]) && links[0].write_count == 1 &&
+              got_write(&links[0], 0, expected_disable_lizard, sizeof(expected_disable_lizard)) && errors_logged > 0,
+          "first write refused: it is skipped, the next one is written, then ready");
+
+    sim_init(1);
+    links[0].refuse_writes = 0xffffffff;
+    sim_run();
+    check(link_ok(&links[0]) && links[0].write_count == 0, "all writes refused: setup doesn't stall, ready");
+}
+
+static void test_att_error(void) {
+    sim_init(1);
+    links[0].att_error_writes = 1 << 0;
+    sim_run();
+    check(link_ok(&links[0]) && links[0].write_count == 2 &&
+              got_write(&links[0], 1, expected_disable_lizard, sizeof(expected_disable_lizard)),
+          "first write fails with an ATT error: the next one is written, then ready");
+}
+
+static void bench(void) {
+    const int rounds = 100000;
+    double t0, t1;
+
+    events = 0;
+    t0 = now_s();
+    for (int i = 0; i < rounds; i++) {
+        sim_init(1);
+        sim_run();
+    }
+    t1 = now_s();
+
+    printf("bench: setup takes %d ATT round trips, %d ms at a %.1f ms connection interval. %.1f ns per event on the host\n",
+           links[0].round_trips, (int)(links[0].ready_us / 1000), CONN_INTERVAL_US / 1000.0, (t1 - t0) / events * 1e9);
+}
+
+int main(void) {
+    test_single();
+    test_concurrent();
+    test_refused_write();
+    test_att_error();
+    bench();
+
+    printf("steam_gatt_sim: %s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
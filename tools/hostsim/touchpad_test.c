@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+// Touchpad to mouse converter, fed with a touch sequence in the DualShock4 report format.
+//
+// Each report has up to 3 touch frames, oldest first, of 2 points each. Like in the DS4 report,
+// each point is: contact (bit 7: not touching, bits 0-6: tracking id), X (12 bits), Y (12 bits).
+// The sequence is a one-finger swipe, a lift and a touch somewhere else, a two-finger scroll, and
+// both fingers lifted.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "uni_touchpad.h"
+
+#define FRAMES_MAX 3
+#define POINT_SIZE 4
+
+typedef struct {
+    int frames;
+    uint8_t data[FRAMES_MAX][UNI_TOUCHPAD_FINGERS_MAX * POINT_SIZE];
+} touch_report_t;
+
+typedef struct {
+    int32_t delta_x;
+    int32_t delta_y;
+    int8_t scroll_wheel;
+} expected_t;
+
+// clang-format off
+static const touch_report_t reports[] = {
+    // Swipe right, 25 units per frame, from X=400 Y=300. Tracking id 5
+    {3, {{0x05, 0x90, 0xc1, 0x12, 0x80, 0x00, 0x00, 0x00}, {0x05, 0xa9, 0xc1, 0x12, 0x80, 0x00, 0x00, 0x00}, {0x05, 0xc2, 0xc1, 0x12, 0x80, 0x00, 0x00, 0x00}}},
+    {3, {{0x05, 0xdb, 0xc1, 0x12, 0x80, 0x00, 0x00, 0x00}, {0x05, 0xf4, 0xc1, 0x12, 0x80, 0x00, 0x00, 0x00}, {0x05, 0x0d, 0xc2, 0x12, 0x80, 0x00, 0x00, 0x00}}},
+    {3, {{0x05, 0x26, 0xc2, 0x12, 0x80, 0x00, 0x00, 0x00}, {0x05, 0x3f, 0xc2, 0x12, 0x80, 0x00, 0x00, 0x00}, {0x05, 0x58, 0xc2, 0x12, 0x80, 0x00, 0x00, 0x00}}},
+    {3, {{0x05, 0x71, 0xc2, 0x12, 0x80, 0x00, 0x00, 0x00}, {0x05, 0x8a, 0xc2, 0x12, 0x80, 0x00, 0x00, 0x00}, {0x05, 0xa3, 0xc2, 0x12, 0x80, 0x00, 0x00, 0x00}}},
+    {3, {{0x05, 0xbc, 0xc2, 0x12, 0x80, 0x00, 0x00, 0x00}, {0x05, 0xd5, 0xc2, 0x12, 0x80, 0x00, 0x00, 0x00}, {0x05, 0xee, 0xc2, 0x12, 0x80, 0x00, 0x00, 0x00}}},
+    // Lifted, and a new touch (id 6) at X=1500 Y=800, moving up
+    {3, {{0x85, 0xee, 0xc2, 0x12, 0x80, 0x00, 0x00, 0x00}, {0x06, 0xdc, 0x05, 0x32, 0x80, 0x00, 0x00, 0x00}, {0x06, 0xdc, 0x65, 0x31, 0x80, 0x00, 0x00, 0x00}}},
+    // Second finger (id 7) lands. Both go down, 15 units per frame
+    {3, {{0x06, 0xdc, 0x65, 0x31, 0x07, 0xe8, 0xa3, 0x32}, {0x06, 0xdc, 0x55, 0x32, 0x07, 0xe8, 0x93, 0x33}, {0x06, 0xdc, 0x45, 0x33, 0x07, 0xe8, 0x83, 0x34}}},
+    {3, {{0x06, 0xdc, 0x35, 0x34, 0x07, 0xe8, 0x73, 0x35}, {0x06, 0xdc, 0x25, 0x35, 0x07, 0xe8, 0x63, 0x36}, {0x06, 0xdc, 0x15, 0x36, 0x07, 0xe8, 0x53, 0x37}}},
+    {3, {{0x06, 0xdc, 0x05, 0x37, 0x07, 0xe8, 0x43, 0x38}, {0x06, 0xdc, 0xf5, 0x37, 0x07, 0xe8, 0x33, 0x39}, {0x06, 0xdc, 0xe5, 0x38, 0x07, 0xe8, 0x23, 0x3a}}},
+    {3, {{0x06, 0xdc, 0xd5, 0x39, 0x07, 0xe8, 0x13, 0x3b}, {0x06, 0xdc, 0xc5, 0x3a, 0x07, 0xe8, 0x03, 0x3c}, {0x06, 0xdc, 0xb5, 0x3b, 0x07, 0xe8, 0xf3, 0x3c}}},
+    // Both lifted
+    {1, {{0x86, 0xdc, 0xb5, 0x3b, 0x87, 0xe8, 0xf3, 0x3c}}},
+};
+
+static const expected_t expected[] = {
+    {50, 0, 0}, {75, 0, 0}, {75, 0, 0}, {75, 0, 0}, {75, 0, 0},
+    // No jump when touching somewhere else
+    {0, -10, 0},
+    // Landing doesn't scroll. The motion that didn't complete a step is carried to the next report
+    {0, 0, 0}, {0, 0, 1}, {0, 0, 2}, {0, 0, 1},
+    {0, 0, 0},
+};
+// clang-format on
+
+// Number of reports of the swipe
+#define SWIPE_REPORTS 5
+
+static int failures;
+
+static void check(bool ok, const char* what) {
+    printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+// Same decoding as the DS4 parser.
+static void decode_frame(const uint8_t* data, uni_touchpad_finger_t fingers[UNI_TOUCHPAD_FINGERS_MAX]) {
+    for (int j = 0; j < UNI_TOUCHPAD_FINGERS_MAX; j++) {
+        const uint8_t* point = &data[j * POINT_SIZE];
+        fingers[j].active = !(point[0] & 0x80);
+        fingers[j].id = point[0] & 0x7f;
+        fingers[j].x = ((point[2] & 0x0f) << 8) + point[1];
+        fingers[j].y = (point[3] << 4) + (point[2] >> 4);
+    }
+}
+
+// Feeds the first "max_frames" frames of the report.
+static void feed_report(uni_touchpad_t* tp, const touch_report_t* r, int max_frames, uni_mouse_t* ms) {
+    uni_touchpad_finger_t fingers[UNI_TOUCHPAD_FINGERS_MAX];
+    int frames = r->frames < max_frames ? r->frames : max_frames;
+
+    uni_touchpad_begin(tp);
+    for (int i = 0; i < frames; i++) {
+        decode_frame(r->data[i], fingers);
+        uni_touchpad_add_frame(tp, fingers);
+    }
+    uni_touchpad_end(tp, ms);
+}
+
+int main(void) {
+    char what[128];
+    uni_touchpad_t tp;
+    uni_mouse_t ms;
+    uint16_t x, y;
+    int32_t swipe = 0;
+    int32_t swipe_first_frame = 0;
+
+    uni_touchpad_init(&tp);
+    check(!uni_touchpad_get_position(&tp, &x, &y), "after init: no finger touching");
+
+    for (size_t i = 0; i < sizeof(reports) / sizeof(reports[0]); i++) {
+        memset(&ms, 0, sizeof(ms));
+        feed_report(&tp, &reports[i], FRAMES_MAX, &ms);
+        snprintf(what, sizeof(what), "report %2zu: %d frames -> dx=%4d dy=%4d wheel=%d (expected %d %d %d)", i,
+                 reports[i].frames, (int)ms.delta_x, (int)ms.delta_y, ms.scroll_wheel, (int)expected[i].delta_x,
+                 (int)expected[i].delta_y, expected[i].scroll_wheel);
+        check(ms.delta_x == expected[i].delta_x && ms.delta_y == expected[i].delta_y &&
+                  ms.scroll_wheel == expected[i].scroll_wheel,
+              what);
+        if (i < SWIPE_REPORTS)
+            swipe += ms.delta_x;
+    }
+    check(!uni_touchpad_get_position(&tp, &x, &y), "both fingers lifted: no finger touching");
+
+    // Init forgets the previous touches: touching again with the same tracking id doesn't move the pointer.
+    uni_touchpad_init(&tp);
+    memset(&ms, 0, sizeof(ms));
+    feed_report(&tp, &reports[1], 1, &ms);
+    check(ms.delta_x == 0 && ms.delta_y == 0 && uni_touchpad_get_position(&tp, &x, &y) && x == 475 && y == 300,
+          "after init: first touch at (475, 300), no motion");
+
+    // What was reported when only the first frame of each report was used
+    uni_touchpad_init(&tp);
+    for (int i = 0; i < SWIPE_REPORTS; i++) {
+        feed_report(&tp, &reports[i], 1, &ms);
+        swipe_first_frame += ms.delta_x;
+    }
+    snprintf(what, sizeof(what), "swipe: %d units reported, %d with only the first frame of each report",
+             (int)swipe, (int)swipe_first_frame);
+    check(swipe == 14 * 25, what);
+
+    printf("touchpad_test: %s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,19 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright 2024 Ricardo Quesada
+// http://retro.moe/unijoysticle2
+
+// Reduced Bluepad32 umbrella header: only what the POSIX example helpers use.
+// The Bluepad32 functions are implemented by the tests.
+
+#ifndef HOSTSIM_UNI_H
+#define HOSTSIM_UNI_H
+
+#include <btstack.h>
+
+#include "controller/uni_controller.h"
+#include "uni_hid_device.h"
+#include "uni_log.h"
+
+void uni_bt_enable_new_connections_unsafe(bool enabled);
+
+#endif  // HOSTSIM_UNI_H